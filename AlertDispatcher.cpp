@@ -0,0 +1,413 @@
+#include "Arduino.h"
+#include "AlertDispatcher.h"
+#include "Network.h"
+#include <ESP8266WiFi.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+
+// Give up on a post after this many tries
+const byte maxAttempts = 5;
+// First retry waits this long, doubling on each further failure (milli * seconds)
+const unsigned long retryBackoffMillis = 1000 * 2;
+// How long to wait on the server before calling the attempt a failure
+const unsigned long responseTimeoutMillis = 1000 * 5;
+
+// Serial.printf() allocates for lines over 64 characters and these carry the
+// alert's text, so they're formatted on the stack instead
+static void logLine(PGM_P format, ...){
+    char line[224];
+    va_list args;
+    va_start(args, format);
+    vsnprintf_P(line, sizeof(line), format, args);
+    va_end(args);
+    Serial.print(line);
+}
+
+// The part of an alert that's written to the store
+const uint16_t AlertDispatcher::STORED_ALERT_BYTES = offsetof(AlertDispatcher::Alert, attempts);
+
+AlertDispatcher::AlertDispatcher(HttpsConnection& connection, const char* apiKey) : _connection(connection){
+    _apiKey = apiKey;
+    _store = NULL;
+    _state = IDLE;
+    _stateMillis = 0;
+    _success = false;
+    _reused = false;
+    _keepAlive = false;
+    _contentLength = 0;
+    _lineLength = 0;
+    _queueHead = 0;
+    _queueCount = 0;
+    _sent = 0;
+    _failedAttempts = 0;
+    _dropped = 0;
+}
+
+// Where to keep alerts while we're offline
+void AlertDispatcher::setStore(FlashLog& store){
+    _store = &store;
+}
+
+// "details" is the readings (or whatever else) to send along with the message
+bool AlertDispatcher::enqueue(const char* action, const char* message, const char* details){
+    Alert alert;
+    strncpy(alert.action, action, sizeof(alert.action) - 1);
+    alert.action[sizeof(alert.action) - 1] = '\0';
+    strncpy(alert.message, message, sizeof(alert.message) - 1);
+    alert.message[sizeof(alert.message) - 1] = '\0';
+    strncpy(alert.details, details, sizeof(alert.details) - 1);
+    alert.details[sizeof(alert.details) - 1] = '\0';
+
+    // Stamp the alert with the time it happened, not the time it gets posted.
+    // If NTP hasn't set the clock yet that's filled in later.
+    alert.timestamp[0] = '\0';
+    alert.createdMillis = millis();
+    stamp(alert, false);
+
+    logLine(PSTR("   (%s) %s %s\n"), alert.timestamp[0] ? alert.timestamp : "time not set", message, details);
+    return add(alert);
+}
+
+// Fill in the timestamp if it's still blank and the clock has been set,
+// working back from now to when the alert was created. If it can't wait any
+// longer for the clock, use the uptime it was created at instead.
+void AlertDispatcher::stamp(Alert& alert, bool uptimeIfUnset){
+    if (alert.timestamp[0]) return;
+    time_t now = time(nullptr);
+    if (!NetworkManager::validTime(now)){
+        if (uptimeIfUnset){
+            snprintf_P(alert.timestamp, sizeof(alert.timestamp), PSTR("T+%lus"), alert.createdMillis / 1000);
+        }
+        return;
+    }
+
+    now -= (millis() - alert.createdMillis) / 1000;
+    struct tm* timeInfo;
+    timeInfo = localtime(&now);
+    sprintf_P(alert.timestamp, PSTR("%02d:%02d:%02d"), timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+}
+
+// Put an alert on the queue, or merge it with an identical one
+bool AlertDispatcher::add(const Alert& alert){
+    // If the same alert is already waiting (and not on the wire) just refresh it
+    for (int i = 0; i < _queueCount; i++){
+        if (i == 0 && _state != IDLE) continue;
+        Alert& queued = _queue[(_queueHead + i) % QUEUE_SIZE];
+        if (strcmp(alert.action, queued.action) == 0 && strcmp(alert.message, queued.message) == 0){
+            strcpy(queued.timestamp, alert.timestamp);
+            strcpy(queued.details, alert.details);
+            queued.createdMillis = alert.createdMillis;
+            Serial.println("   Merged with queued alert.");
+            return true;
+        }
+    }
+
+    if (_queueCount == QUEUE_SIZE){
+        if (store(alert)){
+            Serial.println("   Alert queue full, stored for later.");
+            return true;
+        }
+        Serial.println("   Alert queue full, dropped.");
+        _dropped++;
+        return false;
+    }
+
+    Alert& queued = _queue[(_queueHead + _queueCount) % QUEUE_SIZE];
+    memcpy(&queued, &alert, STORED_ALERT_BYTES);
+    queued.attempts = 0;
+    queued.notBeforeMillis = millis();
+    queued.createdMillis = alert.createdMillis;
+    _queueCount++;
+    return true;
+}
+
+// After a reset there's nothing to work a blank timestamp out from, so an
+// alert going to the store gets one now, as uptime if the clock isn't set
+bool AlertDispatcher::store(const Alert& alert){
+    if (!_store) return false;
+    Alert stored = alert;
+    stamp(stored, true);
+    return _store->append(ALERT_RECORD, &stored, STORED_ALERT_BYTES);
+}
+
+// We're offline, move everything waiting into the store so it survives a reset
+void AlertDispatcher::spillQueue(){
+    int spilled = 0;
+    while (_queueCount > 0){
+        if (store(head())) spilled++;
+        pop();
+    }
+    logLine(PSTR("   Offline, %d alert(s) stored for later.\n"), spilled);
+}
+
+// Move the oldest stored alert back onto the queue. Once they've all been
+// replayed the store is emptied.
+void AlertDispatcher::replayStored(){
+    byte type;
+    byte record[FlashLog::MAX_RECORD];
+    int length = _store->next(type, record, sizeof(record));
+    if (length < 0){
+        _store->clear();
+        return;
+    }
+    if (type != ALERT_RECORD || length != STORED_ALERT_BYTES) return;
+
+    Alert alert;
+    memcpy(&alert, record, STORED_ALERT_BYTES);
+    alert.createdMillis = millis();
+    logLine(PSTR("   Replaying stored alert: (%s) %s\n"), alert.timestamp, alert.message);
+    add(alert);
+}
+
+void AlertDispatcher::update(){
+    WiFiClientSecure& client = _connection.client();
+
+    switch (_state){
+        case IDLE:
+            if (_store){
+                // No point using up attempts while WiFi is down, keep them for later
+                if (WiFi.status() != WL_CONNECTED){
+                    if (_queueCount > 0) spillQueue();
+                    return;
+                }
+                if (_queueCount < QUEUE_SIZE && !_store->isEmpty()) replayStored();
+            }
+            if (_queueCount == 0) {
+                _connection.closeIfIdle();
+                return;
+            }
+            if ((long)(millis() - head().notBeforeMillis) < 0) return;
+            head().attempts++;
+            // Skip straight to the request if we've still got a connection open
+            _reused = _connection.reusable();
+            _state = _reused ? WRITE : CONNECT;
+            break;
+
+        case CONNECT:
+            // Note: WiFiClientSecure does the DNS lookup and TLS handshake inside
+            // connect(), so this is the one step we can't break up any further.
+            client.setTimeout(responseTimeoutMillis);
+            if (!_connection.connect()) {
+                fail("Connection failed.");
+                return;
+            }
+            _state = VERIFY;
+            break;
+
+        case VERIFY:
+            if (!_connection.verify()) {
+                Serial.println("   Certificate doesn't match.");
+            }
+            _state = WRITE;
+            break;
+
+        case WRITE: {
+            Alert& alert = head();
+            // Online but if NTP hasn't answered yet, send it with the uptime rather than hold it up
+            stamp(alert, true);
+            logLine(PSTR("   Requesting URL: %s/trigger/%s/with/key/\n"), _connection.host(), alert.action);
+
+            // Create the post data json
+            FixedString<256> postData;
+            postData.appendf(PSTR("{\"value1\":\"(%s) %s\\n\",\"value2\":\"%s\"}"), 
+                alert.timestamp, alert.message, alert.details);
+
+            // The whole request goes out in one write (one TLS record), asking to keep the connection open
+            FixedString<512> request;
+            request.appendf(PSTR("POST /trigger/%s/with/key/%s HTTP/1.1\r\n"
+                "Host: %s\r\n"
+                "Content-length: %u\r\n"
+                "Content-Type: application/json\r\n"
+                "Connection: keep-alive\r\n\r\n"), 
+                alert.action, _apiKey, _connection.host(), (unsigned int)postData.length());
+            request.append(postData.c_str());
+
+            _connection.beginRequest();
+            size_t sent = client.write((const uint8_t*)request.c_str(), request.length());
+            if (sent == 0) {
+                if (!reconnectIfStale()) fail("Write failed.");
+                return;
+            }
+            Serial.println("   Request sent.");
+
+            _lineLength = 0;
+            _success = false;
+            _keepAlive = true;
+            _contentLength = -1;
+            _stateMillis = millis();
+            _state = READ_STATUS;
+            break;
+        }
+
+        case READ_STATUS:
+            if (!readLine()) return;
+            // e.g. "HTTP/1.1 200 OK"
+            _success = strncmp(_line, "HTTP/1.", 7) == 0 && _line[9] == '2';
+            _lineLength = 0;
+            _state = READ_HEADERS;
+            break;
+
+        case READ_HEADERS:
+            if (!readLine()) return;
+            if (_lineLength == 0) {
+                Serial.println("   Headers received.");
+                // Without a length we can't tell where the body ends, so we can't reuse the connection
+                if (_contentLength < 0) _keepAlive = false;
+                _state = (_keepAlive && _contentLength > 0) ? READ_BODY : DONE;
+            }
+            else if (strncasecmp(_line, "Content-Length:", 15) == 0) {
+                _contentLength = atol(_line + 15);
+            }
+            else if (strncasecmp(_line, "Connection:", 11) == 0 && strstr(_line + 11, "close")) {
+                _keepAlive = false;
+            }
+            _lineLength = 0;
+            break;
+
+        case READ_BODY:
+            // Drain the body so the next request starts on a clean stream
+            while (_contentLength > 0 && client.available()) {
+                client.read();
+                _contentLength--;
+            }
+            if (_contentLength == 0) {
+                _state = DONE;
+            }
+            else if (!client.connected() || millis() - _stateMillis > responseTimeoutMillis) {
+                _keepAlive = false;
+                _state = DONE;
+            }
+            break;
+
+        case DONE:
+            _connection.endRequest(_keepAlive);
+            _state = IDLE;
+            if (_success){
+                logLine(PSTR("   Success! (%lu ms, %lu handshakes, %lu reused)\n"), 
+                    _connection.lastLatencyMillis(), _connection.handshakes(), _connection.reuses());
+                _sent++;
+                pop();
+            }
+            else {
+                fail("Failed.");
+            }
+            break;
+    }
+}
+
+// A kept-alive connection can be closed by the server between posts without
+// us noticing until we try to use it. When that happens go around again with
+// a fresh handshake instead of counting it as a failed attempt.
+bool AlertDispatcher::reconnectIfStale(){
+    if (!_reused) return false;
+    Serial.println("   Kept-alive connection went stale, reconnecting.");
+    _connection.close();
+    _reused = false;
+    _state = CONNECT;
+    return true;
+}
+
+// Read whatever's buffered into the current line without waiting for more.
+// Returns true once a full line (minus the CR/LF) is in _line, the caller
+// resets _lineLength when it's done with it.
+bool AlertDispatcher::readLine(){
+    WiFiClientSecure& client = _connection.client();
+
+    while (client.available()) {
+        char c = client.read();
+        if (c == '\n') {
+            _line[_lineLength] = '\0';
+            _stateMillis = millis();
+            return true;
+        }
+        if (c != '\r' && _lineLength < sizeof(_line) - 1) {
+            _line[_lineLength++] = c;
+        }
+    }
+
+    if (!client.connected() || millis() - _stateMillis > responseTimeoutMillis) {
+        // Nothing at all came back on a reused connection, it was already dead
+        if (_state == READ_STATUS && _lineLength == 0 && reconnectIfStale()) return false;
+        fail("No response.");
+    }
+    return false;
+}
+
+void AlertDispatcher::fail(const char* reason){
+    Serial.print("   ");
+    Serial.println(reason);
+    _connection.close();
+    _state = IDLE;
+    _failedAttempts++;
+
+    Alert& alert = head();
+    if (alert.attempts >= maxAttempts){
+        // Lost WiFi part way through, it'll go out once we're back
+        if (WiFi.status() != WL_CONNECTED && store(alert)){
+            logLine(PSTR("   Offline, alert stored for later: %s\n"), alert.message);
+        }
+        else {
+            logLine(PSTR("   Giving up on alert: %s\n"), alert.message);
+            _dropped++;
+        }
+        pop();
+        return;
+    }
+    alert.notBeforeMillis = millis() + (retryBackoffMillis << (alert.attempts - 1));
+}
+
+// Keep working the queue until it's empty, e.g. before a restart
+void AlertDispatcher::flush(unsigned long timeoutMillis){
+    unsigned long startMillis = millis();
+    while (!isIdle() && millis() - startMillis < timeoutMillis){
+        update();
+        yield();
+    }
+}
+
+bool AlertDispatcher::isIdle(){
+    return _state == IDLE && _queueCount == 0;
+}
+
+int AlertDispatcher::pending(){
+    return _queueCount;
+}
+
+// How long until update() has something to do: 0 part way through a post,
+// the retry backoff while the head of the queue waits, 0xFFFFFFFF if idle
+unsigned long AlertDispatcher::millisUntilDue(){
+    if (_state != IDLE) return 0;
+    bool online = WiFi.status() == WL_CONNECTED;
+    if (_queueCount == 0){
+        return (_store && online && !_store->isEmpty()) ? 0 : 0xFFFFFFFF;
+    }
+    // Offline with a store, update() wants to move the queue to flash
+    if (_store && !online) return 0;
+    long wait = (long)(head().notBeforeMillis - millis());
+    return wait > 0 ? wait : 0;
+}
+
+// Posts that went through
+unsigned long AlertDispatcher::sent(){
+    return _sent;
+}
+
+// Attempts that failed, including ones that were retried and went through later
+unsigned long AlertDispatcher::failedAttempts(){
+    return _failedAttempts;
+}
+
+// Alerts given up on and not stored
+unsigned long AlertDispatcher::dropped(){
+    return _dropped;
+}
+
+AlertDispatcher::Alert& AlertDispatcher::head(){
+    return _queue[_queueHead];
+}
+
+void AlertDispatcher::pop(){
+    _queueHead = (_queueHead + 1) % QUEUE_SIZE;
+    _queueCount--;
+}
@@ -0,0 +1,94 @@
+#ifndef AlertDispatcher_H
+#define AlertDispatcher_H
+
+#include "Arduino.h"
+#include "HttpsConnection.h"
+#include "FlashLog.h"
+#include "FixedString.h"
+
+// Queued IFTTT poster. enqueue() just stores the alert, update() is called
+// once per loop() pass and moves the head of the queue one step along
+// (connect -> verify -> write -> read status -> read headers -> read body
+// -> done). The connection is kept open afterwards so the next post can skip
+// the connect/verify steps.
+// Failed posts are retried with a growing backoff, and an alert that's
+// identical to one still waiting in the queue updates that entry instead
+// of adding another (e.g. repeated "Followup temperature alert!" posts).
+// With a store set, alerts are moved to flash while WiFi is down (or the
+// queue is full) and replayed in order once we're back online, so a reset in
+// between doesn't lose them.
+class AlertDispatcher {
+    public:
+        AlertDispatcher(HttpsConnection& connection, const char* apiKey);
+        void setStore(FlashLog& store);
+        bool enqueue(const char* action, const char* message, const char* details);
+        void update();
+        void flush(unsigned long timeoutMillis);
+        bool isIdle();
+        int pending();
+        unsigned long millisUntilDue();
+        unsigned long sent();
+        unsigned long failedAttempts();
+        unsigned long dropped();
+
+    private:
+        enum State {
+            IDLE,
+            CONNECT,
+            VERIFY,
+            WRITE,
+            READ_STATUS,
+            READ_HEADERS,
+            READ_BODY,
+            DONE,
+        };
+
+        // Everything up to "attempts" is what's kept in the store
+        struct Alert {
+            char action[40];
+            char message[40];
+            char timestamp[12];
+            char details[128];
+            byte attempts;
+            unsigned long notBeforeMillis;
+            unsigned long createdMillis;    // For filling in the timestamp once the clock is set
+        };
+
+        static const int QUEUE_SIZE = 8;
+        static const byte ALERT_RECORD = 1;
+        static const uint16_t STORED_ALERT_BYTES;
+
+        bool add(const Alert& alert);
+        bool store(const Alert& alert);
+        void stamp(Alert& alert, bool uptimeIfUnset);
+        void spillQueue();
+        void replayStored();
+        Alert& head();
+        void pop();
+        void fail(const char* reason);
+        bool reconnectIfStale();
+        bool readLine();
+
+        HttpsConnection& _connection;
+        const char* _apiKey;
+        FlashLog* _store;
+
+        State _state;
+        unsigned long _stateMillis;
+        bool _success;
+        bool _reused;
+        bool _keepAlive;
+        long _contentLength;
+        char _line[64];
+        byte _lineLength;
+
+        Alert _queue[QUEUE_SIZE];
+        int _queueHead;
+        int _queueCount;
+
+        unsigned long _sent;
+        unsigned long _failedAttempts;
+        unsigned long _dropped;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#include "Arduino.h"
+#include "AlertRules.h"
+
+// Rates are worked out over at least this long so one noisy reading doesn't
+// look like a sudden drop (milli * seconds)
+const unsigned long rateWindowMillis = 1000 * 60;
+// Window for each rule's maxPerHour (milli * seconds)
+const unsigned long postBudgetMillis = 1000 * 3600;
+
+AlertEngine::AlertEngine(const AlertRule* rules, int count, AlertHandler handler){
+    _rules = rules;
+    _ruleCount = min(count, MAX_RULES);
+    _handler = handler;
+    _historyCounter = NULL;
+    _breachPredictor = NULL;
+    memset(_states, 0, sizeof(_states));
+    for (int r = 0; r < MAX_RULES; r++){
+        _hourStartMillis[r] = 0;
+        _postsThisHour[r] = 0;
+        _tripped[r] = 0;
+    }
+    _suppressed = 0;
+}
+
+// Lets below/above rules with a historyCount look at the sample history
+void AlertEngine::setHistoryCounter(HistoryCounter counter){
+    _historyCounter = counter;
+}
+
+// Lets the predict rules see where each sensor's trend is heading
+void AlertEngine::setBreachPredictor(BreachPredictor predictor){
+    _breachPredictor = predictor;
+}
+
+// A new reading for one sensor, run every rule that applies to it
+void AlertEngine::update(int sensor, int16_t temp){
+    if (sensor < 0 || sensor >= MAX_SENSORS) return;
+    unsigned long now = millis();
+
+    for (int r = 0; r < _ruleCount; r++){
+        const AlertRule& rule = _rules[r];
+        if (rule.sensor >= 0 && rule.sensor != sensor) continue;
+
+        RuleState& state = _states[r][sensor];
+        bool out = outOfSpec(rule, state, sensor, temp);
+        if (out && !state.breached) state.breachMillis = now;
+        state.breached = out;
+
+        int16_t value = temp;
+        if (rule.kind == RULE_FALLING || rule.kind == RULE_RISING) value = state.rate;
+        else if (rule.kind == RULE_PREDICT_BELOW || rule.kind == RULE_PREDICT_ABOVE) value = state.etaMinutes;
+        if (out){
+            if (!state.active){
+                if (now - state.breachMillis >= rule.dwellMillis){
+                    state.active = true;
+                    state.activeMillis = now;
+                    state.lastAlertMillis = now;
+                    state.notified = false;
+                    _tripped[r]++;
+                    post(r, sensor, ALERT_TRIPPED, value);
+                }
+            }
+            else if (rule.repeatMillis && now - state.lastAlertMillis >= rule.repeatMillis){
+                state.lastAlertMillis = now;
+                bool escalated = rule.escalateMillis && now - state.activeMillis >= rule.escalateMillis;
+                post(r, sensor, escalated ? ALERT_ESCALATED : ALERT_REPEAT, value);
+            }
+        }
+        else if (state.active){
+            state.active = false;
+            // Only tell them it's over if we told them it started, and not when a
+            // predict rule hands a crossed limit to the plain rule: "Cold soon"
+            // cleared just as it goes cold is the wrong thing to hear
+            if (state.notified && !state.crossed) post(r, sensor, ALERT_CLEARED, value);
+        }
+    }
+}
+
+// Is the reading out of spec for this rule? Once breached it has to come back
+// past the hysteresis band before it counts as in spec again.
+bool AlertEngine::outOfSpec(const AlertRule& rule, RuleState& state, int sensor, int16_t temp){
+    bool out = false;
+    switch (rule.kind){
+        case RULE_BELOW:
+            out = state.breached ? temp < rule.limit + rule.hysteresis : temp < rule.limit;
+            if (!out && rule.historyCount && _historyCounter){
+                out = _historyCounter(sensor, rule.limit, true) >= rule.historyCount;
+            }
+            break;
+
+        case RULE_ABOVE:
+            out = state.breached ? temp > rule.limit - rule.hysteresis : temp > rule.limit;
+            if (!out && rule.historyCount && _historyCounter){
+                out = _historyCounter(sensor, rule.limit, false) >= rule.historyCount;
+            }
+            break;
+
+        case RULE_FALLING:
+        case RULE_RISING: {
+            unsigned long now = millis();
+            if (!state.hasRate && state.rateMillis == 0){
+                state.rateTemp = temp;
+                state.rateMillis = now;
+            }
+            else if (now - state.rateMillis >= rateWindowMillis){
+                state.rate = (int32_t)(temp - state.rateTemp) * 60000 / (long)(now - state.rateMillis);
+                state.rateTemp = temp;
+                state.rateMillis = now;
+                state.hasRate = true;
+            }
+            if (!state.hasRate) return false;
+
+            // Positive is in the direction the rule is watching for
+            int16_t rate = (rule.kind == RULE_FALLING) ? -state.rate : state.rate;
+            out = state.breached ? rate > rule.limit - rule.hysteresis : rate >= rule.limit;
+            break;
+        }
+
+        case RULE_PREDICT_BELOW:
+        case RULE_PREDICT_ABOVE: {
+            if (!_breachPredictor) return false;
+            bool below = rule.kind == RULE_PREDICT_BELOW;
+            uint32_t eta = _breachPredictor(sensor, rule.limit, below);
+            state.etaMinutes = (int16_t)min(eta / 60000, (uint32_t)32767);
+            // Already past the limit is the plain limit rule's to report, not "soon"
+            state.crossed = eta == 0;
+            if (state.crossed){
+                out = false;
+                break;
+            }
+            // Once breached it has to stop heading for a limit moved back by the hysteresis
+            if (state.breached){
+                int16_t limit = rule.limit + (below ? rule.hysteresis : -rule.hysteresis);
+                eta = _breachPredictor(sensor, limit, below);
+            }
+            out = eta <= rule.horizonMillis;
+            break;
+        }
+    }
+    return out;
+}
+
+// Hand an event to the handler, if the rule has any of its hourly budget left
+void AlertEngine::post(int r, int sensor, AlertEvent event, int16_t value){
+    const AlertRule& rule = _rules[r];
+    RuleState& state = _states[r][sensor];
+
+    if (rule.maxPerHour){
+        if (millis() - _hourStartMillis[r] >= postBudgetMillis){
+            _hourStartMillis[r] = millis();
+            _postsThisHour[r] = 0;
+        }
+        // Clears of something we did post always go out
+        if (event != ALERT_CLEARED && _postsThisHour[r] >= rule.maxPerHour){
+            _suppressed++;
+            return;
+        }
+        _postsThisHour[r]++;
+    }
+
+    if (event != ALERT_CLEARED) state.notified = true;
+    _handler(rule, sensor, event, value);
+}
+
+// How many rule/sensor pairs are out of spec right now (tripped or still in their dwell)
+int AlertEngine::breachedCount(){
+    int count = 0;
+    for (int r = 0; r < _ruleCount; r++){
+        for (int i = 0; i < MAX_SENSORS; i++){
+            if (_states[r][i].breached) count++;
+        }
+    }
+    return count;
+}
+
+// How many rule/sensor pairs have tripped and not cleared
+int AlertEngine::activeCount(){
+    int count = 0;
+    for (int r = 0; r < _ruleCount; r++){
+        for (int i = 0; i < MAX_SENSORS; i++){
+            if (_states[r][i].active) count++;
+        }
+    }
+    return count;
+}
+
+// Posts held back by the maxPerHour limits
+unsigned long AlertEngine::suppressed(){
+    return _suppressed;
+}
+
+void AlertEngine::report(Print& out){
+    out.println("rule                 tripped  active");
+    for (int r = 0; r < _ruleCount; r++){
+        int active = 0;
+        for (int i = 0; i < MAX_SENSORS; i++){
+            if (_states[r][i].active) active++;
+        }
+        out.printf("%-20s %7lu  %6d\n", _rules[r].name, _tripped[r], active);
+    }
+    out.printf("suppressed by rate limits: %lu\n", _suppressed);
+}
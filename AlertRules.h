@@ -0,0 +1,103 @@
+#ifndef AlertRules_H
+#define AlertRules_H
+
+#include "Arduino.h"
+#include "SensorTable.h"
+
+// Most rules in the table. Each rule keeps a little state per sensor, so this
+// times MAX_SENSORS is what we reserve RAM for.
+#define MAX_RULES 6
+
+enum RuleKind {
+    RULE_BELOW,             // Temp under limit
+    RULE_ABOVE,             // Temp over limit
+    RULE_FALLING,           // Dropping faster than limit per minute
+    RULE_RISING,            // Climbing faster than limit per minute
+    RULE_PREDICT_BELOW,     // Trend says it'll be under limit within horizonMillis (and isn't yet)
+    RULE_PREDICT_ABOVE,     // Trend says it'll be over limit within horizonMillis (and isn't yet)
+};
+
+enum AlertEvent {
+    ALERT_TRIPPED,          // Out of spec for the whole dwell time
+    ALERT_REPEAT,           // Still out of spec, repeatMillis later
+    ALERT_ESCALATED,        // Repeat, but it's been going on for escalateMillis
+    ALERT_CLEARED,          // Back inside the hysteresis band
+};
+
+// One line of the rule table. Temps and rates are in hundredths of a degree
+// (see Temperature.h), rates per minute. 0 turns off the optional parts.
+struct AlertRule {
+    const char* name;               // Goes in the alert, e.g. "Too cold"
+    int8_t sensor;                  // Table index, -1 for every sensor
+    RuleKind kind;
+    int16_t limit;
+    int16_t hysteresis;             // How far back inside the limit before it clears
+    unsigned long dwellMillis;      // Has to stay out of spec this long before it trips
+    unsigned long repeatMillis;     // Follow up this often while it's still out
+    unsigned long escalateMillis;   // Follow ups after this long are escalated
+    uint8_t maxPerHour;             // Most posts this rule may send an hour
+    uint8_t historyCount;           // Below/above only, also out if this many history samples are
+    unsigned long horizonMillis;    // Predict rules only, how far ahead to look
+};
+
+// Evaluates the rule table a sample at a time. update() is given each new
+// reading and moves each matching rule's state for that sensor along:
+// in spec -> breached (waiting out the dwell) -> tripped -> cleared, with
+// hysteresis on the way back so a reading sitting on the limit doesn't flap.
+// Anything worth telling someone about goes to the handler, which decides
+// how to post it.
+class AlertEngine {
+    public:
+        typedef void (*AlertHandler)(const AlertRule& rule, int sensor, AlertEvent event, int16_t value);
+        // How many recent history samples for the sensor are past limit (below or above)
+        typedef uint16_t (*HistoryCounter)(int sensor, int16_t limit, bool below);
+        // How long until the sensor's trend passes limit (below or above), 0 if
+        // it already has, 0xFFFFFFFF if it isn't heading there
+        typedef uint32_t (*BreachPredictor)(int sensor, int16_t limit, bool below);
+
+        AlertEngine(const AlertRule* rules, int count, AlertHandler handler);
+        void setHistoryCounter(HistoryCounter counter);
+        void setBreachPredictor(BreachPredictor predictor);
+        void update(int sensor, int16_t temp);
+        int breachedCount();
+        int activeCount();
+        unsigned long suppressed();
+        void report(Print& out);
+
+    private:
+        struct RuleState {
+            bool breached;
+            bool active;
+            unsigned long breachMillis;
+            unsigned long activeMillis;
+            unsigned long lastAlertMillis;
+            bool notified;                  // The trip was actually posted, so the clear should be too
+            // Reference point for the rate rules, and the last rate worked out
+            int16_t rateTemp;
+            unsigned long rateMillis;
+            int16_t rate;
+            bool hasRate;
+            // Predict rules, minutes to go at the last reading, and whether
+            // the limit's already been crossed (so the plain rule has it now)
+            int16_t etaMinutes;
+            bool crossed;
+        };
+
+        bool outOfSpec(const AlertRule& rule, RuleState& state, int sensor, int16_t temp);
+        void post(int r, int sensor, AlertEvent event, int16_t value);
+
+        const AlertRule* _rules;
+        int _ruleCount;
+        AlertHandler _handler;
+        HistoryCounter _historyCounter;
+        BreachPredictor _breachPredictor;
+        RuleState _states[MAX_RULES][MAX_SENSORS];
+
+        // Per rule post budget
+        unsigned long _hourStartMillis[MAX_RULES];
+        uint8_t _postsThisHour[MAX_RULES];
+        unsigned long _tripped[MAX_RULES];
+        unsigned long _suppressed;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "Arduino.h"
+#include "BufferedPrint.h"
+#include <stdarg.h>
+
+BufferedPrint::BufferedPrint(Print& out, char* buffer, size_t size) : _out(out){
+    _buffer = buffer;
+    _size = size;
+    _length = 0;
+}
+
+BufferedPrint::~BufferedPrint(){
+    flush();
+}
+
+size_t BufferedPrint::write(uint8_t c){
+    if (_length == _size) flush();
+    _buffer[_length++] = c;
+    return 1;
+}
+
+size_t BufferedPrint::write(const uint8_t* data, size_t length){
+    size_t written = 0;
+    while (written < length){
+        if (_length == _size) flush();
+        size_t chunk = min(length - written, _size - _length);
+        memcpy(_buffer + _length, data + written, chunk);
+        _length += chunk;
+        written += chunk;
+    }
+    return written;
+}
+
+// printf straight into the buffer (format string in flash). If it doesn't
+// fit in what's left, send what we've got and try again with the whole
+// buffer; anything longer than that is cut short.
+void BufferedPrint::appendf(PGM_P format, ...){
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf_P(_buffer + _length, _size - _length, format, args);
+    va_end(args);
+    if (length < 0) return;
+
+    if ((size_t)length >= _size - _length && _length > 0){
+        flush();
+        va_start(args, format);
+        length = vsnprintf_P(_buffer, _size, format, args);
+        va_end(args);
+        if (length < 0) return;
+    }
+    // vsnprintf leaves room for its terminator, which we don't send
+    _length += min((size_t)length, _size - _length - 1);
+}
+
+// Copy from flash, a buffer's worth at a time
+void BufferedPrint::append_P(PGM_P data, size_t length){
+    while (length > 0){
+        if (_length == _size) flush();
+        size_t chunk = min(length, _size - _length);
+        memcpy_P(_buffer + _length, data, chunk);
+        _length += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void BufferedPrint::flush(){
+    if (_length == 0) return;
+    _out.write((const uint8_t*)_buffer, _length);
+    _length = 0;
+}
+
+// Hand back how much is in the buffer and forget it, for an owner that
+// sends it on itself (see WebServer) rather than on flush()
+size_t BufferedPrint::release(){
+    size_t length = _length;
+    _length = 0;
+    return length;
+}
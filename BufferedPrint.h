@@ -0,0 +1,28 @@
+#ifndef BufferedPrint_H
+#define BufferedPrint_H
+
+#include "Arduino.h"
+
+// Print that collects output in a caller supplied buffer and passes it on
+// to another Print (e.g. a WiFiClient) in buffer sized writes, so a response
+// put together from lots of small pieces still goes out in a few packets.
+// Whatever's left is sent when it goes out of scope.
+class BufferedPrint : public Print {
+    public:
+        BufferedPrint(Print& out, char* buffer, size_t size);
+        ~BufferedPrint();
+        size_t write(uint8_t c);
+        size_t write(const uint8_t* data, size_t length);
+        void appendf(PGM_P format, ...);
+        void append_P(PGM_P data, size_t length);
+        void flush();
+        size_t release();
+
+    private:
+        Print& _out;
+        char* _buffer;
+        size_t _size;
+        size_t _length;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "Arduino.h"
+#include "Button.h"
+extern "C" {
+#include "gpio.h"                       // gpio_pin_wakeup_enable()
+}
+
+Button* Button::_instance = NULL;
+
+Button::Button(int pin, bool activeHigh, unsigned long holdMillis, unsigned long longHoldMillis)
+    : _gestures(DEBOUNCE_MILLIS, holdMillis, longHoldMillis){
+    _pin = pin;
+    _activeHigh = activeHigh;
+    _edgeHead = 0;
+    _edgeTail = 0;
+    _overflowed = false;
+    _wakeArmed = false;
+    _edgeCount = 0;
+    _overflows = 0;
+}
+
+void Button::begin(){
+    pinMode(_pin, INPUT);
+    // If it's already down at boot that isn't a press
+    _gestures.reset(readDown(), millis());
+    _instance = this;
+    attachInterrupt(digitalPinToInterrupt(_pin), onEdge, CHANGE);
+}
+
+// Runs on every change of the pin, keep it short. A full queue just sets a
+// flag, update() reads the pin to get back in step.
+void IRAM_ATTR Button::onEdge(){
+    Button* button = _instance;
+    if (!button) return;
+    if (button->_wakeArmed) button->restoreChange();
+    uint8_t head = button->_edgeHead;
+    if ((uint8_t)(head - button->_edgeTail) >= EDGE_QUEUE_SIZE){
+        button->_overflowed = true;
+        return;
+    }
+    volatile Edge& edge = button->_edges[head & (EDGE_QUEUE_SIZE - 1)];
+    edge.millis = millis();
+    edge.down = button->readDown();
+    button->_edgeHead = head + 1;
+}
+
+// Hand the queued edges to the gesture recognizer, then let it catch up to now
+void Button::update(){
+    while (_edgeTail != _edgeHead){
+        volatile Edge& edge = _edges[_edgeTail & (EDGE_QUEUE_SIZE - 1)];
+        _gestures.edge(edge.down, edge.millis);
+        _edgeTail++;
+        _edgeCount++;
+    }
+
+    if (_overflowed){
+        // Lost some edges while bouncing, start again from where the pin is now
+        _overflowed = false;
+        _overflows++;
+        _gestures.edge(readDown(), millis());
+    }
+
+    _gestures.update(millis());
+}
+
+// Light sleep can only be woken by a pin level, not an edge. So the pin's
+// interrupt goes to whichever level it isn't at now, and the ISR puts it
+// back to CHANGE the first time it fires (a level interrupt left on would
+// keep firing for as long as the button's held).
+void Button::armWake(){
+    noInterrupts();
+    _wakeArmed = true;
+    bool high = digitalRead(_pin) == HIGH;
+    gpio_pin_wakeup_enable(GPIO_ID_PIN(_pin), high ? GPIO_PIN_INTR_LOLEVEL : GPIO_PIN_INTR_HILEVEL);
+    interrupts();
+}
+
+// Back from sleep, if the button didn't wake us the pin is still on a level
+void Button::disarmWake(){
+    noInterrupts();
+    if (_wakeArmed) restoreChange();
+    interrupts();
+    gpio_pin_wakeup_disable();
+}
+
+// Same as attachInterrupt(CHANGE) does, but safe to do from the ISR
+void IRAM_ATTR Button::restoreChange(){
+    _wakeArmed = false;
+    GPC(_pin) = (GPC(_pin) & ~((0xF << GPCI) | (1 << GPCWE))) | ((CHANGE & 0xF) << GPCI);
+}
+
+bool Button::next(ButtonEvent& event){
+    return _gestures.next(event);
+}
+
+bool Button::isDown(){
+    return _gestures.isDown();
+}
+
+uint32_t Button::edges(){
+    return _edgeCount;
+}
+
+uint32_t Button::overflows(){
+    return _overflows;
+}
+
+bool IRAM_ATTR Button::readDown(){
+    return (digitalRead(_pin) == HIGH) == _activeHigh;
+}
@@ -0,0 +1,59 @@
+#ifndef Button_H
+#define Button_H
+
+#include "Arduino.h"
+#include "ButtonGestures.h"
+
+// Push button on an interrupt. The ISR just timestamps each edge into a
+// small queue, update() hands them to ButtonGestures from loop(). Presses
+// and hold times come out right even when loop() was stuck for a while
+// (a slow page or TLS handshake), they're only noticed a bit later.
+// Only one Button can be attached, the ISR has nowhere to keep a pointer.
+//
+// For light sleep, armWake() just before sleeping makes the button a wake
+// source and disarmWake() straight after puts things back.
+class Button {
+    public:
+        Button(int pin, bool activeHigh, unsigned long holdMillis, unsigned long longHoldMillis);
+        void begin();
+        void update();
+        bool next(ButtonEvent& event);
+        bool isDown();
+        void armWake();
+        void disarmWake();
+        uint32_t edges();
+        uint32_t overflows();
+
+    private:
+        // Must be a power of 2, indexes are free running bytes
+        static const uint8_t EDGE_QUEUE_SIZE = 16;
+        // How long the level has to be steady to count (milli * seconds)
+        static const unsigned long DEBOUNCE_MILLIS = 30;
+
+        struct Edge {
+            uint32_t millis;
+            bool down;
+        };
+
+        static void IRAM_ATTR onEdge();
+        bool IRAM_ATTR readDown();
+        void IRAM_ATTR restoreChange();
+
+        int _pin;
+        bool _activeHigh;
+        ButtonGestures _gestures;
+
+        // Written by the ISR, read in update()
+        volatile Edge _edges[EDGE_QUEUE_SIZE];
+        volatile uint8_t _edgeHead;
+        volatile uint8_t _edgeTail;
+        volatile bool _overflowed;
+        volatile bool _wakeArmed;
+
+        uint32_t _edgeCount;
+        uint32_t _overflows;
+
+        static Button* _instance;
+};
+
+#endif
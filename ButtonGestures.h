@@ -0,0 +1,129 @@
+#ifndef ButtonGestures_H
+#define ButtonGestures_H
+
+#include <stdint.h>
+
+enum ButtonEvent {
+    BUTTON_PRESSED,         // Went down (debounced)
+    BUTTON_HELD,            // Still down after holdMillis
+    BUTTON_LONG_HELD,       // Still down after longHoldMillis
+    BUTTON_RELEASED,        // Came back up
+};
+
+// Turns timestamped raw edges from the button into debounced gestures. It
+// only works from the timestamps it's given, never the clock, so how late
+// the edges are handed over doesn't change how long a hold was, and the
+// whole thing runs anywhere (feed it a made up edge stream to try it out).
+//
+// A level only counts once it's been stable for debounceMillis. Events are
+// queued and read back with next(); each hold event fires once per press.
+class ButtonGestures {
+    public:
+        ButtonGestures(uint32_t debounceMillis, uint32_t holdMillis, uint32_t longHoldMillis){
+            _debounceMillis = debounceMillis;
+            _holdMillis = holdMillis;
+            _longHoldMillis = longHoldMillis;
+            reset(false, 0);
+        }
+
+        // Start over from a known level, e.g. after edges were lost
+        void reset(bool down, uint32_t nowMillis){
+            _rawDown = down;
+            _rawMillis = nowMillis;
+            _down = down;
+            _downMillis = nowMillis;
+            _held = down;
+            _longHeld = down;
+            _eventHead = 0;
+            _eventCount = 0;
+        }
+
+        // The raw pin changed at atMillis. Edges have to be given in order.
+        void edge(bool down, uint32_t atMillis){
+            advance(atMillis);
+            if (down == _rawDown) return;
+            _rawDown = down;
+            _rawMillis = atMillis;
+        }
+
+        // Catch up to nowMillis: settle the debounce and fire any holds that are due
+        void update(uint32_t nowMillis){
+            advance(nowMillis);
+        }
+
+        bool next(ButtonEvent& event){
+            if (_eventCount == 0) return false;
+            event = _events[_eventHead];
+            _eventHead = (_eventHead + 1) % MAX_EVENTS;
+            _eventCount--;
+            return true;
+        }
+
+        bool isDown(){
+            return _down;
+        }
+
+        // How long the current (or last) press has been down
+        uint32_t downMillis(uint32_t nowMillis){
+            return nowMillis - _downMillis;
+        }
+
+    private:
+        static const uint8_t MAX_EVENTS = 8;
+
+        void advance(uint32_t nowMillis){
+            // The raw level has been steady long enough, it's real. It's
+            // dated from the edge, not from when we noticed.
+            if (_rawDown != _down && nowMillis - _rawMillis >= _debounceMillis){
+                // Holds that ran out before the release still count
+                if (_down) checkHolds(_rawMillis);
+                _down = _rawDown;
+                if (_down){
+                    _downMillis = _rawMillis;
+                    _held = false;
+                    _longHeld = false;
+                }
+                push(_down ? BUTTON_PRESSED : BUTTON_RELEASED);
+            }
+            if (_down && _rawDown == _down) checkHolds(nowMillis);
+        }
+
+        void checkHolds(uint32_t nowMillis){
+            uint32_t downFor = nowMillis - _downMillis;
+            if (!_held && downFor >= _holdMillis){
+                _held = true;
+                push(BUTTON_HELD);
+            }
+            if (!_longHeld && downFor >= _longHoldMillis){
+                _longHeld = true;
+                push(BUTTON_LONG_HELD);
+            }
+        }
+
+        // If nobody's reading them, the oldest event is dropped
+        void push(ButtonEvent event){
+            if (_eventCount == MAX_EVENTS){
+                _eventHead = (_eventHead + 1) % MAX_EVENTS;
+                _eventCount--;
+            }
+            _events[(_eventHead + _eventCount) % MAX_EVENTS] = event;
+            _eventCount++;
+        }
+
+        uint32_t _debounceMillis;
+        uint32_t _holdMillis;
+        uint32_t _longHoldMillis;
+
+        bool _rawDown;
+        uint32_t _rawMillis;
+        bool _down;
+        uint32_t _downMillis;
+        bool _held;
+        bool _longHeld;
+
+        ButtonEvent _events[MAX_EVENTS];
+        uint8_t _eventHead;
+        uint8_t _eventCount;
+};
+
+#endif
@@ -19,15 +19,15 @@ class HttpsConfig {
     public:
         HttpsConfig();
         ~HttpsConfig();
-        String apikey();
-        String iftttalert();
-        String iftttnotification();
+        char* apikey();
+        char* iftttalert();
+        char* iftttnotification();
         char* fingerprint();
 
     private:
-        String _apikey;
-        String _iftttalert;
-        String _iftttnotification;
+        char* _apikey;
+        char* _iftttalert;
+        char* _iftttnotification;
         char* _fingerprint;
 };
 
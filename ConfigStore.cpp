@@ -0,0 +1,238 @@
+#include "Arduino.h"
+#include "ConfigStore.h"
+#include "FlashLog.h"
+#include "Temperature.h"
+#include <LittleFS.h>
+#include <stddef.h>
+#include <errno.h>
+
+// "TMC1" backwards, marks a config record
+const uint32_t configMagic = 0x31434D54;
+
+#define CONFIG_FIELD(name, type, min, max) {#name, type, offsetof(RuntimeConfig, name), sizeof(((RuntimeConfig*)0)->name), min, max}
+
+// Longest a time setting can be (milli * seconds)
+const int32_t maxSettingMillis = 1000L * 3600 * 24 * 7;
+
+// name, type, min, max (for text, shortest length and the buffer size)
+const ConfigStore::Field ConfigStore::FIELDS[] = {
+    CONFIG_FIELD(ssid, FIELD_TEXT, 1, 33),
+    CONFIG_FIELD(password, FIELD_SECRET, 0, 65),
+    CONFIG_FIELD(iftttKey, FIELD_SECRET, 0, 48),
+    CONFIG_FIELD(iftttAlert, FIELD_TEXT, 0, 40),
+    CONFIG_FIELD(iftttNotification, FIELD_TEXT, 0, 40),
+    CONFIG_FIELD(fingerprint, FIELD_TEXT, 0, 60),
+    CONFIG_FIELD(tzHours, FIELD_INT, -12, 14),
+    CONFIG_FIELD(dstMinutes, FIELD_UINT, 0, 120),
+    // What a DS18B20 can read, and a hysteresis band of up to 10 degrees
+    CONFIG_FIELD(alertLimit, FIELD_TEMP, fromCelsius(-55), fromCelsius(125)),
+    CONFIG_FIELD(alertHysteresis, FIELD_TEMP, 0, fahrenheitDelta(10.00)),
+    CONFIG_FIELD(alertDwellMillis, FIELD_UINT, 0, maxSettingMillis),
+    CONFIG_FIELD(alertRepeatMillis, FIELD_UINT, 0, maxSettingMillis),
+    CONFIG_FIELD(alertEscalateMillis, FIELD_UINT, 0, maxSettingMillis),
+    CONFIG_FIELD(sensorFaultMillis, FIELD_UINT, 1000, maxSettingMillis),
+    CONFIG_FIELD(telemetryHost, FIELD_TEXT, 0, 40),
+    CONFIG_FIELD(telemetryPort, FIELD_UINT, 1, 65535),
+    CONFIG_FIELD(configToken, FIELD_SECRET, 0, 33),
+};
+const int ConfigStore::FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+ConfigStore::ConfigStore(const char* path){
+    _path = path;
+    _result = LOAD_NOT_TRIED;
+}
+
+// config should already hold the defaults, they're left alone unless a good
+// record is found
+ConfigStore::LoadResult ConfigStore::load(RuntimeConfig& config){
+    if (!LittleFS.begin()){
+        _result = NO_FILESYSTEM;
+        return _result;
+    }
+    File file = LittleFS.open(_path, "r");
+    if (!file){
+        _result = MISSING;
+        return _result;
+    }
+
+    // One read for the lot, header and record
+    byte buff[sizeof(Header) + sizeof(RuntimeConfig)];
+    size_t length = file.read(buff, sizeof(buff));
+    file.close();
+
+    Header header;
+    memcpy(&header, buff, sizeof(header));
+    bool ok = length >= sizeof(Header) &&
+        header.magic == configMagic &&
+        header.version >= 1 && header.version <= CONFIG_VERSION &&
+        header.length <= sizeof(RuntimeConfig) &&
+        length == sizeof(Header) + header.length;
+    if (ok){
+        uint32_t crc = header.crc;
+        header.crc = 0;
+        ok = FlashLog::crc32(FlashLog::crc32(0, (const byte*)&header, sizeof(header)), 
+            buff + sizeof(Header), header.length) == crc;
+    }
+    if (!ok){
+        Serial.printf("%s: bad config record, using defaults\n", _path);
+        _result = CORRUPT;
+        return _result;
+    }
+
+    memcpy(&config, buff + sizeof(Header), header.length);
+    // Text fields have to end inside their buffers whatever was in the file
+    for (int i = 0; i < FIELD_COUNT; i++){
+        if (FIELDS[i].type == FIELD_TEXT || FIELDS[i].type == FIELD_SECRET){
+            ((char*)&config)[FIELDS[i].offset + FIELDS[i].size - 1] = '\0';
+        }
+    }
+    _result = (header.version < CONFIG_VERSION || header.length < sizeof(RuntimeConfig)) ? MIGRATED : LOADED;
+    return _result;
+}
+
+bool ConfigStore::save(const RuntimeConfig& config){
+    Header header;
+    header.magic = configMagic;
+    header.version = CONFIG_VERSION;
+    header.length = sizeof(RuntimeConfig);
+    header.crc = 0;
+    header.crc = FlashLog::crc32(FlashLog::crc32(0, (const byte*)&header, sizeof(header)), 
+        (const byte*)&config, sizeof(config));
+
+    char tempPath[32];
+    snprintf_P(tempPath, sizeof(tempPath), PSTR("%s.new"), _path);
+    File file = LittleFS.open(tempPath, "w");
+    if (!file) return false;
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+        file.write((const uint8_t*)&config, sizeof(config)) == sizeof(config);
+    file.close();
+    if (!ok){
+        LittleFS.remove(tempPath);
+        return false;
+    }
+    return LittleFS.rename(tempPath, _path);
+}
+
+ConfigStore::LoadResult ConfigStore::loadResult(){
+    return _result;
+}
+
+const char* ConfigStore::loadResultName(LoadResult result){
+    switch (result){
+        case LOAD_NOT_TRIED: return "not loaded";
+        case LOADED: return "loaded";
+        case MIGRATED: return "migrated";
+        case MISSING: return "defaults";
+        case CORRUPT: return "corrupt, defaults";
+        case NO_FILESYSTEM: return "no filesystem, defaults";
+    }
+    return "?";
+}
+
+// Set one field from text, e.g. ("alertLimit", "35.5"). False if there's no
+// such field or the value isn't allowed for it; nothing is changed then.
+bool ConfigStore::set(RuntimeConfig& config, const char* name, const char* value){
+    for (int i = 0; i < FIELD_COUNT; i++){
+        const Field& field = FIELDS[i];
+        if (strcmp(field.name, name) != 0) continue;
+        byte* p = (byte*)&config + field.offset;
+
+        switch (field.type){
+            case FIELD_TEXT:
+            case FIELD_SECRET: {
+                size_t length = strlen(value);
+                if (length < (size_t)field.min || length >= field.size) return false;
+                strcpy((char*)p, value);
+                return true;
+            }
+
+            case FIELD_TEMP: {
+                int16_t centi;
+                if (!parseTemperature(value, centi)) return false;
+                if (centi < field.min || centi > field.max) return false;
+                memcpy(p, &centi, sizeof(centi));
+                return true;
+            }
+
+            case FIELD_INT:
+            case FIELD_UINT: {
+                // The whole string has to be a number, and not one strtol() had to clamp
+                char* end;
+                errno = 0;
+                long number = strtol(value, &end, 10);
+                if (errno != 0 || end == value || *end != '\0') return false;
+                if (number < field.min || number > field.max) return false;
+                if (field.size == 1){
+                    *p = (byte)number;
+                }
+                else if (field.size == 2){
+                    uint16_t bits = number;
+                    memcpy(p, &bits, sizeof(bits));
+                }
+                else {
+                    uint32_t bits = number;
+                    memcpy(p, &bits, sizeof(bits));
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Every field as a JSON object, secrets only say whether they're set
+void ConfigStore::printJson(Print& out, const RuntimeConfig& config){
+    out.print("{");
+    for (int i = 0; i < FIELD_COUNT; i++){
+        const Field& field = FIELDS[i];
+        const byte* p = (const byte*)&config + field.offset;
+        out.printf("%s\"%s\":", i > 0 ? "," : "", field.name);
+
+        switch (field.type){
+            case FIELD_TEXT:
+                // Settings are ours, but keep the JSON valid whatever's in them
+                out.print('"');
+                for (const char* c = (const char*)p; *c; c++){
+                    if (*c == '"' || *c == '\\') out.print('\\');
+                    if ((byte)*c >= ' ') out.print(*c);
+                }
+                out.print('"');
+                break;
+
+            case FIELD_SECRET:
+                out.print(*p ? "\"(set)\"" : "\"\"");
+                break;
+
+            case FIELD_TEMP: {
+                int16_t centi;
+                memcpy(&centi, p, sizeof(centi));
+                char text[TEMP_TEXT_SIZE];
+                formatTemperature(text, centi, 2);
+                out.print(text);
+                break;
+            }
+
+            case FIELD_INT:
+            case FIELD_UINT: {
+                long number;
+                if (field.size == 1){
+                    number = (field.type == FIELD_INT) ? (long)(int8_t)*p : (long)*p;
+                }
+                else if (field.size == 2){
+                    uint16_t bits;
+                    memcpy(&bits, p, sizeof(bits));
+                    number = (field.type == FIELD_INT) ? (long)(int16_t)bits : (long)bits;
+                }
+                else {
+                    uint32_t bits;
+                    memcpy(&bits, p, sizeof(bits));
+                    out.printf("%lu", (unsigned long)bits);
+                    break;
+                }
+                out.printf("%ld", number);
+                break;
+            }
+        }
+    }
+    out.print("}");
+}
@@ -0,0 +1,98 @@
+#ifndef ConfigStore_H
+#define ConfigStore_H
+
+#include "Arduino.h"
+
+// Everything that can be changed without a reflash. Plain data only, it's
+// written to flash as is. Temps are in hundredths of a degree (Temperature.h).
+//
+// Only ever add fields at the end (and bump CONFIG_VERSION): a record saved
+// by older firmware is shorter, so it's read over the defaults and the new
+// fields keep their default values.
+struct RuntimeConfig {
+    char ssid[33];
+    char password[65];
+    char iftttKey[48];
+    char iftttAlert[40];
+    char iftttNotification[40];
+    char fingerprint[60];
+    int8_t tzHours;                     // (utc+)
+    uint8_t dstMinutes;
+    // The main threshold rule (the first in the alert rule table)
+    int16_t alertLimit;
+    int16_t alertHysteresis;
+    uint32_t alertDwellMillis;
+    uint32_t alertRepeatMillis;
+    uint32_t alertEscalateMillis;
+    uint32_t sensorFaultMillis;
+    char telemetryHost[40];
+    uint16_t telemetryPort;
+    // Added in version 2
+    char configToken[33];               // Needed to change any of this, see sendConfig()
+};
+
+// Keeps a RuntimeConfig in a LittleFS file as one record: a small header
+// (magic, version, length, CRC-32) then the struct. load() is a single read;
+// if the file is missing or doesn't check out the defaults are kept.
+// save() writes a temp file and renames it over the old one, so a reset part
+// way through leaves the previous config rather than half of each.
+//
+// Fields are also settable by name from text (for the /config endpoint),
+// anything that isn't a whole number in the field's range is refused.
+class ConfigStore {
+    public:
+        static const uint16_t CONFIG_VERSION = 2;
+
+        enum LoadResult {
+            LOAD_NOT_TRIED,
+            LOADED,
+            MIGRATED,           // Saved by older firmware, new fields are defaults
+            MISSING,            // First boot, defaults
+            CORRUPT,            // Failed the checks, defaults
+            NO_FILESYSTEM,
+        };
+
+        ConfigStore(const char* path);
+        LoadResult load(RuntimeConfig& config);
+        bool save(const RuntimeConfig& config);
+        LoadResult loadResult();
+        static const char* loadResultName(LoadResult result);
+
+        static bool set(RuntimeConfig& config, const char* name, const char* value);
+        static void printJson(Print& out, const RuntimeConfig& config);
+
+    private:
+        struct Header {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t length;
+            uint32_t crc;
+        };
+
+        enum FieldType {
+            FIELD_TEXT,
+            FIELD_SECRET,           // Text that's never sent back out
+            FIELD_INT,
+            FIELD_UINT,
+            FIELD_TEMP,             // Hundredths of a degree, set and shown as "35.50"
+        };
+
+        // min and max are the allowed range for numbers and temps, and the
+        // shortest allowed text (max is the buffer size then)
+        struct Field {
+            const char* name;
+            FieldType type;
+            uint16_t offset;
+            uint8_t size;
+            int32_t min;
+            int32_t max;
+        };
+
+        static const Field FIELDS[];
+        static const int FIELD_COUNT;
+
+        const char* _path;
+        LoadResult _result;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef FixedString_H
+#define FixedString_H
+
+#include "Arduino.h"
+#include <stdarg.h>
+
+// String with its storage inline (on the stack, or in the object that owns
+// it) instead of on the heap, for text we put together all the time. It's
+// always terminated, and anything past CAPACITY is cut off and noted rather
+// than growing. It's a Print, so print()/printf() into it work as well.
+//
+//   FixedString<32> label;
+//   label.appendf(PSTR("%s:"), sensor.label);
+template <size_t CAPACITY>
+class FixedString : public Print {
+    public:
+        FixedString(){
+            clear();
+        }
+
+        void clear(){
+            _length = 0;
+            _text[0] = '\0';
+            _truncated = false;
+        }
+
+        size_t write(uint8_t c){
+            if (_length >= CAPACITY){
+                _truncated = true;
+                return 0;
+            }
+            _text[_length++] = c;
+            _text[_length] = '\0';
+            return 1;
+        }
+
+        size_t write(const uint8_t* data, size_t length){
+            size_t room = CAPACITY - _length;
+            if (length > room){
+                length = room;
+                _truncated = true;
+            }
+            memcpy(_text + _length, data, length);
+            _length += length;
+            _text[_length] = '\0';
+            return length;
+        }
+        using Print::write;
+
+        FixedString& append(const char* text){
+            write((const uint8_t*)text, strlen(text));
+            return *this;
+        }
+
+        // Text in flash, e.g. append_P(PSTR("..."))
+        FixedString& append_P(PGM_P text){
+            size_t length = strlen_P(text);
+            size_t room = CAPACITY - _length;
+            if (length > room){
+                length = room;
+                _truncated = true;
+            }
+            memcpy_P(_text + _length, text, length);
+            _length += length;
+            _text[_length] = '\0';
+            return *this;
+        }
+
+        FixedString& appendf(PGM_P format, ...){
+            va_list args;
+            va_start(args, format);
+            int length = vsnprintf_P(_text + _length, CAPACITY + 1 - _length, format, args);
+            va_end(args);
+            if (length < 0) return *this;
+            if ((size_t)length > CAPACITY - _length){
+                length = CAPACITY - _length;
+                _truncated = true;
+            }
+            _length += length;
+            return *this;
+        }
+
+        const char* c_str() const {
+            return _text;
+        }
+
+        size_t length() const {
+            return _length;
+        }
+
+        size_t capacity() const {
+            return CAPACITY;
+        }
+
+        // Something didn't fit
+        bool truncated() const {
+            return _truncated;
+        }
+
+    private:
+        char _text[CAPACITY + 1];
+        size_t _length;
+        bool _truncated;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "Arduino.h"
+#include "FlashLog.h"
+#include <LittleFS.h>
+
+// Marks the start of a record, anything else is the end of the valid data
+const uint8_t recordMagic = 0xA5;
+
+FlashLog::FlashLog(const char* name, size_t segmentBytes, unsigned long flushMillis){
+    snprintf_P(_paths[0], sizeof(_paths[0]), PSTR("/%s.0"), name);
+    snprintf_P(_paths[1], sizeof(_paths[1]), PSTR("/%s.1"), name);
+    _segmentBytes = segmentBytes;
+    _flushMillis = flushMillis;
+    _ready = false;
+    _active = 0;
+    _bytes[0] = 0;
+    _bytes[1] = 0;
+    _seq = 1;
+    _batchLength = 0;
+    _batchMillis = 0;
+    _readStep = 0;
+    _readOffset = 0;
+    _appended = 0;
+    _flushes = 0;
+}
+
+// Mount the filesystem and find where each segment's valid records end.
+// Whichever segment has the newest record is the one we keep appending to.
+bool FlashLog::begin(){
+    if (!LittleFS.begin()){
+        Serial.println("LittleFS mount failed, log is RAM only.");
+        return false;
+    }
+
+    uint32_t lastSeq[2];
+    for (byte s = 0; s < 2; s++){
+        _bytes[s] = scan(s, lastSeq[s]);
+    }
+    _active = (lastSeq[1] > lastSeq[0]) ? 1 : 0;
+    _seq = max(lastSeq[0], lastSeq[1]) + 1;
+    _ready = true;
+    rewind();
+
+    Serial.printf("%s: %u bytes in log\n", _paths[0], (unsigned int)(_bytes[0] + _bytes[1]));
+    return true;
+}
+
+// Walk a segment's records checking each CRC. Anything after the last good
+// record (a write cut short by a reset) is truncated away.
+size_t FlashLog::scan(byte segment, uint32_t& lastSeq){
+    lastSeq = 0;
+    File file = LittleFS.open(_paths[segment], "r");
+    if (!file) return 0;
+    size_t fileSize = file.size();
+
+    size_t offset = 0;
+    Header header;
+    byte data[MAX_RECORD];
+    while (offset < fileSize && readRecord(file, header, data, sizeof(data))){
+        lastSeq = header.seq;
+        offset += sizeof(Header) + header.length;
+    }
+    file.close();
+
+    if (offset < fileSize){
+        Serial.printf("%s: dropping %u bad bytes\n", _paths[segment], (unsigned int)(fileSize - offset));
+        file = LittleFS.open(_paths[segment], "r+");
+        if (file){
+            file.truncate(offset);
+            file.close();
+        }
+    }
+    return offset;
+}
+
+// Read the record at the file's current position and check it
+bool FlashLog::readRecord(File& file, Header& header, byte* data, uint16_t size){
+    bool ok = file &&
+        file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+        header.magic == recordMagic &&
+        header.length <= MAX_RECORD &&
+        header.length <= size &&
+        file.read(data, header.length) == header.length;
+    if (!ok) return false;
+
+    uint32_t crc = header.crc;
+    header.crc = 0;
+    bool valid = crc32(crc32(0, (const byte*)&header, sizeof(header)), data, header.length) == crc;
+    header.crc = crc;
+    return valid;
+}
+
+// Add a record to the batch. It's written out when the batch fills up or
+// flushMillis after the first record in it, whichever comes first (or
+// straight away if flushMillis is 0).
+bool FlashLog::append(byte type, const void* data, uint16_t length){
+    if (length > MAX_RECORD) return false;
+    if (_batchLength + sizeof(Header) + length > sizeof(_batch)){
+        flush();
+    }
+
+    Header header;
+    header.magic = recordMagic;
+    header.type = type;
+    header.length = length;
+    header.seq = _seq++;
+    header.crc = 0;
+    header.crc = crc32(crc32(0, (const byte*)&header, sizeof(header)), (const byte*)data, length);
+
+    if (_batchLength == 0) _batchMillis = millis();
+    memcpy(_batch + _batchLength, &header, sizeof(header));
+    memcpy(_batch + _batchLength + sizeof(header), data, length);
+    _batchLength += sizeof(header) + length;
+    _appended++;
+
+    if (_flushMillis == 0) flush();
+    return true;
+}
+
+// Write the batch out in one go, moving to the other segment first if it won't fit
+void FlashLog::flush(){
+    if (_batchLength == 0 || !_ready) return;
+
+    if (_bytes[_active] + _batchLength > _segmentBytes){
+        _active = 1 - _active;
+        _bytes[_active] = 0;
+        // What the reader was on is now the older segment. If that was the one
+        // we just emptied, carry on from the start of the segment after it.
+        if (_readStep == 0) _readOffset = 0;
+        _readStep = 0;
+        File file = LittleFS.open(_paths[_active], "w");
+        file.close();
+    }
+
+    File file = LittleFS.open(_paths[_active], "a");
+    if (!file){
+        Serial.printf("%s: open failed\n", _paths[_active]);
+        return;
+    }
+    size_t written = file.write(_batch, _batchLength);
+    file.close();
+    _bytes[_active] += written;
+    _batchLength = 0;
+    _flushes++;
+}
+
+void FlashLog::flushIfDue(){
+    if (_batchLength > 0 && millis() - _batchMillis >= _flushMillis){
+        flush();
+    }
+}
+
+// Start reading again from the oldest record
+void FlashLog::rewind(){
+    flush();
+    _readStep = 0;
+    _readOffset = 0;
+}
+
+// Copy the next record out, oldest first. data should have room for
+// MAX_RECORD bytes. Returns its length, or -1 once there's nothing more to
+// read (records appended after that are picked up by the next call).
+int FlashLog::next(byte& type, void* data, uint16_t size){
+    if (!_ready) return -1;
+    flush();
+
+    // Step 0 is the older (inactive) segment, step 1 the active one
+    for (;;){
+        byte segment = (_readStep == 0) ? 1 - _active : _active;
+        if (_readOffset < _bytes[segment]){
+            File file = LittleFS.open(_paths[segment], "r");
+            Header header;
+            bool ok = file && file.seek(_readOffset, SeekSet) && readRecord(file, header, (byte*)data, size);
+            file.close();
+            if (ok){
+                _readOffset += sizeof(Header) + header.length;
+                type = header.type;
+                return header.length;
+            }
+        }
+        if (_readStep == 1) return -1;
+        _readStep = 1;
+        _readOffset = 0;
+    }
+}
+
+// Drop everything, e.g. once it's all been replayed
+void FlashLog::clear(){
+    _batchLength = 0;
+    if (_ready){
+        for (byte s = 0; s < 2; s++){
+            File file = LittleFS.open(_paths[s], "w");
+            file.close();
+        }
+    }
+    _bytes[0] = 0;
+    _bytes[1] = 0;
+    _readStep = 0;
+    _readOffset = 0;
+}
+
+bool FlashLog::isEmpty(){
+    return _bytes[0] == 0 && _bytes[1] == 0 && _batchLength == 0;
+}
+
+uint32_t FlashLog::appended(){
+    return _appended;
+}
+
+uint32_t FlashLog::flushes(){
+    return _flushes;
+}
+
+// Standard CRC-32 (same as zlib), done a bit at a time since records are small
+uint32_t FlashLog::crc32(uint32_t crc, const byte* data, size_t length){
+    crc = ~crc;
+    while (length--){
+        crc ^= *data++;
+        for (byte i = 0; i < 8; i++){
+            crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,68 @@
+#ifndef FlashLog_H
+#define FlashLog_H
+
+#include "Arduino.h"
+#include <FS.h>
+
+// Append only record log in LittleFS, for things that have to survive a
+// reset while we're offline (alerts that couldn't be sent, offline samples).
+//
+// Records go into a small RAM batch first and are written out together, so
+// frequent small records don't mean frequent flash writes. The log is two
+// segment files used in turn: when the active one fills up the other is
+// emptied and takes over, so the oldest records are dropped and the log never
+// grows past two segments. Each record carries a sequence number and a CRC,
+// so anything half written by a reset is found and cut off at begin().
+// LittleFS does its own wear leveling underneath.
+class FlashLog {
+    public:
+        // Biggest payload a record can have
+        static const uint16_t MAX_RECORD = 240;
+
+        FlashLog(const char* name, size_t segmentBytes, unsigned long flushMillis);
+        bool begin();
+        bool append(byte type, const void* data, uint16_t length);
+        void flush();
+        void flushIfDue();
+        void rewind();
+        int next(byte& type, void* data, uint16_t size);
+        void clear();
+        bool isEmpty();
+        uint32_t appended();
+        uint32_t flushes();
+        static uint32_t crc32(uint32_t crc, const byte* data, size_t length);
+
+    private:
+        struct Header {
+            uint8_t magic;
+            uint8_t type;
+            uint16_t length;
+            uint32_t seq;
+            uint32_t crc;
+        };
+
+        size_t scan(byte segment, uint32_t& lastSeq);
+        bool readRecord(File& file, Header& header, byte* data, uint16_t size);
+
+        char _paths[2][24];
+        size_t _segmentBytes;
+        unsigned long _flushMillis;
+        bool _ready;
+
+        byte _active;
+        size_t _bytes[2];
+        uint32_t _seq;
+
+        byte _batch[256];
+        size_t _batchLength;
+        unsigned long _batchMillis;
+
+        // Read cursor, oldest segment first
+        byte _readStep;
+        size_t _readOffset;
+
+        uint32_t _appended;
+        uint32_t _flushes;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "Arduino.h"
+#include "HttpRequest.h"
+
+HttpRequest::HttpRequest(){
+    reset();
+}
+
+void HttpRequest::reset(){
+    _lineLength = 0;
+    _headerBytes = 0;
+    _firstLine = true;
+    _result = INCOMPLETE;
+    _method[0] = '\0';
+    _path[0] = '\0';
+    _query[0] = '\0';
+    _ifNoneMatch[0] = '\0';
+}
+
+HttpRequest::Result HttpRequest::feed(char c){
+    if (_result != INCOMPLETE) return _result;
+
+    if (++_headerBytes > MAX_HEADER_BYTES){
+        _result = TOO_LARGE;
+        return _result;
+    }
+
+    if (c == '\n'){
+        endLine();
+    }
+    else if (c != '\r' && _lineLength < MAX_LINE - 1){
+        // Anything past the end of the buffer is dropped
+        _line[_lineLength++] = c;
+    }
+    return _result;
+}
+
+void HttpRequest::endLine(){
+    _line[_lineLength] = '\0';
+
+    if (_firstLine){
+        parseRequestLine();
+        _firstLine = false;
+    }
+    else if (_lineLength == 0){
+        // Blank line, that's the end of the headers
+        _result = COMPLETE;
+    }
+    else {
+        parseHeader();
+    }
+    _lineLength = 0;
+}
+
+// e.g. "GET /index.html HTTP/1.1", anything after a '?' is the query
+void HttpRequest::parseRequestLine(){
+    char* space = strchr(_line, ' ');
+    if (!space || space - _line >= (int)sizeof(_method)){
+        _result = BAD_REQUEST;
+        return;
+    }
+    *space = '\0';
+    strcpy(_method, _line);
+
+    char* path = space + 1;
+    char* end = strchr(path, ' ');
+    if (end) *end = '\0';
+    char* query = strchr(path, '?');
+    if (query) *query++ = '\0';
+    if (path[0] != '/' || strlen(path) >= sizeof(_path) || (query && strlen(query) >= sizeof(_query))){
+        _result = BAD_REQUEST;
+        return;
+    }
+    strcpy(_path, path);
+    strcpy(_query, query ? query : "");
+}
+
+// We only care about a couple of headers, everything else is skipped
+void HttpRequest::parseHeader(){
+    if (strncasecmp(_line, "If-None-Match:", 14) == 0){
+        const char* value = _line + 14;
+        while (*value == ' ') value++;
+        strncpy(_ifNoneMatch, value, sizeof(_ifNoneMatch) - 1);
+        _ifNoneMatch[sizeof(_ifNoneMatch) - 1] = '\0';
+    }
+}
+
+HttpRequest::Result HttpRequest::result(){
+    return _result;
+}
+
+const char* HttpRequest::method(){
+    return _method;
+}
+
+const char* HttpRequest::path(){
+    return _path;
+}
+
+// Without the '?', "" if there wasn't one
+const char* HttpRequest::query(){
+    return _query;
+}
+
+// Split the next name=value pair off a query string, URL decoded, and move
+// query past it. False once there are no more. A pair that doesn't fit the
+// buffers comes back with an empty name.
+bool HttpRequest::nextParam(const char*& query, char* name, size_t nameSize, char* value, size_t valueSize){
+    while (*query == '&') query++;
+    if (!*query) return false;
+
+    name[0] = '\0';
+    value[0] = '\0';
+    char* out = name;
+    size_t room = nameSize - 1;
+    bool inValue = false;
+    bool fits = true;
+    for (; *query && *query != '&'; query++){
+        char c = *query;
+        if (c == '=' && !inValue){
+            *out = '\0';
+            out = value;
+            room = valueSize - 1;
+            inValue = true;
+            continue;
+        }
+        if (c == '+'){
+            c = ' ';
+        }
+        else if (c == '%' && isxdigit(query[1]) && isxdigit(query[2])){
+            char hex[3] = {query[1], query[2], '\0'};
+            c = strtol(hex, NULL, 16);
+            query += 2;
+        }
+        if (room == 0){
+            fits = false;
+            continue;
+        }
+        *out++ = c;
+        room--;
+    }
+    *out = '\0';
+    if (!fits) name[0] = '\0';
+    return true;
+}
+
+// Did the client say it already has this version of the resource?
+bool HttpRequest::ifNoneMatch(const char* etag){
+    return _ifNoneMatch[0] != '\0' && strcmp(_ifNoneMatch, etag) == 0;
+}
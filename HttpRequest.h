@@ -0,0 +1,48 @@
+#ifndef HttpRequest_H
+#define HttpRequest_H
+
+#include "Arduino.h"
+
+// Bounded HTTP request scanner. Bytes are fed in one at a time as they come
+// off the socket; only the current line is buffered (and truncated if it's
+// too long), so a request never costs more than the fixed buffers below no
+// matter what the client sends.
+class HttpRequest {
+    public:
+        enum Result {
+            INCOMPLETE,         // Still waiting on the blank line after the headers
+            COMPLETE,           // Got the whole request
+            BAD_REQUEST,        // Request line didn't make sense
+            TOO_LARGE,          // Headers went over MAX_HEADER_BYTES
+        };
+
+        HttpRequest();
+        void reset();
+        Result feed(char c);
+        Result result();
+        const char* method();
+        const char* path();
+        const char* query();
+        bool ifNoneMatch(const char* etag);
+        static bool nextParam(const char*& query, char* name, size_t nameSize, char* value, size_t valueSize);
+
+    private:
+        static const int MAX_LINE = 192;
+        static const int MAX_HEADER_BYTES = 2048;
+
+        void endLine();
+        void parseRequestLine();
+        void parseHeader();
+
+        char _line[MAX_LINE];
+        uint8_t _lineLength;
+        uint16_t _headerBytes;
+        bool _firstLine;
+        Result _result;
+        char _method[8];
+        char _path[64];
+        char _query[128];
+        char _ifNoneMatch[24];
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "Arduino.h"
+#include "HttpsConnection.h"
+
+// Drop a kept-alive connection after this long unused. The server will close
+// it on its end eventually anyway, and the TLS buffers are a big chunk of our
+// heap. (milli * seconds)
+const unsigned long keepAliveIdleMillis = 1000 * 30;
+
+HttpsConnection::HttpsConnection(const char* host, int port, char* fingerprint){
+    _host = host;
+    _port = port;
+    _fingerprint = fingerprint;
+    _open = false;
+    _fresh = false;
+    _lastUsedMillis = 0;
+    _requestStartMillis = 0;
+    _handshakes = 0;
+    _reuses = 0;
+    _requests = 0;
+    _lastLatencyMillis = 0;
+    _maxLatencyMillis = 0;
+    _totalLatencyMillis = 0;
+}
+
+// Is there a live connection we can send the next request on?
+bool HttpsConnection::reusable(){
+    if (!_open) return false;
+    if (!_client.connected() || millis() - _lastUsedMillis > keepAliveIdleMillis){
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Fresh connection and TLS handshake
+bool HttpsConnection::connect(){
+    close();
+    _handshakes++;
+    if (!_client.connect(_host, _port)) {
+        return false;
+    }
+    _open = true;
+    _fresh = true;
+    _lastUsedMillis = millis();
+    return true;
+}
+
+// Verify the fingerprint matches the host we're connected to
+bool HttpsConnection::verify(){
+    return _client.verify(_fingerprint, _host);
+}
+
+void HttpsConnection::close(){
+    if (_open){
+        _client.stop();
+    }
+    _open = false;
+}
+
+void HttpsConnection::closeIfIdle(){
+    if (_open && millis() - _lastUsedMillis > keepAliveIdleMillis){
+        close();
+    }
+}
+
+WiFiClientSecure& HttpsConnection::client(){
+    return _client;
+}
+
+void HttpsConnection::beginRequest(){
+    if (!_fresh) _reuses++;
+    _fresh = false;
+    _requestStartMillis = millis();
+}
+
+// Request finished, record how long it took and either park the connection
+// for the next one or close it.
+void HttpsConnection::endRequest(bool keepAlive){
+    _lastLatencyMillis = millis() - _requestStartMillis;
+    if (_lastLatencyMillis > _maxLatencyMillis) _maxLatencyMillis = _lastLatencyMillis;
+    _totalLatencyMillis += _lastLatencyMillis;
+    _requests++;
+    _lastUsedMillis = millis();
+
+    if (!keepAlive){
+        close();
+    }
+}
+
+const char* HttpsConnection::host(){
+    return _host;
+}
+
+unsigned long HttpsConnection::handshakes(){
+    return _handshakes;
+}
+
+unsigned long HttpsConnection::reuses(){
+    return _reuses;
+}
+
+unsigned long HttpsConnection::lastLatencyMillis(){
+    return _lastLatencyMillis;
+}
+
+unsigned long HttpsConnection::maxLatencyMillis(){
+    return _maxLatencyMillis;
+}
+
+unsigned long HttpsConnection::averageLatencyMillis(){
+    if (_requests == 0) return 0;
+    return _totalLatencyMillis / _requests;
+}
+
+unsigned long HttpsConnection::requests(){
+    return _requests;
+}
+
+unsigned long HttpsConnection::totalLatencyMillis(){
+    return _totalLatencyMillis;
+}
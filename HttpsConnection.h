@@ -0,0 +1,51 @@
+#ifndef HttpsConnection_H
+#define HttpsConnection_H
+
+#include "Arduino.h"
+#include <WiFiClientSecure.h>
+
+// Keeps one TLS connection to a host open between requests so back to back
+// posts don't each pay for a full handshake. If the connection has dropped
+// or sat idle too long it's thrown away and the next request connects fresh.
+// Also keeps count of handshakes and how long each request took.
+class HttpsConnection {
+    public:
+        HttpsConnection(const char* host, int port, char* fingerprint);
+        bool reusable();
+        bool connect();
+        bool verify();
+        void close();
+        void closeIfIdle();
+        WiFiClientSecure& client();
+
+        void beginRequest();
+        void endRequest(bool keepAlive);
+
+        const char* host();
+        unsigned long handshakes();
+        unsigned long reuses();
+        unsigned long lastLatencyMillis();
+        unsigned long maxLatencyMillis();
+        unsigned long averageLatencyMillis();
+        unsigned long requests();
+        unsigned long totalLatencyMillis();
+
+    private:
+        const char* _host;
+        int _port;
+        char* _fingerprint;
+        WiFiClientSecure _client;
+        bool _open;
+        bool _fresh;
+        unsigned long _lastUsedMillis;
+        unsigned long _requestStartMillis;
+
+        unsigned long _handshakes;
+        unsigned long _reuses;
+        unsigned long _requests;
+        unsigned long _lastLatencyMillis;
+        unsigned long _maxLatencyMillis;
+        unsigned long _totalLatencyMillis;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "Arduino.h"
+#include "Network.h"
+#include <ESP8266WiFi.h>
+#include <coredecls.h>                  // settimeofday_cb()
+#include <time.h>
+
+// Give up on the cached BSSID/channel after this long (milli * seconds)
+const unsigned long fastConnectTimeoutMillis = 1000 * 5;
+// Where the cache lives in RTC user memory (in 4 byte blocks) and how we
+// know it's ours
+const uint32_t rtcCacheOffset = 0;
+const uint32_t rtcCacheMagic = 0x57494649;
+// Anything before this is the clock counting up from 1970 at boot (2020-01-01)
+const time_t minValidTime = 1577836800;
+
+bool NetworkManager::_clockSet = false;
+
+NetworkManager::NetworkManager(const char* ssid, const char* password){
+    _ssid = ssid;
+    _password = password;
+    _state = CONNECT;
+    _stateMillis = 0;
+    _lastConnectMillis = 0;
+    _connects = 0;
+    _fast = false;
+}
+
+// Start joining the network, doesn't wait for it
+void NetworkManager::begin(){
+    settimeofday_cb(onTimeSet);
+
+    // We pass the credentials in every time, no need to wear the flash writing them
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+
+    RtcCache cache;
+    _stateMillis = millis();
+    if (readCache(cache)){
+        Serial.printf("WiFi: fast connect on channel %u\n", cache.channel);
+        WiFi.begin(_ssid, _password, cache.channel, cache.bssid);
+        _state = FAST_CONNECT;
+    }
+    else {
+        WiFi.begin(_ssid, _password);
+        _state = CONNECT;
+    }
+}
+
+void NetworkManager::update(){
+    bool up = WiFi.status() == WL_CONNECTED;
+
+    switch (_state){
+        case FAST_CONNECT:
+        case CONNECT:
+            if (up){
+                _lastConnectMillis = millis() - _stateMillis;
+                _connects++;
+                _fast = (_state == FAST_CONNECT);
+                IPAddress ip = WiFi.localIP();
+                Serial.printf("WiFi connected in %lu ms%s, IP address: %u.%u.%u.%u\n", _lastConnectMillis, 
+                    _fast ? " (fast)" : "", ip[0], ip[1], ip[2], ip[3]);
+                writeCache();
+                _state = CONNECTED;
+            }
+            else if (_state == FAST_CONNECT && millis() - _stateMillis >= fastConnectTimeoutMillis){
+                Serial.println("WiFi: fast connect failed, scanning.");
+                WiFi.disconnect();
+                WiFi.begin(_ssid, _password);
+                _stateMillis = millis();
+                _state = CONNECT;
+            }
+            break;
+
+        case CONNECTED:
+            if (!up){
+                // The SDK reconnects on its own, we just time it
+                Serial.println("WiFi connection lost.");
+                _stateMillis = millis();
+                _state = CONNECT;
+            }
+            break;
+    }
+}
+
+// Drop the network and join again, e.g. after the SSID or password changed.
+// The cached BSSID may be for another AP now, so this does a full scan.
+void NetworkManager::reconnect(){
+    Serial.printf("WiFi: reconnecting to %s\n", _ssid);
+    WiFi.disconnect();
+    WiFi.begin(_ssid, _password);
+    _stateMillis = millis();
+    _state = CONNECT;
+}
+
+bool NetworkManager::connected(){
+    return _state == CONNECTED;
+}
+
+// Has SNTP set the clock since boot?
+bool NetworkManager::clockSet(){
+    return _clockSet;
+}
+
+// How long the last (re)connect took
+unsigned long NetworkManager::lastConnectMillis(){
+    return _lastConnectMillis;
+}
+
+unsigned long NetworkManager::connects(){
+    return _connects;
+}
+
+// Did the last connect use the cached BSSID/channel?
+bool NetworkManager::fastConnected(){
+    return _fast;
+}
+
+// Is this a real time, rather than the clock counting up from 1970 at boot?
+bool NetworkManager::validTime(time_t t){
+    return t >= minValidTime;
+}
+
+void NetworkManager::onTimeSet(){
+    if (!_clockSet) Serial.println("Clock set by NTP.");
+    _clockSet = true;
+}
+
+bool NetworkManager::readCache(RtcCache& cache){
+    if (!ESP.rtcUserMemoryRead(rtcCacheOffset, (uint32_t*)&cache, sizeof(cache))) return false;
+    return cache.magic == rtcCacheMagic && cache.check == checksum(cache) && cache.channel > 0 && cache.channel <= 14;
+}
+
+// Remember the AP we ended up on, only writing if it changed
+void NetworkManager::writeCache(){
+    RtcCache cache;
+    cache.magic = rtcCacheMagic;
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.check = checksum(cache);
+
+    RtcCache old;
+    if (readCache(old) && memcmp(&old, &cache, sizeof(cache)) == 0) return;
+    ESP.rtcUserMemoryWrite(rtcCacheOffset, (uint32_t*)&cache, sizeof(cache));
+}
+
+uint8_t NetworkManager::checksum(const RtcCache& cache){
+    const uint8_t* bytes = (const uint8_t*)&cache;
+    uint8_t sum = 0x5A;
+    for (size_t i = 0; i < offsetof(RtcCache, check); i++){
+        sum = (sum << 1 | sum >> 7) ^ bytes[i];
+    }
+    return sum;
+}
@@ -0,0 +1,60 @@
+#ifndef Network_H
+#define Network_H
+
+#include "Arduino.h"
+#include <time.h>
+
+// Brings WiFi and the clock up in the background so setup() doesn't have to
+// wait on them. begin() just starts the association and update() (run as a
+// task) follows it along.
+// The AP's BSSID and channel are cached in RTC memory, which survives a
+// reset, so after a restart we can join without scanning. If that doesn't
+// work within a few seconds (the AP moved channel, or it's a cold boot and
+// RTC memory is garbage) we fall back to a normal connect.
+// The clock is set by SNTP whenever it gets through, clockSet() says whether
+// that's happened yet so timestamps can be filled in afterwards.
+class NetworkManager {
+    public:
+        NetworkManager(const char* ssid, const char* password);
+        void begin();
+        void reconnect();
+        void update();
+        bool connected();
+        bool clockSet();
+        unsigned long lastConnectMillis();
+        unsigned long connects();
+        bool fastConnected();
+        static bool validTime(time_t t);
+
+    private:
+        enum State {
+            FAST_CONNECT,       // Joining with the cached BSSID/channel
+            CONNECT,            // Normal connect, scanning for the AP
+            CONNECTED,
+        };
+
+        // Kept in RTC user memory, must be a multiple of 4 bytes
+        struct RtcCache {
+            uint32_t magic;
+            uint8_t bssid[6];
+            uint8_t channel;
+            uint8_t check;
+        };
+
+        bool readCache(RtcCache& cache);
+        void writeCache();
+        static uint8_t checksum(const RtcCache& cache);
+        static void onTimeSet();
+
+        const char* _ssid;
+        const char* _password;
+        State _state;
+        unsigned long _stateMillis;
+        unsigned long _lastConnectMillis;
+        unsigned long _connects;
+        bool _fast;
+
+        static bool _clockSet;
+};
+
+#endif
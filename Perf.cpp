@@ -0,0 +1,141 @@
+#include "Arduino.h"
+#include "Perf.h"
+
+PerfProbe* PerfProbe::_first = NULL;
+
+PerfProbe::PerfProbe(const char* name){
+    _name = name;
+    reset();
+    _next = _first;
+    _first = this;
+}
+
+void PerfProbe::record(uint32_t cycles){
+    uint32_t micros = cycles / ESP.getCpuFreqMHz();
+
+    _count++;
+    _totalMicros += micros;
+    if (micros < _minMicros) _minMicros = micros;
+    if (micros > _maxMicros) _maxMicros = micros;
+
+    // Highest set bit of one less picks the bucket, 2^i itself is in bucket i
+    int index = (micros <= 1) ? 0 : 32 - __builtin_clz(micros - 1);
+    if (index >= BUCKETS) index = BUCKETS - 1;
+    _buckets[index]++;
+}
+
+void PerfProbe::reset(){
+    _count = 0;
+    _minMicros = 0xFFFFFFFF;
+    _maxMicros = 0;
+    _totalMicros = 0;
+    for (int i = 0; i < BUCKETS; i++){
+        _buckets[i] = 0;
+    }
+}
+
+const char* PerfProbe::name(){
+    return _name;
+}
+
+uint32_t PerfProbe::count(){
+    return _count;
+}
+
+uint64_t PerfProbe::totalMicros(){
+    return _totalMicros;
+}
+
+uint32_t PerfProbe::minMicros(){
+    return _count ? _minMicros : 0;
+}
+
+uint32_t PerfProbe::maxMicros(){
+    return _maxMicros;
+}
+
+uint32_t PerfProbe::averageMicros(){
+    if (_count == 0) return 0;
+    return _totalMicros / _count;
+}
+
+uint32_t PerfProbe::bucket(int index){
+    return _buckets[index];
+}
+
+// Upper bound of a histogram bucket in us, inclusive
+uint32_t PerfProbe::bucketLimitMicros(int index){
+    return 1UL << index;
+}
+
+// Summary line plus the non-empty histogram buckets. Through appendf(), since
+// Print::printf() allocates for anything over 64 characters.
+void PerfProbe::report(BufferedPrint& out){
+    out.appendf(PSTR("%-10s n=%lu min=%lu avg=%lu max=%lu us\n"), _name,
+        (unsigned long)_count,
+        (unsigned long)minMicros(),
+        (unsigned long)averageMicros(),
+        (unsigned long)_maxMicros);
+    for (int i = 0; i < BUCKETS; i++){
+        if (_buckets[i] == 0) continue;
+        if (i == BUCKETS - 1){
+            out.appendf(PSTR("    > %7lu us: %lu\n"), (unsigned long)bucketLimitMicros(i - 1), (unsigned long)_buckets[i]);
+        }
+        else {
+            out.appendf(PSTR("    <=%7lu us: %lu\n"), (unsigned long)bucketLimitMicros(i), (unsigned long)_buckets[i]);
+        }
+    }
+}
+
+void PerfProbe::reportAll(BufferedPrint& out){
+    for (PerfProbe* probe = _first; probe; probe = probe->_next){
+        probe->report(out);
+    }
+}
+
+PerfProbe* PerfProbe::at(int index){
+    PerfProbe* probe = _first;
+    while (probe && index-- > 0) probe = probe->_next;
+    return probe;
+}
+
+HeapMonitor::HeapMonitor(){
+    _freeLowWater = 0xFFFFFFFF;
+    _minMaxFreeBlock = 0xFFFFFFFF;
+    _maxFragmentation = 0;
+}
+
+void HeapMonitor::sample(){
+    uint32_t free = ESP.getFreeHeap();
+    if (free < _freeLowWater) _freeLowWater = free;
+}
+
+void HeapMonitor::sampleFragmentation(){
+    sample();
+    uint32_t maxBlock = ESP.getMaxFreeBlockSize();
+    if (maxBlock < _minMaxFreeBlock) _minMaxFreeBlock = maxBlock;
+    uint8_t fragmentation = ESP.getHeapFragmentation();
+    if (fragmentation > _maxFragmentation) _maxFragmentation = fragmentation;
+}
+
+uint32_t HeapMonitor::freeLowWater(){
+    return _freeLowWater;
+}
+
+uint32_t HeapMonitor::minMaxFreeBlock(){
+    return _minMaxFreeBlock;
+}
+
+uint8_t HeapMonitor::maxFragmentation(){
+    return _maxFragmentation;
+}
+
+void HeapMonitor::report(BufferedPrint& out){
+    out.appendf(PSTR("heap free=%lu low=%lu maxblock=%lu minblock=%lu frag=%u%% maxfrag=%u%%\n"),
+        (unsigned long)ESP.getFreeHeap(),
+        (unsigned long)_freeLowWater,
+        (unsigned long)ESP.getMaxFreeBlockSize(),
+        (unsigned long)_minMaxFreeBlock,
+        ESP.getHeapFragmentation(),
+        _maxFragmentation);
+}
@@ -0,0 +1,78 @@
+#ifndef Perf_H
+#define Perf_H
+
+#include "Arduino.h"
+#include "BufferedPrint.h"
+
+// Lightweight timing probes. A PerfTimer on the stack times its scope with
+// the CPU cycle counter and records the result into a PerfProbe, which keeps
+// count/min/max/total and a log2 histogram of the times in microseconds.
+// Recording is a handful of integer ops, cheap enough to leave on.
+class PerfProbe {
+    public:
+        // Bucket i counts times over 2^(i-1) up to and including 2^i us, so
+        // its limit is an inclusive upper bound like a Prometheus "le". The
+        // first takes 0 and 1 us, the last everything over 2^18 us (about a
+        // quarter second).
+        static const int BUCKETS = 20;
+
+        PerfProbe(const char* name);
+        void record(uint32_t cycles);
+        void reset();
+
+        const char* name();
+        uint32_t count();
+        uint32_t minMicros();
+        uint32_t maxMicros();
+        uint32_t averageMicros();
+        uint64_t totalMicros();
+        uint32_t bucket(int index);
+        static uint32_t bucketLimitMicros(int index);
+
+        void report(BufferedPrint& out);
+        static void reportAll(BufferedPrint& out);
+        // The probes in the order reportAll() goes through them, NULL past the last
+        static PerfProbe* at(int index);
+
+    private:
+        const char* _name;
+        uint32_t _count;
+        uint32_t _minMicros;
+        uint32_t _maxMicros;
+        uint64_t _totalMicros;
+        uint32_t _buckets[BUCKETS];
+
+        // All probes, so they can be reported together
+        PerfProbe* _next;
+        static PerfProbe* _first;
+};
+
+class PerfTimer {
+    public:
+        PerfTimer(PerfProbe& probe) : _probe(probe), _startCycles(ESP.getCycleCount()) {}
+        ~PerfTimer(){ _probe.record(ESP.getCycleCount() - _startCycles); }
+
+    private:
+        PerfProbe& _probe;
+        uint32_t _startCycles;
+};
+
+// Heap low water mark and fragmentation. sample() is cheap (free heap only),
+// sampleFragmentation() walks the heap so it should be called sparingly.
+class HeapMonitor {
+    public:
+        HeapMonitor();
+        void sample();
+        void sampleFragmentation();
+        uint32_t freeLowWater();
+        uint32_t minMaxFreeBlock();
+        uint8_t maxFragmentation();
+        void report(BufferedPrint& out);
+
+    private:
+        uint32_t _freeLowWater;
+        uint32_t _minMaxFreeBlock;
+        uint8_t _maxFragmentation;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef RingBuffer_H
+#define RingBuffer_H
+
+#include <stdint.h>
+
+// Fixed size history of integer samples (e.g. temps in hundredths of a
+// degree). Nothing is allocated, the capacity is set at compile time and
+// the oldest sample is overwritten once it's full.
+//
+// push() is O(1). The sum is kept as we go so mean() is O(1) as well, and
+// min/max are kept up to date on push. When the sample that held the min or
+// max falls off the end, the next min()/max() rescans the buffer, which is
+// O(CAPACITY): a steadily falling fridge pays that on every call. Monotonic
+// deques would make it O(1), but at two index arrays a buffer that's over
+// 3 KB across 16 sensors' histories, for numbers only the readings JSON
+// asks for, of the 10 sample buffer. The bench's "ring" scenario times
+// both cases at a few capacities.
+template <typename T, uint16_t CAPACITY>
+class RingBuffer {
+    public:
+        RingBuffer(){
+            clear();
+        }
+
+        void clear(){
+            _head = 0;
+            _count = 0;
+            _sum = 0;
+            _min = 0;
+            _max = 0;
+            _minMaxStale = false;
+        }
+
+        void push(T value){
+            if (_count == CAPACITY){
+                T evicted = _items[_head];
+                _sum -= evicted;
+                if (evicted == _min || evicted == _max){
+                    _minMaxStale = true;
+                }
+            }
+            else {
+                _count++;
+            }
+
+            _items[_head] = value;
+            _sum += value;
+            _head = (_head + 1) % CAPACITY;
+
+            if (_count == 1){
+                _min = value;
+                _max = value;
+                _minMaxStale = false;
+            }
+            else if (!_minMaxStale){
+                if (value < _min) _min = value;
+                if (value > _max) _max = value;
+            }
+        }
+
+        uint16_t count(){
+            return _count;
+        }
+
+        uint16_t capacity(){
+            return CAPACITY;
+        }
+
+        bool isEmpty(){
+            return _count == 0;
+        }
+
+        // Sample by age, 0 is the newest
+        T at(uint16_t age){
+            return _items[(_head + CAPACITY - 1 - age) % CAPACITY];
+        }
+
+        T newest(){
+            return at(0);
+        }
+
+        T min(){
+            refreshMinMax();
+            return _min;
+        }
+
+        T max(){
+            refreshMinMax();
+            return _max;
+        }
+
+        T mean(){
+            if (_count == 0) return 0;
+            return (T)(_sum / _count);
+        }
+
+        // How many of the last "lastM" samples are below the threshold
+        uint16_t countBelow(T threshold, uint16_t lastM){
+            if (lastM > _count) lastM = _count;
+            uint16_t below = 0;
+            for (uint16_t age = 0; age < lastM; age++){
+                if (at(age) < threshold) below++;
+            }
+            return below;
+        }
+
+    private:
+        void refreshMinMax(){
+            if (!_minMaxStale) return;
+            _min = newest();
+            _max = _min;
+            for (uint16_t age = 1; age < _count; age++){
+                T value = at(age);
+                if (value < _min) _min = value;
+                if (value > _max) _max = value;
+            }
+            _minMaxStale = false;
+        }
+
+        T _items[CAPACITY];
+        uint16_t _head;
+        uint16_t _count;
+        int32_t _sum;
+        T _min;
+        T _max;
+        bool _minMaxStale;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "Arduino.h"
+#include "Scheduler.h"
+
+Scheduler::Scheduler(){
+    _taskCount = 0;
+}
+
+// Returns the task's index, or -1 if the table is full
+int Scheduler::add(const char* name, TaskFunction function, unsigned long periodMillis){
+    if (_taskCount == MAX_TASKS) return -1;
+
+    Task& task = _tasks[_taskCount];
+    task.name = name;
+    task.function = function;
+    task.periodMillis = periodMillis;
+    task.nextMillis = millis();
+    task.runs = 0;
+    task.totalMicros = 0;
+    task.maxMicros = 0;
+    task.maxLateMillis = 0;
+    return _taskCount++;
+}
+
+// Run every task that's due, in the order they were added
+void Scheduler::run(){
+    for (int i = 0; i < _taskCount; i++){
+        Task& task = _tasks[i];
+        unsigned long now = millis();
+        unsigned long late = now - task.nextMillis;
+        if ((long)late < 0) continue;
+
+        unsigned long startMicros = micros();
+        task.function();
+        unsigned long runMicros = micros() - startMicros;
+
+        task.runs++;
+        task.totalMicros += runMicros;
+        if (runMicros > task.maxMicros) task.maxMicros = runMicros;
+        if (late > task.maxLateMillis) task.maxLateMillis = late;
+
+        // Keep to the original cadence, unless we've fallen a whole period behind
+        if (late >= task.periodMillis){
+            task.nextMillis = now + task.periodMillis;
+        }
+        else {
+            task.nextMillis += task.periodMillis;
+        }
+    }
+}
+
+// How long until the next task is due (0 if one is due now)
+unsigned long Scheduler::millisUntilNextTask(){
+    unsigned long now = millis();
+    unsigned long soonest = 0xFFFFFFFF;
+    for (int i = 0; i < _taskCount; i++){
+        long wait = (long)(_tasks[i].nextMillis - now);
+        if (wait <= 0) return 0;
+        if ((unsigned long)wait < soonest) soonest = wait;
+    }
+    return soonest;
+}
+
+// Same, but leaving out the every pass (period 0) tasks. Those are polls
+// that can wait for the next timed task, e.g. while we sleep.
+unsigned long Scheduler::millisUntilNextTimedTask(){
+    unsigned long now = millis();
+    unsigned long soonest = 0xFFFFFFFF;
+    for (int i = 0; i < _taskCount; i++){
+        if (_tasks[i].periodMillis == 0) continue;
+        long wait = (long)(_tasks[i].nextMillis - now);
+        if (wait <= 0) return 0;
+        if ((unsigned long)wait < soonest) soonest = wait;
+    }
+    return soonest;
+}
+
+// Per task run counts and timings, one line each
+void Scheduler::report(Print& out){
+    out.println("task        runs   avg us   max us  max late ms");
+    for (int i = 0; i < _taskCount; i++){
+        out.printf("%-10s %6lu %8lu %8lu %12lu\n",
+            _tasks[i].name,
+            _tasks[i].runs,
+            taskAverageMicros(i),
+            _tasks[i].maxMicros,
+            _tasks[i].maxLateMillis);
+    }
+}
+
+void Scheduler::resetStats(){
+    for (int i = 0; i < _taskCount; i++){
+        _tasks[i].runs = 0;
+        _tasks[i].totalMicros = 0;
+        _tasks[i].maxMicros = 0;
+        _tasks[i].maxLateMillis = 0;
+    }
+}
+
+int Scheduler::taskCount(){
+    return _taskCount;
+}
+
+const char* Scheduler::taskName(int task){
+    return _tasks[task].name;
+}
+
+unsigned long Scheduler::taskRuns(int task){
+    return _tasks[task].runs;
+}
+
+unsigned long Scheduler::taskMaxMicros(int task){
+    return _tasks[task].maxMicros;
+}
+
+unsigned long Scheduler::taskAverageMicros(int task){
+    if (_tasks[task].runs == 0) return 0;
+    return _tasks[task].totalMicros / _tasks[task].runs;
+}
+
+unsigned long Scheduler::taskMaxLateMillis(int task){
+    return _tasks[task].maxLateMillis;
+}
@@ -0,0 +1,48 @@
+#ifndef Scheduler_H
+#define Scheduler_H
+
+#include "Arduino.h"
+
+// Fixed table cooperative scheduler. Each task runs every periodMillis (0 =
+// every pass through loop()). Deadlines are compared with unsigned
+// subtraction so they keep working when millis() rolls over, and a task that
+// falls more than a period behind is re-anchored rather than run back to back
+// to catch up. Each task's run time and how late it started are recorded.
+class Scheduler {
+    public:
+        typedef void (*TaskFunction)();
+
+        Scheduler();
+        int add(const char* name, TaskFunction function, unsigned long periodMillis);
+        void run();
+        unsigned long millisUntilNextTask();
+        unsigned long millisUntilNextTimedTask();
+        void report(Print& out);
+        void resetStats();
+
+        int taskCount();
+        const char* taskName(int task);
+        unsigned long taskRuns(int task);
+        unsigned long taskMaxMicros(int task);
+        unsigned long taskAverageMicros(int task);
+        unsigned long taskMaxLateMillis(int task);
+
+    private:
+        static const int MAX_TASKS = 12;
+
+        struct Task {
+            const char* name;
+            TaskFunction function;
+            unsigned long periodMillis;
+            unsigned long nextMillis;
+            unsigned long runs;
+            unsigned long totalMicros;
+            unsigned long maxMicros;
+            unsigned long maxLateMillis;
+        };
+
+        Task _tasks[MAX_TASKS];
+        int _taskCount;
+};
+
+#endif
@@ -0,0 +1,515 @@
+#include "Arduino.h"
+#include "SensorTable.h"
+
+// How long to wait before searching again when no device answers, doubling
+// each time up to the max (milli * seconds)
+const unsigned long searchBackoffMillis = 250;
+const unsigned long maxSearchBackoffMillis = 1000 * 60;
+// Tries at reading a scratchpad before we give up on the sensor until next time
+const byte maxReadAttempts = 3;
+// Copy Scratchpad takes up to 10 ms to write the EEPROM, leave the bus alone until then
+const unsigned long copyScratchpadMillis = 10;
+
+// Conversion time for 9, 10, 11 and 12 bits (93.75/187.5/375/750 ms, rounded up)
+static const unsigned long conversionTimes[] = {94, 188, 375, 750};
+
+SensorTable::SensorTable(unsigned long sampleIntervalMillis){
+    _busCount = 0;
+    _sensorCount = 0;
+    _settings = NULL;
+    _settingsCount = 0;
+    _sampleIntervalMillis = sampleIntervalMillis;
+}
+
+bool SensorTable::addBus(uint8_t pin){
+    if (_busCount == MAX_BUSES) return false;
+
+    Bus& bus = _buses[_busCount++];
+    bus.wire.begin(pin);
+    bus.wire.reset_search();
+    bus.state = SEARCH;
+    bus.stateMillis = 0;
+    bus.found = 0;
+    bus.nextRead = -1;
+    bus.attempts = 0;
+    bus.backoffMillis = searchBackoffMillis;
+    bus.conversionMillis = 0;
+    bus.pollable = false;
+    return true;
+}
+
+// Labels, resolutions and sample intervals to give sensors as they're found.
+// Anything not listed gets "Sensor N" at 12 bits and the default interval.
+void SensorTable::setSettings(const SensorSettings* settings, int count){
+    _settings = settings;
+    _settingsCount = count;
+}
+
+// Change a sensor's resolution, it's written to the sensor the next time its bus is idle
+void SensorTable::setResolution(int index, byte bits){
+    Sensor& sensor = _sensors[index];
+    bits = constrain(bits, 9, 12);
+    // The DS18S20 is fixed at 9 bits (extended to 12 with count remain)
+    if (sensor.type_s || bits == sensor.resolution) return;
+    sensor.resolution = bits;
+    sensor.configured = false;
+}
+
+void SensorTable::setSampleInterval(int index, unsigned long intervalMillis){
+    _sensors[index].sampleIntervalMillis = intervalMillis;
+}
+
+void SensorTable::update(){
+    // Search the buses one at a time so sensors land in the table in bus order
+    for (byte b = 0; b < _busCount; b++){
+        if (_buses[b].state == SEARCH){
+            search(b);
+            return;
+        }
+    }
+
+    for (byte b = 0; b < _busCount; b++){
+        Bus& bus = _buses[b];
+        switch (bus.state){
+            case SEARCH:
+                break;
+
+            case SEARCH_BACKOFF:
+                if (millis() - bus.stateMillis >= bus.backoffMillis){
+                    bus.found = 0;
+                    bus.state = SEARCH;
+                }
+                break;
+
+            case CONFIGURE:
+                configureNext(b);
+                break;
+
+            case COPYING:
+                if (millis() - bus.stateMillis >= copyScratchpadMillis){
+                    bus.state = CONFIGURE;
+                }
+                break;
+
+            case IDLE:
+                // A resolution change goes out before the next conversion
+                if (needsConfig(b)){
+                    bus.state = CONFIGURE;
+                }
+                else if (anyDue(b)){
+                    startConversion(b);
+                }
+                break;
+
+            case CONVERTING:
+                // The sensors hold the bus low until they're done. That only tells us
+                // anything after a single convert command, and doesn't work at all on
+                // parasite power, so otherwise wait out the conversion time.
+                if ((bus.pollable && bus.wire.read_bit()) || millis() - bus.stateMillis >= bus.conversionMillis){
+                    bus.nextRead = nextPending(b, 0);
+                    bus.attempts = 0;
+                    bus.state = READING;
+                }
+                break;
+
+            case READING:
+                readNext(b);
+                break;
+        }
+    }
+}
+
+// Look for one more device on the bus. Once the search runs out, set up the
+// sensors we found, otherwise back off and try again later.
+void SensorTable::search(byte b){
+    Bus& bus = _buses[b];
+    byte addr[8];
+
+    if (!bus.wire.search(addr)) {
+        bus.wire.reset_search();
+        if (bus.found == 0){
+            // A dead or empty bus, don't keep hammering it
+            if (bus.backoffMillis == searchBackoffMillis || bus.backoffMillis >= maxSearchBackoffMillis){
+                Serial.printf("No sensors on bus %d, next search in %lu ms\n", b, bus.backoffMillis);
+            }
+            bus.stateMillis = millis();
+            bus.state = SEARCH_BACKOFF;
+            bus.backoffMillis = min(bus.backoffMillis * 2, maxSearchBackoffMillis);
+        }
+        else {
+            bus.backoffMillis = searchBackoffMillis;
+            bus.state = CONFIGURE;
+        }
+        return;
+    }
+
+    if (OneWire::crc8(addr, 7) != addr[7]) {
+        Serial.println("CRC is not valid!");
+        return;
+    }
+
+    // Only the DS18x20 family, skip anything else sharing the bus
+    if (addr[0] != 0x10 && addr[0] != 0x22 && addr[0] != 0x28) return;
+
+    addSensor(b, addr);
+    bus.found++;
+}
+
+// Add a newly found sensor to the table. Sensors we already know keep their
+// slot (and history) if they turn up again after a re-search.
+void SensorTable::addSensor(byte b, const byte* addr){
+    for (int i = 0; i < _sensorCount; i++){
+        if (memcmp(_sensors[i].addr, addr, 8) == 0){
+            _sensors[i].bus = b;
+            // It may have been swapped or power cycled, check its resolution again
+            _sensors[i].configured = false;
+            return;
+        }
+    }
+
+    if (_sensorCount == MAX_SENSORS){
+        Serial.println("Sensor table full!");
+        return;
+    }
+
+    Sensor& sensor = _sensors[_sensorCount];
+    memcpy(sensor.addr, addr, 8);
+    sensor.bus = b;
+    // The first ROM byte tells us which chip we're talking to
+    sensor.type_s = (addr[0] == 0x10) ? 1 : 0;
+    sensor.resolution = 12;
+    sensor.sampleIntervalMillis = _sampleIntervalMillis;
+    sensor.temp = 0;
+    sensor.sampleMillis = 0;
+    sensor.hasReading = false;
+    sensor.health = SENSOR_UNREAD;
+    sensor.failures = 0;
+    sensor.configured = false;
+    sensor.pending = false;
+    sensor.convertMillis = 0;
+
+    snprintf_P(sensor.label, sizeof(sensor.label), PSTR("Sensor %d"), _sensorCount + 1);
+    for (int i = 0; i < _settingsCount; i++){
+        const SensorSettings& settings = _settings[i];
+        if (settings.label && memcmp(settings.addr, addr, 8) == 0){
+            strncpy(sensor.label, settings.label, sizeof(sensor.label) - 1);
+            sensor.label[sizeof(sensor.label) - 1] = '\0';
+            if (settings.resolution && !sensor.type_s) sensor.resolution = constrain(settings.resolution, 9, 12);
+            if (settings.sampleIntervalMillis) sensor.sampleIntervalMillis = settings.sampleIntervalMillis;
+        }
+    }
+
+    char hex[17];
+    formatAddress(addr, hex);
+    Serial.printf("Found %s (%s) on bus %d, %u bit\n", sensor.label, hex, b, sensor.resolution);
+    _sensorCount++;
+}
+
+// Make sure the next unconfigured sensor on the bus is set to the resolution
+// we want. The config register lives in EEPROM, so it's only written (and
+// copied) when it's actually different.
+void SensorTable::configureNext(byte b){
+    Bus& bus = _buses[b];
+
+    int index = -1;
+    for (int i = nextOnBus(b, 0); i >= 0; i = nextOnBus(b, i + 1)){
+        if (!_sensors[i].configured){
+            index = i;
+            break;
+        }
+    }
+    if (index < 0){
+        bus.stateMillis = millis();
+        bus.state = IDLE;
+        return;
+    }
+
+    Sensor& sensor = _sensors[index];
+    // Don't keep retrying a sensor that won't answer, it'll be picked up again on a re-search
+    sensor.configured = true;
+    if (sensor.type_s) return;
+
+    if (!bus.wire.reset()){
+        lostBus(b);
+        return;
+    }
+    bus.wire.select(sensor.addr);
+    bus.wire.write(0xBE);           // Read Scratchpad
+    byte data[9];
+    for (byte i = 0; i < 9; i++) {
+        data[i] = bus.wire.read();
+    }
+    if (OneWire::crc8(data, 8) != data[8]){
+        Serial.println("Scratchpad CRC is not valid!");
+        return;
+    }
+
+    // Config register is 0 R1 R0 1 1 1 1 1
+    byte config = ((sensor.resolution - 9) << 5) | 0x1F;
+    if (data[4] == config) return;
+
+    // Write Scratchpad takes TH, TL and config, keep the alarm bytes as they were
+    bus.wire.reset();
+    bus.wire.select(sensor.addr);
+    bus.wire.write(0x4E);
+    bus.wire.write(data[2]);
+    bus.wire.write(data[3]);
+    bus.wire.write(config);
+
+    // Copy Scratchpad so it survives a power cycle
+    bus.wire.reset();
+    bus.wire.select(sensor.addr);
+    bus.wire.write(0x48, 0);
+    bus.stateMillis = millis();
+    bus.state = COPYING;
+
+    Serial.printf("%s set to %u bit\n", sensor.label, sensor.resolution);
+}
+
+// Has any sensor on the bus had its resolution changed?
+bool SensorTable::needsConfig(byte b){
+    for (int i = nextOnBus(b, 0); i >= 0; i = nextOnBus(b, i + 1)){
+        if (!_sensors[i].configured) return true;
+    }
+    return false;
+}
+
+// Is any sensor on the bus due for a new conversion?
+bool SensorTable::anyDue(byte b){
+    for (int i = nextOnBus(b, 0); i >= 0; i = nextOnBus(b, i + 1)){
+        Sensor& sensor = _sensors[i];
+        if (sensor.health == SENSOR_UNREAD || millis() - sensor.convertMillis >= sensor.sampleIntervalMillis){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Start the sensors that are due converting. If that's every sensor on the
+// bus one Skip ROM convert does it, otherwise each is started by address.
+void SensorTable::startConversion(byte b){
+    Bus& bus = _buses[b];
+
+    int due = 0;
+    int total = 0;
+    bus.conversionMillis = 0;
+    for (int i = nextOnBus(b, 0); i >= 0; i = nextOnBus(b, i + 1)){
+        Sensor& sensor = _sensors[i];
+        total++;
+        sensor.pending = sensor.health == SENSOR_UNREAD || millis() - sensor.convertMillis >= sensor.sampleIntervalMillis;
+        if (sensor.pending){
+            due++;
+            bus.conversionMillis = max(bus.conversionMillis, conversionMillis(sensor.resolution));
+        }
+    }
+
+    // No presence pulse means the sensors went away, look for them again
+    if (!bus.wire.reset()){
+        lostBus(b);
+        return;
+    }
+    if (due == total){
+        bus.wire.skip();
+        bus.wire.write(0x44, 0);    // start conversion, with parasite power OFF at the end
+    }
+    else {
+        bool first = true;
+        for (int i = nextPending(b, 0); i >= 0; i = nextPending(b, i + 1)){
+            if (!first) bus.wire.reset();
+            first = false;
+            bus.wire.select(_sensors[i].addr);
+            bus.wire.write(0x44, 0);
+        }
+    }
+
+    // Sample intervals are timed from the start of the conversion
+    bus.stateMillis = millis();
+    for (int i = nextPending(b, 0); i >= 0; i = nextPending(b, i + 1)){
+        _sensors[i].convertMillis = bus.stateMillis;
+    }
+    bus.pollable = (due == 1 || due == total);
+    bus.state = CONVERTING;
+}
+
+// Read the scratchpad of the next pending sensor on this bus. A bad read is
+// tried again on the next step, up to maxReadAttempts, before the sensor is
+// marked with whatever went wrong.
+void SensorTable::readNext(byte b){
+    Bus& bus = _buses[b];
+    if (bus.nextRead < 0){
+        bus.state = IDLE;
+        return;
+    }
+
+    Sensor& sensor = _sensors[bus.nextRead];
+    int16_t temp;
+    SensorHealth health = readScratchpad(b, sensor, temp);
+    if (health == SENSOR_BUS_FAULT){
+        lostBus(b);
+        return;
+    }
+    // Reading it again won't help with the power-on value, it needs a new conversion
+    if (health != SENSOR_OK && health != SENSOR_POWER_ON && ++bus.attempts < maxReadAttempts){
+        return;
+    }
+
+    bus.attempts = 0;
+    sensor.pending = false;
+    bus.nextRead = nextPending(b, bus.nextRead + 1);
+
+    if (health == SENSOR_OK){
+        if (sensor.health != SENSOR_OK && sensor.health != SENSOR_UNREAD){
+            Serial.printf("%s recovered after %u failed reads\n", sensor.label, sensor.failures);
+        }
+        sensor.temp = temp;
+        sensor.sampleMillis = millis();
+        sensor.hasReading = true;
+        sensor.failures = 0;
+    }
+    else {
+        if (sensor.health != health){
+            Serial.printf("%s: %s\n", sensor.label, healthName(health));
+        }
+        sensor.failures++;
+    }
+    sensor.health = health;
+}
+
+// One scratchpad read, checked every way we can. Only sets temp if it's OK.
+SensorHealth SensorTable::readScratchpad(byte b, Sensor& sensor, int16_t& temp){
+    Bus& bus = _buses[b];
+    if (!bus.wire.reset()){
+        return SENSOR_BUS_FAULT;
+    }
+    bus.wire.select(sensor.addr);
+    bus.wire.write(0xBE);           // Read Scratchpad
+
+    // we need 9 bytes
+    byte data[9];
+    byte ones = 0xFF;
+    byte zeros = 0x00;
+    for (byte i = 0; i < 9; i++) {
+        data[i] = bus.wire.read();
+        ones &= data[i];
+        zeros |= data[i];
+    }
+
+    // Nobody drove the bus, so the pullup read as all 1s
+    if (ones == 0xFF) return SENSOR_MISSING;
+    // All 0s passes the CRC, but it's the data line shorted to ground
+    if (zeros == 0x00) return SENSOR_BUS_FAULT;
+    if (OneWire::crc8(data, 8) != data[8]) return SENSOR_CRC_ERROR;
+
+    // Convert the data to actual temperature
+    // because the result is a 16 bit signed integer, it should
+    // be stored to an "int16_t" type, which is always 16 bits
+    // even when compiled on a 32 bit processor.
+    int16_t raw = (data[1] << 8) | data[0];
+
+    // 85 C is what the register holds after power up. If the last good reading
+    // wasn't anywhere near that the sensor browned out and never converted.
+    if (raw == (sensor.type_s ? 0x00AA : 0x0550) &&
+        !(sensor.hasReading && abs(sensor.temp - fromCelsius(85)) <= fromCelsius(5) - fromCelsius(0))){
+        return SENSOR_POWER_ON;
+    }
+
+    if (sensor.type_s) {
+        raw = raw << 3; // 9 bit resolution default
+        if (data[7] == 0x10) {
+            // "count remain" gives full 12 bit resolution
+            raw = (raw & 0xFFF0) + 12 - data[6];
+        }
+    } else {
+        byte cfg = (data[4] & 0x60);
+        // at lower res, the low bits are undefined, so let's zero them
+        if (cfg == 0x00) raw = raw & ~7;  // 9 bit resolution, 93.75 ms
+        else if (cfg == 0x20) raw = raw & ~3; // 10 bit res, 187.5 ms
+        else if (cfg == 0x40) raw = raw & ~1; // 11 bit res, 375 ms
+        //// default is 12 bit resolution, 750 ms conversion time
+    }
+    temp = rawToCenti(raw);
+    return SENSOR_OK;
+}
+
+// Nothing answered a reset, forget what's in flight and search the bus again
+void SensorTable::lostBus(byte b){
+    for (int i = nextOnBus(b, 0); i >= 0; i = nextOnBus(b, i + 1)){
+        Sensor& sensor = _sensors[i];
+        sensor.pending = false;
+        if (sensor.health != SENSOR_BUS_FAULT){
+            Serial.printf("%s: %s\n", sensor.label, healthName(SENSOR_BUS_FAULT));
+        }
+        sensor.health = SENSOR_BUS_FAULT;
+        sensor.failures++;
+    }
+    _buses[b].found = 0;
+    _buses[b].state = SEARCH;
+}
+
+// Index of the next sensor on the bus at or after "from", or -1
+int SensorTable::nextOnBus(byte b, int from){
+    for (int i = from; i < _sensorCount; i++){
+        if (_sensors[i].bus == b) return i;
+    }
+    return -1;
+}
+
+// Same, but only sensors in the current conversion
+int SensorTable::nextPending(byte b, int from){
+    for (int i = nextOnBus(b, from); i >= 0; i = nextOnBus(b, i + 1)){
+        if (_sensors[i].pending) return i;
+    }
+    return -1;
+}
+
+int SensorTable::count(){
+    return _sensorCount;
+}
+
+Sensor& SensorTable::sensor(int index){
+    return _sensors[index];
+}
+
+// True once every sensor in the table has been read (or tried) at least once
+bool SensorTable::allChecked(){
+    if (_sensorCount == 0) return false;
+    for (int i = 0; i < _sensorCount; i++){
+        if (_sensors[i].health == SENSOR_UNREAD) return false;
+    }
+    return true;
+}
+
+// How many sensors have a problem right now
+int SensorTable::faultCount(){
+    int faults = 0;
+    for (int i = 0; i < _sensorCount; i++){
+        SensorHealth health = _sensors[i].health;
+        if (health != SENSOR_OK && health != SENSOR_UNREAD) faults++;
+    }
+    return faults;
+}
+
+// ROM address as 16 hex digits, buff needs room for 17 chars
+void SensorTable::formatAddress(const byte* addr, char* buff){
+    for (int i = 0; i < 8; i++){
+        sprintf_P(buff + i * 2, PSTR("%02X"), addr[i]);
+    }
+}
+
+// How long a conversion takes at this resolution
+unsigned long SensorTable::conversionMillis(byte resolution){
+    return conversionTimes[constrain(resolution, 9, 12) - 9];
+}
+
+// Short name for a health state, for Serial, alerts and the web page
+const char* SensorTable::healthName(SensorHealth health){
+    switch (health){
+        case SENSOR_UNREAD: return "unread";
+        case SENSOR_OK: return "ok";
+        case SENSOR_CRC_ERROR: return "crc error";
+        case SENSOR_POWER_ON: return "power-on reset";
+        case SENSOR_MISSING: return "missing";
+        case SENSOR_BUS_FAULT: return "bus fault";
+    }
+    return "?";
+}
@@ -0,0 +1,125 @@
+#ifndef SensorTable_H
+#define SensorTable_H
+
+#include "Arduino.h"
+#include <OneWire.h>
+#include "Temperature.h"
+
+// Most sensors we'll track across all buses, and most buses
+#define MAX_SENSORS 16
+#define MAX_BUSES 4
+
+// How the last read of a sensor went. Anything other than OK means the
+// reading in the table is stale and shouldn't be trusted for alerting.
+enum SensorHealth {
+    SENSOR_UNREAD,          // Found, not read yet
+    SENSOR_OK,
+    SENSOR_CRC_ERROR,       // Scratchpad CRC kept failing (noise, long wires)
+    SENSOR_POWER_ON,        // Read 85 C, the power-on value, so it reset instead of converting
+    SENSOR_MISSING,         // Didn't answer (reads all 1s), unplugged or broken lead
+    SENSOR_BUS_FAULT,       // Nothing on the bus answers, or the data line is stuck low
+};
+
+// One DS18B20 (or DS18S20) and its latest reading
+struct Sensor {
+    byte addr[8];
+    char label[16];
+    byte bus;
+    byte type_s;
+    byte resolution;                    // 9 - 12 bits
+    unsigned long sampleIntervalMillis;
+    int16_t temp;                       // Hundredths of a degree, see Temperature.h
+    unsigned long sampleMillis;
+    bool hasReading;                    // Has had at least one good reading
+    SensorHealth health;
+    uint16_t failures;                  // Failed reads in a row
+    bool configured;                    // Resolution checked against the sensor's config register
+    bool pending;                       // Converting now, read it at the end of this cycle
+    unsigned long convertMillis;        // When its current/last conversion started
+};
+
+// User settings for a sensor, matched on ROM address. Zero for resolution or
+// sampleIntervalMillis keeps the default (12 bits, the table's interval).
+struct SensorSettings {
+    byte addr[8];
+    const char* label;
+    byte resolution;
+    unsigned long sampleIntervalMillis;
+};
+
+// Every sensor on every bus. Each bus is searched once for all of its devices
+// and their ROM addresses go in the table. After that a single Skip ROM
+// convert (0xCC 0x44) starts every sensor on a bus at once, so adding probes
+// doesn't add conversion wait, and then each one's scratchpad is read in turn.
+// update() does one small step per bus per call so it never holds up loop().
+//
+// Each sensor can have its own resolution and sample interval. Lower
+// resolutions convert faster (93.75/187.5/375/750 ms for 9/10/11/12 bits), so
+// a critical probe can be sampled fast at 9 bits while the rest take their
+// time at 12. When only some of a bus's sensors are due they're started
+// individually, and the bus only waits as long as the slowest of those needs.
+//
+// Every scratchpad read is CRC checked and retried a couple of times, and a
+// sensor that still can't be read gets a health state instead of a made up
+// temperature. A bus with nothing on it is searched again less and less often.
+class SensorTable {
+    public:
+        SensorTable(unsigned long sampleIntervalMillis);
+        bool addBus(uint8_t pin);
+        void setSettings(const SensorSettings* settings, int count);
+        void setResolution(int index, byte bits);
+        void setSampleInterval(int index, unsigned long intervalMillis);
+        void update();
+        int count();
+        Sensor& sensor(int index);
+        bool allChecked();
+        int faultCount();
+        static void formatAddress(const byte* addr, char* buff);
+        static const char* healthName(SensorHealth health);
+        static unsigned long conversionMillis(byte resolution);
+
+    private:
+        enum State {
+            SEARCH,             // Looking for devices, one ROM per step
+            SEARCH_BACKOFF,     // Nothing found, wait a bit before searching again
+            CONFIGURE,          // Checking/writing each sensor's resolution, one per step
+            COPYING,            // Waiting for a Copy Scratchpad to finish writing EEPROM
+            IDLE,               // Waiting for a sensor's sample interval to come up
+            CONVERTING,         // 0x44 issued, waiting out the conversion time
+            READING,            // Reading each sensor's scratchpad, one per step
+        };
+
+        struct Bus {
+            OneWire wire;
+            State state;
+            unsigned long stateMillis;
+            byte found;
+            int nextRead;
+            byte attempts;                  // Tries at reading the current sensor
+            unsigned long backoffMillis;    // Grows while searches keep finding nothing
+            unsigned long conversionMillis; // Longest conversion time of the pending sensors
+            bool pollable;                  // Single convert command, so read_bit() tells us when it's done
+        };
+
+        void search(byte bus);
+        void addSensor(byte bus, const byte* addr);
+        void configureNext(byte bus);
+        bool needsConfig(byte bus);
+        bool anyDue(byte bus);
+        void startConversion(byte bus);
+        void readNext(byte bus);
+        SensorHealth readScratchpad(byte bus, Sensor& sensor, int16_t& temp);
+        int nextOnBus(byte bus, int from);
+        int nextPending(byte bus, int from);
+        void lostBus(byte bus);
+
+        Bus _buses[MAX_BUSES];
+        int _busCount;
+        Sensor _sensors[MAX_SENSORS];
+        int _sensorCount;
+        const SensorSettings* _settings;
+        int _settingsCount;
+        unsigned long _sampleIntervalMillis;
+};
+
+#endif
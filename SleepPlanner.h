@@ -0,0 +1,65 @@
+#ifndef SleepPlanner_H
+#define SleepPlanner_H
+
+#include <stdint.h>
+
+// Decides how long loop() can sleep before the next thing it has to do, and
+// keeps count of how much of the time it's been asleep. It's only handed
+// times and never reads the clock, so it can be run against a made up one.
+//
+// The caller works out how long until the next deadline (next scheduled
+// task, alert retry...) and asks plan() how long to sleep: nothing if it's
+// too short to be worth it, and never more than maxSleepMillis so anything
+// we aren't told about (a browser connecting) doesn't wait too long.
+class SleepPlanner {
+    public:
+        // Nothing is due, for untilDeadline values that have no deadline
+        static const uint32_t NO_DEADLINE = 0xFFFFFFFF;
+
+        SleepPlanner(uint32_t minSleepMillis, uint32_t maxSleepMillis){
+            _minSleepMillis = minSleepMillis;
+            _maxSleepMillis = maxSleepMillis;
+            _sleptMillis = 0;
+            _sleeps = 0;
+        }
+
+        // The sooner of two waits, for folding deadlines together
+        static uint32_t sooner(uint32_t a, uint32_t b){
+            return a < b ? a : b;
+        }
+
+        // How long to sleep for, 0 to carry straight on
+        uint32_t plan(uint32_t untilDeadlineMillis, bool busy){
+            if (busy || untilDeadlineMillis < _minSleepMillis) return 0;
+            return sooner(untilDeadlineMillis, _maxSleepMillis);
+        }
+
+        // How long we actually ended up asleep
+        void slept(uint32_t millis){
+            _sleptMillis += millis;
+            _sleeps++;
+        }
+
+        uint32_t sleptMillis(){
+            return _sleptMillis;
+        }
+
+        uint32_t sleeps(){
+            return _sleeps;
+        }
+
+        // Share of uptime spent awake, in tenths of a percent
+        uint16_t awakePermille(uint32_t uptimeMillis){
+            if (uptimeMillis == 0) return 1000;
+            if (_sleptMillis >= uptimeMillis) return 0;
+            return (uint16_t)(1000 - (uint64_t)_sleptMillis * 1000 / uptimeMillis);
+        }
+
+    private:
+        uint32_t _minSleepMillis;
+        uint32_t _maxSleepMillis;
+        uint32_t _sleptMillis;
+        uint32_t _sleeps;
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include "Arduino.h"
+#include "Telemetry.h"
+#include "Temperature.h"
+#include "Network.h"
+#include "FlashLog.h"
+#include <time.h>
+#include <new>
+
+// First resend waits this long, doubling each time after (milli * seconds)
+const unsigned long ackTimeoutMillis = 1000 * 2;
+const unsigned long maxResendMillis = 1000 * 60;
+// How often to retry a collector name that didn't resolve (milli * seconds)
+const unsigned long resolveRetryMillis = 1000 * 60;
+// Most acks to read per update()
+const int ackBudget = 4;
+
+static void put16(uint8_t* p, uint16_t value){
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t value){
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+static uint32_t get32(const uint8_t* p){
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+Telemetry::Telemetry(SensorTable& sensors, uint8_t batchSamples, unsigned long sampleMillis, unsigned long flushMillis)
+    : _sensors(sensors){
+    _batchSamples = constrain(batchSamples, 1, MAX_BATCH);
+    _sampleMillis = sampleMillis;
+    _flushMillis = flushMillis;
+    _host = NULL;
+    _port = 0;
+    _resolved = false;
+    _resolveMillis = 0;
+    _listening = false;
+    _batchCount = 0;
+    _batchSensors = 0;
+    _batchMillis = 0;
+    _lastSampleMillis = 0;
+    _sampled = false;
+    _batch = NULL;
+    _slots = NULL;
+    _seq = 1;
+    _device = 0;
+    _sent = 0;
+    _acked = 0;
+    _resent = 0;
+    _dropped = 0;
+    _bytes = 0;
+    _samples = 0;
+}
+
+// host is an IP address or a name, NULL or "" leaves telemetry off. Can be
+// called again to move to another collector, unacked frames go to the new one.
+void Telemetry::begin(const char* host, uint16_t port){
+    // The buffers are taken once and kept, so switching it off and on again
+    // doesn't fragment the heap
+    if (host && host[0] && !_slots){
+        _batch = new (std::nothrow) uint8_t[MAX_FRAME];
+        _slots = new (std::nothrow) Slot[SLOTS];
+        if (!_batch || !_slots){
+            delete[] _batch;
+            delete[] _slots;
+            _batch = NULL;
+            _slots = NULL;
+            Serial.println("Telemetry: not enough memory, staying off");
+        }
+        else {
+            for (int i = 0; i < SLOTS; i++){
+                _slots[i].length = 0;
+                _slots[i].unacked = false;
+            }
+        }
+    }
+    _host = host;
+    _port = port;
+    _device = ESP.getChipId();
+    _resolved = false;
+    _resolveMillis = 0;
+    if (_listening){
+        _udp.stop();
+        _listening = false;
+    }
+}
+
+void Telemetry::update(){
+    if (!_host || !_host[0] || !_slots) return;
+
+    if (_sensors.allChecked() && (!_sampled || millis() - _lastSampleMillis >= _sampleMillis)){
+        sample();
+    }
+    if (_batchCount > 0 && (_batchCount >= _batchSamples || millis() - _batchMillis >= _flushMillis)){
+        flush();
+    }
+
+    if (WiFi.status() != WL_CONNECTED){
+        // The socket doesn't survive losing the network
+        if (_listening){
+            _udp.stop();
+            _listening = false;
+        }
+        return;
+    }
+    if (!resolve()) return;
+    if (!_listening){
+        _listening = _udp.begin(_port);
+    }
+    readAcks();
+    resend();
+}
+
+// Look the collector up once we're on the network. A name that doesn't
+// resolve is tried again a minute later, hostByName() waits on DNS.
+bool Telemetry::resolve(){
+    if (_resolved) return true;
+    if (_resolveMillis != 0 && millis() - _resolveMillis < resolveRetryMillis) return false;
+    _resolveMillis = millis();
+    _resolved = _collector.fromString(_host) || WiFi.hostByName(_host, _collector);
+    if (!_resolved){
+        Serial.printf("Telemetry: can't resolve %s\n", _host);
+    }
+    return _resolved;
+}
+
+// Add the current cached readings to the frame being filled
+void Telemetry::sample(){
+    _lastSampleMillis = millis();
+    _sampled = true;
+
+    uint8_t count = _sensors.count();
+    time_t now = time(nullptr);
+    uint8_t* p = startSample(count, NetworkManager::validTime(now) ? (uint32_t)now : 0x80000000UL | (millis() / 1000));
+    for (int i = 0; i < count; i++){
+        const Sensor& sensor = _sensors.sensor(i);
+        put16(p, sensor.health == SENSOR_OK ? sensor.temp : 0);
+        p[2] = sensor.health;
+        p += 3;
+    }
+}
+
+// Whether replay() can take samples now: telemetry's on, the collector's
+// reachable and everything sent so far has been acked, so old samples never
+// push live ones out of the replay slots
+bool Telemetry::readyForReplay(){
+    if (!_host || !_host[0] || !_slots || !_resolved || !_listening) return false;
+    if (_batchCount > 0 || WiFi.status() != WL_CONNECTED) return false;
+    for (int i = 0; i < SLOTS; i++){
+        if (_slots[i].unacked) return false;
+    }
+    return true;
+}
+
+// Add a sample taken earlier. time is what time() said then, temps are
+// INT16_MIN for a sensor that couldn't be read. Up to batchSamples of them
+// can be added each time readyForReplay() says so.
+void Telemetry::replay(uint32_t time, const int16_t* temps, uint8_t count){
+    if (!_slots) return;
+    count = min(count, (uint8_t)MAX_SENSORS);
+    uint8_t* p = startSample(count, NetworkManager::validTime(time) ? time : 0x80000000UL | time);
+    for (int i = 0; i < count; i++){
+        put16(p, temps[i] != INT16_MIN ? temps[i] : 0);
+        p[2] = temps[i] != INT16_MIN ? SENSOR_OK : SENSOR_MISSING;
+        p += 3;
+    }
+    if (_batchCount >= _batchSamples) flush();
+}
+
+// Start a sample in the frame being filled, returns where its readings go
+uint8_t* Telemetry::startSample(uint8_t count, uint32_t time){
+    // Every sample in a frame has to have the same sensors, start a new frame if that changed
+    if (_batchCount > 0 && count != _batchSensors) flush();
+    if (_batchCount == 0){
+        _batchSensors = count;
+        _batchMillis = millis();
+    }
+
+    uint8_t* p = _batch + HEADER_BYTES + _batchCount * (4 + count * 3);
+    put32(p, time);
+    _batchCount++;
+    _samples++;
+    return p + 4;
+}
+
+// Close off the frame being filled and send it
+void Telemetry::flush(){
+    Slot* slot = freeSlot();
+    uint8_t* f = slot->frame;
+    int length = HEADER_BYTES + _batchCount * (4 + _batchSensors * 3);
+    memcpy(f + HEADER_BYTES, _batch + HEADER_BYTES, length - HEADER_BYTES);
+    f[0] = 'T';
+    f[1] = 'M';
+    f[2] = VERSION;
+    f[3] = tempInFahrenheit ? 1 : 0;
+    put32(f + 4, _device);
+    put32(f + 8, _seq);
+    f[12] = _batchSensors;
+    f[13] = _batchCount;
+    put16(f + 14, 0);
+    put32(f + length, FlashLog::crc32(0, f, length));
+
+    slot->length = length + 4;
+    slot->seq = _seq++;
+    slot->unacked = true;
+    slot->attempts = 0;
+    _batchCount = 0;
+
+    // Offline it just waits in its slot, resend() sends it once we're back
+    if (WiFi.status() == WL_CONNECTED && _resolved && _listening){
+        send(*slot);
+    }
+}
+
+// An empty (or acked) slot, or the oldest unacked one if they're all waiting
+Telemetry::Slot* Telemetry::freeSlot(){
+    Slot* oldest = &_slots[0];
+    for (int i = 0; i < SLOTS; i++){
+        if (!_slots[i].unacked) return &_slots[i];
+        if (_slots[i].seq < oldest->seq) oldest = &_slots[i];
+    }
+    _dropped++;
+    return oldest;
+}
+
+void Telemetry::send(Slot& slot){
+    if (slot.attempts > 0) _resent++;
+    else _sent++;
+    slot.attempts++;
+    slot.sentMillis = millis();
+    _udp.beginPacket(_collector, _port);
+    _udp.write(slot.frame, slot.length);
+    if (_udp.endPacket()) _bytes += slot.length;
+}
+
+void Telemetry::readAcks(){
+    for (int n = 0; n < ackBudget && _udp.parsePacket() > 0; n++){
+        uint8_t ack[12];
+        if (_udp.read(ack, sizeof(ack)) != sizeof(ack)) continue;
+        if (ack[0] != 'T' || ack[1] != 'A' || ack[2] != VERSION || get32(ack + 4) != _device) continue;
+        uint32_t seq = get32(ack + 8);
+        for (int i = 0; i < SLOTS; i++){
+            if (_slots[i].unacked && _slots[i].seq == seq){
+                _slots[i].unacked = false;
+                _acked++;
+            }
+        }
+    }
+}
+
+// Send unacked frames again, oldest first, one per update() so a backlog
+// after an outage goes out gradually
+void Telemetry::resend(){
+    Slot* due = NULL;
+    for (int i = 0; i < SLOTS; i++){
+        Slot& slot = _slots[i];
+        if (!slot.unacked) continue;
+        // Never sent at all (we were offline) goes straight away
+        if (slot.attempts > 0){
+            unsigned long wait = min(ackTimeoutMillis << min(slot.attempts - 1, 5), maxResendMillis);
+            if (millis() - slot.sentMillis < wait) continue;
+        }
+        if (!due || slot.seq < due->seq) due = &slot;
+    }
+    if (due) send(*due);
+}
+
+uint32_t Telemetry::framesSent(){
+    return _sent;
+}
+
+uint32_t Telemetry::framesAcked(){
+    return _acked;
+}
+
+uint32_t Telemetry::framesResent(){
+    return _resent;
+}
+
+uint32_t Telemetry::framesDropped(){
+    return _dropped;
+}
+
+uint32_t Telemetry::bytesSent(){
+    return _bytes;
+}
+
+uint32_t Telemetry::samples(){
+    return _samples;
+}
@@ -0,0 +1,115 @@
+#ifndef Telemetry_H
+#define Telemetry_H
+
+#include "Arduino.h"
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "SensorTable.h"
+
+// Streams the readings to a collector on the local network as small binary
+// UDP frames, see tools/telemetry_collector.py for the other end.
+//
+// A sample (every sensor's reading and health) is taken every sampleMillis
+// and samples are batched into a frame, which goes out when it has
+// batchSamples in it or flushMillis after its first sample. The collector
+// acks each frame by sequence number. Unacked frames are kept and sent again
+// with a growing backoff, until their slot is needed for a newer frame.
+// Samples kept from earlier (e.g. while offline) can be handed back in with
+// replay(), they go out in frames of their own with their original times.
+//
+// The frame buffers (about 2 KB) are only allocated the first time begin()
+// is given a host, so with telemetry off they cost nothing.
+//
+// Frame, all little endian:
+//   0  'T' 'M'      magic
+//   2  uint8        version (1)
+//   3  uint8        flags, bit 0 set if temps are Fahrenheit
+//   4  uint32       device (chip id)
+//   8  uint32       sequence number, from 1 at boot
+//   12 uint8        sensors per sample
+//   13 uint8        samples in the frame
+//   14 uint16       reserved
+//   16 samples:     uint32 time (unix seconds, or uptime seconds with the top
+//                   bit set if the clock isn't set yet), then per sensor an
+//                   int16 temp in hundredths of a degree and a uint8 health
+//                   (SensorHealth)
+//   end uint32      CRC-32 of everything before it
+// Ack: 'T' 'A', uint8 version, uint8 0, uint32 device, uint32 sequence.
+class Telemetry {
+    public:
+        // Most samples a frame can carry
+        static const uint8_t MAX_BATCH = 8;
+
+        Telemetry(SensorTable& sensors, uint8_t batchSamples, unsigned long sampleMillis, unsigned long flushMillis);
+        void begin(const char* host, uint16_t port);
+        void update();
+        bool readyForReplay();
+        void replay(uint32_t time, const int16_t* temps, uint8_t count);
+
+        uint32_t framesSent();
+        uint32_t framesAcked();
+        uint32_t framesResent();
+        uint32_t framesDropped();
+        uint32_t bytesSent();
+        uint32_t samples();
+
+    private:
+        static const uint8_t VERSION = 1;
+        static const int HEADER_BYTES = 16;
+        static const int MAX_FRAME = HEADER_BYTES + MAX_BATCH * (4 + MAX_SENSORS * 3) + 4;
+        // Frames kept for replay until they're acked
+        static const int SLOTS = 4;
+
+        struct Slot {
+            uint8_t frame[MAX_FRAME];
+            uint16_t length;
+            uint32_t seq;
+            bool unacked;
+            uint8_t attempts;
+            unsigned long sentMillis;
+        };
+
+        bool resolve();
+        void sample();
+        uint8_t* startSample(uint8_t count, uint32_t time);
+        void flush();
+        void send(Slot& slot);
+        void readAcks();
+        void resend();
+        Slot* freeSlot();
+
+        SensorTable& _sensors;
+        uint8_t _batchSamples;
+        unsigned long _sampleMillis;
+        unsigned long _flushMillis;
+
+        const char* _host;
+        uint16_t _port;
+        IPAddress _collector;
+        bool _resolved;
+        unsigned long _resolveMillis;
+        WiFiUDP _udp;
+        bool _listening;
+
+        // The frame being filled, and the frames kept for replay. NULL until
+        // there's a host, see begin()
+        uint8_t* _batch;
+        uint8_t _batchCount;
+        uint8_t _batchSensors;
+        unsigned long _batchMillis;
+        unsigned long _lastSampleMillis;
+        bool _sampled;
+
+        Slot* _slots;
+        uint32_t _seq;
+        uint32_t _device;
+
+        uint32_t _sent;
+        uint32_t _acked;
+        uint32_t _resent;
+        uint32_t _dropped;
+        uint32_t _bytes;
+        uint32_t _samples;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "Arduino.h"
+#include "Temperature.h"
+
+// Print hundredths of a degree with 0, 1 or 2 decimals (rounded), e.g.
+// 3350 -> "33.5" with 1 decimal. buff needs TEMP_TEXT_SIZE chars. Returns
+// the length. No printf and no heap, it's called for every reading we show.
+int formatTemperature(char* buff, int16_t centi, byte decimals){
+    if (decimals > 2) decimals = 2;
+    int32_t scale = (decimals == 2) ? 1 : (decimals == 1) ? 10 : 100;
+    int32_t value = divRound(centi, scale);
+
+    char* p = buff;
+    if (value < 0){
+        *p++ = '-';
+        value = -value;
+    }
+
+    // Digits come out backwards, always at least one before the point
+    char digits[8];
+    int count = 0;
+    int minDigits = decimals ? decimals + 2 : 1;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+        if (count == decimals) digits[count++] = '.';
+    } while (value > 0 || count < minDigits);
+
+    while (count > 0){
+        *p++ = digits[--count];
+    }
+    *p = '\0';
+    return p - buff;
+}
+
+// The other way, "33.5" -> 3350. Up to 2 decimals, anything past that is
+// rounded off. False if it isn't a number or won't fit.
+bool parseTemperature(const char* text, int16_t& centi){
+    bool negative = (*text == '-');
+    if (negative) text++;
+    if (!isdigit(*text) && !(*text == '.' && isdigit(text[1]))) return false;
+
+    int32_t value = 0;
+    while (isdigit(*text)){
+        value = value * 10 + (*text++ - '0');
+        if (value > 100000) return false;
+    }
+    int decimals = 0;
+    bool roundUp = false;
+    if (*text == '.'){
+        text++;
+        while (isdigit(*text)){
+            if (decimals < 2){
+                value = value * 10 + (*text - '0');
+                decimals++;
+            }
+            else if (decimals == 2){
+                roundUp = (*text >= '5');
+                decimals++;
+            }
+            text++;
+        }
+    }
+    if (*text != '\0') return false;
+    for (; decimals < 2; decimals++) value *= 10;
+    if (roundUp) value++;
+    if (negative) value = -value;
+    if (value < INT16_MIN || value > INT16_MAX) return false;
+    centi = value;
+    return true;
+}
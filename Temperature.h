@@ -0,0 +1,62 @@
+#ifndef Temperature_H
+#define Temperature_H
+
+#include "Arduino.h"
+
+// Temperatures are carried everywhere as hundredths of a degree in an
+// int16_t, in the unit picked below. The ESP8266 has no FPU so float math is
+// all done in software; this way decoding a reading, comparing it against the
+// threshold, keeping history and printing it are all plain integer work.
+// The unit conversion is folded into the constants at compile time.
+// -55 to 125 C is -6700 to 25700 F hundredths, so int16_t holds either unit.
+
+// Change to false to run everything in Celsius
+constexpr bool tempInFahrenheit = true;
+constexpr char tempUnit = tempInFahrenheit ? 'F' : 'C';
+
+// Room for "-327.68" and the terminator
+#define TEMP_TEXT_SIZE 8
+
+// Integer divide, rounding half away from zero
+constexpr int32_t divRound(int32_t n, int32_t d){
+    return (n >= 0 ? n + d / 2 : n - d / 2) / d;
+}
+
+// Keeps a result in int16_t, short of INT16_MIN which means "no reading"
+constexpr int32_t clampCenti(int32_t centi){
+    return centi < INT16_MIN + 1 ? INT16_MIN + 1 : centi > INT16_MAX ? INT16_MAX : centi;
+}
+
+// DS18x20 raw reading (sixteenths of a degree C) to hundredths of a degree.
+// C is raw * 100 / 16, F is raw * 100 * 9 / (16 * 5) + 3200. Within half a
+// hundredth of the float conversion for every raw value; ones far outside
+// the sensor's range (a garbled read that passed the CRC) are clamped
+// rather than wrapped.
+constexpr int16_t rawToCenti(int16_t raw){
+    return clampCenti(tempInFahrenheit ? divRound((int32_t)raw * 45, 4) + 3200 : divRound((int32_t)raw * 25, 4));
+}
+
+// Settings are written in whichever unit is natural and converted here. Only
+// meant for constants, declare the result constexpr so the compiler does the
+// float math, e.g. constexpr int16_t threshold = fromFahrenheit(35.00);
+constexpr int16_t roundCenti(double centi){
+    return (int16_t)(centi >= 0 ? centi + 0.5 : centi - 0.5);
+}
+
+constexpr int16_t fromFahrenheit(double f){
+    return tempInFahrenheit ? roundCenti(f * 100) : roundCenti((f - 32) * 500 / 9);
+}
+
+constexpr int16_t fromCelsius(double c){
+    return tempInFahrenheit ? roundCenti(c * 180 + 3200) : roundCenti(c * 100);
+}
+
+// For differences rather than temps (hysteresis bands, rates), no 32 offset
+constexpr int16_t fahrenheitDelta(double f){
+    return tempInFahrenheit ? roundCenti(f * 100) : roundCenti(f * 500 / 9);
+}
+
+int formatTemperature(char* buff, int16_t centi, byte decimals);
+bool parseTemperature(const char* text, int16_t& centi);
+
+#endif
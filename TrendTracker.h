@@ -0,0 +1,299 @@
+#ifndef TrendTracker_H
+#define TrendTracker_H
+
+#include <stdint.h>
+
+// Running statistics for one sensor's readings (hundredths of a degree, see
+// Temperature.h), for alerting on where a temp is heading rather than only
+// where it is. It's only handed readings and their times and never reads the
+// clock, so it can be run over a recorded trace as well.
+//
+// Each reading goes through three stages, all O(1) with nothing allocated:
+//   - A median of the last MEDIAN_OF readings, so a single glitched read
+//     never gets any further (two in a row with MEDIAN_OF 3 still would).
+//   - An exponentially weighted mean and variance of what comes out of the
+//     median, weighted to roughly the last 2^EWMA_SHIFT readings.
+//   - A least squares line through the last WINDOW filtered readings taken
+//     stepMillis apart. The sums it needs are kept as points come and go, so
+//     a new point doesn't mean a pass over the window.
+//
+// The fit gives the slope and, from that, how long until the temp crosses a
+// limit. A slope that isn't clearly bigger than the scatter around the line
+// (a t statistic under 3) predicts nothing, so a flat but noisy reading
+// sitting just inside a limit doesn't look like it's about to cross it.
+//
+// It's integer math throughout since the ESP8266 has no FPU. The sums are
+// sized for WINDOW up to 32.
+template <uint16_t WINDOW, uint8_t MEDIAN_OF>
+class TrendTracker {
+    static_assert(WINDOW >= 3 && WINDOW <= 32, "fit sums are sized for 3 to 32 points");
+    static_assert(MEDIAN_OF % 2 == 1 && MEDIAN_OF <= 9, "median needs an odd count of 9 or less");
+
+    public:
+        // What millisUntil() gives when the trend isn't heading for the limit
+        static const uint32_t NO_PREDICTION = 0xFFFFFFFF;
+        // Mean and variance follow about the last 2^EWMA_SHIFT readings
+        static const uint8_t EWMA_SHIFT = 4;
+        // Fewest points the fit needs before it predicts anything
+        static const uint16_t MIN_FIT = WINDOW / 2 > 3 ? WINDOW / 2 : 3;
+        // Readings further apart than this many steps start the trend over
+        static const uint8_t GAP_STEPS = 3;
+        // Spikes are readings the median held back that were this many
+        // standard deviations from the mean
+        static const uint8_t SPIKE_SIGMAS = 4;
+
+        TrendTracker(){
+            _stepMillis = 1000;
+            _minSpike = 0;
+            _spikes = 0;
+            clear();
+        }
+
+        // How far apart the fit's points are, and the smallest jump that
+        // counts as a spike (so a flat trace with no variance doesn't call
+        // every rounding step one)
+        void configure(uint32_t stepMillis, int16_t minSpike){
+            _stepMillis = stepMillis > 0 ? stepMillis : 1;
+            _minSpike = minSpike;
+            clear();
+        }
+
+        // Forget the readings (the spike count is kept)
+        void clear(){
+            _recentCount = 0;
+            _recentHead = 0;
+            _readings = 0;
+            _lastMillis = 0;
+            _filtered = 0;
+            _mean = 0;
+            _variance = 0;
+            _count = 0;
+            _head = 0;
+            _pointMillis = 0;
+            _sy = 0;
+            _sxy = 0;
+            _syy = 0;
+        }
+
+        // A new reading, taken at atMillis. The same reading handed in again
+        // (same time) is ignored, so it's fine to call this every pass.
+        // Returns the filtered reading, which is what alerts should look at.
+        int16_t add(int16_t value, uint32_t atMillis){
+            if (_readings > 0){
+                if (atMillis == _lastMillis) return _filtered;
+                if (atMillis - _lastMillis > GAP_STEPS * _stepMillis) clear();
+            }
+            _lastMillis = atMillis;
+
+            _recent[_recentHead] = value;
+            _recentHead = (_recentHead + 1) % MEDIAN_OF;
+            if (_recentCount < MEDIAN_OF) _recentCount++;
+            _filtered = median();
+
+            // Mean in 256ths of a hundredth so small steps don't round away
+            int32_t scaled = (int32_t)_filtered * 256;
+            if (_readings == 0){
+                _mean = scaled;
+            }
+            else {
+                if (value != _filtered){
+                    int32_t away = (int32_t)value * 256 - _mean;
+                    int64_t awaySquared = (int64_t)away * away >> 16;
+                    if (awaySquared > (int64_t)SPIKE_SIGMAS * SPIKE_SIGMAS * _variance &&
+                        awaySquared > (int64_t)_minSpike * _minSpike){
+                        _spikes++;
+                    }
+                }
+                // West's incremental form: var = (1 - a) * (var + diff * a * diff)
+                int32_t diff = scaled - _mean;
+                int32_t step = diff / (1 << EWMA_SHIFT);
+                _mean += step;
+                int64_t variance = (int64_t)_variance + ((int64_t)diff * step >> 16);
+                _variance = (uint32_t)(variance - (variance >> EWMA_SHIFT));
+            }
+            if (_readings < 0xFFFFFFFF) _readings++;
+
+            // One fit point per step. Stepping the due time along rather than
+            // restarting it keeps the average spacing at exactly stepMillis.
+            if (_count == 0 || atMillis - _pointMillis >= 2 * _stepMillis){
+                _pointMillis = atMillis;
+                push(_filtered);
+            }
+            else if (atMillis - _pointMillis >= _stepMillis){
+                _pointMillis += _stepMillis;
+                push(_filtered);
+            }
+            return _filtered;
+        }
+
+        bool hasReading(){
+            return _readings > 0;
+        }
+
+        int16_t filtered(){
+            return _filtered;
+        }
+
+        int16_t mean(){
+            return (int16_t)((_mean + (_mean >= 0 ? 128 : -128)) / 256);
+        }
+
+        // In hundredths of a degree squared
+        uint32_t variance(){
+            return _variance;
+        }
+
+        uint16_t stddev(){
+            return isqrt(_variance);
+        }
+
+        // Readings the median filter held back as glitches, since boot
+        uint32_t spikes(){
+            return _spikes;
+        }
+
+        // Points in the fit so far, up to WINDOW
+        uint16_t points(){
+            return _count;
+        }
+
+        // Slope of the fit in hundredths of a degree an hour, 0 until there
+        // are MIN_FIT points
+        int32_t slopePerHour(){
+            if (_count < MIN_FIT) return 0;
+            int64_t num, den;
+            sums(num, den);
+            return (int32_t)(num * 3600000 / (den * (int64_t)_stepMillis));
+        }
+
+        // Where the fit puts the temp now (at the newest point)
+        int16_t level(){
+            if (_count < MIN_FIT) return _filtered;
+            int64_t num, den;
+            sums(num, den);
+            return fittedLevel(num, den);
+        }
+
+        // How long until the fit crosses limit (going below it, or above), 0 if
+        // it's already past it. NO_PREDICTION if it's flat, heading the other
+        // way, or the slope is lost in the noise.
+        uint32_t millisUntil(int16_t limit, bool below){
+            if (_count < MIN_FIT) return NO_PREDICTION;
+            int64_t num, den;
+            sums(num, den);
+
+            int32_t level = fittedLevel(num, den);
+            int32_t toGo = below ? level - limit : (int32_t)limit - level;
+            if (toGo <= 0) return 0;
+            int64_t toward = below ? -num : num;
+            if (toward <= 0 || !significant(num, den)) return NO_PREDICTION;
+
+            int64_t eta = (int64_t)toGo * den * _stepMillis / toward;
+            return eta >= NO_PREDICTION ? NO_PREDICTION - 1 : (uint32_t)eta;
+        }
+
+    private:
+        // Add a point to the fit. Points are x = 0 (oldest) to n - 1 (newest),
+        // so dropping the oldest shifts every x down by one:
+        // sum(x*y) loses sum(y) of what's left and the new point comes in at n - 1.
+        void push(int16_t y){
+            if (_count < WINDOW){
+                _sxy += (int32_t)_count * y;
+                _count++;
+            }
+            else {
+                int16_t oldest = _points[_head];
+                _sxy += (int32_t)(WINDOW - 1) * y - (_sy - oldest);
+                _sy -= oldest;
+                _syy -= (int32_t)oldest * oldest;
+            }
+            _points[_head] = y;
+            _head = (_head + 1) % WINDOW;
+            _sy += y;
+            _syy += (int32_t)y * y;
+        }
+
+        // Numerator and denominator of the slope per point, both times n:
+        // n*sum(xy) - sum(x)*sum(y) over n*sum(xx) - sum(x)^2
+        void sums(int64_t& num, int64_t& den){
+            int64_t n = _count;
+            int64_t sx = n * (n - 1) / 2;
+            int64_t sxx = (n - 1) * n * (2 * n - 1) / 6;
+            num = n * _sxy - sx * _sy;
+            den = n * sxx - sx * sx;
+        }
+
+        // mean(y) + slope * (n - 1) / 2, the fit at the newest x
+        int16_t fittedLevel(int64_t num, int64_t den){
+            int64_t n = _count;
+            return (int16_t)((2 * _sy * den + num * (n - 1) * n) / (2 * n * den));
+        }
+
+        // Slope's t statistic is at least 3, i.e. slope^2 >= 9 * its variance.
+        // Multiplied out in terms of the n-scaled sums that's
+        // num^2 * (n - 2 + 9) >= 9 * (n*sum(yy) - sum(y)^2) * den
+        bool significant(int64_t num, int64_t den){
+            int64_t n = _count;
+            int64_t spread = n * _syy - (int64_t)_sy * _sy;
+            return num * num * (n + 7) >= 9 * spread * den;
+        }
+
+        int16_t median(){
+            int16_t sorted[MEDIAN_OF];
+            for (uint8_t i = 0; i < _recentCount; i++){
+                int16_t value = _recent[i];
+                uint8_t j = i;
+                while (j > 0 && sorted[j - 1] > value){
+                    sorted[j] = sorted[j - 1];
+                    j--;
+                }
+                sorted[j] = value;
+            }
+            // With an even count so far, the lower middle one
+            return sorted[(_recentCount - 1) / 2];
+        }
+
+        static uint16_t isqrt(uint32_t n){
+            uint32_t root = 0;
+            uint32_t bit = 1UL << 30;
+            while (bit > n) bit >>= 2;
+            while (bit){
+                if (n >= root + bit){
+                    n -= root + bit;
+                    root = (root >> 1) + bit;
+                }
+                else {
+                    root >>= 1;
+                }
+                bit >>= 2;
+            }
+            return (uint16_t)root;
+        }
+
+        uint32_t _stepMillis;
+        int16_t _minSpike;
+        uint32_t _spikes;
+
+        // Median filter
+        int16_t _recent[MEDIAN_OF];
+        uint8_t _recentCount;
+        uint8_t _recentHead;
+        uint32_t _readings;
+        uint32_t _lastMillis;
+        int16_t _filtered;
+
+        // Weighted mean (256ths of a hundredth) and variance (hundredths squared)
+        int32_t _mean;
+        uint32_t _variance;
+
+        // Fit window and its running sums
+        int16_t _points[WINDOW];
+        uint16_t _count;
+        uint16_t _head;
+        uint32_t _pointMillis;
+        int32_t _sy;
+        int32_t _sxy;
+        int64_t _syy;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef WebPage_H
+#define WebPage_H
+
+#include "Arduino.h"
+
+// The status page, kept in flash. It's a static shell that the browser can
+// cache (we answer revalidations with a 304) and it pulls the live values
+// from /api/v1/readings itself, so a refresh is one small JSON request.
+
+// Headers for the page. Arg: ETag
+static const char PAGE_SHELL_HEADERS[] PROGMEM =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Type: text/html\r\n"
+  "Cache-Control: no-cache\r\n"
+  "ETag: %s\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+static const char PAGE_SHELL[] PROGMEM = R"=====(<!DOCTYPE html><html>
+<head>
+  <meta name="viewport" content="width=device-width, initial-scale=1">
+  <link rel="icon" href="data:,">
+  <style>
+    html {font-family: Helvetica;}
+    table {border-collapse:collapse;width: 50%}
+    table, td, th {border:1px solid gray;padding:5px;text-align:center;}
+    th {background-color: #666361; color: white;}
+    .temp {font-size: x-large;}
+    .alert {color: red; font-weight: bold;}
+  </style>
+</head>
+<body>
+<br>
+<table align="center" style="width: 100%; max-width: 500px;">
+  <tr>
+    <th>Remote Timestamp</th>
+  </tr>
+  <tr>
+    <td id="timestamp">-</td>
+  </tr>
+</table>
+<br>
+<table align="center" style="width: 100%; max-width: 500px;">
+  <thead>
+    <tr>
+      <th>Sensor</th>
+      <th>Temp</th>
+      <th>Min / Mean / Max</th>
+    </tr>
+  </thead>
+  <tbody id="sensors"></tbody>
+</table>
+<p align="center" id="status" class="alert"></p>
+<script>
+  function set(id, html, className) {
+    var e = document.getElementById(id);
+    e.innerHTML = html;
+    if (className !== undefined) e.className = className;
+  }
+  function update(d) {
+    set("timestamp", d.timestamp);
+    var rows = document.getElementById("sensors");
+    while (rows.rows.length > d.sensors.length) rows.deleteRow(-1);
+    d.sensors.forEach(function(s, i) {
+      var row = rows.rows[i] || rows.insertRow(-1);
+      while (row.cells.length < 3) row.insertCell(-1);
+      row.title = s.id;
+      row.cells[0].innerHTML = s.name;
+      var ok = s.health == "ok";
+      var low = ok && s.temp < d.threshold;
+      row.cells[1].innerHTML = ok ? s.temp.toFixed(2) + "&deg" + d.unit + (low ? "!" : "") : s.health;
+      row.cells[1].className = low || (!ok && s.health != "unread") ? "temp alert" : "temp";
+      var h = s.history;
+      row.cells[2].innerHTML = h.count ? h.min.toFixed(1) + " / " + h.mean.toFixed(1) + " / " + h.max.toFixed(1) +
+        "&deg" + d.unit + " (last " + h.count + " min)" : "No history yet";
+    });
+    set("status", d.alert.alerting ? "Temperature alert!" : (d.alert.outOfSpec ? "Out of spec" :
+      (d.alert.faults ? "Sensor fault" : "")));
+  }
+  function refresh() {
+    fetch("/api/v1/readings")
+      .then(function(r) { return r.json(); })
+      .then(update)
+      .catch(function() { set("status", "Lost contact with the monitor"); })
+      .then(function() { setTimeout(refresh, 15000); });
+  }
+  refresh();
+</script>
+</body>
+</html>
+)=====";
+
+// Headers for the readings JSON. It's streamed out, so the body ends when
+// the connection closes.
+static const char API_HEADERS[] PROGMEM =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Type: application/json\r\n"
+  "Cache-Control: no-store\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+// A /config change that was refused, followed by {"error":...}
+static const char CONFIG_REJECTED_HEADERS[] PROGMEM =
+  "HTTP/1.1 400 Bad Request\r\n"
+  "Content-Type: application/json\r\n"
+  "Cache-Control: no-store\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+// A /config change without the right token, followed by {"error":...}
+static const char CONFIG_FORBIDDEN_HEADERS[] PROGMEM =
+  "HTTP/1.1 403 Forbidden\r\n"
+  "Content-Type: application/json\r\n"
+  "Cache-Control: no-store\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+// A /config change too soon after a wrong token, followed by {"error":...}
+static const char CONFIG_RETRY_HEADERS[] PROGMEM =
+  "HTTP/1.1 429 Too Many Requests\r\n"
+  "Content-Type: application/json\r\n"
+  "Cache-Control: no-store\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+// Headers for /metrics, Prometheus text exposition format
+static const char METRICS_HEADERS[] PROGMEM =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+  "Cache-Control: no-store\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+// Headers for the plain text /debug pages
+static const char DEBUG_HEADERS[] PROGMEM =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Type: text/plain\r\n"
+  "Cache-Control: no-store\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+// Canned responses
+static const char PAGE_NOT_MODIFIED[] PROGMEM = "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nConnection: close\r\n\r\n";
+static const char PAGE_NOT_FOUND[] PROGMEM = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+
+#endif
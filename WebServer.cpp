@@ -0,0 +1,160 @@
+#include "Arduino.h"
+#include "WebServer.h"
+
+// Give up on a client that hasn't finished sending its request (milli * seconds)
+const unsigned long clientTimeoutMillis = 1000 * 2;
+// Or that's taken nothing of its response for this long (milli * seconds)
+const unsigned long sendTimeoutMillis = 1000 * 10;
+
+// Canned error responses
+static const char RESPONSE_BAD_REQUEST[] PROGMEM = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+static const char RESPONSE_TOO_LARGE[] PROGMEM = "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n";
+static const char RESPONSE_BUSY[] PROGMEM = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+
+WebServer::WebServer(uint16_t port, Handler handler) : _server(port){
+    _handler = handler;
+    for (int i = 0; i < MAX_CLIENTS; i++){
+        _connections[i].active = false;
+    }
+}
+
+void WebServer::begin(){
+    _server.begin();
+}
+
+void WebServer::update(){
+    accept();
+    for (int i = 0; i < MAX_CLIENTS; i++){
+        if (_connections[i].active){
+            service(_connections[i]);
+        }
+    }
+}
+
+// Take any new connections into free slots, turn them away if we're full
+void WebServer::accept(){
+    WiFiClient client = _server.available();
+    while (client){
+        Connection* slot = NULL;
+        for (int i = 0; i < MAX_CLIENTS; i++){
+            if (!_connections[i].active){
+                slot = &_connections[i];
+                break;
+            }
+        }
+
+        if (slot){
+            Serial.println("New Client.");
+            slot->client = client;
+            slot->request.reset();
+            slot->startMillis = millis();
+            slot->active = true;
+            slot->responding = false;
+        }
+        else {
+            Serial.println("Too many clients, turned one away.");
+            client.write_P(RESPONSE_BUSY, strlen_P(RESPONSE_BUSY));
+            client.stop();
+        }
+        client = _server.available();
+    }
+}
+
+// Feed whatever this client has sent so far to its parser, and start on
+// the response once the request is complete.
+void WebServer::service(Connection& connection){
+    if (connection.responding){
+        send(connection);
+        return;
+    }
+    WiFiClient& client = connection.client;
+
+    int budget = READ_BUDGET;
+    while (budget-- > 0 && client.available() && connection.request.result() == HttpRequest::INCOMPLETE){
+        connection.request.feed(client.read());
+    }
+
+    if (connection.request.result() == HttpRequest::INCOMPLETE){
+        if (!client.connected()){
+            close(connection);
+        }
+        else if (millis() - connection.startMillis > clientTimeoutMillis){
+            Serial.println("Client timed out.");
+            close(connection);
+        }
+        return;
+    }
+    respond(connection);
+}
+
+// The first part of the response, the handler's or one of the canned errors
+void WebServer::respond(Connection& connection){
+    connection.responding = true;
+    connection.part = 0;
+    connection.sentMillis = millis();
+
+    if (connection.request.result() == HttpRequest::COMPLETE){
+        Serial.printf("%s %s\n", connection.request.method(), connection.request.path());
+        nextPart(connection);
+    }
+    else {
+        strcpy_P(connection.response, connection.request.result() == HttpRequest::BAD_REQUEST ? RESPONSE_BAD_REQUEST : RESPONSE_TOO_LARGE);
+        connection.responseLength = strlen(connection.response);
+        connection.responseSent = 0;
+        connection.morePending = false;
+    }
+    send(connection);
+}
+
+// Have the handler fill the buffer with the next part
+void WebServer::nextPart(Connection& connection){
+    BufferedPrint out(connection.client, connection.response, RESPONSE_BUFFER);
+    connection.morePending = _handler(out, connection.request, connection.part++);
+    connection.responseLength = out.release();
+    connection.responseSent = 0;
+}
+
+// Write as much as the socket will take without waiting, moving on to the
+// next part when this one's gone, and close after the last
+void WebServer::send(Connection& connection){
+    WiFiClient& client = connection.client;
+    while (true){
+        if (connection.responseSent == connection.responseLength){
+            if (!connection.morePending){
+                close(connection);
+                return;
+            }
+            nextPart(connection);
+            continue;
+        }
+        size_t room = client.availableForWrite();
+        if (room == 0) break;
+        size_t length = min(room, connection.responseLength - connection.responseSent);
+        size_t written = client.write((const uint8_t*)connection.response + connection.responseSent, length);
+        connection.responseSent += written;
+        if (written) connection.sentMillis = millis();
+        if (written < length) break;
+    }
+
+    if (!client.connected()){
+        close(connection);
+    }
+    else if (millis() - connection.sentMillis > sendTimeoutMillis){
+        Serial.println("Client stopped reading.");
+        close(connection);
+    }
+}
+
+void WebServer::close(Connection& connection){
+    connection.client.stop();
+    connection.active = false;
+    Serial.println("Client disconnected.");
+}
+
+int WebServer::activeClients(){
+    int count = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++){
+        if (_connections[i].active) count++;
+    }
+    return count;
+}
@@ -0,0 +1,67 @@
+#ifndef WebServer_H
+#define WebServer_H
+
+#include "Arduino.h"
+#include <ESP8266WiFi.h>
+#include "HttpRequest.h"
+#include "BufferedPrint.h"
+
+// Event driven HTTP server. Each client gets a slot with its own request
+// parser, timeout and response buffer, and update() only handles what's
+// already arrived on each socket, and only sends what each socket can take
+// without waiting, before returning. So a slow or idle browser, or one that
+// stops reading halfway through a response, can't hold up loop().
+//
+// Once a request is complete the handler is asked for the response a part
+// at a time: each call writes part number "part" and says whether there's
+// more to come. The next part is asked for once the last has gone out, and
+// the connection is closed after the final one.
+class WebServer {
+    public:
+        // Each part should fit in this. A bigger one still goes out, but
+        // whatever didn't fit is written straight to the socket, which can
+        // wait on a slow reader.
+        static const size_t RESPONSE_BUFFER = 1024;
+
+        typedef bool (*Handler)(BufferedPrint& out, HttpRequest& request, uint16_t part);
+
+        WebServer(uint16_t port, Handler handler);
+        void begin();
+        void update();
+        int activeClients();
+
+    private:
+        // lwIP on the ESP8266 only has 5 TCP connections to go around, and
+        // we need one for the IFTTT posts.
+        static const int MAX_CLIENTS = 4;
+        // Most bytes to read from one client per update()
+        static const int READ_BUDGET = 256;
+
+        struct Connection {
+            WiFiClient client;
+            HttpRequest request;
+            unsigned long startMillis;
+            bool active;
+            // The part being sent, how far it's got and whether there's another
+            bool responding;
+            char response[RESPONSE_BUFFER];
+            size_t responseLength;
+            size_t responseSent;
+            uint16_t part;
+            bool morePending;
+            unsigned long sentMillis;
+        };
+
+        void accept();
+        void service(Connection& connection);
+        void respond(Connection& connection);
+        void nextPart(Connection& connection);
+        void send(Connection& connection);
+        void close(Connection& connection);
+
+        WiFiServer _server;
+        Handler _handler;
+        Connection _connections[MAX_CLIENTS];
+};
+
+#endif
@@ -0,0 +1,45 @@
+// Config.cpp for the host build, so it doesn't need (or see) the real one
+
+#include "Arduino.h"
+#include "Config.h"
+
+WiFiConfig::WiFiConfig(){
+    _ssid = "HostNet";         // hostAccessPoint's
+    _password = "hostpass";
+}
+char* WiFiConfig::ssid(){
+    return _ssid;
+}
+char* WiFiConfig::password(){
+    return _password;
+}
+WiFiConfig::~WiFiConfig(){
+    _ssid = "";
+    _password = "";
+}
+
+HttpsConfig::HttpsConfig(){
+    _apikey = "hostkey";
+    _iftttalert = "temp_alert";
+    _iftttnotification = "temp_notification";
+    // hostHttpsServer.fingerprintMatches decides whether this matches
+    _fingerprint = "00 11 22 33 44 55 66 77 88 99 AA BB CC DD EE FF 00 11 22 33";
+}
+char* HttpsConfig::apikey(){
+    return _apikey;
+}
+char* HttpsConfig::iftttalert(){
+    return _iftttalert;
+}
+char* HttpsConfig::iftttnotification(){
+    return _iftttnotification;
+}
+char* HttpsConfig::fingerprint(){
+    return _fingerprint;
+}
+HttpsConfig::~HttpsConfig(){
+    _apikey = "";
+    _iftttalert = "";
+    _iftttnotification = "";
+    _fingerprint = "";
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "Sketch.h"
+
+// The core's own work between loop()s, about what a NodeMCU's loop() manages
+// with nothing to do
+const uint32_t defaultStepMicros = 1000;
+
+static uint32_t passes = 0;
+static uint32_t stepMicros = defaultStepMicros;
+
+void sketchSetup(){
+    passes = 0;
+    setup();
+    hostRunScheduled();
+}
+
+void sketchPass(){
+    loop();
+    hostRunScheduled();
+    hostAdvanceMicros(stepMicros);
+    passes++;
+}
+
+void sketchRunFor(unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms) sketchPass();
+}
+
+bool sketchRunUntil(bool (*done)(), unsigned long timeoutMillis){
+    unsigned long start = millis();
+    while (!done()){
+        if (millis() - start >= timeoutMillis) return false;
+        sketchPass();
+    }
+    return true;
+}
+
+uint32_t sketchPasses(){
+    return passes;
+}
+
+void sketchSetStep(uint32_t micros){
+    stepMicros = micros;
+}
@@ -0,0 +1,25 @@
+#ifndef Sketch_H
+#define Sketch_H
+
+#include "Arduino.h"
+
+// Runs main.ino the way the core does: setup() once, then loop() over and
+// over with the core's scheduled work (SNTP) in between. Each pass moves
+// the virtual clock on by stepMicros, on top of whatever the pass itself
+// spent in delay() or blocking calls, so a minute of running is a minute
+// of millis().
+
+void setup();
+void loop();
+
+void sketchSetup();
+// One loop() and what the core does after it
+void sketchPass();
+void sketchRunFor(unsigned long ms);
+// Until done() says so or the time's up, true if done() did
+bool sketchRunUntil(bool (*done)(), unsigned long timeoutMillis);
+// loop() passes since sketchSetup()
+uint32_t sketchPasses();
+void sketchSetStep(uint32_t stepMicros);
+
+#endif
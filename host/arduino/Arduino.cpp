@@ -0,0 +1,230 @@
+#include "Arduino.h"
+#include "HostInternal.h"
+#include <chrono>
+#include <string>
+
+// The virtual clock starts about where the core's is by the time setup() runs,
+// so nothing sees a millis() of 0 (the sketch uses 0 for "not yet")
+const uint64_t bootMicros = 1000 * 100;
+// A pass through the SDK from yield(), so a loop waiting on the clock moves along
+const uint64_t yieldMicros = 100;
+// Keep at most this much Serial output, dropping the oldest half beyond it
+const size_t maxSerialBytes = 1024 * 64;
+
+static const int PINS = 17;
+
+static uint64_t virtualMicros = bootMicros;
+static int pinLevels[PINS];
+static int pinWritten[PINS];
+static void (*pinIsrs[PINS])();
+static std::string* serialOutput;
+static bool serialEcho = false;
+static bool restarted = false;
+static uint32_t rtcMemory[128];
+
+uint32_t GPC_REGS[16];
+HardwareSerial Serial;
+EspClass ESP;
+
+unsigned long millis(){
+    return virtualMicros / 1000;
+}
+
+unsigned long micros(){
+    return virtualMicros;
+}
+
+void delay(unsigned long ms){
+    virtualMicros += (uint64_t)ms * 1000;
+}
+
+void yield(){
+    virtualMicros += yieldMicros;
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+    if (pin < PINS && mode == INPUT_PULLUP) pinLevels[pin] = HIGH;
+}
+
+int digitalRead(uint8_t pin){
+    return pin < PINS ? pinLevels[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+    if (pin < PINS) pinWritten[pin] = value;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode){
+    if (pin >= PINS) return;
+    pinIsrs[pin] = isr;
+    GPC(pin) = (GPC(pin) & ~(0xF << GPCI)) | ((mode & 0xF) << GPCI);
+}
+
+// There's only the one thread, nothing to hold off
+void noInterrupts(){
+}
+
+void interrupts(){
+}
+
+size_t Print::write(const uint8_t* data, size_t length){
+    size_t written = 0;
+    while (length--) written += write(*data++);
+    return written;
+}
+
+size_t Print::print(int value){
+    return printf("%d", value);
+}
+
+size_t Print::print(unsigned int value){
+    return printf("%u", value);
+}
+
+size_t Print::print(long value){
+    return printf("%ld", value);
+}
+
+size_t Print::print(unsigned long value){
+    return printf("%lu", value);
+}
+
+// Same as the core: a 64 byte buffer on the stack, anything longer is allocated
+size_t Print::printf(const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    char buff[64];
+    char* text = buff;
+    int length = vsnprintf(buff, sizeof(buff), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    if (length >= (int)sizeof(buff)){
+        text = new char[length + 1];
+        va_start(args, format);
+        vsnprintf(text, length + 1, format, args);
+        va_end(args);
+    }
+    size_t written = write((const uint8_t*)text, length);
+    if (text != buff) delete[] text;
+    return written;
+}
+
+void HardwareSerial::begin(unsigned long baud){
+}
+
+size_t HardwareSerial::write(uint8_t c){
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t length){
+    HostUncounted uncounted;
+    if (!serialOutput) serialOutput = new std::string();
+    serialOutput->append((const char*)data, length);
+    if (serialOutput->size() > maxSerialBytes) serialOutput->erase(0, serialOutput->size() - maxSerialBytes / 2);
+    if (serialEcho) fwrite(data, 1, length, stdout);
+    return length;
+}
+
+// The firmware expects restart() not to come back, here it does and the
+// test or bench decides what happens next
+void EspClass::restart(){
+    restarted = true;
+}
+
+uint32_t EspClass::getChipId(){
+    return 0x00C0FFEE;
+}
+
+// Runs at 80 MHz off the host's own clock, plus whatever virtual time the
+// firmware has spent waiting (delay(), a TLS handshake...), so PerfTimer
+// measures what the code really costs here and what it blocks for
+uint32_t EspClass::getCycleCount(){
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t realMicros = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count() / 1000;
+    return (uint32_t)((realMicros + virtualMicros) * getCpuFreqMHz());
+}
+
+uint8_t EspClass::getCpuFreqMHz(){
+    return 80;
+}
+
+// 512 bytes of user memory, in 4 byte blocks
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size){
+    if (offset * 4 + size > sizeof(rtcMemory) || size % 4) return false;
+    memcpy(data, (uint8_t*)rtcMemory + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size){
+    if (offset * 4 + size > sizeof(rtcMemory) || size % 4) return false;
+    memcpy((uint8_t*)rtcMemory + offset * 4, data, size);
+    return true;
+}
+
+void hostReset(bool warm){
+    virtualMicros = bootMicros;
+    for (int i = 0; i < PINS; i++){
+        pinLevels[i] = LOW;
+        pinWritten[i] = LOW;
+        pinIsrs[i] = NULL;
+    }
+    memset(GPC_REGS, 0, sizeof(GPC_REGS));
+    hostSerialClear();
+    restarted = false;
+    hostSetHeapSize(0);
+    hostResetNetwork();
+    hostResetUdp();
+    hostResetClock();
+    hostResetOneWire(warm);
+    hostResetDisplay();
+    // After a power cycle RTC memory is whatever it powered up as
+    if (!warm){
+        uint32_t noise = 0x9E3779B9;
+        for (size_t i = 0; i < sizeof(rtcMemory) / sizeof(rtcMemory[0]); i++){
+            noise = noise * 1664525 + 1013904223;
+            rtcMemory[i] = noise;
+        }
+    }
+}
+
+void hostAdvanceMillis(unsigned long ms){
+    virtualMicros += (uint64_t)ms * 1000;
+}
+
+void hostAdvanceMicros(uint64_t us){
+    virtualMicros += us;
+}
+
+// Interrupt types as they're kept in GPC: 1 rising, 2 falling, 3 change,
+// 4 low level, 5 high level
+void hostSetPin(uint8_t pin, int level){
+    if (pin >= PINS || pinLevels[pin] == level) return;
+    pinLevels[pin] = level;
+    if (!pinIsrs[pin]) return;
+    uint32_t type = (GPC(pin) >> GPCI) & 7;
+    bool fire = type == CHANGE ||
+        (level == HIGH && (type == RISING || type == 5)) ||
+        (level == LOW && (type == FALLING || type == 4));
+    if (fire) pinIsrs[pin]();
+}
+
+int hostPinWritten(uint8_t pin){
+    return pin < PINS ? pinWritten[pin] : LOW;
+}
+
+const char* hostSerialOutput(){
+    return serialOutput ? serialOutput->c_str() : "";
+}
+
+void hostSerialClear(){
+    if (serialOutput) serialOutput->clear();
+}
+
+void hostSerialEcho(bool on){
+    serialEcho = on;
+}
+
+bool hostRestarted(){
+    return restarted;
+}
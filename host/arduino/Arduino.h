@@ -0,0 +1,184 @@
+#ifndef Arduino_H
+#define Arduino_H
+
+// Host stand-in for the ESP8266 Arduino core, just enough of it to build the
+// sketch's modules (and main.ino) natively. Time comes from a virtual clock
+// that only moves when a test or the bench moves it, or the code calls
+// delay(), so a run goes the same way every time.
+//
+// unsigned long is 64 bits here rather than 32, so millis() never rolls
+// over on the host; rollover handling can only be checked on the device.
+//
+// The host* functions at the bottom are for the tests and the bench to
+// drive things from the outside, the firmware never calls them.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include "binary.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// There's no separate flash address space, PROGMEM data is plain data
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+typedef const char* PGM_P;
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+
+// NodeMCU pin names
+enum { D0 = 16, D1 = 5, D2 = 4, D3 = 0, D4 = 2, D5 = 14, D6 = 12, D7 = 13, D8 = 15 };
+#define digitalPinToInterrupt(p) (p)
+
+// As the core has them, taking mixed types
+template <class T, class U> auto min(const T& a, const U& b) -> decltype(b < a ? b : a){ return b < a ? b : a; }
+template <class T, class U> auto max(const T& a, const U& b) -> decltype(b > a ? b : a){ return b > a ? b : a; }
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void noInterrupts();
+void interrupts();
+
+// Sets the zone and starts SNTP, see Clock.cpp
+void configTime(long timezone, int daylightOffset, const char* server1, const char* server2 = NULL, const char* server3 = NULL);
+
+// GPIO pin control registers, for code that sets the interrupt type directly
+extern uint32_t GPC_REGS[16];
+#define GPC(p) GPC_REGS[(p) & 0xF]
+#define GPCI 7
+#define GPCWE 10
+
+class Print {
+    public:
+        virtual ~Print(){}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* data, size_t length);
+        size_t write(const char* text){ return write((const uint8_t*)text, strlen(text)); }
+        size_t write_P(PGM_P data, size_t length){ return write((const uint8_t*)data, length); }
+
+        size_t print(const char* text){ return write(text); }
+        size_t print(char c){ return write((uint8_t)c); }
+        size_t print(int value);
+        size_t print(unsigned int value);
+        size_t print(long value);
+        size_t print(unsigned long value);
+        size_t println(){ return write("\r\n"); }
+        size_t println(const char* text){ return print(text) + println(); }
+        size_t println(int value){ return print(value) + println(); }
+        size_t println(unsigned long value){ return print(value) + println(); }
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Everything printed is kept (see hostSerialOutput()), and echoed to stdout
+// if hostSerialEcho() is on
+class HardwareSerial : public Print {
+    public:
+        void begin(unsigned long baud);
+        size_t write(uint8_t c);
+        size_t write(const uint8_t* data, size_t length);
+        using Print::write;
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+    public:
+        void restart();
+        uint32_t getChipId();
+        uint32_t getCycleCount();
+        uint8_t getCpuFreqMHz();
+        uint32_t getFreeHeap();
+        uint32_t getMaxFreeBlockSize();
+        uint8_t getHeapFragmentation();
+        bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+        bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+};
+extern EspClass ESP;
+
+// Host side, for tests and the bench
+
+// Put the device back as it is at power on: clock, pins, Serial, WiFi and
+// sockets, the display, and the sensors' scratchpads. What's outside it (the
+// access point, servers, the sensors themselves) and what's in flash stays.
+// A warm reset (ESP.restart()) keeps RTC memory, a cold one leaves it garbage.
+void hostReset(bool warm = false);
+// Move the virtual clock on (delay() does the same from the firmware's side)
+void hostAdvanceMillis(unsigned long ms);
+void hostAdvanceMicros(uint64_t us);
+// Drive an input pin, firing its interrupt if the change matches its mode
+void hostSetPin(uint8_t pin, int level);
+int hostPinWritten(uint8_t pin);
+// What's been printed to Serial since the last clear
+const char* hostSerialOutput();
+void hostSerialClear();
+void hostSerialEcho(bool on);
+// ESP.restart() was called
+bool hostRestarted();
+// Run what the core runs between loop()s, i.e. SNTP setting the clock. The
+// driver calls it after each loop().
+void hostRunScheduled();
+// How much heap the firmware has before anything's allocated, 0 for the
+// default. Allocations past it fail (new throws, new (std::nothrow) is NULL).
+void hostSetHeapSize(uint32_t bytes);
+
+// Every operator new the firmware makes is counted, see HostHeap.cpp
+struct HostHeapStats {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;
+    int64_t liveBytes;
+    int64_t peakLiveBytes;
+};
+HostHeapStats hostHeapStats();
+
+// The NTP pool: whether it answers, how long after WiFi comes up it does,
+// and what time() was at boot by its clock
+struct HostNtpServer {
+    bool reachable;
+    unsigned long answerMillis;
+    time_t bootTime;
+};
+extern HostNtpServer hostNtpServer;
+// Allocations the stand-ins make for themselves aren't the firmware's, they
+// wrap them in one of these so they aren't counted
+class HostUncounted {
+    public:
+        HostUncounted();
+        ~HostUncounted();
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "Arduino.h"
+#include "coredecls.h"
+#include "HostInternal.h"
+#include <time.h>
+
+// time() for the firmware (the host build links with --wrap=time): counts up
+// from 1970 at boot like the device's, until SNTP gets an answer from
+// hostNtpServer, some time after WiFi comes up
+HostNtpServer hostNtpServer = {true, 1000, 1760000000};
+
+static TrivialCB timeSetCallback;
+static bool ntpStarted = false;
+static bool clockSet = false;
+static unsigned long upSinceMillis = 0;
+
+extern "C" time_t __wrap_time(time_t* t){
+    time_t now = millis() / 1000;
+    if (clockSet) now += hostNtpServer.bootTime;
+    if (t) *t = now;
+    return now;
+}
+
+void settimeofday_cb(const TrivialCB& cb){
+    HostUncounted uncounted;
+    timeSetCallback = cb;
+}
+
+// A fixed offset, DST included, as the core's legacy configTime() does. POSIX
+// TZ offsets are the other way round, west of UTC is positive.
+void configTime(long timezone, int daylightOffset, const char* server1, const char* server2, const char* server3){
+    long offset = -(timezone + daylightOffset);
+    char tz[32];
+    snprintf(tz, sizeof(tz), "HST%c%ld:%02ld", offset < 0 ? '-' : '+', labs(offset) / 3600, labs(offset) / 60 % 60);
+    setenv("TZ", tz, 1);
+    tzset();
+    ntpStarted = server1 != NULL;
+}
+
+void hostRunScheduled(){
+    if (!ntpStarted || !hostNtpServer.reachable || !hostWiFiUp()){
+        upSinceMillis = 0;
+        return;
+    }
+    if (upSinceMillis == 0) upSinceMillis = millis();
+    if (clockSet || millis() - upSinceMillis < hostNtpServer.answerMillis) return;
+    clockSet = true;
+    if (timeSetCallback) timeSetCallback();
+}
+
+void hostResetClock(){
+    HostUncounted uncounted;
+    timeSetCallback = nullptr;
+    ntpStarted = false;
+    clockSet = false;
+    upSinceMillis = 0;
+    setenv("TZ", "UTC0", 1);
+    tzset();
+}
@@ -0,0 +1,243 @@
+#include "ESP8266WiFi.h"
+#include "HostInternal.h"
+
+// What the firmware gets once it's on the network, and what names resolve to
+static const IPAddress localAddress(192, 168, 1, 50);
+static const IPAddress resolvedAddress(192, 168, 1, 10);
+static const int MAX_LISTENING = 8;
+static const int MAX_PENDING = 16;
+
+ESP8266WiFiClass WiFi;
+// A fast join that has the BSSID and channel right is quick, a scan isn't
+HostAccessPoint hostAccessPoint = {
+    "HostNet", "hostpass", {0x02, 0x00, 0x5E, 0x10, 0x20, 0x30}, 6, true, 3000, 400, true
+};
+
+// The SDK's side of the association
+static wl_status_t wifiStatus;
+static bool joining;
+static unsigned long joinStartMillis;
+static char wantSsid[33];
+static char wantPassword[65];
+static int32_t wantChannel;
+static uint8_t wantBssid[6];
+static bool wantFast;
+static bool autoReconnect;
+static int32_t joinedChannel;
+static uint8_t joinedBssid[6];
+
+static uint16_t listening[MAX_LISTENING];
+static HostSocket* pending[MAX_PENDING];
+static int pendingCount;
+
+static void startJoin(bool fast){
+    joining = true;
+    wantFast = fast;
+    joinStartMillis = millis();
+    wifiStatus = WL_DISCONNECTED;
+}
+
+// Move the association along to where it'd be by now. The firmware only
+// ever sees it through status() so that's where it happens.
+static void updateStatus(){
+    HostAccessPoint& ap = hostAccessPoint;
+    if (wifiStatus == WL_CONNECTED){
+        if (ap.up && ap.channel == joinedChannel && memcmp(ap.bssid, joinedBssid, 6) == 0) return;
+        wifiStatus = WL_CONNECTION_LOST;
+        if (autoReconnect) startJoin(false);
+        return;
+    }
+    if (!joining) return;
+
+    unsigned long elapsed = millis() - joinStartMillis;
+    bool found = ap.up && strcmp(ap.ssid, wantSsid) == 0;
+    if (wantFast){
+        // Straight to the given BSSID on the given channel, if the AP isn't
+        // there it just never answers
+        found = found && wantChannel == ap.channel && memcmp(wantBssid, ap.bssid, 6) == 0;
+        if (!found || elapsed < ap.fastJoinMillis) return;
+    }
+    else {
+        if (elapsed < ap.joinMillis) return;
+        if (!found){
+            // Nothing on the scan, the SDK keeps looking
+            wifiStatus = WL_NO_SSID_AVAIL;
+            joinStartMillis = millis();
+            return;
+        }
+    }
+
+    if (strcmp(ap.password, wantPassword) != 0){
+        wifiStatus = WL_CONNECT_FAILED;
+        joining = false;
+        return;
+    }
+    joining = false;
+    joinedChannel = ap.channel;
+    memcpy(joinedBssid, ap.bssid, 6);
+    wifiStatus = WL_CONNECTED;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char* ssid, const char* password, int32_t channel, const uint8_t* bssid, bool connect){
+    strncpy(wantSsid, ssid, sizeof(wantSsid) - 1);
+    strncpy(wantPassword, password ? password : "", sizeof(wantPassword) - 1);
+    wantChannel = channel;
+    if (bssid) memcpy(wantBssid, bssid, 6);
+    if (connect) startJoin(channel != 0 && bssid != NULL);
+    return wifiStatus;
+}
+
+wl_status_t ESP8266WiFiClass::status(){
+    updateStatus();
+    return wifiStatus;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifiOff){
+    joining = false;
+    wifiStatus = WL_DISCONNECTED;
+    return true;
+}
+
+IPAddress ESP8266WiFiClass::localIP(){
+    return status() == WL_CONNECTED ? localAddress : IPAddress();
+}
+
+uint8_t* ESP8266WiFiClass::BSSID(){
+    return joinedBssid;
+}
+
+int32_t ESP8266WiFiClass::channel(){
+    return joinedChannel;
+}
+
+int32_t ESP8266WiFiClass::RSSI(){
+    return status() == WL_CONNECTED ? -60 : 31;
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t mode){
+    return true;
+}
+
+void ESP8266WiFiClass::persistent(bool persistent){
+}
+
+bool ESP8266WiFiClass::setAutoReconnect(bool on){
+    autoReconnect = on;
+    return true;
+}
+
+bool ESP8266WiFiClass::enableAP(bool enable){
+    return true;
+}
+
+bool ESP8266WiFiClass::setSleepMode(WiFiSleepType_t type, uint8_t listenInterval){
+    return true;
+}
+
+int ESP8266WiFiClass::hostByName(const char* host, IPAddress& result){
+    if (status() != WL_CONNECTED || !hostAccessPoint.dnsWorks){
+        result = IPAddress();
+        return 0;
+    }
+    result = resolvedAddress;
+    return 1;
+}
+
+bool IPAddress::fromString(const char* text){
+    uint32_t address = 0;
+    for (int octet = 0; octet < 4; octet++){
+        if (!isdigit((unsigned char)*text)) return false;
+        int value = 0;
+        while (isdigit((unsigned char)*text)){
+            value = value * 10 + (*text++ - '0');
+            if (value > 255) return false;
+        }
+        address |= (uint32_t)value << (octet * 8);
+        if (octet < 3 && *text++ != '.') return false;
+    }
+    if (*text) return false;
+    _address = address;
+    return true;
+}
+
+bool hostWiFiUp(){
+    return WiFi.status() == WL_CONNECTED;
+}
+
+bool hostListening(uint16_t port){
+    for (int i = 0; i < MAX_LISTENING; i++){
+        if (listening[i] == port) return true;
+    }
+    return false;
+}
+
+// The listen backlog, a connection that doesn't fit is refused like the
+// stack would
+void hostQueueConnection(HostSocket* socket){
+    if (pendingCount == MAX_PENDING){
+        socket->peerClosed = true;
+        socket->deviceClosed = true;
+        return;
+    }
+    hostRetain(socket);
+    pending[pendingCount++] = socket;
+}
+
+WiFiServer::WiFiServer(uint16_t port){
+    _port = port;
+    _listening = false;
+}
+
+WiFiServer::~WiFiServer(){
+    stop();
+}
+
+void WiFiServer::begin(){
+    if (hostListening(_port)) return;
+    for (int i = 0; i < MAX_LISTENING; i++){
+        if (listening[i] == 0){
+            listening[i] = _port;
+            _listening = true;
+            return;
+        }
+    }
+}
+
+void WiFiServer::stop(){
+    if (!_listening) return;
+    for (int i = 0; i < MAX_LISTENING; i++){
+        if (listening[i] == _port) listening[i] = 0;
+    }
+    _listening = false;
+}
+
+WiFiClient WiFiServer::available(){
+    if (!hostListening(_port)) return WiFiClient();
+    for (int i = 0; i < pendingCount; i++){
+        HostSocket* socket = pending[i];
+        if (socket->port != _port) continue;
+        memmove(pending + i, pending + i + 1, (pendingCount - i - 1) * sizeof(pending[0]));
+        pendingCount--;
+        WiFiClient client(socket);
+        hostRelease(socket);
+        return client;
+    }
+    return WiFiClient();
+}
+
+void WiFiServer::setNoDelay(bool noDelay){
+}
+
+void hostResetNetwork(){
+    wifiStatus = WL_IDLE_STATUS;
+    joining = false;
+    autoReconnect = false;
+    joinedChannel = 0;
+    memset(joinedBssid, 0, sizeof(joinedBssid));
+    memset(listening, 0, sizeof(listening));
+    for (int i = 0; i < pendingCount; i++){
+        pending[i]->peerClosed = true;
+        hostRelease(pending[i]);
+    }
+    pendingCount = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef ESP8266WiFi_H
+#define ESP8266WiFi_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+#include "WiFiClientSecure.h"
+
+// Station mode WiFi against one simulated access point (hostAccessPoint),
+// joining takes virtual time like it does on the device
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3,
+} WiFiMode_t;
+
+typedef enum {
+    WIFI_NONE_SLEEP = 0,
+    WIFI_LIGHT_SLEEP = 1,
+    WIFI_MODEM_SLEEP = 2,
+} WiFiSleepType_t;
+
+class ESP8266WiFiClass {
+    public:
+        wl_status_t begin(const char* ssid, const char* password = NULL, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true);
+        wl_status_t status();
+        bool disconnect(bool wifiOff = false);
+        IPAddress localIP();
+        uint8_t* BSSID();
+        int32_t channel();
+        int32_t RSSI();
+        bool mode(WiFiMode_t mode);
+        void persistent(bool persistent);
+        bool setAutoReconnect(bool autoReconnect);
+        bool enableAP(bool enable);
+        bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0);
+        int hostByName(const char* host, IPAddress& result);
+};
+extern ESP8266WiFiClass WiFi;
+
+// Host side: the one access point there is. Change it between loop()s to
+// take the network away, move it to another channel, etc.
+struct HostAccessPoint {
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];
+    int32_t channel;
+    bool up;
+    // How long a join takes with a scan, and with the BSSID and channel given
+    unsigned long joinMillis;
+    unsigned long fastJoinMillis;
+    // Names resolve to 192.168.1.10, or nothing does
+    bool dnsWorks;
+};
+extern HostAccessPoint hostAccessPoint;
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef ESPHTTPClient_H
+#define ESPHTTPClient_H
+
+// Included by the sketch but nothing from it is used
+#include "Arduino.h"
+
+#endif
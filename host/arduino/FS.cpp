@@ -0,0 +1,292 @@
+#include "FS.h"
+#include "LittleFS.h"
+#include <map>
+#include <string>
+
+// None of this is the firmware's heap, it's flash
+struct HostFileData {
+    int refs;
+    std::string bytes;
+};
+
+typedef std::map<std::string, HostFileData*> FileMap;
+
+FS LittleFS;
+
+static FileMap* files;
+static bool mountFails = false;
+static long writeLimit = -1;
+static uint64_t bytesWritten = 0;
+static uint64_t writes = 0;
+
+static void retain(HostFileData* data){
+    if (data) data->refs++;
+}
+
+static void release(HostFileData* data){
+    if (!data || --data->refs > 0) return;
+    HostUncounted uncounted;
+    delete data;
+}
+
+static FileMap& fileMap(){
+    HostUncounted uncounted;
+    if (!files) files = new FileMap();
+    return *files;
+}
+
+static HostFileData* find(const char* path){
+    HostUncounted uncounted;
+    FileMap::iterator it = fileMap().find(path);
+    return it == fileMap().end() ? NULL : it->second;
+}
+
+static HostFileData* create(const char* path){
+    HostUncounted uncounted;
+    HostFileData* data = find(path);
+    if (data) return data;
+    data = new HostFileData();
+    data->refs = 1;
+    fileMap()[path] = data;
+    return data;
+}
+
+static bool erase(const char* path){
+    HostUncounted uncounted;
+    FileMap::iterator it = fileMap().find(path);
+    if (it == fileMap().end()) return false;
+    release(it->second);
+    fileMap().erase(it);
+    return true;
+}
+
+File::File(){
+    _data = NULL;
+    _name[0] = '\0';
+    _position = 0;
+    _readable = false;
+    _writable = false;
+    _append = false;
+}
+
+File::File(HostFileData* data, const char* name, bool readable, bool writable, bool append){
+    _data = data;
+    retain(_data);
+    strncpy(_name, name, sizeof(_name) - 1);
+    _name[sizeof(_name) - 1] = '\0';
+    _position = 0;
+    _readable = readable;
+    _writable = writable;
+    _append = append;
+}
+
+File::File(const File& other){
+    _data = NULL;
+    *this = other;
+}
+
+File& File::operator=(const File& other){
+    retain(other._data);
+    release(_data);
+    _data = other._data;
+    memcpy(_name, other._name, sizeof(_name));
+    _position = other._position;
+    _readable = other._readable;
+    _writable = other._writable;
+    _append = other._append;
+    return *this;
+}
+
+File::~File(){
+    release(_data);
+}
+
+size_t File::write(uint8_t c){
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t size){
+    if (!_data || !_writable) return 0;
+    if (writeLimit >= 0 && (long)size > writeLimit) size = writeLimit;
+    if (writeLimit >= 0) writeLimit -= size;
+
+    HostUncounted uncounted;
+    std::string& bytes = _data->bytes;
+    if (_append) _position = bytes.size();
+    if (_position > bytes.size()) bytes.resize(_position);
+    bytes.replace(_position, min(size, bytes.size() - _position), (const char*)buf, size);
+    _position += size;
+    bytesWritten += size;
+    writes++;
+    return size;
+}
+
+int File::read(){
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t size){
+    int count = min((size_t)available(), size);
+    if (count <= 0 || !_readable) return 0;
+    memcpy(buf, _data->bytes.data() + _position, count);
+    _position += count;
+    return count;
+}
+
+int File::available(){
+    if (!_data || _position >= _data->bytes.size()) return 0;
+    return _data->bytes.size() - _position;
+}
+
+int File::peek(){
+    if (available() <= 0) return -1;
+    return (uint8_t)_data->bytes[_position];
+}
+
+bool File::seek(uint32_t pos, SeekMode mode){
+    if (!_data) return false;
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? _position : _data->bytes.size();
+    if (base + pos > _data->bytes.size()) return false;
+    _position = base + pos;
+    return true;
+}
+
+size_t File::position(){
+    return _position;
+}
+
+size_t File::size(){
+    return _data ? _data->bytes.size() : 0;
+}
+
+bool File::truncate(uint32_t size){
+    if (!_data || !_writable || size > _data->bytes.size()) return false;
+    HostUncounted uncounted;
+    _data->bytes.resize(size);
+    if (_position > size) _position = size;
+    return true;
+}
+
+void File::flush(){
+}
+
+void File::close(){
+    release(_data);
+    _data = NULL;
+}
+
+const char* File::name(){
+    return _name;
+}
+
+File::operator bool(){
+    return _data != NULL;
+}
+
+bool FS::begin(){
+    return !mountFails;
+}
+
+void FS::end(){
+}
+
+bool FS::format(){
+    hostFsFormat();
+    return true;
+}
+
+File FS::open(const char* path, const char* mode){
+    if (mountFails) return File();
+    bool plus = mode[1] == '+';
+    HostFileData* data = find(path);
+    switch (mode[0]){
+        case 'r':
+            if (!data) return File();
+            return File(data, path, true, plus, false);
+        case 'w':
+            data = create(path);
+            {
+                HostUncounted uncounted;
+                data->bytes.clear();
+            }
+            return File(data, path, plus, true, false);
+        case 'a': {
+            data = create(path);
+            File file(data, path, plus, true, true);
+            file.seek(0, SeekEnd);
+            return file;
+        }
+    }
+    return File();
+}
+
+bool FS::exists(const char* path){
+    return find(path) != NULL;
+}
+
+bool FS::remove(const char* path){
+    return erase(path);
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo){
+    HostFileData* data = find(pathFrom);
+    if (!data) return false;
+    if (strcmp(pathFrom, pathTo) == 0) return true;
+    retain(data);
+    erase(pathFrom);
+    erase(pathTo);
+    HostUncounted uncounted;
+    fileMap()[pathTo] = data;
+    return true;
+}
+
+void hostFsFormat(){
+    HostUncounted uncounted;
+    for (FileMap::iterator it = fileMap().begin(); it != fileMap().end(); ++it){
+        release(it->second);
+    }
+    fileMap().clear();
+}
+
+void hostFsMountFails(bool fails){
+    mountFails = fails;
+}
+
+void hostFsWriteLimit(long bytes){
+    writeLimit = bytes;
+}
+
+const uint8_t* hostFsFileData(const char* path, size_t& size){
+    HostFileData* data = find(path);
+    size = data ? data->bytes.size() : 0;
+    return data ? (const uint8_t*)data->bytes.data() : NULL;
+}
+
+void hostFsWriteFile(const char* path, const uint8_t* data, size_t size){
+    HostUncounted uncounted;
+    create(path)->bytes.assign((const char*)data, size);
+}
+
+bool hostFsCorrupt(const char* path, size_t offset, uint8_t xorMask){
+    HostFileData* data = find(path);
+    if (!data || offset >= data->bytes.size()) return false;
+    data->bytes[offset] ^= xorMask;
+    return true;
+}
+
+bool hostFsTruncate(const char* path, size_t size){
+    HostFileData* data = find(path);
+    if (!data || size > data->bytes.size()) return false;
+    HostUncounted uncounted;
+    data->bytes.resize(size);
+    return true;
+}
+
+uint64_t hostFsBytesWritten(){
+    return bytesWritten;
+}
+
+uint64_t hostFsWrites(){
+    return writes;
+}
@@ -0,0 +1,78 @@
+#ifndef FS_H
+#define FS_H
+
+#include "Arduino.h"
+
+// An in-memory flash filesystem. What's in it survives hostReset(), like
+// flash does, and writes can be cut short to simulate losing power part way.
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2,
+};
+
+// A file's contents, shared by every File open on it. See FS.cpp.
+struct HostFileData;
+
+class File {
+    public:
+        File();
+        File(HostFileData* data, const char* name, bool readable, bool writable, bool append);
+        File(const File& other);
+        File& operator=(const File& other);
+        ~File();
+
+        size_t write(uint8_t c);
+        size_t write(const uint8_t* buf, size_t size);
+        int read();
+        size_t read(uint8_t* buf, size_t size);
+        int available();
+        int peek();
+        bool seek(uint32_t pos, SeekMode mode = SeekSet);
+        size_t position();
+        size_t size();
+        bool truncate(uint32_t size);
+        void flush();
+        void close();
+        const char* name();
+        operator bool();
+
+    private:
+        HostFileData* _data;
+        char _name[32];
+        size_t _position;
+        bool _readable;
+        bool _writable;
+        bool _append;
+};
+
+class FS {
+    public:
+        bool begin();
+        void end();
+        bool format();
+        // "r", "r+", "w", "w+", "a" and "a+", as fopen()
+        File open(const char* path, const char* mode);
+        bool exists(const char* path);
+        bool remove(const char* path);
+        bool rename(const char* pathFrom, const char* pathTo);
+};
+
+// Host side
+void hostFsFormat();
+void hostFsMountFails(bool fails);
+// Let only this many more bytes be written, after that writes come up short
+// as if the power went. -1 for no limit.
+void hostFsWriteLimit(long bytes);
+// A file's contents, NULL if there's no such file
+const uint8_t* hostFsFileData(const char* path, size_t& size);
+void hostFsWriteFile(const char* path, const uint8_t* data, size_t size);
+// Flip bits in a file, or cut it short, as a bad sector or power cut would
+bool hostFsCorrupt(const char* path, size_t offset, uint8_t xorMask);
+bool hostFsTruncate(const char* path, size_t size);
+// Bytes written and write() calls since boot, the flash wear
+uint64_t hostFsBytesWritten();
+uint64_t hostFsWrites();
+
+#endif
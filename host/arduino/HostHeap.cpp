@@ -0,0 +1,113 @@
+#include "Arduino.h"
+#include <new>
+
+// Global operator new and delete, counting what the firmware allocates. Each
+// block carries its size (and whether it was counted) in front of it so
+// delete can take it back off. The header is 16 bytes to keep the block
+// aligned the way malloc() would.
+struct BlockHeader {
+    size_t size;
+    size_t counted;
+};
+static_assert(sizeof(BlockHeader) == 16, "blocks have to stay 16 byte aligned");
+
+// What the firmware has to play with before anything is allocated, about
+// what a NodeMCU has left over after the SDK and the sketch's globals
+const uint32_t defaultHeapBytes = 1024 * 48;
+
+static HostHeapStats stats;
+static int uncountedDepth = 0;
+static uint32_t heapBytes = defaultHeapBytes;
+
+// The firmware's allocations fail once they'd take more than the heap it's
+// been given, like they would on the device
+static void* allocate(size_t size){
+    if (uncountedDepth == 0 && stats.liveBytes + (int64_t)size > heapBytes) return NULL;
+    BlockHeader* header = (BlockHeader*)malloc(sizeof(BlockHeader) + size);
+    if (!header) return NULL;
+    header->size = size;
+    header->counted = uncountedDepth == 0;
+    if (header->counted){
+        stats.allocations++;
+        stats.bytes += size;
+        stats.liveBytes += size;
+        if (stats.liveBytes > stats.peakLiveBytes) stats.peakLiveBytes = stats.liveBytes;
+    }
+    return header + 1;
+}
+
+static void release(void* p){
+    if (!p) return;
+    BlockHeader* header = (BlockHeader*)p - 1;
+    if (header->counted){
+        stats.frees++;
+        stats.liveBytes -= header->size;
+    }
+    free(header);
+}
+
+void* operator new(size_t size){
+    void* p = allocate(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size){
+    void* p = allocate(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept{
+    release(p);
+}
+
+void operator delete[](void* p) noexcept{
+    release(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept{
+    release(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept{
+    release(p);
+}
+
+uint32_t EspClass::getFreeHeap(){
+    return stats.liveBytes >= heapBytes ? 0 : heapBytes - (uint32_t)stats.liveBytes;
+}
+
+// The host's heap doesn't fragment the way the ESP8266's does, so this is
+// just the free heap
+uint32_t EspClass::getMaxFreeBlockSize(){
+    return getFreeHeap();
+}
+
+uint8_t EspClass::getHeapFragmentation(){
+    return 0;
+}
+
+void hostSetHeapSize(uint32_t bytes){
+    heapBytes = bytes ? bytes : defaultHeapBytes;
+}
+
+HostHeapStats hostHeapStats(){
+    return stats;
+}
+
+HostUncounted::HostUncounted(){
+    uncountedDepth++;
+}
+
+HostUncounted::~HostUncounted(){
+    uncountedDepth--;
+}
@@ -0,0 +1,54 @@
+#ifndef HostInternal_H
+#define HostInternal_H
+
+// Shared between the stand-ins' own .cpp files, not for the firmware or tests
+
+#include "Arduino.h"
+#include <string>
+
+struct HostSocket {
+    int refs;
+    // Written by the peer, read by the firmware from readOffset on
+    std::string toDevice;
+    size_t readOffset;
+    // Written by the firmware, and in how many write()s (each one's a
+    // packet on the device, more or less)
+    std::string fromDevice;
+    size_t writes;
+    bool deviceClosed;
+    bool peerClosed;
+    // The peer's gone but the firmware hasn't been told, writes just fail
+    bool writesFail;
+    // The peer's stopped reading (HostPeer::stopReading()), and how much
+    // it's left unread since. Past what the socket buffers, write() waits
+    // out its timeout like the core's does.
+    bool peerStalled;
+    size_t unread;
+    unsigned long writeTimeoutMillis;
+    uint16_t port;
+    // For connections the firmware makes, the stand-in server at the other
+    // end answers whatever's been sent so far each time the firmware looks
+    void (*serve)(HostSocket& socket);
+    size_t served;
+    unsigned long respondMillis;
+    bool responding;
+};
+
+HostSocket* hostNewSocket(uint16_t port);
+void hostRetain(HostSocket* socket);
+void hostRelease(HostSocket* socket);
+
+// WiFi's associated and the firmware has an address
+bool hostWiFiUp();
+// A WiFiServer's listening on the port
+bool hostListening(uint16_t port);
+void hostQueueConnection(HostSocket* socket);
+
+// Each stand-in's part of hostReset()
+void hostResetNetwork();
+void hostResetUdp();
+void hostResetClock();
+void hostResetOneWire(bool warm);
+void hostResetDisplay();
+
+#endif
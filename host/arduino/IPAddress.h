@@ -0,0 +1,22 @@
+#ifndef IPAddress_H
+#define IPAddress_H
+
+#include "Arduino.h"
+
+// IPv4 only. Kept in network order like the core's, so the first octet is
+// the low byte of the uint32_t.
+class IPAddress {
+    public:
+        IPAddress() : _address(0) {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+        IPAddress(uint32_t address) : _address(address) {}
+
+        operator uint32_t() const { return _address; }
+        uint8_t operator[](int index) const { return _address >> (index * 8); }
+        bool fromString(const char* text);
+
+    private:
+        uint32_t _address;
+};
+
+#endif
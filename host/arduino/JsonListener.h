@@ -0,0 +1,7 @@
+#ifndef JsonListener_H
+#define JsonListener_H
+
+// Included by the sketch but nothing from it is used
+#include "Arduino.h"
+
+#endif
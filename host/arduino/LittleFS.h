@@ -0,0 +1,8 @@
+#ifndef LittleFS_H
+#define LittleFS_H
+
+#include "FS.h"
+
+extern FS LittleFS;
+
+#endif
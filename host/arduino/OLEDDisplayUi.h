@@ -0,0 +1,7 @@
+#ifndef OLEDDisplayUi_H
+#define OLEDDisplayUi_H
+
+// Included by the sketch but nothing from it is used
+#include "Arduino.h"
+
+#endif
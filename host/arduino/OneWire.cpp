@@ -0,0 +1,259 @@
+#include "OneWire.h"
+#include "HostInternal.h"
+
+static const int PINS = 17;
+static const int MAX_DEVICES = 8;
+
+// Datasheet conversion times for 9 to 12 bits, as SensorTable rounds them
+static const unsigned long conversionTimes[] = {94, 188, 375, 750};
+
+static HostDS18B20 devices[PINS][MAX_DEVICES];
+static int deviceCount[PINS];
+static bool shorted[PINS];
+
+static void updateCrc(HostDS18B20& device){
+    device.scratchpad[8] = OneWire::crc8(device.scratchpad, 8);
+}
+
+void HostDS18B20::powerCycle(){
+    static const uint8_t powerOn[] = {0x50, 0x05};
+    scratchpad[0] = powerOn[0];
+    scratchpad[1] = powerOn[1];
+    memcpy(scratchpad + 2, eeprom, 3);
+    scratchpad[5] = 0xFF;
+    scratchpad[6] = 0x0C;
+    scratchpad[7] = 0x10;
+    updateCrc(*this);
+    converting = false;
+}
+
+uint8_t HostDS18B20::resolution(){
+    return 9 + ((scratchpad[4] >> 5) & 3);
+}
+
+// Latch the temperature if its conversion's done. The bits below the
+// resolution are undefined on the real thing, here they're all 1s.
+static void settle(HostDS18B20& device){
+    if (!device.converting || millis() < device.convertDoneMillis) return;
+    device.converting = false;
+    device.conversions++;
+    int16_t raw = (int16_t)lround(device.celsius * 16);
+    raw |= (1 << (12 - device.resolution())) - 1;
+    device.scratchpad[0] = raw & 0xFF;
+    device.scratchpad[1] = (raw >> 8) & 0xFF;
+    updateCrc(device);
+}
+
+static bool anyPresent(uint8_t pin){
+    for (int i = 0; i < deviceCount[pin]; i++){
+        if (!devices[pin][i].missing) return true;
+    }
+    return false;
+}
+
+OneWire::OneWire(){
+    _pin = 0;
+    _phase = IDLE;
+    _index = 0;
+    _searchNext = 0;
+    memset(_selected, 0, sizeof(_selected));
+}
+
+OneWire::OneWire(uint8_t pin){
+    _phase = IDLE;
+    _index = 0;
+    _searchNext = 0;
+    memset(_selected, 0, sizeof(_selected));
+    begin(pin);
+}
+
+void OneWire::begin(uint8_t pin){
+    _pin = pin < PINS ? pin : 0;
+}
+
+uint8_t OneWire::reset(){
+    _phase = IDLE;
+    memset(_selected, 0, sizeof(_selected));
+    for (int i = 0; i < deviceCount[_pin]; i++) settle(devices[_pin][i]);
+    return !shorted[_pin] && anyPresent(_pin);
+}
+
+void OneWire::select(const uint8_t rom[8]){
+    if (_phase != IDLE) return;
+    for (int i = 0; i < deviceCount[_pin]; i++){
+        HostDS18B20& device = devices[_pin][i];
+        _selected[i] = !device.missing && memcmp(device.rom, rom, 8) == 0;
+    }
+    _phase = FUNCTION;
+}
+
+void OneWire::skip(){
+    if (_phase != IDLE) return;
+    for (int i = 0; i < deviceCount[_pin]; i++){
+        _selected[i] = !devices[_pin][i].missing;
+    }
+    _phase = FUNCTION;
+}
+
+void OneWire::write(uint8_t v, uint8_t power){
+    if (shorted[_pin]) return;
+    if (_phase == FUNCTION){
+        command(v);
+        return;
+    }
+    if (_phase != WRITING) return;
+
+    // TH, TL, config. Only R1 and R0 of the config register can be written.
+    if (_index == 2) v = (v & 0x60) | 0x1F;
+    for (int i = 0; i < deviceCount[_pin]; i++){
+        if (!_selected[i]) continue;
+        devices[_pin][i].scratchpad[2 + _index] = v;
+        updateCrc(devices[_pin][i]);
+    }
+    if (++_index == 3) _phase = IDLE;
+}
+
+void OneWire::command(uint8_t v){
+    _phase = IDLE;
+    _index = 0;
+    switch (v){
+        case 0x44:      // Convert T
+            for (int i = 0; i < deviceCount[_pin]; i++){
+                HostDS18B20& device = devices[_pin][i];
+                if (!_selected[i] || device.converting) continue;
+                unsigned long duration = device.conversionMillis ? device.conversionMillis :
+                    conversionTimes[device.resolution() - 9];
+                device.converting = true;
+                device.convertDoneMillis = millis() + duration;
+            }
+            break;
+
+        case 0xBE:      // Read Scratchpad, whoever's selected drives the bus together (wired AND)
+            memset(_data, 0xFF, sizeof(_data));
+            for (int i = 0; i < deviceCount[_pin]; i++){
+                HostDS18B20& device = devices[_pin][i];
+                if (!_selected[i]) continue;
+                uint8_t data[9];
+                memcpy(data, device.scratchpad, sizeof(data));
+                if (device.crcErrors > 0){
+                    device.crcErrors--;
+                    data[0] ^= 0x04;
+                }
+                for (int b = 0; b < 9; b++) _data[b] &= data[b];
+            }
+            _phase = READING;
+            break;
+
+        case 0x4E:      // Write Scratchpad
+            _phase = WRITING;
+            break;
+
+        case 0x48:      // Copy Scratchpad
+            for (int i = 0; i < deviceCount[_pin]; i++){
+                HostDS18B20& device = devices[_pin][i];
+                if (!_selected[i]) continue;
+                memcpy(device.eeprom, device.scratchpad + 2, 3);
+                device.eepromWrites++;
+            }
+            break;
+    }
+}
+
+void OneWire::write_bytes(const uint8_t* buf, uint16_t count, bool power){
+    while (count--) write(*buf++, power);
+}
+
+uint8_t OneWire::read(){
+    if (shorted[_pin]) return 0x00;
+    if (_phase != READING || _index >= sizeof(_data)) return 0xFF;
+    return _data[_index++];
+}
+
+void OneWire::read_bytes(uint8_t* buf, uint16_t count){
+    while (count--) *buf++ = read();
+}
+
+// A DS18B20 holds the line low while it's converting
+uint8_t OneWire::read_bit(){
+    if (shorted[_pin]) return 0;
+    for (int i = 0; i < deviceCount[_pin]; i++){
+        HostDS18B20& device = devices[_pin][i];
+        settle(device);
+        if (!device.missing && device.converting) return 0;
+    }
+    return 1;
+}
+
+void OneWire::depower(){
+}
+
+void OneWire::reset_search(){
+    _searchNext = 0;
+}
+
+// Devices come back in the order they were added, not ROM order like the
+// real search, nothing here depends on that
+bool OneWire::search(uint8_t* newAddr, bool searchMode){
+    if (!reset()) return false;
+    _phase = IDLE;
+    while (_searchNext < deviceCount[_pin]){
+        HostDS18B20& device = devices[_pin][_searchNext++];
+        if (device.missing) continue;
+        memcpy(newAddr, device.rom, 8);
+        return true;
+    }
+    return false;
+}
+
+// Dallas/Maxim CRC, x^8 + x^5 + x^4 + 1
+uint8_t OneWire::crc8(const uint8_t* addr, uint8_t len){
+    uint8_t crc = 0;
+    while (len--){
+        uint8_t inbyte = *addr++;
+        for (uint8_t i = 8; i; i--){
+            uint8_t mix = (crc ^ inbyte) & 0x01;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            inbyte >>= 1;
+        }
+    }
+    return crc;
+}
+
+HostDS18B20* hostAddDS18B20(uint8_t pin, float celsius){
+    if (pin >= PINS || deviceCount[pin] == MAX_DEVICES) return NULL;
+    HostDS18B20& device = devices[pin][deviceCount[pin]];
+    memset(&device, 0, sizeof(device));
+    uint8_t rom[8] = {0x28, (uint8_t)(0x10 + deviceCount[pin]), pin, 0x5A, 0x0B, 0x00, 0x00, 0x00};
+    rom[7] = OneWire::crc8(rom, 7);
+    memcpy(device.rom, rom, sizeof(rom));
+    device.celsius = celsius;
+    device.eeprom[0] = 0x4B;
+    device.eeprom[1] = 0x46;
+    device.eeprom[2] = 0x7F;
+    device.powerCycle();
+    deviceCount[pin]++;
+    return &device;
+}
+
+int hostDS18B20Count(uint8_t pin){
+    return pin < PINS ? deviceCount[pin] : 0;
+}
+
+HostDS18B20* hostDS18B20(uint8_t pin, int index){
+    if (pin >= PINS || index < 0 || index >= deviceCount[pin]) return NULL;
+    return &devices[pin][index];
+}
+
+void hostShortBus(uint8_t pin, bool on){
+    if (pin < PINS) shorted[pin] = on;
+}
+
+// The sensors are powered from the board, a power cycle resets them too but
+// ESP.restart() doesn't
+void hostResetOneWire(bool warm){
+    if (warm) return;
+    for (int p = 0; p < PINS; p++){
+        for (int i = 0; i < deviceCount[p]; i++) devices[p][i].powerCycle();
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef OneWire_H
+#define OneWire_H
+
+#include "Arduino.h"
+
+// A 1-Wire bus with simulated DS18B20s on it (hostAddDS18B20()). Enough of
+// the protocol for what SensorTable does: search, Match/Skip ROM, Convert T,
+// Read/Write/Copy Scratchpad, and polling the bus during a conversion.
+class OneWire {
+    public:
+        OneWire();
+        OneWire(uint8_t pin);
+        void begin(uint8_t pin);
+        // 1 if something answered with a presence pulse
+        uint8_t reset();
+        void select(const uint8_t rom[8]);
+        void skip();
+        void write(uint8_t v, uint8_t power = 0);
+        void write_bytes(const uint8_t* buf, uint16_t count, bool power = 0);
+        uint8_t read();
+        void read_bytes(uint8_t* buf, uint16_t count);
+        uint8_t read_bit();
+        void depower();
+        void reset_search();
+        bool search(uint8_t* newAddr, bool searchMode = true);
+        static uint8_t crc8(const uint8_t* addr, uint8_t len);
+
+    private:
+        enum Phase {
+            IDLE,               // After a reset, waiting for a ROM command
+            FUNCTION,           // Devices selected, waiting for a function command
+            READING,            // Read Scratchpad
+            WRITING,            // Write Scratchpad
+        };
+
+        void command(uint8_t v);
+
+        uint8_t _pin;
+        Phase _phase;
+        bool _selected[8];
+        uint8_t _data[9];
+        uint8_t _index;
+        int _searchNext;
+};
+
+// Host side: one sensor. Change celsius whenever, the next conversion
+// picks it up.
+struct HostDS18B20 {
+    uint8_t rom[8];
+    float celsius;
+    // Unplugged: doesn't answer anything, and keeps its state
+    bool missing;
+    // This many scratchpad reads from now on come back with a bit flipped
+    uint8_t crcErrors;
+    // How long a conversion takes, 0 for the datasheet's time at its resolution
+    unsigned long conversionMillis;
+    uint32_t conversions;
+    uint32_t eepromWrites;
+    uint8_t scratchpad[9];
+    // TH, TL and config, loaded into the scratchpad at power up
+    uint8_t eeprom[3];
+    bool converting;
+    unsigned long convertDoneMillis;
+
+    // As if it lost power: the scratchpad back to 85 C and the EEPROM's settings
+    void powerCycle();
+    // 9 to 12, from the config register
+    uint8_t resolution();
+};
+
+// Put a new sensor on the bus on this pin, at most 8 to a pin. It starts
+// powered up at 12 bits, reading 85 C until its first conversion.
+HostDS18B20* hostAddDS18B20(uint8_t pin, float celsius);
+int hostDS18B20Count(uint8_t pin);
+HostDS18B20* hostDS18B20(uint8_t pin, int index);
+// Data line stuck low: no presence pulse, everything reads 0
+void hostShortBus(uint8_t pin, bool shorted);
+
+#endif
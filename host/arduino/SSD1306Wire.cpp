@@ -0,0 +1,114 @@
+#include "SSD1306Wire.h"
+#include "HostInternal.h"
+
+static const uint16_t WIDTH = 128;
+static const uint16_t HEIGHT = 64;
+
+const uint8_t ArialMT_Plain_10[] = {10, 13};
+const uint8_t ArialMT_Plain_16[] = {16, 19};
+const uint8_t ArialMT_Plain_24[] = {24, 28};
+
+static uint32_t frames;
+static uint32_t draws;
+static bool on;
+// Fixed buffers so the display's never on the firmware's heap
+static char drawing[1024];
+static char shown[1024];
+
+static void drawText(const char* text){
+    draws++;
+    size_t used = strlen(drawing);
+    snprintf(drawing + used, sizeof(drawing) - used, "%s\n", text);
+}
+
+SSD1306Wire::SSD1306Wire(uint8_t address, int sda, int scl){
+}
+
+bool SSD1306Wire::init(){
+    on = true;
+    return true;
+}
+
+void SSD1306Wire::clear(){
+    drawing[0] = '\0';
+}
+
+void SSD1306Wire::display(){
+    frames++;
+    memcpy(shown, drawing, sizeof(shown));
+}
+
+void SSD1306Wire::displayOn(){
+    on = true;
+}
+
+void SSD1306Wire::displayOff(){
+    on = false;
+}
+
+void SSD1306Wire::flipScreenVertically(){
+}
+
+void SSD1306Wire::setFont(const uint8_t* fontData){
+}
+
+void SSD1306Wire::setTextAlignment(OLEDDISPLAY_TEXT_ALIGNMENT alignment){
+}
+
+void SSD1306Wire::setContrast(uint8_t contrast){
+}
+
+void SSD1306Wire::setColor(OLEDDISPLAY_COLOR color){
+}
+
+void SSD1306Wire::drawString(int16_t x, int16_t y, const char* text){
+    drawText(text);
+}
+
+void SSD1306Wire::drawStringMaxWidth(int16_t x, int16_t y, uint16_t maxLineWidth, const char* text){
+    drawText(text);
+}
+
+void SSD1306Wire::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1){
+    draws++;
+}
+
+void SSD1306Wire::drawHorizontalLine(int16_t x, int16_t y, int16_t length){
+    draws++;
+}
+
+void SSD1306Wire::fillRect(int16_t x, int16_t y, int16_t width, int16_t height){
+    draws++;
+}
+
+uint16_t SSD1306Wire::getWidth(){
+    return WIDTH;
+}
+
+uint16_t SSD1306Wire::getHeight(){
+    return HEIGHT;
+}
+
+uint32_t hostDisplayFrames(){
+    return frames;
+}
+
+uint32_t hostDisplayDraws(){
+    return draws;
+}
+
+bool hostDisplayOn(){
+    return on;
+}
+
+const char* hostDisplayText(){
+    return shown;
+}
+
+void hostResetDisplay(){
+    frames = 0;
+    draws = 0;
+    on = false;
+    drawing[0] = '\0';
+    shown[0] = '\0';
+}
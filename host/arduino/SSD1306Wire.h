@@ -0,0 +1,59 @@
+#ifndef SSD1306Wire_H
+#define SSD1306Wire_H
+
+#include "Arduino.h"
+
+// The OLED. Nothing's rendered, but what's drawn is kept as text so a test
+// can see what would be on the screen, along with counts of frames and
+// draws for the bench.
+
+enum OLEDDISPLAY_COLOR {
+    BLACK = 0,
+    WHITE = 1,
+    INVERSE = 2,
+};
+
+enum OLEDDISPLAY_TEXT_ALIGNMENT {
+    TEXT_ALIGN_LEFT = 0,
+    TEXT_ALIGN_RIGHT = 1,
+    TEXT_ALIGN_CENTER = 2,
+    TEXT_ALIGN_CENTER_BOTH = 3,
+};
+
+// The library's fonts, just their heights here
+extern const uint8_t ArialMT_Plain_10[];
+extern const uint8_t ArialMT_Plain_16[];
+extern const uint8_t ArialMT_Plain_24[];
+
+class SSD1306Wire {
+    public:
+        SSD1306Wire(uint8_t address, int sda, int scl);
+        bool init();
+        void clear();
+        void display();
+        void displayOn();
+        void displayOff();
+        void flipScreenVertically();
+        void setFont(const uint8_t* fontData);
+        void setTextAlignment(OLEDDISPLAY_TEXT_ALIGNMENT alignment);
+        void setContrast(uint8_t contrast);
+        void setColor(OLEDDISPLAY_COLOR color);
+        void drawString(int16_t x, int16_t y, const char* text);
+        void drawStringMaxWidth(int16_t x, int16_t y, uint16_t maxLineWidth, const char* text);
+        void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+        void drawHorizontalLine(int16_t x, int16_t y, int16_t length);
+        void fillRect(int16_t x, int16_t y, int16_t width, int16_t height);
+        uint16_t getWidth();
+        uint16_t getHeight();
+};
+
+// Host side
+// display() calls, and drawing calls of any kind, since boot
+uint32_t hostDisplayFrames();
+uint32_t hostDisplayDraws();
+bool hostDisplayOn();
+// Every string drawn, one per line, from the last clear() up to the last
+// display(), roughly what's on screen
+const char* hostDisplayText();
+
+#endif
@@ -0,0 +1,236 @@
+#include "WiFiClient.h"
+#include "HostInternal.h"
+
+// lwIP's TCP_SND_BUF, two full size segments. A peer that's stopped reading
+// is taken to have a full window already, so that's all write() can hand over.
+const size_t hostSocketBuffer = 2 * 1460;
+// The core's default write timeout (milli * seconds)
+const unsigned long hostWriteTimeoutMillis = 1000 * 5;
+
+// Sockets are the stand-in's, not the firmware's, so they aren't counted as
+// its allocations. The last handle on either end frees it.
+HostSocket* hostNewSocket(uint16_t port){
+    HostUncounted uncounted;
+    HostSocket* socket = new HostSocket();
+    socket->refs = 0;
+    socket->readOffset = 0;
+    socket->writes = 0;
+    socket->deviceClosed = false;
+    socket->peerClosed = false;
+    socket->writesFail = false;
+    socket->peerStalled = false;
+    socket->unread = 0;
+    socket->writeTimeoutMillis = hostWriteTimeoutMillis;
+    socket->port = port;
+    socket->serve = NULL;
+    socket->served = 0;
+    socket->respondMillis = 0;
+    socket->responding = false;
+    return socket;
+}
+
+void hostRetain(HostSocket* socket){
+    if (socket) socket->refs++;
+}
+
+void hostRelease(HostSocket* socket){
+    if (!socket || --socket->refs > 0) return;
+    HostUncounted uncounted;
+    delete socket;
+}
+
+// Let the server at the other end catch up before the firmware looks
+static void serve(HostSocket* socket){
+    if (socket && socket->serve && !socket->deviceClosed) socket->serve(*socket);
+}
+
+WiFiClient::WiFiClient(){
+    _socket = NULL;
+}
+
+WiFiClient::WiFiClient(HostSocket* socket){
+    _socket = NULL;
+    attach(socket);
+}
+
+WiFiClient::WiFiClient(const WiFiClient& other) : Print(other){
+    _socket = NULL;
+    attach(other._socket);
+}
+
+WiFiClient& WiFiClient::operator=(const WiFiClient& other){
+    attach(other._socket);
+    return *this;
+}
+
+WiFiClient::~WiFiClient(){
+    hostRelease(_socket);
+}
+
+void WiFiClient::attach(HostSocket* socket){
+    hostRetain(socket);
+    hostRelease(_socket);
+    _socket = socket;
+}
+
+// Plain outgoing connections aren't used by the sketch, there's nothing to connect to
+int WiFiClient::connect(const char* host, uint16_t port){
+    return 0;
+}
+
+// Open, or closed but with data still to read, same as the core
+uint8_t WiFiClient::connected(){
+    if (!_socket || _socket->deviceClosed) return 0;
+    serve(_socket);
+    if (!_socket->peerClosed && hostWiFiUp()) return 1;
+    return available() > 0;
+}
+
+int WiFiClient::available(){
+    if (!_socket || _socket->deviceClosed) return 0;
+    serve(_socket);
+    return _socket->toDevice.size() - _socket->readOffset;
+}
+
+int WiFiClient::read(){
+    if (available() <= 0) return -1;
+    return (uint8_t)_socket->toDevice[_socket->readOffset++];
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size){
+    int count = min((size_t)available(), size);
+    if (count <= 0) return 0;
+    memcpy(buffer, _socket->toDevice.data() + _socket->readOffset, count);
+    _socket->readOffset += count;
+    return count;
+}
+
+int WiFiClient::peek(){
+    if (available() <= 0) return -1;
+    return (uint8_t)_socket->toDevice[_socket->readOffset];
+}
+
+size_t WiFiClient::write(uint8_t c){
+    return write(&c, 1);
+}
+
+// What write() can take without waiting on the peer
+size_t WiFiClient::availableForWrite(){
+    if (!_socket || _socket->deviceClosed || _socket->peerClosed || _socket->writesFail || !hostWiFiUp()) return 0;
+    return hostSocketBuffer - min(_socket->unread, hostSocketBuffer);
+}
+
+// More than the socket can take from a peer that isn't reading blocks for
+// the whole timeout and then comes back short, as on the device
+size_t WiFiClient::write(const uint8_t* data, size_t length){
+    if (!_socket || _socket->deviceClosed || _socket->peerClosed || _socket->writesFail || !hostWiFiUp()) return 0;
+    if (_socket->peerStalled){
+        size_t room = availableForWrite();
+        if (length > room){
+            hostAdvanceMillis(_socket->writeTimeoutMillis);
+            length = room;
+        }
+        _socket->unread += length;
+        if (length == 0) return 0;
+    }
+    HostUncounted uncounted;
+    _socket->fromDevice.append((const char*)data, length);
+    _socket->writes++;
+    return length;
+}
+
+size_t WiFiClient::write_P(PGM_P data, size_t length){
+    return write((const uint8_t*)data, length);
+}
+
+void WiFiClient::stop(){
+    if (_socket) _socket->deviceClosed = true;
+}
+
+void WiFiClient::setTimeout(unsigned long timeoutMillis){
+    if (_socket) _socket->writeTimeoutMillis = timeoutMillis;
+}
+
+void WiFiClient::setNoDelay(bool noDelay){
+}
+
+WiFiClient::operator bool(){
+    return connected();
+}
+
+HostPeer::HostPeer(){
+    _socket = NULL;
+}
+
+HostPeer::HostPeer(HostSocket* socket){
+    _socket = socket;
+    hostRetain(socket);
+}
+
+HostPeer::HostPeer(const HostPeer& other){
+    _socket = other._socket;
+    hostRetain(_socket);
+}
+
+HostPeer& HostPeer::operator=(const HostPeer& other){
+    hostRetain(other._socket);
+    hostRelease(_socket);
+    _socket = other._socket;
+    return *this;
+}
+
+HostPeer::~HostPeer(){
+    hostRelease(_socket);
+}
+
+bool HostPeer::valid(){
+    return _socket != NULL;
+}
+
+void HostPeer::send(const char* text){
+    send((const uint8_t*)text, strlen(text));
+}
+
+void HostPeer::send(const uint8_t* data, size_t length){
+    if (!_socket || _socket->peerClosed) return;
+    HostUncounted uncounted;
+    _socket->toDevice.append((const char*)data, length);
+}
+
+const char* HostPeer::received(){
+    return _socket ? _socket->fromDevice.c_str() : "";
+}
+
+size_t HostPeer::receivedLength(){
+    return _socket ? _socket->fromDevice.size() : 0;
+}
+
+size_t HostPeer::receivedWrites(){
+    return _socket ? _socket->writes : 0;
+}
+
+void HostPeer::stopReading(){
+    if (_socket) _socket->peerStalled = true;
+}
+
+// Takes in everything it left unread
+void HostPeer::resumeReading(){
+    if (!_socket) return;
+    _socket->peerStalled = false;
+    _socket->unread = 0;
+}
+
+void HostPeer::close(){
+    if (_socket) _socket->peerClosed = true;
+}
+
+bool HostPeer::closedByDevice(){
+    return !_socket || _socket->deviceClosed;
+}
+
+HostPeer hostConnect(uint16_t port){
+    if (!hostWiFiUp() || !hostListening(port)) return HostPeer();
+    HostSocket* socket = hostNewSocket(port);
+    hostQueueConnection(socket);
+    return HostPeer(socket);
+}
@@ -0,0 +1,80 @@
+#ifndef WiFiClient_H
+#define WiFiClient_H
+
+#include "Arduino.h"
+
+// One TCP connection, shared by the firmware's WiFiClient handles and the
+// HostPeer at the other end. See WiFiClient.cpp.
+struct HostSocket;
+
+// A TCP connection from the firmware's side. Copies are handles on the same
+// connection, like the core's.
+class WiFiClient : public Print {
+    public:
+        WiFiClient();
+        WiFiClient(const WiFiClient& other);
+        WiFiClient& operator=(const WiFiClient& other);
+        virtual ~WiFiClient();
+
+        virtual int connect(const char* host, uint16_t port);
+        uint8_t connected();
+        int available();
+        int read();
+        int read(uint8_t* buffer, size_t size);
+        int peek();
+        size_t write(uint8_t c);
+        size_t write(const uint8_t* data, size_t length);
+        size_t write_P(PGM_P data, size_t length);
+        size_t availableForWrite();
+        using Print::write;
+        void stop();
+        void setTimeout(unsigned long timeoutMillis);
+        void setNoDelay(bool noDelay);
+        operator bool();
+
+        // Host side, for WiFiServer handing over a connection
+        explicit WiFiClient(HostSocket* socket);
+
+    protected:
+        void attach(HostSocket* socket);
+
+        HostSocket* _socket;
+};
+
+// Host side: the other end of a connection, what a browser (or the server
+// the firmware connected to) sees
+class HostPeer {
+    public:
+        HostPeer();
+        explicit HostPeer(HostSocket* socket);
+        HostPeer(const HostPeer& other);
+        HostPeer& operator=(const HostPeer& other);
+        ~HostPeer();
+
+        // Connected at all (hostConnect() can fail)
+        bool valid();
+        void send(const char* text);
+        void send(const uint8_t* data, size_t length);
+        // Everything the firmware has written so far
+        const char* received();
+        size_t receivedLength();
+        // How many write()s that took
+        size_t receivedWrites();
+        // Stop taking in what the firmware sends, so once the socket's
+        // buffer is full its write()s block, and pick up again
+        void stopReading();
+        void resumeReading();
+        // Hang up from this end
+        void close();
+        // The firmware has called stop()
+        bool closedByDevice();
+
+    private:
+        HostSocket* _socket;
+};
+
+// Open a connection to a WiFiServer listening on the device, as a browser
+// would. Not valid() if WiFi isn't up or nothing's listening on the port.
+HostPeer hostConnect(uint16_t port);
+
+#endif
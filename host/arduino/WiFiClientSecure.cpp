@@ -0,0 +1,134 @@
+#include "WiFiClientSecure.h"
+#include "HostInternal.h"
+#include <string>
+#include <vector>
+
+// Keep the text of at most this many requests, the count goes on past it
+static const size_t MAX_KEPT_REQUESTS = 4096;
+static const int MAX_OPEN = 8;
+
+// Like IFTTT: a long handshake, and a few hundred ms to answer a post
+HostHttpsServer hostHttpsServer = {true, true, 1200, 300, 200, true};
+
+static std::vector<std::string>* requests;
+static std::vector<unsigned long>* requestMillis;
+static int requestCount;
+static HostSocket* open[MAX_OPEN];
+
+static void record(const std::string& request){
+    HostUncounted uncounted;
+    if (!requests){
+        requests = new std::vector<std::string>();
+        requestMillis = new std::vector<unsigned long>();
+    }
+    if (requests->size() < MAX_KEPT_REQUESTS){
+        requests->push_back(request);
+        requestMillis->push_back(millis());
+    }
+    requestCount++;
+}
+
+static void answer(HostSocket& socket){
+    HostUncounted uncounted;
+    static const char body[] = "Congratulations! You've fired the event";
+    char head[128];
+    snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+        hostHttpsServer.status, hostHttpsServer.status == 200 ? "OK" : "Error",
+        (unsigned int)strlen(body), hostHttpsServer.keepAlive ? "keep-alive" : "close");
+    socket.toDevice.append(head);
+    socket.toDevice.append(body);
+    if (!hostHttpsServer.keepAlive) socket.peerClosed = true;
+}
+
+// Take each complete request (headers plus Content-length bytes of body) off
+// what the firmware's written, and answer it responseMillis later
+static void serveHttps(HostSocket& socket){
+    HostUncounted uncounted;
+    while (!socket.peerClosed && !socket.writesFail){
+        if (!hostHttpsServer.up){
+            socket.peerClosed = true;
+            return;
+        }
+        if (socket.responding){
+            if (millis() < socket.respondMillis) return;
+            socket.responding = false;
+            answer(socket);
+            continue;
+        }
+
+        size_t end = socket.fromDevice.find("\r\n\r\n", socket.served);
+        if (end == std::string::npos) return;
+        long length = 0;
+        for (size_t line = socket.served; line < end; line = socket.fromDevice.find("\r\n", line) + 2){
+            if (strncasecmp(socket.fromDevice.c_str() + line, "Content-length:", 15) == 0){
+                length = atol(socket.fromDevice.c_str() + line + 15);
+            }
+        }
+        size_t total = end + 4 + length;
+        if (socket.fromDevice.size() < total) return;
+
+        record(socket.fromDevice.substr(socket.served, total - socket.served));
+        socket.served = total;
+        socket.responding = true;
+        socket.respondMillis = millis() + hostHttpsServer.responseMillis;
+    }
+}
+
+// Remember the connection so hostHttpsDropConnections() can find it, letting
+// go of ones the firmware's finished with
+static void track(HostSocket* socket){
+    for (int i = 0; i < MAX_OPEN; i++){
+        if (open[i] && open[i]->deviceClosed){
+            hostRelease(open[i]);
+            open[i] = NULL;
+        }
+    }
+    for (int i = 0; i < MAX_OPEN; i++){
+        if (!open[i]){
+            hostRetain(socket);
+            open[i] = socket;
+            return;
+        }
+    }
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port){
+    attach(NULL);
+    if (!hostWiFiUp()) return 0;
+    hostAdvanceMillis(hostHttpsServer.handshakeMillis);
+    if (!hostHttpsServer.up || !hostWiFiUp()) return 0;
+
+    HostSocket* socket = hostNewSocket(port);
+    socket->serve = serveHttps;
+    attach(socket);
+    track(socket);
+    return 1;
+}
+
+bool WiFiClientSecure::verify(const char* fingerprint, const char* host){
+    return connected() && hostHttpsServer.fingerprintMatches;
+}
+
+int hostHttpsRequestCount(){
+    return requestCount;
+}
+
+const char* hostHttpsRequest(int index){
+    if (!requests || index < 0 || index >= (int)requests->size()) return "";
+    return (*requests)[index].c_str();
+}
+
+unsigned long hostHttpsRequestMillis(int index){
+    if (!requestMillis || index < 0 || index >= (int)requestMillis->size()) return 0;
+    return (*requestMillis)[index];
+}
+
+void hostHttpsDropConnections(bool noticed){
+    for (int i = 0; i < MAX_OPEN; i++){
+        if (!open[i]) continue;
+        if (noticed) open[i]->peerClosed = true;
+        else open[i]->writesFail = true;
+        hostRelease(open[i]);
+        open[i] = NULL;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef WiFiClientSecure_H
+#define WiFiClientSecure_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+// The TLS client, connected to the one HTTPS server there is
+// (hostHttpsServer), which stands in for IFTTT's webhooks: it answers each
+// complete request it's sent after responseMillis.
+class WiFiClientSecure : public WiFiClient {
+    public:
+        // DNS and the handshake block, the virtual clock moves on by
+        // handshakeMillis before this returns
+        int connect(const char* host, uint16_t port);
+        bool verify(const char* fingerprint, const char* host);
+};
+
+struct HostHttpsServer {
+    bool up;
+    bool fingerprintMatches;
+    unsigned long handshakeMillis;
+    unsigned long responseMillis;
+    // Status code for the next answers, e.g. 500 to have the posts fail
+    int status;
+    // Answer with "Connection: keep-alive", or close after each one
+    bool keepAlive;
+};
+extern HostHttpsServer hostHttpsServer;
+
+// Every request the server's had since the last reset: its full text, and
+// the virtual millis() it arrived at
+int hostHttpsRequestCount();
+const char* hostHttpsRequest(int index);
+unsigned long hostHttpsRequestMillis(int index);
+// The server drops any open connections. Noticed: the firmware sees them
+// closed. Not noticed: they look open, but the next write fails, the way a
+// kept-alive connection dies while it's idle.
+void hostHttpsDropConnections(bool noticed);
+
+#endif
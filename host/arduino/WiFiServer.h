@@ -0,0 +1,23 @@
+#ifndef WiFiServer_H
+#define WiFiServer_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+// Listens on a port for hostConnect()
+class WiFiServer {
+    public:
+        WiFiServer(uint16_t port);
+        ~WiFiServer();
+        void begin();
+        void stop();
+        // The next connection waiting to be taken, or one that's false if none
+        WiFiClient available();
+        void setNoDelay(bool noDelay);
+
+    private:
+        uint16_t _port;
+        bool _listening;
+};
+
+#endif
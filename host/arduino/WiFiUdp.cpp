@@ -0,0 +1,162 @@
+#include "WiFiUdp.h"
+#include "HostInternal.h"
+#include <deque>
+#include <vector>
+
+// Keep at most this many sent datagrams, the count goes on past it
+static const size_t MAX_KEPT_SENT = 4096;
+// Per socket receive queue, anything past it is dropped like the stack would
+static const size_t MAX_QUEUED = 16;
+
+struct Binding {
+    WiFiUDP* udp;
+    uint16_t port;
+    std::deque<HostDatagram> queue;
+};
+
+static std::vector<Binding>* bindings;
+static std::vector<HostDatagram>* sent;
+static int sentCount;
+static void (*responder)(const HostDatagram& datagram);
+
+static Binding* binding(uint16_t port){
+    if (!bindings) return NULL;
+    for (size_t i = 0; i < bindings->size(); i++){
+        if ((*bindings)[i].port == port) return &(*bindings)[i];
+    }
+    return NULL;
+}
+
+// The stand-in's buffers are its own, none of this is counted
+WiFiUDP::WiFiUDP(){
+    _port = 0;
+    _out = NULL;
+    _in = NULL;
+    _readOffset = 0;
+}
+
+WiFiUDP::~WiFiUDP(){
+    stop();
+    HostUncounted uncounted;
+    delete _out;
+    delete _in;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port){
+    stop();
+    if (!hostWiFiUp() || binding(port)) return 0;
+    HostUncounted uncounted;
+    if (!bindings) bindings = new std::vector<Binding>();
+    Binding b;
+    b.udp = this;
+    b.port = port;
+    bindings->push_back(b);
+    _port = port;
+    return 1;
+}
+
+void WiFiUDP::stop(){
+    if (!_port || !bindings) return;
+    HostUncounted uncounted;
+    for (size_t i = 0; i < bindings->size(); i++){
+        if ((*bindings)[i].udp == this){
+            bindings->erase(bindings->begin() + i);
+            break;
+        }
+    }
+    _port = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port){
+    HostUncounted uncounted;
+    if (!_out) _out = new HostDatagram();
+    _out->ip = ip;
+    _out->port = port;
+    _out->data.clear();
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t* data, size_t length){
+    if (!_out) return 0;
+    HostUncounted uncounted;
+    _out->data.append((const char*)data, length);
+    return length;
+}
+
+int WiFiUDP::endPacket(){
+    if (!_out || !hostWiFiUp()) return 0;
+    {
+        HostUncounted uncounted;
+        if (!sent) sent = new std::vector<HostDatagram>();
+        if (sent->size() < MAX_KEPT_SENT) sent->push_back(*_out);
+        sentCount++;
+    }
+    if (responder) responder(*_out);
+    return 1;
+}
+
+int WiFiUDP::parsePacket(){
+    HostUncounted uncounted;
+    Binding* b = binding(_port);
+    if (!_port || !b || b->queue.empty()) return 0;
+    if (!_in) _in = new HostDatagram();
+    *_in = b->queue.front();
+    b->queue.pop_front();
+    _readOffset = 0;
+    return _in->data.size();
+}
+
+int WiFiUDP::available(){
+    return _in ? _in->data.size() - _readOffset : 0;
+}
+
+int WiFiUDP::read(){
+    if (available() <= 0) return -1;
+    return (uint8_t)_in->data[_readOffset++];
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t length){
+    int count = min((size_t)available(), length);
+    if (count <= 0) return 0;
+    memcpy(buffer, _in->data.data() + _readOffset, count);
+    _readOffset += count;
+    return count;
+}
+
+IPAddress WiFiUDP::remoteIP(){
+    return _in ? _in->ip : IPAddress();
+}
+
+uint16_t WiFiUDP::remotePort(){
+    return _in ? _in->port : 0;
+}
+
+int hostUdpSentCount(){
+    return sentCount;
+}
+
+const HostDatagram& hostUdpSent(int index){
+    static const HostDatagram none = HostDatagram();
+    if (!sent || index < 0 || index >= (int)sent->size()) return none;
+    return (*sent)[index];
+}
+
+void hostUdpDeliver(uint16_t port, IPAddress from, uint16_t fromPort, const uint8_t* data, size_t length){
+    Binding* b = binding(port);
+    if (!b || b->queue.size() >= MAX_QUEUED || !hostWiFiUp()) return;
+    HostUncounted uncounted;
+    HostDatagram datagram;
+    datagram.ip = from;
+    datagram.port = fromPort;
+    datagram.data.assign((const char*)data, length);
+    b->queue.push_back(datagram);
+}
+
+void hostUdpSetResponder(void (*r)(const HostDatagram& datagram)){
+    responder = r;
+}
+
+void hostResetUdp(){
+    HostUncounted uncounted;
+    if (bindings) bindings->clear();
+}
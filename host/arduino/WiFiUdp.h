@@ -0,0 +1,48 @@
+#ifndef WiFiUdp_H
+#define WiFiUdp_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include <string>
+
+// One datagram, on its way out of the firmware or into it
+struct HostDatagram {
+    IPAddress ip;
+    uint16_t port;
+    std::string data;
+};
+
+// Datagrams go out only while WiFi's up. What comes in is whatever a test
+// or the bench hands to hostUdpDeliver(), or its responder sends back.
+class WiFiUDP {
+    public:
+        WiFiUDP();
+        ~WiFiUDP();
+        uint8_t begin(uint16_t port);
+        void stop();
+        int beginPacket(IPAddress ip, uint16_t port);
+        size_t write(const uint8_t* data, size_t length);
+        int endPacket();
+        int parsePacket();
+        int available();
+        int read();
+        int read(uint8_t* buffer, size_t length);
+        IPAddress remoteIP();
+        uint16_t remotePort();
+
+    private:
+        uint16_t _port;
+        HostDatagram* _out;
+        HostDatagram* _in;
+        size_t _readOffset;
+};
+
+// Host side
+int hostUdpSentCount();
+const HostDatagram& hostUdpSent(int index);
+// Queue a datagram for the socket bound to port, dropped if there isn't one
+void hostUdpDeliver(uint16_t port, IPAddress from, uint16_t fromPort, const uint8_t* data, size_t length);
+// Called for every datagram the firmware sends, e.g. to ack it with hostUdpDeliver()
+void hostUdpSetResponder(void (*responder)(const HostDatagram& datagram));
+
+#endif
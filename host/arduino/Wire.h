@@ -0,0 +1,13 @@
+#ifndef Wire_H
+#define Wire_H
+
+#include "Arduino.h"
+
+// Only the display talks I2C, and SSD1306Wire doesn't need it here
+class TwoWire {
+    public:
+        void begin(int sda, int scl){}
+};
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef coredecls_H
+#define coredecls_H
+
+#include "Arduino.h"
+#include <functional>
+
+typedef std::function<void()> TrivialCB;
+
+// Called each time SNTP sets the clock
+void settimeofday_cb(const TrivialCB& cb);
+
+#endif
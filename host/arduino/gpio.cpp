@@ -0,0 +1,20 @@
+#include "gpio.h"
+#include "Wire.h"
+
+TwoWire Wire;
+
+// Sets the pin's interrupt type to the level and marks it as a wakeup source
+void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE state){
+    if (state != GPIO_PIN_INTR_LOLEVEL && state != GPIO_PIN_INTR_HILEVEL) return;
+    GPC(pin) = (GPC(pin) & ~(0xF << GPCI)) | (state << GPCI) | (1 << GPCWE);
+}
+
+// Like the SDK, this turns the interrupt off altogether on any pin that's
+// still marked as a wakeup source, it's up to the caller to put it back
+void gpio_pin_wakeup_disable(){
+    for (int pin = 0; pin < 16; pin++){
+        if (GPC(pin) & (1 << GPCWE)){
+            GPC(pin) &= ~((0xF << GPCI) | (1 << GPCWE));
+        }
+    }
+}
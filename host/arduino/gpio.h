@@ -0,0 +1,25 @@
+#ifndef gpio_H
+#define gpio_H
+
+#include "Arduino.h"
+
+// The SDK's GPIO wakeup calls, working on the same GPC registers as
+// attachInterrupt()
+
+typedef enum {
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_POSEDGE = 1,
+    GPIO_PIN_INTR_NEGEDGE = 2,
+    GPIO_PIN_INTR_ANYEDGE = 3,
+    GPIO_PIN_INTR_LOLEVEL = 4,
+    GPIO_PIN_INTR_HILEVEL = 5,
+} GPIO_INT_TYPE;
+
+#define GPIO_ID_PIN(n) (n)
+
+extern "C" {
+    void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE state);
+    void gpio_pin_wakeup_disable();
+}
+
+#endif
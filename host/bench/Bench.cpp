@@ -0,0 +1,504 @@
+// Runs main.ino on the host build against scripted sensors and browsers and
+// reports what the device would care about: how long loop() takes, how
+// long after a fridge crosses the limit the alert goes out, and how much
+// the firmware allocates doing it.
+//
+//     make -C host bench
+//     make -C host bench ARGS="--minutes 30 --clients 8"
+//     make -C host bench ARGS="--trace samples.csv --sensor 1"
+//
+// Each scenario runs in its own process from a fresh boot. Loop times are
+// the host's own time for a pass (useful for comparing builds, not as
+// NodeMCU numbers) plus the virtual time it spent blocked in delay() or a
+// TLS handshake, which is what the device would spend too.
+//
+// After those, micro benchmarks of the modules on their own.
+//
+// --trace replays a telemetry_collector.py CSV (device,seq,time,sensor,
+// temp,health, temps in F) on the first sensor, from boot, and lists the
+// alerts it raised.
+
+#include "Sketch.h"
+#include <ESP8266WiFi.h>
+#include <WiFiClientSecure.h>
+#include <OneWire.h>
+#include "Temperature.h"
+#include "RingBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <signal.h>
+#include <string>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The sketch's two sensor buses (sensorBusPins), a fridge on each
+const uint8_t fridgePin = D1;
+const uint8_t otherPin = D6;
+// Where the fridges sit when they're working (F)
+const double fridgeF = 38.0;
+const double otherF = 40.0;
+// Where "Too cold" and "Cold soon" trip with the stock config (F)
+const double limitF = 35.0;
+// The alert scenario's fridge falls this fast once it starts to fail (F an
+// hour), and how long after it crosses the limit the run goes on (milli * seconds)
+const double failingFPerHour = 6.0;
+const unsigned long alertTailMillis = 1000 * 60 * 20;
+// How long a browser waits between requests, and gives up after (milli * seconds)
+const unsigned long thinkMillis = 200;
+const unsigned long requestTimeoutMillis = 1000 * 10;
+// Long runs step the clock further each pass, the sketch doesn't need a
+// 1 ms loop to catch a fridge warming up (micro * milli)
+const uint32_t traceStepMicros = 1000 * 10;
+// Times over for the micro benchmarks, the best round is the one reported
+const int conversionRounds = 20;
+// Pushes for each RingBuffer timing
+const size_t ringPushes = 1000 * 1000;
+
+struct Options {
+    int minutes;
+    int clients;
+    const char* trace;
+    int sensor;
+};
+
+static Options options = {10, 4, NULL, 0};
+
+double toCelsius(double f){
+    return (f - 32.0) * 5.0 / 9.0;
+}
+
+// Everything the bench keeps for itself is kept out of the firmware's heap numbers
+struct Samples {
+    std::vector<uint32_t> values;
+
+    void add(uint32_t value){
+        HostUncounted uncounted;
+        values.push_back(value);
+    }
+
+    uint32_t percentile(double p){
+        if (values.empty()) return 0;
+        HostUncounted uncounted;
+        std::vector<uint32_t> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        size_t at = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+        return sorted[at];
+    }
+
+    uint32_t max(){
+        return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    }
+};
+
+// Times each pass: the host's nanoseconds in loop() and the virtual
+// microseconds it blocked for beyond the pass's own step
+struct LoopStats {
+    Samples realNanos;
+    Samples blockedMicros;
+    uint32_t stepMicros;
+    uint64_t totalBlockedMicros;
+    HostHeapStats heapStart;
+    int64_t lowestFree;
+    unsigned long startMillis;
+
+    void start(){
+        totalBlockedMicros = 0;
+        heapStart = hostHeapStats();
+        lowestFree = ESP.getFreeHeap();
+        startMillis = millis();
+    }
+
+    void pass(){
+        unsigned long before = micros();
+        auto start = std::chrono::steady_clock::now();
+        sketchPass();
+        uint32_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        uint64_t blocked = micros() - before;
+        blocked = blocked > stepMicros ? blocked - stepMicros : 0;
+        realNanos.add(nanos);
+        if (blocked) blockedMicros.add(blocked);
+        totalBlockedMicros += blocked;
+        lowestFree = std::min(lowestFree, (int64_t)ESP.getFreeHeap());
+    }
+
+    void report(){
+        HostHeapStats heap = hostHeapStats();
+        size_t passes = realNanos.values.size();
+        unsigned long elapsed = millis() - startMillis;
+        printf("  loop     %zu passes over %.1f min\n", passes, elapsed / 60000.0);
+        printf("           host time p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            realNanos.percentile(0.50) / 1000.0, realNanos.percentile(0.99) / 1000.0, realNanos.max() / 1000.0);
+        printf("           blocked in %zu passes, max %.1f ms, %.2f%% of the time\n",
+            blockedMicros.values.size(), blockedMicros.max() / 1000.0, elapsed ? totalBlockedMicros / 10.0 / elapsed : 0.0);
+        uint64_t allocations = heap.allocations - heapStart.allocations;
+        printf("  heap     %llu allocations (%.2f a pass), %llu bytes, %lld live at the end\n",
+            (unsigned long long)allocations, passes ? (double)allocations / passes : 0.0,
+            (unsigned long long)(heap.bytes - heapStart.bytes), (long long)heap.liveBytes);
+        printf("           peak %lld bytes live, lowest free %lld\n", (long long)heap.peakLiveBytes, (long long)lowestFree);
+    }
+};
+
+static LoopStats stats;
+
+// The alerts the firmware has posted to IFTTT so far, as "message" and when it went
+struct Alert {
+    std::string message;
+    unsigned long millis;
+};
+
+std::vector<Alert> postedAlerts(){
+    HostUncounted uncounted;
+    std::vector<Alert> alerts;
+    for (int i = 0; i < hostHttpsRequestCount(); i++){
+        std::string request = hostHttpsRequest(i);
+        size_t start = request.find("\"value1\":\"(");
+        if (start == std::string::npos) continue;
+        start = request.find(") ", start);
+        size_t end = request.find("\\n\"", start);
+        if (start == std::string::npos || end == std::string::npos) continue;
+        Alert alert = {request.substr(start + 2, end - start - 2), hostHttpsRequestMillis(i)};
+        alerts.push_back(alert);
+    }
+    return alerts;
+}
+
+void boot(uint32_t stepMicros){
+    stats.stepMicros = stepMicros;
+    sketchSetStep(stepMicros);
+    sketchSetup();
+    // Past joining WiFi and the first readings, so they don't count
+    sketchRunFor(1000 * 10);
+    stats.start();
+}
+
+// Two sensors sitting still, the device doing nothing but reading them
+void benchSteady(){
+    hostAddDS18B20(fridgePin, toCelsius(fridgeF));
+    hostAddDS18B20(otherPin, toCelsius(otherF));
+    boot(1000);
+    unsigned long runMillis = 1000UL * 60 * options.minutes;
+    while (millis() - stats.startMillis < runMillis) stats.pass();
+    stats.report();
+}
+
+// Browsers hitting the pages a dashboard would, each one asking again a
+// little after its last answer
+void benchHttp(){
+    static const char* paths[] = {"/", "/api/v1/readings", "/metrics"};
+    struct Browser {
+        HostPeer peer;
+        unsigned long sentMillis;
+        unsigned long nextMillis;
+        int path;
+    };
+
+    hostAddDS18B20(fridgePin, toCelsius(fridgeF));
+    hostAddDS18B20(otherPin, toCelsius(otherF));
+    boot(1000);
+
+    std::vector<Browser> browsers;
+    {
+        HostUncounted uncounted;
+        browsers.resize(options.clients);
+    }
+    for (int i = 0; i < options.clients; i++){
+        browsers[i].nextMillis = millis() + i * 10;
+        browsers[i].path = i % 3;
+    }
+
+    Samples latency;
+    int answered[3] = {0, 0, 0};
+    int refused = 0;
+    int timedOut = 0;
+    char request[96];
+    unsigned long runMillis = 1000UL * 60 * options.minutes;
+    while (millis() - stats.startMillis < runMillis){
+        for (Browser& browser : browsers){
+            if (!browser.peer.valid()){
+                if ((long)(millis() - browser.nextMillis) < 0) continue;
+                browser.peer = hostConnect(80);
+                snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: thermo\r\n\r\n", paths[browser.path]);
+                browser.peer.send(request);
+                browser.sentMillis = millis();
+                continue;
+            }
+            bool done = browser.peer.closedByDevice();
+            if (!done && millis() - browser.sentMillis < requestTimeoutMillis) continue;
+            if (!done) timedOut++;
+            else if (strncmp(browser.peer.received(), "HTTP/1.1 200", 12) == 0){
+                answered[browser.path]++;
+                latency.add(millis() - browser.sentMillis);
+            }
+            else refused++;
+            browser.peer.close();
+            browser.peer = HostPeer();
+            browser.path = (browser.path + 1) % 3;
+            browser.nextMillis = millis() + thinkMillis;
+        }
+        stats.pass();
+    }
+
+    printf("  http     %d clients: %d pages, %d readings, %d metrics answered, %d refused, %d timed out\n",
+        options.clients, answered[0], answered[1], answered[2], refused, timedOut);
+    printf("           answered in p50 %u ms, p99 %u ms, max %u ms\n",
+        latency.percentile(0.50), latency.percentile(0.99), latency.max());
+    stats.report();
+}
+
+// A fridge that's been steady starts to fail and falls through the limit,
+// how long before (predicted) or after the crossing each alert goes out
+void benchAlert(){
+    HostDS18B20* fridge = hostAddDS18B20(fridgePin, toCelsius(fridgeF));
+    hostAddDS18B20(otherPin, toCelsius(otherF));
+    boot(1000);
+
+    // Settled for an hour first, so the history and trend are full of steady readings
+    unsigned long failMillis = millis() + 1000UL * 60 * 60;
+    unsigned long crossMillis = failMillis + (unsigned long)((fridgeF - limitF) / failingFPerHour * 3600 * 1000);
+    unsigned long endMillis = crossMillis + alertTailMillis;
+    while (millis() < endMillis){
+        double f = fridgeF;
+        if (millis() > failMillis) f -= failingFPerHour * (millis() - failMillis) / 3600000.0;
+        fridge->celsius = toCelsius(f);
+        stats.pass();
+    }
+
+    printf("  alert    fridge falling %.1f F/h from %.1f F, crosses %.2f F at %.1f min\n",
+        failingFPerHour, fridgeF, limitF, (crossMillis - stats.startMillis) / 60000.0);
+    std::vector<Alert> alerts = postedAlerts();
+    if (alerts.empty()) printf("           no alerts\n");
+    for (const Alert& alert : alerts){
+        long after = (long)alert.millis - (long)crossMillis;
+        printf("           %-36s %6.1f s %s the crossing\n", alert.message.c_str(), labs(after) / 1000.0, after < 0 ? "before" : "after");
+    }
+    stats.report();
+}
+
+struct TracePoint {
+    unsigned long millis;
+    double f;
+};
+
+// Same format tools/trend_bench.cpp reads: time is ISO or T+seconds,
+// unhealthy readings have no temp
+std::vector<TracePoint> loadTrace(const char* path, int sensor){
+    HostUncounted uncounted;
+    std::vector<TracePoint> trace;
+    FILE* file = fopen(path, "r");
+    if (!file){
+        perror(path);
+        exit(1);
+    }
+    char line[256];
+    long first = -1;
+    while (fgets(line, sizeof(line), file)){
+        char* fields[6];
+        int count = 0;
+        for (char* p = strtok(line, ",\n"); p && count < 6; p = strtok(NULL, ",\n")) fields[count++] = p;
+        if (count < 6 || atoi(fields[3]) != sensor) continue;
+
+        long seconds;
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (fields[2][0] == 'T') seconds = atol(fields[2] + 2);
+        else if (strptime(fields[2], "%Y-%m-%dT%H:%M:%S", &tm)) seconds = mktime(&tm);
+        else continue;
+        if (first < 0) first = seconds;
+
+        TracePoint point = {(unsigned long)(seconds - first) * 1000, atof(fields[4])};
+        trace.push_back(point);
+    }
+    fclose(file);
+    return trace;
+}
+
+// A recorded trace played on the first sensor, in real time from just after
+// boot, stepping the loop every 10 ms to keep days of trace quick
+void benchTrace(){
+    std::vector<TracePoint> trace = loadTrace(options.trace, options.sensor);
+    if (trace.empty()){
+        fprintf(stderr, "%s: no readings for sensor %d\n", options.trace, options.sensor);
+        exit(1);
+    }
+    HostDS18B20* sensor = hostAddDS18B20(fridgePin, toCelsius(trace[0].f));
+    boot(traceStepMicros);
+
+    size_t at = 0;
+    unsigned long endMillis = stats.startMillis + trace.back().millis;
+    while (millis() < endMillis){
+        while (at + 1 < trace.size() && stats.startMillis + trace[at + 1].millis <= millis()) at++;
+        sensor->celsius = toCelsius(trace[at].f);
+        stats.pass();
+    }
+
+    printf("  trace    %zu readings of sensor %d over %.1f h\n", trace.size(), options.sensor, trace.back().millis / 3600000.0);
+    std::vector<Alert> alerts = postedAlerts();
+    if (alerts.empty()) printf("           no alerts\n");
+    for (const Alert& alert : alerts){
+        printf("           %-36s at %.1f min\n", alert.message.c_str(), (alert.millis - stats.startMillis) / 60000.0);
+    }
+    stats.report();
+}
+
+// Decoding, checking and showing a reading the float way the sketch used to
+// (getTemp(), round() to a tenth, String(float)) against the integer
+// hundredths it uses now, over every reading a 12 bit sensor can give. The
+// host has an FPU and the ESP8266 doesn't, so on the device the float side
+// is far slower than this shows; it's here to keep the integer side honest.
+typedef int32_t (*ReadingFunction)(int16_t raw, char* buff);
+
+static int32_t floatConvert(int16_t raw, char* buff){
+    float celsius = (float)raw / 16.0;
+    return (celsius * 1.8 + 32.0) * 100;
+}
+
+static int32_t integerConvert(int16_t raw, char* buff){
+    return rawToCenti(raw);
+}
+
+static int32_t floatReading(int16_t raw, char* buff){
+    float celsius = (float)raw / 16.0;
+    float fahrenheit = celsius * 1.8 + 32.0;
+    float rounded = round(fahrenheit * 10) / 10.0;
+    snprintf(buff, TEMP_TEXT_SIZE, "%.1f", rounded);
+    return rounded < (float)limitF;
+}
+
+static int32_t integerReading(int16_t raw, char* buff){
+    int16_t centi = rawToCenti(raw);
+    formatTemperature(buff, centi, 1);
+    return centi < fromFahrenheit(limitF);
+}
+
+// Where the readings' results go, so the compiler can't skip working them out
+volatile int32_t readingSink;
+
+// Host nanoseconds a reading, the best of conversionRounds over every raw value
+static double timeReadings(ReadingFunction reading){
+    const int32_t lowest = -55 * 16;
+    const int32_t highest = 125 * 16;
+    double best = 0;
+    for (int round = 0; round < conversionRounds; round++){
+        char buff[TEMP_TEXT_SIZE];
+        int32_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int32_t raw = lowest; raw <= highest; raw++) sum += reading(raw, buff);
+        double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        readingSink = sum;
+        nanos /= highest - lowest + 1;
+        if (round == 0 || nanos < best) best = nanos;
+    }
+    return best;
+}
+
+void benchTemps(){
+    printf("  temps    host ns a reading      float  integer\n");
+    printf("           convert               %6.1f  %7.1f\n", timeReadings(floatConvert), timeReadings(integerConvert));
+    printf("           convert, check, show  %6.1f  %7.1f\n", timeReadings(floatReading), timeReadings(integerReading));
+}
+
+// Host nanoseconds an operation on a RingBuffer of each capacity: a push
+// alone, then a push followed by each query. min/max are timed twice, on
+// noisy readings, and on a falling fridge, where every push evicts the max
+// and the next max() has to rescan the whole buffer (its worst case).
+template <uint16_t CAPACITY>
+void benchRing(const std::vector<int16_t>& noisy){
+    RingBuffer<int16_t, CAPACITY> buffer;
+    const size_t pushes = ringPushes;
+    int32_t sum = 0;
+    auto time = [&](int query, bool falling){
+        buffer.clear();
+        for (uint16_t i = 0; i < CAPACITY; i++) buffer.push(noisy[i]);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < pushes; i++){
+            int16_t value = falling ? (int16_t)(4000 - (i & 0x3FFF) / 4) : noisy[i % noisy.size()];
+            buffer.push(value);
+            if (query == 1) sum += buffer.mean();
+            else if (query == 2) sum += buffer.min() + buffer.max();
+            else if (query == 3) sum += buffer.countBelow(3500, 10);
+        }
+        double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return nanos / pushes;
+    };
+    double push = time(0, false);
+    double mean = time(1, false);
+    double minMax = time(2, false);
+    double falling = time(2, true);
+    double below = time(3, false);
+    readingSink = sum;
+    printf("           %5u  %6.1f  %6.1f  %7.1f  %7.1f  %9.1f\n", CAPACITY, push, mean, minMax, falling, below);
+}
+
+void benchRingBuffer(){
+    std::vector<int16_t> noisy;
+    {
+        HostUncounted uncounted;
+        noisy.resize(4096);
+    }
+    // Around 38 F, give or take a degree
+    uint32_t seed = 1;
+    for (int16_t& value : noisy){
+        seed = seed * 1103515245 + 12345;
+        value = 3800 + (int16_t)((seed >> 16) % 200) - 100;
+    }
+    printf("  ring     host ns a push, then a push and a query\n");
+    printf("           capacity push    mean    min/max  falling  below(10)\n");
+    benchRing<10>(noisy);
+    benchRing<96>(noisy);
+    benchRing<256>(noisy);
+    benchRing<1024>(noisy);
+}
+
+void run(const char* name, void (*scenario)()){
+    printf("%s\n", name);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0){
+        perror("fork");
+        exit(2);
+    }
+    if (pid == 0){
+        hostReset(false);
+        hostSerialEcho(getenv("SERIAL") != NULL);
+        scenario();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        printf("  failed%s%s\n", WIFSIGNALED(status) ? ": " : "", WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "");
+    }
+    printf("\n");
+}
+
+void usage(){
+    fprintf(stderr, "usage: bench [--minutes N] [--clients N] [--trace samples.csv [--sensor N]]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv){
+    for (int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--minutes") == 0 && hasValue) options.minutes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--clients") == 0 && hasValue) options.clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0 && hasValue) options.trace = argv[++i];
+        else if (strcmp(argv[i], "--sensor") == 0 && hasValue) options.sensor = atoi(argv[++i]);
+        else usage();
+    }
+    if (options.minutes < 1 || options.clients < 1) usage();
+
+    if (options.trace){
+        run("trace", benchTrace);
+        return 0;
+    }
+    run("steady", benchSteady);
+    run("http", benchHttp);
+    run("alert", benchAlert);
+    run("temps", benchTemps);
+    run("ring", benchRingBuffer);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Turn the sketch into a C++ file the way the Arduino builder does.
+
+It adds #include <Arduino.h> at the top, and a prototype for every function
+just before the first function definition, so a function can be used above
+where it's defined. #line directives keep compiler errors pointing at the
+.ino file.
+
+    mkprototypes.py main.ino build/main.ino.cpp
+"""
+
+import os
+import re
+import sys
+
+SIGNATURE = re.compile(r'^([A-Za-z_][\w<>,\s\*&:]*?[\s\*&]+(\w+)\s*\([^;{}]*\))\s*\{')
+KEYWORDS = {'if', 'while', 'for', 'switch', 'return', 'else', 'do', 'catch'}
+
+
+def top_level_lines(lines):
+    """Yield (index, line) for lines that start outside any braces, skipping
+    braces in comments, strings and character literals."""
+    depth = 0
+    in_comment = False
+    for index, line in enumerate(lines):
+        if depth == 0 and not in_comment:
+            yield index, line
+        i = 0
+        while i < len(line):
+            c = line[i]
+            if in_comment:
+                if line.startswith('*/', i):
+                    in_comment = False
+                    i += 1
+            elif line.startswith('//', i):
+                break
+            elif line.startswith('/*', i):
+                in_comment = True
+                i += 1
+            elif c in '"\'':
+                i += 1
+                while i < len(line) and line[i] != c:
+                    i += 2 if line[i] == '\\' else 1
+            elif c == '{':
+                depth += 1
+            elif c == '}':
+                depth -= 1
+            i += 1
+
+
+def main():
+    source, output = sys.argv[1], sys.argv[2]
+    with open(source) as f:
+        lines = f.read().split('\n')
+
+    prototypes = []
+    first = None
+    for index, line in top_level_lines(lines):
+        match = SIGNATURE.match(line)
+        if not match or match.group(2) in KEYWORDS:
+            continue
+        if first is None:
+            first = index
+        prototypes.append(re.sub(r'\s+', ' ', match.group(1)).strip() + ';')
+
+    if first is None:
+        first = len(lines)
+    path = os.path.abspath(source)
+    out = ['#include <Arduino.h>', '#line 1 "%s"' % path]
+    out += lines[:first]
+    out += prototypes
+    out.append('#line %d "%s"' % (first + 1, path))
+    out += lines[first:]
+
+    os.makedirs(os.path.dirname(output) or '.', exist_ok=True)
+    with open(output, 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
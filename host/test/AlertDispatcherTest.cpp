@@ -0,0 +1,327 @@
+#include "Check.h"
+#include "AlertDispatcher.h"
+#include <ESP8266WiFi.h>
+
+static char fingerprint[] = "00 11 22 33 44 55 66 77 88 99 AA BB CC DD EE FF 00 11 22 33";
+
+static void joinWiFi(){
+    WiFi.begin("HostNet", "hostpass");
+    hostAdvanceMillis(1000 * 5);
+}
+
+// update() as loop() would call it, a millisecond apart. Also keeps the
+// longest any one call held things up.
+static unsigned long longestUpdateMillis;
+
+static void runDispatcher(AlertDispatcher& dispatcher, unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms){
+        unsigned long before = millis();
+        dispatcher.update();
+        longestUpdateMillis = max(longestUpdateMillis, millis() - before);
+        hostAdvanceMillis(1);
+    }
+}
+
+TEST(AlertDispatcherPostsAnAlert){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    CHECK(dispatcher.isIdle());
+    CHECK_EQUAL(0xFFFFFFFFul, dispatcher.millisUntilDue());
+
+    CHECK(dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "Sensor 1 = 34.50"));
+    CHECK_EQUAL(1, dispatcher.pending());
+    CHECK_EQUAL(0ul, dispatcher.millisUntilDue());
+    runDispatcher(dispatcher, 1000 * 3);
+
+    CHECK(dispatcher.isIdle());
+    CHECK_EQUAL(1ul, dispatcher.sent());
+    CHECK_EQUAL(0ul, dispatcher.failedAttempts());
+    CHECK_EQUAL(1, hostHttpsRequestCount());
+    const char* request = hostHttpsRequest(0);
+    CHECK_CONTAINS("POST /trigger/temp_alert/with/key/hostkey HTTP/1.1\r\nHost: maker.ifttt.com\r\n", request);
+    CHECK_CONTAINS("Connection: keep-alive\r\n", request);
+    // No clock yet, so it's stamped with the uptime
+    const char* body = strstr(request, "\r\n\r\n") + 4;
+    CHECK_STRING("{\"value1\":\"(T+5s) Too cold: Sensor 1\\n\",\"value2\":\"Sensor 1 = 34.50\"}", body);
+    char length[32];
+    snprintf(length, sizeof(length), "Content-length: %u\r\n", (unsigned)strlen(body));
+    CHECK_CONTAINS(length, request);
+}
+
+TEST(AlertDispatcherOnlyBlocksForTheHandshake){
+    joinWiFi();
+    hostHttpsServer.responseMillis = 1000;
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    runDispatcher(dispatcher, 1000 * 5);
+
+    // Waiting on the answer is spread over many passes, only connect() holds loop() up
+    CHECK_EQUAL(1ul, dispatcher.sent());
+    CHECK_EQUAL(hostHttpsServer.handshakeMillis, longestUpdateMillis);
+    CHECK_NEAR(1000, connection.lastLatencyMillis(), 10);
+}
+
+TEST(AlertDispatcherMergesAWaitingDuplicate){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "Sensor 1 = 34.50");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "Sensor 1 = 34.00");
+    CHECK_EQUAL(1, dispatcher.pending());
+    CHECK_CONTAINS("Merged with queued alert.", hostSerialOutput());
+    // Different message, its own entry
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+    CHECK_EQUAL(2, dispatcher.pending());
+
+    runDispatcher(dispatcher, 1000 * 5);
+    CHECK_EQUAL(2, hostHttpsRequestCount());
+    CHECK_CONTAINS("Sensor 1 = 34.00", hostHttpsRequest(0));
+    CHECK_CONTAINS("Too cold: Sensor 2", hostHttpsRequest(1));
+}
+
+TEST(AlertDispatcherBacksOffThenGivesUp){
+    joinWiFi();
+    hostHttpsServer.status = 500;
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    runDispatcher(dispatcher, 1000 * 60);
+
+    // Five tries, 2, 4, 8 then 16 s apart (plus the time each took)
+    CHECK_EQUAL(5, hostHttpsRequestCount());
+    for (int i = 1; i < 4; i++){
+        unsigned long gap = hostHttpsRequestMillis(i + 1) - hostHttpsRequestMillis(i);
+        unsigned long before = hostHttpsRequestMillis(i) - hostHttpsRequestMillis(i - 1);
+        CHECK(gap > before);
+    }
+    CHECK_EQUAL(5ul, dispatcher.failedAttempts());
+    CHECK_EQUAL(1ul, dispatcher.dropped());
+    CHECK_EQUAL(0ul, dispatcher.sent());
+    CHECK(dispatcher.isIdle());
+    CHECK_CONTAINS("Giving up on alert: Too cold: Sensor 1", hostSerialOutput());
+}
+
+TEST(AlertDispatcherRetriesUntilTheServerIsBack){
+    joinWiFi();
+    hostHttpsServer.up = false;
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    runDispatcher(dispatcher, 1000 * 5);
+    CHECK_EQUAL(2ul, dispatcher.failedAttempts());
+    CHECK(dispatcher.millisUntilDue() > 0);
+    CHECK_CONTAINS("Connection failed.", hostSerialOutput());
+
+    hostHttpsServer.up = true;
+    runDispatcher(dispatcher, 1000 * 10);
+    CHECK_EQUAL(1ul, dispatcher.sent());
+    CHECK_EQUAL(0ul, dispatcher.dropped());
+}
+
+TEST(AlertDispatcherDropsWhenTheQueueIsFull){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    char message[40];
+    for (int i = 0; i < 8; i++){
+        snprintf(message, sizeof(message), "Alert %d", i);
+        CHECK(dispatcher.enqueue("temp_alert", message, ""));
+    }
+    CHECK(!dispatcher.enqueue("temp_alert", "One too many", ""));
+    CHECK_EQUAL(1ul, dispatcher.dropped());
+    CHECK_EQUAL(8, dispatcher.pending());
+
+    // And they go out in order
+    runDispatcher(dispatcher, 1000 * 10);
+    CHECK_EQUAL(8, hostHttpsRequestCount());
+    CHECK_CONTAINS("Alert 0", hostHttpsRequest(0));
+    CHECK_CONTAINS("Alert 7", hostHttpsRequest(7));
+}
+
+TEST(AlertDispatcherFlushBeforeARestart){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Restarting", "");
+    dispatcher.flush(1000 * 10);
+    CHECK(dispatcher.isIdle());
+    CHECK_EQUAL(1ul, dispatcher.sent());
+}
+
+TEST(AlertDispatcherKeepsTheConnectionOpen){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+    runDispatcher(dispatcher, 1000 * 5);
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 3", "");
+    runDispatcher(dispatcher, 1000 * 5);
+
+    CHECK_EQUAL(3ul, dispatcher.sent());
+    CHECK_EQUAL(1ul, connection.handshakes());
+    CHECK_EQUAL(2ul, connection.reuses());
+    CHECK_EQUAL(3ul, connection.requests());
+    CHECK(connection.reusable());
+}
+
+TEST(AlertDispatcherReconnectsWhenTheServerCloses){
+    joinWiFi();
+    hostHttpsServer.keepAlive = false;
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+    runDispatcher(dispatcher, 1000 * 10);
+
+    CHECK_EQUAL(2ul, dispatcher.sent());
+    CHECK_EQUAL(2ul, connection.handshakes());
+    CHECK_EQUAL(0ul, connection.reuses());
+    CHECK(!connection.reusable());
+}
+
+TEST(AlertDispatcherStaleConnectionIsntAFailure){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    runDispatcher(dispatcher, 1000 * 3);
+
+    // Dropped at the server's end while idle, found out by the next write
+    hostHttpsDropConnections(false);
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+    runDispatcher(dispatcher, 1000 * 3);
+    CHECK_EQUAL(2ul, dispatcher.sent());
+    CHECK_EQUAL(0ul, dispatcher.failedAttempts());
+    CHECK_EQUAL(2ul, connection.handshakes());
+    CHECK_CONTAINS("Kept-alive connection went stale, reconnecting.", hostSerialOutput());
+
+    // And closed where we can see it, it isn't used again
+    hostHttpsDropConnections(true);
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 3", "");
+    runDispatcher(dispatcher, 1000 * 3);
+    CHECK_EQUAL(3ul, dispatcher.sent());
+    CHECK_EQUAL(0ul, dispatcher.failedAttempts());
+    CHECK_EQUAL(3ul, connection.handshakes());
+}
+
+TEST(AlertDispatcherClosesAnIdleConnection){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    runDispatcher(dispatcher, 1000 * 3);
+    CHECK(connection.reusable());
+
+    // Its TLS buffers are worth more than the next handshake after 30 s
+    runDispatcher(dispatcher, 1000 * 31);
+    CHECK(!connection.reusable());
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+    runDispatcher(dispatcher, 1000 * 3);
+    CHECK_EQUAL(2ul, connection.handshakes());
+}
+
+TEST(AlertDispatcherTimesEachRequest){
+    joinWiFi();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    hostHttpsServer.responseMillis = 300;
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    runDispatcher(dispatcher, 1000 * 3);
+    hostHttpsServer.responseMillis = 700;
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+    runDispatcher(dispatcher, 1000 * 3);
+
+    CHECK_NEAR(700, connection.lastLatencyMillis(), 10);
+    CHECK_NEAR(700, connection.maxLatencyMillis(), 10);
+    CHECK_NEAR(500, connection.averageLatencyMillis(), 10);
+    CHECK_NEAR(1000, connection.totalLatencyMillis(), 20);
+}
+
+TEST(AlertDispatcherStoresAlertsWhileOffline){
+    joinWiFi();
+    WiFi.setAutoReconnect(true);
+    hostAccessPoint.up = false;
+    {
+        FlashLog log("alerts", 4096, 0);
+        log.begin();
+        HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+        AlertDispatcher dispatcher(connection, "hostkey");
+        dispatcher.setStore(log);
+        dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+        dispatcher.enqueue("temp_alert", "Too cold: Sensor 2", "");
+        dispatcher.enqueue("temp_alert", "Too warm: Sensor 1", "");
+        runDispatcher(dispatcher, 1000 * 10);
+
+        // Nothing tried, nothing given up on, it's all in flash
+        CHECK_EQUAL(0, hostHttpsRequestCount());
+        CHECK_EQUAL(0ul, dispatcher.failedAttempts());
+        CHECK_EQUAL(0, dispatcher.pending());
+        CHECK_EQUAL(3u, log.appended());
+        CHECK_CONTAINS("Offline, 3 alert(s) stored for later.", hostSerialOutput());
+    }
+
+    // After a reset, and WiFi's back
+    hostAccessPoint.up = true;
+    FlashLog log("alerts", 4096, 0);
+    log.begin();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.setStore(log);
+    runDispatcher(dispatcher, 1000 * 20);
+
+    CHECK_EQUAL(3ul, dispatcher.sent());
+    CHECK_EQUAL(3, hostHttpsRequestCount());
+    CHECK_CONTAINS("Too cold: Sensor 1", hostHttpsRequest(0));
+    CHECK_CONTAINS("Too cold: Sensor 2", hostHttpsRequest(1));
+    CHECK_CONTAINS("Too warm: Sensor 1", hostHttpsRequest(2));
+    // Stamped with the uptime when they were stored, not when they went out
+    CHECK_CONTAINS("(T+5s) Too cold: Sensor 1", hostHttpsRequest(0));
+    CHECK(log.isEmpty());
+    CHECK(dispatcher.isIdle());
+}
+
+// What loop() sleeps on in low power mode
+TEST(AlertDispatcherSaysWhenItsNextDue){
+    joinWiFi();
+    hostHttpsServer.up = false;
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    while (dispatcher.failedAttempts() == 0) dispatcher.update();
+
+    // Waiting out the 2 s backoff
+    CHECK_NEAR(2000, dispatcher.millisUntilDue(), 10);
+    hostAdvanceMillis(500);
+    CHECK_NEAR(1500, dispatcher.millisUntilDue(), 10);
+    hostAdvanceMillis(1500);
+    CHECK_EQUAL(0ul, dispatcher.millisUntilDue());
+}
+
+TEST(AlertDispatcherIsDueWhenTheStoreNeedsIt){
+    joinWiFi();
+    WiFi.setAutoReconnect(true);
+    FlashLog log("alerts", 4096, 0);
+    log.begin();
+    HttpsConnection connection("maker.ifttt.com", 443, fingerprint);
+    AlertDispatcher dispatcher(connection, "hostkey");
+    dispatcher.setStore(log);
+
+    // Offline, the queue has to go to flash before we sleep
+    hostAccessPoint.up = false;
+    dispatcher.enqueue("temp_alert", "Too cold: Sensor 1", "");
+    CHECK_EQUAL(0ul, dispatcher.millisUntilDue());
+    dispatcher.update();
+    CHECK_EQUAL(0xFFFFFFFFul, dispatcher.millisUntilDue());
+
+    // Back online, there's something to replay
+    hostAccessPoint.up = true;
+    hostAdvanceMillis(1000 * 5);
+    CHECK_EQUAL(0ul, dispatcher.millisUntilDue());
+    runDispatcher(dispatcher, 1000 * 5);
+    CHECK_EQUAL(1ul, dispatcher.sent());
+    CHECK_EQUAL(0xFFFFFFFFul, dispatcher.millisUntilDue());
+}
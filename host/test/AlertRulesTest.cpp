@@ -0,0 +1,306 @@
+#include "Check.h"
+#include "AlertRules.h"
+
+struct Posted {
+    int rule;
+    int sensor;
+    AlertEvent event;
+    int16_t value;
+    unsigned long millis;
+};
+
+static const AlertRule* postedRules;
+static Posted posted[64];
+static int postedCount;
+
+static void record(const AlertRule& rule, int sensor, AlertEvent event, int16_t value){
+    if (postedCount == 64) return;
+    Posted& post = posted[postedCount++];
+    post.rule = &rule - postedRules;
+    post.sensor = sensor;
+    post.event = event;
+    post.value = value;
+    post.millis = millis();
+}
+
+// A reading every 10 s for this long, all the same
+static void feed(AlertEngine& engine, int sensor, int16_t temp, unsigned long ms){
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += 1000 * 10){
+        engine.update(sensor, temp);
+        hostAdvanceMillis(1000 * 10);
+    }
+}
+
+static const AlertRule belowRules[] = {
+    {"Too cold", -1, RULE_BELOW, fromFahrenheit(35.00), fahrenheitDelta(1.00), 1000 * 30, 1000 * 60 * 10, 1000 * 60 * 30, 0, 0, 0},
+};
+
+TEST(AlertRulesWaitOutTheDwell){
+    postedRules = belowRules;
+    AlertEngine engine(belowRules, 1, record);
+
+    feed(engine, 0, fromFahrenheit(38.00), 1000 * 60);
+    CHECK_EQUAL(0, postedCount);
+
+    // A blip below for less than the dwell doesn't trip
+    feed(engine, 0, fromFahrenheit(34.00), 1000 * 20);
+    CHECK_EQUAL(1, engine.breachedCount());
+    CHECK_EQUAL(0, engine.activeCount());
+    feed(engine, 0, fromFahrenheit(38.00), 1000 * 60);
+    CHECK_EQUAL(0, engine.breachedCount());
+    CHECK_EQUAL(0, postedCount);
+
+    // Staying below does, once, at 30 s
+    unsigned long start = millis();
+    feed(engine, 0, fromFahrenheit(34.00), 1000 * 60);
+    CHECK_EQUAL(1, postedCount);
+    CHECK_EQUAL(ALERT_TRIPPED, posted[0].event);
+    CHECK_EQUAL(0, posted[0].sensor);
+    CHECK_EQUAL(fromFahrenheit(34.00), posted[0].value);
+    CHECK_EQUAL(start + 1000 * 30, posted[0].millis);
+    CHECK_EQUAL(1, engine.activeCount());
+}
+
+TEST(AlertRulesClearPastTheHysteresis){
+    postedRules = belowRules;
+    AlertEngine engine(belowRules, 1, record);
+    feed(engine, 0, fromFahrenheit(34.00), 1000 * 60);
+    CHECK_EQUAL(1, postedCount);
+
+    // Back over the limit but inside the band, still out
+    feed(engine, 0, fromFahrenheit(35.50), 1000 * 60);
+    CHECK_EQUAL(1, engine.activeCount());
+    feed(engine, 0, fromFahrenheit(35.99), 1000 * 60);
+    CHECK_EQUAL(1, engine.activeCount());
+    CHECK_EQUAL(1, postedCount);
+
+    feed(engine, 0, fromFahrenheit(36.00), 1000 * 10);
+    CHECK_EQUAL(0, engine.activeCount());
+    CHECK_EQUAL(2, postedCount);
+    CHECK_EQUAL(ALERT_CLEARED, posted[1].event);
+
+    // And has to go under the limit itself to breach again
+    feed(engine, 0, fromFahrenheit(35.00), 1000 * 60);
+    CHECK_EQUAL(0, engine.breachedCount());
+}
+
+TEST(AlertRulesRepeatThenEscalate){
+    postedRules = belowRules;
+    AlertEngine engine(belowRules, 1, record);
+    feed(engine, 0, fromFahrenheit(34.00), 1000 * 60 * 45);
+
+    // Tripped at 30 s, repeats every 10 min, escalated from 30 min on
+    CHECK_EQUAL(5, postedCount);
+    CHECK_EQUAL(ALERT_TRIPPED, posted[0].event);
+    CHECK_EQUAL(ALERT_REPEAT, posted[1].event);
+    CHECK_EQUAL(ALERT_REPEAT, posted[2].event);
+    CHECK_EQUAL(ALERT_ESCALATED, posted[3].event);
+    CHECK_EQUAL(ALERT_ESCALATED, posted[4].event);
+    CHECK_EQUAL(posted[0].millis + 1000 * 60 * 10, posted[1].millis);
+}
+
+TEST(AlertRulesKeepSensorsApart){
+    postedRules = belowRules;
+    AlertEngine engine(belowRules, 1, record);
+    for (int i = 0; i < 6; i++){
+        engine.update(0, fromFahrenheit(34.00));
+        engine.update(1, fromFahrenheit(38.00));
+        hostAdvanceMillis(1000 * 10);
+    }
+    CHECK_EQUAL(1, postedCount);
+    CHECK_EQUAL(0, posted[0].sensor);
+
+    // A rule for one sensor only leaves the others alone
+    static const AlertRule oneSensor[] = {
+        {"Too cold", 1, RULE_BELOW, fromFahrenheit(35.00), 0, 0, 0, 0, 0, 0, 0},
+    };
+    postedRules = oneSensor;
+    postedCount = 0;
+    AlertEngine single(oneSensor, 1, record);
+    single.update(0, fromFahrenheit(30.00));
+    CHECK_EQUAL(0, postedCount);
+    single.update(1, fromFahrenheit(30.00));
+    CHECK_EQUAL(1, postedCount);
+    CHECK_EQUAL(1, posted[0].sensor);
+}
+
+TEST(AlertRulesStayWithinMaxPerHour){
+    static const AlertRule rules[] = {
+        {"Too warm", -1, RULE_ABOVE, fromFahrenheit(45.00), fahrenheitDelta(1.00), 0, 1000 * 60, 0, 4, 0, 0},
+    };
+    postedRules = rules;
+    AlertEngine engine(rules, 1, record);
+
+    // Tripped plus a repeat a minute, but only 4 an hour
+    feed(engine, 0, fromFahrenheit(50.00), 1000 * 60 * 30);
+    CHECK_EQUAL(4, postedCount);
+    CHECK_EQUAL(26u, engine.suppressed());
+
+    // The clear still goes out over budget, so nobody's left thinking it's warm
+    feed(engine, 0, fromFahrenheit(40.00), 1000 * 10);
+    CHECK_EQUAL(5, postedCount);
+    CHECK_EQUAL(ALERT_CLEARED, posted[4].event);
+
+    // A fresh hour, a fresh budget
+    feed(engine, 0, fromFahrenheit(40.00), 1000 * 60 * 30);
+    feed(engine, 0, fromFahrenheit(50.00), 1000 * 60 * 2);
+    CHECK_EQUAL(7, postedCount);
+    CHECK_EQUAL(ALERT_TRIPPED, posted[5].event);
+}
+
+TEST(AlertRulesOnlyClearWhatWasPosted){
+    static const AlertRule rules[] = {
+        {"Too warm", -1, RULE_ABOVE, fromFahrenheit(45.00), 0, 0, 0, 0, 1, 0, 0},
+    };
+    postedRules = rules;
+    AlertEngine engine(rules, 1, record);
+    feed(engine, 0, fromFahrenheit(50.00), 1000 * 10);
+    feed(engine, 0, fromFahrenheit(40.00), 1000 * 10);
+    CHECK_EQUAL(2, postedCount);
+
+    // Over budget, so the trip's suppressed and so is its clear
+    feed(engine, 0, fromFahrenheit(50.00), 1000 * 10);
+    feed(engine, 0, fromFahrenheit(40.00), 1000 * 10);
+    CHECK_EQUAL(2, postedCount);
+    CHECK_EQUAL(1u, engine.suppressed());
+}
+
+TEST(AlertRulesWatchTheRate){
+    static const AlertRule rules[] = {
+        {"Falling fast", -1, RULE_FALLING, fahrenheitDelta(2.00), fahrenheitDelta(0.50), 0, 0, 0, 0, 0, 0},
+    };
+    postedRules = rules;
+    AlertEngine engine(rules, 1, record);
+
+    // 1 F a minute isn't fast enough
+    int16_t temp = fromFahrenheit(40.00);
+    for (int i = 0; i < 30; i++){
+        engine.update(0, temp);
+        temp -= fahrenheitDelta(1.00) / 6;
+        hostAdvanceMillis(1000 * 10);
+    }
+    CHECK_EQUAL(0, postedCount);
+
+    // 3 F a minute is, once a full minute's been seen
+    for (int i = 0; i < 14; i++){
+        engine.update(0, temp);
+        temp -= fahrenheitDelta(3.00) / 6;
+        hostAdvanceMillis(1000 * 10);
+    }
+    CHECK_EQUAL(1, postedCount);
+    CHECK_NEAR(-fahrenheitDelta(3.00), posted[0].value, fahrenheitDelta(0.10));
+
+    // Slowing to 1.6 F a minute is still inside the hysteresis, stopping isn't
+    for (int i = 0; i < 14; i++){
+        engine.update(0, temp);
+        temp -= fahrenheitDelta(1.60) / 6;
+        hostAdvanceMillis(1000 * 10);
+    }
+    CHECK_EQUAL(1, engine.activeCount());
+    feed(engine, 0, temp, 1000 * 60 * 3);
+    CHECK_EQUAL(0, engine.activeCount());
+    CHECK_EQUAL(ALERT_CLEARED, posted[1].event);
+}
+
+static uint16_t historyBelow;
+
+static uint16_t countHistory(int sensor, int16_t limit, bool below){
+    return below ? historyBelow : 0;
+}
+
+TEST(AlertRulesLookAtTheHistory){
+    static const AlertRule rules[] = {
+        {"Too cold", -1, RULE_BELOW, fromFahrenheit(35.00), 0, 0, 0, 0, 0, 3, 0},
+    };
+    postedRules = rules;
+    AlertEngine engine(rules, 1, record);
+    engine.setHistoryCounter(countHistory);
+
+    // The reading's fine but enough of the history wasn't
+    historyBelow = 2;
+    engine.update(0, fromFahrenheit(36.00));
+    CHECK_EQUAL(0, postedCount);
+    historyBelow = 3;
+    engine.update(0, fromFahrenheit(36.00));
+    CHECK_EQUAL(1, postedCount);
+    CHECK_EQUAL(fromFahrenheit(36.00), posted[0].value);
+}
+
+TEST(AlertRulesReport){
+    postedRules = belowRules;
+    AlertEngine engine(belowRules, 1, record);
+    feed(engine, 2, fromFahrenheit(34.00), 1000 * 60);
+    engine.report(Serial);
+    CHECK_CONTAINS("Too cold                   1       1", hostSerialOutput());
+    CHECK_CONTAINS("suppressed by rate limits: 0", hostSerialOutput());
+}
+
+// Where the fake trend is heading: below "floor" in "eta" ms from now
+static int16_t trendFloor;
+static uint32_t trendEta;
+
+static uint32_t predictBreach(int sensor, int16_t limit, bool below){
+    if (!below || limit < trendFloor) return 0xFFFFFFFF;
+    return trendEta;
+}
+
+TEST(AlertRulesPredictBeforeTheLimit){
+    static const AlertRule rules[] = {
+        {"Cold soon", -1, RULE_PREDICT_BELOW, fromFahrenheit(35.00), fahrenheitDelta(0.50), 1000 * 60, 0, 0, 0, 0, 1000 * 60 * 30},
+    };
+    postedRules = rules;
+    AlertEngine engine(rules, 1, record);
+    // Without a predictor it's never out
+    feed(engine, 0, fromFahrenheit(37.00), 1000 * 60 * 2);
+    CHECK_EQUAL(0, engine.breachedCount());
+
+    engine.setBreachPredictor(predictBreach);
+    trendFloor = fromFahrenheit(30.00);
+    trendEta = 1000 * 60 * 45;
+    feed(engine, 0, fromFahrenheit(37.00), 1000 * 60 * 2);
+    CHECK_EQUAL(0, postedCount);
+
+    // Inside the horizon for the dwell, and it says how long's left
+    trendEta = 1000 * 60 * 20;
+    feed(engine, 0, fromFahrenheit(36.00), 1000 * 60 * 2);
+    CHECK_EQUAL(1, postedCount);
+    CHECK_EQUAL(ALERT_TRIPPED, posted[0].event);
+    CHECK_EQUAL(20, posted[0].value);
+
+    // It's still heading below the limit plus hysteresis, so it stays out
+    trendFloor = fromFahrenheit(35.25);
+    feed(engine, 0, fromFahrenheit(36.00), 1000 * 60);
+    CHECK_EQUAL(1, engine.activeCount());
+    // Levelling off above that clears it
+    trendFloor = fromFahrenheit(35.75);
+    feed(engine, 0, fromFahrenheit(36.00), 1000 * 10);
+    CHECK_EQUAL(0, engine.activeCount());
+    CHECK_EQUAL(ALERT_CLEARED, posted[1].event);
+}
+
+TEST(AlertRulesLeaveACrossedLimitToThePlainRule){
+    static const AlertRule rules[] = {
+        {"Cold soon", -1, RULE_PREDICT_BELOW, fromFahrenheit(35.00), fahrenheitDelta(0.50), 0, 0, 0, 0, 0, 1000 * 60 * 30},
+    };
+    postedRules = rules;
+    AlertEngine engine(rules, 1, record);
+    engine.setBreachPredictor(predictBreach);
+    trendFloor = fromFahrenheit(30.00);
+    trendEta = 1000 * 60 * 5;
+    feed(engine, 0, fromFahrenheit(35.50), 1000 * 10);
+    CHECK_EQUAL(1, postedCount);
+
+    // Past the limit now, "soon" is over, but quietly: a clear here would
+    // land just as the plain rule trips
+    trendEta = 0;
+    feed(engine, 0, fromFahrenheit(34.50), 1000 * 10);
+    CHECK_EQUAL(0, engine.activeCount());
+    CHECK_EQUAL(1, postedCount);
+    feed(engine, 0, fromFahrenheit(34.00), 1000 * 60);
+    CHECK_EQUAL(1, postedCount);
+
+    // Nor when it comes back up and levels off
+    trendFloor = fromFahrenheit(36.00);
+    feed(engine, 0, fromFahrenheit(37.00), 1000 * 60);
+    CHECK_EQUAL(1, postedCount);
+}
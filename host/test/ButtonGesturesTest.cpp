@@ -0,0 +1,120 @@
+#include "Check.h"
+#include "ButtonGestures.h"
+
+static const uint32_t debounceMillis = 20;
+static const uint32_t holdMillis = 4000;
+static const uint32_t longHoldMillis = 20000;
+
+// The events queued so far as letters: P pressed, H held, L long held, R released
+static void events(ButtonGestures& gestures, char* buff){
+    static const char letters[] = "PHLR";
+    ButtonEvent event;
+    while (gestures.next(event)) *buff++ = letters[event];
+    *buff = '\0';
+}
+
+TEST(ButtonGesturesIgnoresBounce){
+    ButtonGestures gestures(debounceMillis, holdMillis, longHoldMillis);
+    char seen[16];
+    gestures.edge(true, 1000);
+    gestures.edge(false, 1003);
+    gestures.edge(true, 1007);
+    gestures.edge(false, 1012);
+    gestures.update(1100);
+    events(gestures, seen);
+    CHECK_STRING("", seen);
+    CHECK(!gestures.isDown());
+
+    // Settles down this time, and the press is dated from its last edge
+    gestures.edge(true, 2000);
+    gestures.edge(false, 2005);
+    gestures.edge(true, 2008);
+    gestures.update(2027);
+    events(gestures, seen);
+    CHECK_STRING("", seen);
+    gestures.update(2028);
+    events(gestures, seen);
+    CHECK_STRING("P", seen);
+    CHECK(gestures.isDown());
+    CHECK_EQUAL(92, gestures.downMillis(2100));
+}
+
+TEST(ButtonGesturesHoldsFireOnce){
+    ButtonGestures gestures(debounceMillis, holdMillis, longHoldMillis);
+    char seen[16];
+    gestures.edge(true, 500);
+    gestures.update(4499);
+    events(gestures, seen);
+    CHECK_STRING("P", seen);
+    gestures.update(4500);
+    gestures.update(4600);
+    events(gestures, seen);
+    CHECK_STRING("H", seen);
+    gestures.update(20500);
+    gestures.update(30000);
+    gestures.edge(false, 30001);
+    gestures.update(30100);
+    events(gestures, seen);
+    CHECK_STRING("LR", seen);
+}
+
+// loop() was held up and only handed the edges over late: the hold is timed
+// from the edges, not from when they were seen
+TEST(ButtonGesturesLateHandover){
+    ButtonGestures gestures(debounceMillis, holdMillis, longHoldMillis);
+    char seen[16];
+    gestures.edge(true, 0);
+    gestures.edge(false, 5000);
+    gestures.update(60000);
+    events(gestures, seen);
+    CHECK_STRING("PHR", seen);
+
+    // A short press handed over late is still a short press
+    gestures.edge(true, 70000);
+    gestures.edge(false, 70500);
+    gestures.update(90000);
+    events(gestures, seen);
+    CHECK_STRING("PR", seen);
+}
+
+TEST(ButtonGesturesAcrossRollover){
+    ButtonGestures gestures(debounceMillis, holdMillis, longHoldMillis);
+    char seen[16];
+    uint32_t start = 0xFFFFFFFF - 1000;
+    gestures.reset(false, start - 100);
+    gestures.edge(true, start);
+    gestures.update(start + holdMillis - 1);
+    events(gestures, seen);
+    CHECK_STRING("P", seen);
+    gestures.update(start + holdMillis);
+    events(gestures, seen);
+    CHECK_STRING("H", seen);
+    CHECK_EQUAL(holdMillis + 10, gestures.downMillis(start + holdMillis + 10));
+}
+
+TEST(ButtonGesturesDropsOldestWhenNobodyReads){
+    ButtonGestures gestures(debounceMillis, holdMillis, longHoldMillis);
+    char seen[16];
+    uint32_t t = 1000;
+    for (int i = 0; i < 5; i++){
+        gestures.edge(true, t);
+        gestures.edge(false, t + 100);
+        t += 200;
+    }
+    gestures.update(t);
+    events(gestures, seen);
+    // 10 events, the queue holds 8
+    CHECK_STRING("PRPRPRPR", seen);
+}
+
+TEST(ButtonGesturesResetDown){
+    ButtonGestures gestures(debounceMillis, holdMillis, longHoldMillis);
+    char seen[16];
+    // Started with it already held: no press, and no holds for it either
+    gestures.reset(true, 100);
+    gestures.update(50000);
+    gestures.edge(false, 50000);
+    gestures.update(50100);
+    events(gestures, seen);
+    CHECK_STRING("R", seen);
+}
@@ -0,0 +1,161 @@
+#include "Check.h"
+#include "Button.h"
+#include "gpio.h"
+
+static const uint8_t pin = D3;
+
+// The events queued so far as letters: P pressed, H held, L long held, R released
+static void events(Button& button, char* buff){
+    static const char letters[] = "PHLR";
+    ButtonEvent event;
+    while (button.next(event)) *buff++ = letters[event];
+    *buff = '\0';
+}
+
+static void runButton(Button& button, unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms){
+        button.update();
+        hostAdvanceMillis(1);
+    }
+}
+
+// Bouncing a few ms between edges, ending at level
+static void bounce(bool level){
+    for (int i = 0; i < 3; i++){
+        hostSetPin(pin, level ? HIGH : LOW);
+        hostAdvanceMillis(2);
+        hostSetPin(pin, level ? LOW : HIGH);
+        hostAdvanceMillis(3);
+    }
+    hostSetPin(pin, level ? HIGH : LOW);
+}
+
+TEST(ButtonPressAndRelease){
+    Button button(pin, true, 1000 * 4, 1000 * 20);
+    button.begin();
+    char seen[16];
+
+    bounce(true);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("P", seen);
+    CHECK(button.isDown());
+    CHECK_EQUAL(7u, button.edges());
+
+    bounce(false);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("R", seen);
+    CHECK(!button.isDown());
+    CHECK_EQUAL(0u, button.overflows());
+}
+
+TEST(ButtonActiveLow){
+    hostSetPin(pin, HIGH);
+    Button button(pin, false, 1000 * 4, 1000 * 20);
+    button.begin();
+    char seen[16];
+    runButton(button, 100);
+    CHECK(!button.isDown());
+
+    hostSetPin(pin, LOW);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("P", seen);
+}
+
+TEST(ButtonTimesHoldsWhileLoopIsStuck){
+    Button button(pin, true, 1000 * 4, 1000 * 20);
+    button.begin();
+    char seen[16];
+
+    // Held 5 s while loop() was off in a slow TLS handshake, the edges
+    // carry their own times so it still counts as a hold
+    hostSetPin(pin, HIGH);
+    hostAdvanceMillis(1000 * 5);
+    hostSetPin(pin, LOW);
+    hostAdvanceMillis(1000 * 3);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("PHR", seen);
+
+    // Held through a long hold with loop() running
+    hostSetPin(pin, HIGH);
+    runButton(button, 1000 * 21);
+    hostSetPin(pin, LOW);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("PHLR", seen);
+}
+
+TEST(ButtonCatchesUpAfterOverflow){
+    Button button(pin, true, 1000 * 4, 1000 * 20);
+    button.begin();
+    char seen[16];
+
+    // More edges than the queue holds before loop() gets to them
+    for (int i = 0; i < 12; i++){
+        hostSetPin(pin, HIGH);
+        hostAdvanceMillis(1);
+        hostSetPin(pin, LOW);
+        hostAdvanceMillis(1);
+    }
+    hostSetPin(pin, HIGH);
+    runButton(button, 100);
+    CHECK_EQUAL(1u, button.overflows());
+    CHECK_EQUAL(16u, button.edges());
+    CHECK(button.isDown());
+    events(button, seen);
+    CHECK_STRING("P", seen);
+}
+
+TEST(ButtonDownAtBootIsNotAPress){
+    hostSetPin(pin, HIGH);
+    Button button(pin, true, 1000 * 4, 1000 * 20);
+    button.begin();
+    char seen[16];
+    runButton(button, 1000 * 5);
+    events(button, seen);
+    CHECK_STRING("", seen);
+    CHECK(button.isDown());
+
+    hostSetPin(pin, LOW);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("R", seen);
+}
+
+// The interrupt type is GPC's bits 7-9, bit 10 is the wakeup enable
+static uint32_t interruptType(){
+    return (GPC(pin) >> GPCI) & 7;
+}
+
+TEST(ButtonWakesOnTheOtherLevel){
+    Button button(pin, true, 1000 * 4, 1000 * 20);
+    button.begin();
+    char seen[16];
+    CHECK_EQUAL((uint32_t)CHANGE, interruptType());
+
+    // Up now, so it wakes on high, and a press puts it back on CHANGE
+    button.armWake();
+    CHECK_EQUAL((uint32_t)GPIO_PIN_INTR_HILEVEL, interruptType());
+    CHECK(GPC(pin) & (1 << GPCWE));
+    hostSetPin(pin, HIGH);
+    button.disarmWake();
+    CHECK_EQUAL((uint32_t)CHANGE, interruptType());
+    CHECK(!(GPC(pin) & (1 << GPCWE)));
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("P", seen);
+
+    // Woken by something else, the level interrupt mustn't be left on
+    button.armWake();
+    CHECK_EQUAL((uint32_t)GPIO_PIN_INTR_LOLEVEL, interruptType());
+    button.disarmWake();
+    CHECK_EQUAL((uint32_t)CHANGE, interruptType());
+    hostSetPin(pin, LOW);
+    runButton(button, 100);
+    events(button, seen);
+    CHECK_STRING("R", seen);
+}
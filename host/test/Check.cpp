@@ -0,0 +1,107 @@
+#include "Check.h"
+#include <exception>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Most tests there can be, and how long one gets before it's taken as hung (seconds)
+static const int MAX_TESTS = 512;
+static const unsigned int testTimeoutSeconds = 60;
+
+struct Test {
+    const char* name;
+    TestFunction function;
+};
+
+static Test tests[MAX_TESTS];
+static int testCount = 0;
+static int failures = 0;
+
+CheckRegistration::CheckRegistration(const char* name, TestFunction test){
+    if (testCount == MAX_TESTS){
+        fprintf(stderr, "Too many tests, %s left out\n", name);
+        return;
+    }
+    tests[testCount].name = name;
+    tests[testCount].function = test;
+    testCount++;
+}
+
+void checkFailed(const char* file, int line, const char* format, ...){
+    failures++;
+    printf("    %s:%d: ", file, line);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+void checkTrue(bool condition, const char* expression, const char* file, int line){
+    if (!condition) checkFailed(file, line, "%s", expression);
+}
+
+void checkString(const char* expected, const char* actual, const char* expression, const char* file, int line){
+    if (!actual) actual = "(null)";
+    if (strcmp(expected, actual) != 0) checkFailed(file, line, "%s is \"%s\", expected \"%s\"", expression, actual, expected);
+}
+
+void checkNear(double expected, double actual, double tolerance, const char* expression, const char* file, int line){
+    if (fabs(expected - actual) > tolerance) checkFailed(file, line, "%s is %g, expected %g +/- %g", expression, actual, expected, tolerance);
+}
+
+void checkContains(const char* part, const char* text, const char* expression, const char* file, int line){
+    if (!text) text = "(null)";
+    if (!strstr(text, part)) checkFailed(file, line, "%s doesn't contain \"%s\":\n%s", expression, part, text);
+}
+
+// In the child: run it from power on, exit 1 if anything failed
+static void runChild(const Test& test){
+    alarm(testTimeoutSeconds);
+    hostReset();
+    hostSerialEcho(getenv("SERIAL") != NULL);
+    try {
+        test.function();
+    }
+    catch (std::exception& e){
+        checkFailed(__FILE__, __LINE__, "threw %s", e.what());
+    }
+    fflush(stdout);
+    _exit(failures ? 1 : 0);
+}
+
+// Runs every test (or those with the first argument in their name) and
+// exits non-zero if any failed
+int main(int argc, char** argv){
+    const char* only = argc > 1 ? argv[1] : NULL;
+    int run = 0;
+    int failed = 0;
+    for (int i = 0; i < testCount; i++){
+        const Test& test = tests[i];
+        if (only && !strstr(test.name, only)) continue;
+        run++;
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0){
+            perror("fork");
+            return 2;
+        }
+        if (pid == 0) runChild(test);
+
+        int status;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0){
+            printf("ok   %s\n", test.name);
+        }
+        else {
+            failed++;
+            if (WIFSIGNALED(status)){
+                printf("FAIL %s (%s)\n", test.name, WTERMSIG(status) == SIGALRM ? "timed out" : strsignal(WTERMSIG(status)));
+            }
+            else {
+                printf("FAIL %s\n", test.name);
+            }
+        }
+    }
+    printf("\n%d tests, %d failed\n", run, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+#ifndef Check_H
+#define Check_H
+
+#include "Arduino.h"
+#include <type_traits>
+
+// Just enough of a test framework for the host build. Each TEST runs in its
+// own process after hostReset(), so the sketch's globals and the stand-ins
+// start out fresh for every one. A failed CHECK is reported and the test
+// carries on, the test fails at the end.
+//
+//     TEST(RingBufferWraps){
+//         RingBuffer<int16_t, 3> buffer;
+//         ...
+//         CHECK_EQUAL(3, buffer.count());
+//     }
+
+typedef void (*TestFunction)();
+
+class CheckRegistration {
+    public:
+        CheckRegistration(const char* name, TestFunction test);
+};
+
+#define TEST(name) \
+    static void test_##name(); \
+    static CheckRegistration registration_##name(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(condition) checkTrue((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(expected, actual) checkEqual((expected), (actual), #actual, __FILE__, __LINE__)
+#define CHECK_STRING(expected, actual) checkString((expected), (actual), #actual, __FILE__, __LINE__)
+#define CHECK_NEAR(expected, actual, tolerance) checkNear((expected), (actual), (tolerance), #actual, __FILE__, __LINE__)
+// The text contains the expected part
+#define CHECK_CONTAINS(part, text) checkContains((part), (text), #text, __FILE__, __LINE__)
+
+void checkFailed(const char* file, int line, const char* format, ...) __attribute__((format(printf, 3, 4)));
+void checkTrue(bool condition, const char* expression, const char* file, int line);
+void checkString(const char* expected, const char* actual, const char* expression, const char* file, int line);
+void checkNear(double expected, double actual, double tolerance, const char* expression, const char* file, int line);
+void checkContains(const char* part, const char* text, const char* expression, const char* file, int line);
+
+// Values as text for a failed CHECK_EQUAL
+template <class T>
+typename std::enable_if<std::is_floating_point<T>::value>::type describe(char* buff, size_t size, T value){
+    snprintf(buff, size, "%g", (double)value);
+}
+
+template <class T>
+typename std::enable_if<std::is_enum<T>::value || (std::is_integral<T>::value && std::is_signed<T>::value)>::type
+describe(char* buff, size_t size, T value){
+    snprintf(buff, size, "%lld", (long long)value);
+}
+
+template <class T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type describe(char* buff, size_t size, T value){
+    snprintf(buff, size, "%llu", (unsigned long long)value);
+}
+
+template <class T>
+void describe(char* buff, size_t size, T* value){
+    snprintf(buff, size, "%p", (const void*)value);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-compare"
+template <class E, class A>
+void checkEqual(const E& expected, const A& actual, const char* expression, const char* file, int line){
+    if (expected == actual) return;
+    char e[32];
+    char a[32];
+    describe(e, sizeof(e), expected);
+    describe(a, sizeof(a), actual);
+    checkFailed(file, line, "%s is %s, expected %s", expression, a, e);
+}
+#pragma GCC diagnostic pop
+
+#endif
@@ -0,0 +1,187 @@
+#include "Check.h"
+#include "ConfigStore.h"
+#include "FlashLog.h"
+#include "Temperature.h"
+#include <LittleFS.h>
+#include <stddef.h>
+
+static const char* path = "/config.bin";
+
+// The header as ConfigStore writes it: magic, version, length, CRC-32
+struct RecordHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t crc;
+};
+
+static RuntimeConfig defaults(){
+    RuntimeConfig config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.ssid, "HostNet");
+    strcpy(config.password, "hostpass");
+    config.tzHours = -5;
+    config.alertLimit = fromFahrenheit(35.00);
+    config.alertDwellMillis = 1000 * 10;
+    config.sensorFaultMillis = 1000 * 30;
+    config.telemetryPort = 4210;
+    strcpy(config.configToken, "default");
+    return config;
+}
+
+// A record the way an older firmware would have saved it
+static void writeRecord(uint16_t version, const RuntimeConfig& config, uint16_t length){
+    uint8_t buff[sizeof(RecordHeader) + sizeof(RuntimeConfig)];
+    RecordHeader header = {0x31434D54, version, length, 0};
+    header.crc = FlashLog::crc32(FlashLog::crc32(0, (const byte*)&header, sizeof(header)), (const byte*)&config, length);
+    memcpy(buff, &header, sizeof(header));
+    memcpy(buff + sizeof(header), &config, length);
+    hostFsWriteFile(path, buff, sizeof(header) + length);
+}
+
+TEST(ConfigStoreSavesAndLoads){
+    ConfigStore store(path);
+    RuntimeConfig config = defaults();
+    CHECK_EQUAL(ConfigStore::LOAD_NOT_TRIED, store.loadResult());
+    CHECK_EQUAL(ConfigStore::MISSING, store.load(config));
+    CHECK_STRING("HostNet", config.ssid);
+
+    strcpy(config.ssid, "Kitchen");
+    config.alertLimit = fromFahrenheit(36.50);
+    CHECK(store.save(config));
+    CHECK(!LittleFS.exists("/config.bin.new"));
+
+    RuntimeConfig loaded = defaults();
+    CHECK_EQUAL(ConfigStore::LOADED, store.load(loaded));
+    CHECK_EQUAL(0, memcmp(&config, &loaded, sizeof(config)));
+    CHECK_STRING("loaded", ConfigStore::loadResultName(store.loadResult()));
+}
+
+TEST(ConfigStoreRejectsACorruptRecord){
+    ConfigStore store(path);
+    RuntimeConfig config = defaults();
+    strcpy(config.ssid, "Kitchen");
+    store.save(config);
+
+    // One flipped bit in the middle of the record
+    CHECK(hostFsCorrupt(path, sizeof(RecordHeader) + offsetof(RuntimeConfig, alertLimit), 0x01));
+    RuntimeConfig loaded = defaults();
+    CHECK_EQUAL(ConfigStore::CORRUPT, store.load(loaded));
+    CHECK_STRING("HostNet", loaded.ssid);
+    CHECK_CONTAINS("bad config record", hostSerialOutput());
+
+    // Cut short
+    store.save(config);
+    CHECK(hostFsTruncate(path, sizeof(RecordHeader) + 10));
+    CHECK_EQUAL(ConfigStore::CORRUPT, store.load(loaded));
+
+    // From firmware newer than this
+    writeRecord(ConfigStore::CONFIG_VERSION + 1, config, sizeof(config));
+    CHECK_EQUAL(ConfigStore::CORRUPT, store.load(loaded));
+    CHECK_STRING("HostNet", loaded.ssid);
+}
+
+TEST(ConfigStoreMigratesAnOlderRecord){
+    // Version 1 stopped before configToken
+    RuntimeConfig old = defaults();
+    strcpy(old.ssid, "Garage");
+    old.telemetryPort = 5000;
+    writeRecord(1, old, offsetof(RuntimeConfig, configToken));
+
+    ConfigStore store(path);
+    RuntimeConfig config = defaults();
+    CHECK_EQUAL(ConfigStore::MIGRATED, store.load(config));
+    CHECK_STRING("Garage", config.ssid);
+    CHECK_EQUAL(5000, config.telemetryPort);
+    CHECK_STRING("default", config.configToken);
+
+    // Saved again it's the current version
+    store.save(config);
+    CHECK_EQUAL(ConfigStore::LOADED, store.load(config));
+}
+
+TEST(ConfigStoreTerminatesTextFromTheFile){
+    RuntimeConfig config = defaults();
+    memset(config.ssid, 'x', sizeof(config.ssid));
+    writeRecord(ConfigStore::CONFIG_VERSION, config, sizeof(config));
+
+    ConfigStore store(path);
+    RuntimeConfig loaded = defaults();
+    CHECK_EQUAL(ConfigStore::LOADED, store.load(loaded));
+    CHECK_EQUAL(sizeof(config.ssid) - 1, strlen(loaded.ssid));
+}
+
+TEST(ConfigStoreKeepsTheOldRecordWhenASaveFails){
+    ConfigStore store(path);
+    RuntimeConfig config = defaults();
+    strcpy(config.ssid, "Kitchen");
+    CHECK(store.save(config));
+
+    // The power goes part way through writing the new one
+    strcpy(config.ssid, "Garage");
+    hostFsWriteLimit(100);
+    CHECK(!store.save(config));
+    hostFsWriteLimit(-1);
+    CHECK(!LittleFS.exists("/config.bin.new"));
+
+    RuntimeConfig loaded = defaults();
+    CHECK_EQUAL(ConfigStore::LOADED, store.load(loaded));
+    CHECK_STRING("Kitchen", loaded.ssid);
+}
+
+TEST(ConfigStoreWithoutAFilesystem){
+    hostFsMountFails(true);
+    ConfigStore store(path);
+    RuntimeConfig config = defaults();
+    CHECK_EQUAL(ConfigStore::NO_FILESYSTEM, store.load(config));
+    CHECK_STRING("HostNet", config.ssid);
+}
+
+TEST(ConfigStoreSetsFieldsInRange){
+    RuntimeConfig config = defaults();
+    CHECK(ConfigStore::set(config, "ssid", "Kitchen"));
+    CHECK_STRING("Kitchen", config.ssid);
+    CHECK(!ConfigStore::set(config, "ssid", ""));
+    CHECK(!ConfigStore::set(config, "ssid", "0123456789012345678901234567890123"));
+    CHECK(ConfigStore::set(config, "password", ""));
+
+    CHECK(ConfigStore::set(config, "tzHours", "-12"));
+    CHECK_EQUAL(-12, config.tzHours);
+    CHECK(!ConfigStore::set(config, "tzHours", "15"));
+    CHECK(!ConfigStore::set(config, "tzHours", "3x"));
+    CHECK(!ConfigStore::set(config, "tzHours", ""));
+    CHECK_EQUAL(-12, config.tzHours);
+
+    CHECK(ConfigStore::set(config, "telemetryPort", "65535"));
+    CHECK_EQUAL(65535, config.telemetryPort);
+    CHECK(!ConfigStore::set(config, "telemetryPort", "65536"));
+    CHECK(!ConfigStore::set(config, "telemetryPort", "0"));
+
+    CHECK(ConfigStore::set(config, "alertDwellMillis", "604800000"));
+    CHECK_EQUAL(604800000u, config.alertDwellMillis);
+    CHECK(!ConfigStore::set(config, "alertDwellMillis", "604800001"));
+    CHECK(!ConfigStore::set(config, "alertDwellMillis", "99999999999999999999"));
+    CHECK(!ConfigStore::set(config, "alertDwellMillis", "-1"));
+
+    CHECK(ConfigStore::set(config, "alertLimit", "36.5"));
+    CHECK_EQUAL(fromFahrenheit(36.50), config.alertLimit);
+    CHECK(!ConfigStore::set(config, "alertLimit", "warm"));
+    CHECK(!ConfigStore::set(config, "alertHysteresis", "-1"));
+
+    CHECK(!ConfigStore::set(config, "nonsense", "1"));
+}
+
+TEST(ConfigStorePrintsJsonWithoutSecrets){
+    RuntimeConfig config = defaults();
+    strcpy(config.iftttAlert, "say \"hi\"");
+    config.iftttKey[0] = '\0';
+    ConfigStore::printJson(Serial, config);
+    const char* json = hostSerialOutput();
+    CHECK_CONTAINS("{\"ssid\":\"HostNet\",\"password\":\"(set)\",\"iftttKey\":\"\",", json);
+    CHECK_CONTAINS("\"iftttAlert\":\"say \\\"hi\\\"\"", json);
+    CHECK_CONTAINS("\"tzHours\":-5,", json);
+    CHECK_CONTAINS("\"alertLimit\":35.00,", json);
+    CHECK_CONTAINS("\"alertDwellMillis\":10000,", json);
+    CHECK_CONTAINS("\"configToken\":\"(set)\"}", json);
+    CHECK(!strstr(json, "hostpass"));
+}
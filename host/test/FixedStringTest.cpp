@@ -0,0 +1,71 @@
+#include "Check.h"
+#include "FixedString.h"
+#include "BufferedPrint.h"
+
+TEST(FixedStringAppends){
+    FixedString<32> text;
+    CHECK_STRING("", text.c_str());
+    CHECK_EQUAL(32u, text.capacity());
+    text.append("Sensor").append_P(PSTR(" 1")).appendf(PSTR(" = %d.%02d"), 34, 5);
+    CHECK_STRING("Sensor 1 = 34.05", text.c_str());
+    CHECK_EQUAL(16u, text.length());
+    CHECK(!text.truncated());
+
+    // It's a Print too
+    text.clear();
+    text.print(42);
+    text.print(' ');
+    text.printf("%s", "printf");
+    CHECK_STRING("42 printf", text.c_str());
+}
+
+TEST(FixedStringCutsOffWhatDoesntFit){
+    FixedString<8> text;
+    text.append("12345");
+    text.append("6789");
+    CHECK_STRING("12345678", text.c_str());
+    CHECK(text.truncated());
+
+    text.clear();
+    CHECK(!text.truncated());
+    text.appendf(PSTR("%s"), "abcdefghij");
+    CHECK_STRING("abcdefgh", text.c_str());
+    CHECK_EQUAL(8u, text.length());
+    CHECK(text.truncated());
+
+    text.clear();
+    text.append_P(PSTR("0123456789"));
+    CHECK_STRING("01234567", text.c_str());
+    // Full, a byte at a time doesn't go in either
+    CHECK_EQUAL(0u, text.write('x'));
+}
+
+TEST(FixedStringDoesntAllocate){
+    uint64_t allocations = hostHeapStats().allocations;
+    FixedString<128> text;
+    for (int i = 0; i < 20; i++) text.appendf(PSTR("%d,"), i);
+    CHECK_EQUAL(allocations, hostHeapStats().allocations);
+}
+
+TEST(BufferedPrintSendsWholeBuffers){
+    FixedString<256> out;
+    char buff[16];
+    {
+        BufferedPrint print(out, buff, sizeof(buff));
+        print.appendf(PSTR("%s"), "0123456789");
+        print.appendf(PSTR("%s"), "abcdefghij");
+        // The second didn't fit after the first, so the first went out alone
+        CHECK_STRING("0123456789", out.c_str());
+        print.print("xyz");
+    }
+    // The rest goes when it's done with
+    CHECK_STRING("0123456789abcdefghijxyz", out.c_str());
+
+    // Longer than the buffer is cut short
+    out.clear();
+    {
+        BufferedPrint print(out, buff, sizeof(buff));
+        print.appendf(PSTR("%s"), "0123456789abcdefghij");
+    }
+    CHECK_STRING("0123456789abcde", out.c_str());
+}
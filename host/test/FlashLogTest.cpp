@@ -0,0 +1,237 @@
+#include "Check.h"
+#include "FlashLog.h"
+#include <LittleFS.h>
+
+// A record's header: magic, type, length, seq, CRC
+static const size_t headerBytes = 12;
+
+struct Sample {
+    uint32_t number;
+    uint8_t padding[16];
+};
+
+static void appendSamples(FlashLog& log, uint32_t from, uint32_t to){
+    for (uint32_t i = from; i < to; i++){
+        Sample sample;
+        sample.number = i;
+        memset(sample.padding, i & 0xFF, sizeof(sample.padding));
+        CHECK(log.append(1, &sample, sizeof(sample)));
+    }
+}
+
+// Read on to the end, keeping each record's number, how many there were
+static int readNumbers(FlashLog& log, uint32_t* numbers, int max){
+    byte type;
+    byte data[FlashLog::MAX_RECORD];
+    int count = 0;
+    int length;
+    while ((length = log.next(type, data, sizeof(data))) >= 0 && count < max){
+        Sample sample;
+        memcpy(&sample, data, sizeof(sample));
+        CHECK_EQUAL((int)sizeof(Sample), length);
+        CHECK_EQUAL(1, type);
+        numbers[count++] = sample.number;
+    }
+    return count;
+}
+
+static size_t fileSize(const char* path){
+    size_t size = 0;
+    return hostFsFileData(path, size) ? size : 0;
+}
+
+TEST(FlashLogCrc32){
+    CHECK_EQUAL(0xCBF43926u, FlashLog::crc32(0, (const byte*)"123456789", 9));
+    // Can be done in pieces
+    uint32_t crc = FlashLog::crc32(0, (const byte*)"1234", 4);
+    CHECK_EQUAL(0xCBF43926u, FlashLog::crc32(crc, (const byte*)"56789", 5));
+}
+
+TEST(FlashLogReadsBackInOrder){
+    FlashLog log("log", 1024, 0);
+    CHECK(log.begin());
+    CHECK(log.isEmpty());
+    appendSamples(log, 0, 5);
+    CHECK(!log.isEmpty());
+
+    uint32_t numbers[16];
+    CHECK_EQUAL(5, readNumbers(log, numbers, 16));
+    for (int i = 0; i < 5; i++) CHECK_EQUAL((uint32_t)i, numbers[i]);
+
+    // More appended after the reader ran out are picked up next time
+    appendSamples(log, 5, 7);
+    CHECK_EQUAL(2, readNumbers(log, numbers, 16));
+    CHECK_EQUAL(5u, numbers[0]);
+    log.rewind();
+    CHECK_EQUAL(7, readNumbers(log, numbers, 16));
+
+    // Too big for a record
+    byte big[FlashLog::MAX_RECORD + 1];
+    CHECK(!log.append(2, big, sizeof(big)));
+    CHECK_EQUAL(7u, log.appended());
+
+    log.clear();
+    CHECK(log.isEmpty());
+    CHECK_EQUAL(0, readNumbers(log, numbers, 16));
+}
+
+TEST(FlashLogBatchesWrites){
+    FlashLog log("log", 4096, 1000 * 5);
+    log.begin();
+    uint64_t writes = hostFsWrites();
+    appendSamples(log, 0, 3);
+    log.flushIfDue();
+    CHECK_EQUAL(0u, log.flushes());
+    CHECK_EQUAL(writes, hostFsWrites());
+
+    hostAdvanceMillis(1000 * 5);
+    log.flushIfDue();
+    CHECK_EQUAL(1u, log.flushes());
+    CHECK_EQUAL(writes + 1, hostFsWrites());
+    CHECK_EQUAL(3 * (headerBytes + sizeof(Sample)), fileSize("/log.0"));
+
+    // A full batch goes out without waiting, 256 bytes is 8 of these
+    appendSamples(log, 3, 12);
+    CHECK_EQUAL(2u, log.flushes());
+    uint32_t numbers[16];
+    CHECK_EQUAL(12, readNumbers(log, numbers, 16));
+}
+
+TEST(FlashLogRollsOverToTheOtherSegment){
+    // Room for 6 records a segment
+    const size_t segmentBytes = 6 * (headerBytes + sizeof(Sample));
+    FlashLog log("log", segmentBytes, 0);
+    log.begin();
+    appendSamples(log, 0, 6);
+    CHECK_EQUAL(segmentBytes, fileSize("/log.0"));
+    CHECK_EQUAL(0u, fileSize("/log.1"));
+
+    appendSamples(log, 6, 12);
+    CHECK_EQUAL(segmentBytes, fileSize("/log.1"));
+
+    // The oldest six go to make room, never more than two segments
+    appendSamples(log, 12, 14);
+    CHECK_EQUAL(2 * (headerBytes + sizeof(Sample)), fileSize("/log.0"));
+    uint32_t numbers[16];
+    CHECK_EQUAL(8, readNumbers(log, numbers, 16));
+    CHECK_EQUAL(6u, numbers[0]);
+    CHECK_EQUAL(13u, numbers[7]);
+}
+
+TEST(FlashLogRolloverWhileReading){
+    const size_t segmentBytes = 4 * (headerBytes + sizeof(Sample));
+    FlashLog log("log", segmentBytes, 0);
+    log.begin();
+    appendSamples(log, 0, 8);
+
+    // Part way through the older segment when it's emptied
+    uint32_t numbers[16];
+    CHECK_EQUAL(2, readNumbers(log, numbers, 2));
+    appendSamples(log, 8, 9);
+    int count = readNumbers(log, numbers, 16);
+    CHECK_EQUAL(5, count);
+    CHECK_EQUAL(4u, numbers[0]);
+    CHECK_EQUAL(8u, numbers[count - 1]);
+}
+
+TEST(FlashLogPicksUpAfterAReset){
+    const size_t segmentBytes = 6 * (headerBytes + sizeof(Sample));
+    {
+        FlashLog log("log", segmentBytes, 0);
+        log.begin();
+        appendSamples(log, 0, 9);
+    }
+
+    // The newest segment is the one that's carried on with
+    FlashLog log("log", segmentBytes, 0);
+    CHECK(log.begin());
+    CHECK_CONTAINS("/log.0: 288 bytes in log", hostSerialOutput());
+    appendSamples(log, 9, 12);
+    CHECK_EQUAL(segmentBytes, fileSize("/log.1"));
+    uint32_t numbers[16];
+    CHECK_EQUAL(12, readNumbers(log, numbers, 16));
+    CHECK_EQUAL(11u, numbers[11]);
+}
+
+TEST(FlashLogCrashBeforeAFlush){
+    const size_t recordBytes = headerBytes + sizeof(Sample);
+    {
+        // A reset with records still in the batch loses them
+        FlashLog log("batched", 4096, 1000 * 60);
+        log.begin();
+        appendSamples(log, 0, 2);
+        hostAdvanceMillis(1000 * 60);
+        log.flushIfDue();
+        appendSamples(log, 2, 4);
+    }
+    {
+        // Written as they're appended there's nothing to lose
+        FlashLog log("each", 4096, 0);
+        log.begin();
+        appendSamples(log, 0, 4);
+    }
+
+    uint32_t numbers[16];
+    FlashLog batched("batched", 4096, 1000 * 60);
+    CHECK(batched.begin());
+    CHECK_EQUAL(2 * recordBytes, fileSize("/batched.0"));
+    CHECK_EQUAL(2, readNumbers(batched, numbers, 16));
+    FlashLog each("each", 4096, 0);
+    CHECK(each.begin());
+    CHECK_EQUAL(4, readNumbers(each, numbers, 16));
+    CHECK_EQUAL(3u, numbers[3]);
+}
+
+TEST(FlashLogCutsOffAHalfWrittenRecord){
+    const size_t recordBytes = headerBytes + sizeof(Sample);
+    {
+        FlashLog log("log", 1024, 0);
+        log.begin();
+        appendSamples(log, 0, 4);
+        // The power goes part way through the fifth
+        hostFsWriteLimit(recordBytes / 2);
+        appendSamples(log, 4, 5);
+        hostFsWriteLimit(-1);
+    }
+    CHECK_EQUAL(4 * recordBytes + recordBytes / 2, fileSize("/log.0"));
+
+    FlashLog log("log", 1024, 0);
+    log.begin();
+    CHECK_CONTAINS("dropping 16 bad bytes", hostSerialOutput());
+    CHECK_EQUAL(4 * recordBytes, fileSize("/log.0"));
+
+    // Appends carry on from the last good record
+    appendSamples(log, 5, 6);
+    uint32_t numbers[16];
+    CHECK_EQUAL(5, readNumbers(log, numbers, 16));
+    CHECK_EQUAL(3u, numbers[3]);
+    CHECK_EQUAL(5u, numbers[4]);
+}
+
+TEST(FlashLogStopsAtABadCrc){
+    const size_t recordBytes = headerBytes + sizeof(Sample);
+    {
+        FlashLog log("log", 1024, 0);
+        log.begin();
+        appendSamples(log, 0, 5);
+    }
+    // A bit flipped in the third record's payload, it and everything after go
+    CHECK(hostFsCorrupt("/log.0", 2 * recordBytes + headerBytes + 4, 0x10));
+
+    FlashLog log("log", 1024, 0);
+    log.begin();
+    uint32_t numbers[16];
+    CHECK_EQUAL(2, readNumbers(log, numbers, 16));
+    CHECK_EQUAL(2 * recordBytes, fileSize("/log.0"));
+}
+
+TEST(FlashLogWithoutAFilesystem){
+    hostFsMountFails(true);
+    FlashLog log("log", 1024, 0);
+    CHECK(!log.begin());
+    CHECK_CONTAINS("log is RAM only", hostSerialOutput());
+    CHECK(log.append(1, "x", 1));
+    uint32_t numbers[4];
+    CHECK_EQUAL(0, readNumbers(log, numbers, 4));
+    CHECK_EQUAL(0u, log.flushes());
+}
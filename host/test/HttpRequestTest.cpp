@@ -0,0 +1,109 @@
+#include "Check.h"
+#include "HttpRequest.h"
+
+static HttpRequest::Result feedAll(HttpRequest& request, const char* text){
+    HttpRequest::Result result = HttpRequest::INCOMPLETE;
+    while (*text) result = request.feed(*text++);
+    return result;
+}
+
+TEST(HttpRequestParsesRequestLine){
+    HttpRequest request;
+    CHECK_EQUAL(HttpRequest::INCOMPLETE, feedAll(request, "GET /api/v1/readings?sensor=1 HTTP/1.1\r\nHost: thermo\r\n"));
+    CHECK_EQUAL(HttpRequest::COMPLETE, feedAll(request, "\r\n"));
+    CHECK_STRING("GET", request.method());
+    CHECK_STRING("/api/v1/readings", request.path());
+    CHECK_STRING("sensor=1", request.query());
+}
+
+TEST(HttpRequestBareNewlines){
+    HttpRequest request;
+    CHECK_EQUAL(HttpRequest::COMPLETE, feedAll(request, "GET / HTTP/1.0\n\n"));
+    CHECK_STRING("/", request.path());
+    CHECK_STRING("", request.query());
+}
+
+TEST(HttpRequestIfNoneMatch){
+    HttpRequest request;
+    feedAll(request, "GET / HTTP/1.1\r\nif-none-match:   \"abc123\"\r\n\r\n");
+    CHECK(request.ifNoneMatch("\"abc123\""));
+    CHECK(!request.ifNoneMatch("\"abc124\""));
+
+    request.reset();
+    feedAll(request, "GET / HTTP/1.1\r\n\r\n");
+    CHECK(!request.ifNoneMatch(""));
+}
+
+TEST(HttpRequestBadRequestLines){
+    const char* bad[] = {
+        "GARBAGE\r\n",
+        "LONGMETHOD / HTTP/1.1\r\n",
+        "GET index.html HTTP/1.1\r\n",
+        "GET /aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa HTTP/1.1\r\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++){
+        HttpRequest request;
+        CHECK_EQUAL(HttpRequest::BAD_REQUEST, feedAll(request, bad[i]));
+        // And it stays that way whatever comes after
+        CHECK_EQUAL(HttpRequest::BAD_REQUEST, feedAll(request, "\r\n\r\n"));
+    }
+}
+
+TEST(HttpRequestTooLarge){
+    HttpRequest request;
+    feedAll(request, "GET / HTTP/1.1\r\n");
+    HttpRequest::Result result = HttpRequest::INCOMPLETE;
+    for (int i = 0; i < 100 && result == HttpRequest::INCOMPLETE; i++){
+        result = feedAll(request, "X-Filler: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\r\n");
+    }
+    CHECK_EQUAL(HttpRequest::TOO_LARGE, result);
+}
+
+TEST(HttpRequestLongHeaderLineIsTruncated){
+    HttpRequest request;
+    feedAll(request, "GET /x HTTP/1.1\r\nCookie: ");
+    for (int i = 0; i < 1000; i++) request.feed('c');
+    CHECK_EQUAL(HttpRequest::COMPLETE, feedAll(request, "\r\n\r\n"));
+    CHECK_STRING("/x", request.path());
+}
+
+TEST(HttpRequestResetForTheNextOne){
+    HttpRequest request;
+    feedAll(request, "BOGUS\r\n");
+    request.reset();
+    CHECK_EQUAL(HttpRequest::COMPLETE, feedAll(request, "POST /config?a=b HTTP/1.1\r\n\r\n"));
+    CHECK_STRING("POST", request.method());
+    CHECK_STRING("a=b", request.query());
+}
+
+TEST(HttpRequestNextParam){
+    const char* query = "ssid=My%20Net&pw=a+b&&flag&x=%zz";
+    char name[16];
+    char value[16];
+    CHECK(HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+    CHECK_STRING("ssid", name);
+    CHECK_STRING("My Net", value);
+    CHECK(HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+    CHECK_STRING("pw", name);
+    CHECK_STRING("a b", value);
+    CHECK(HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+    CHECK_STRING("flag", name);
+    CHECK_STRING("", value);
+    // Not a valid escape, left as it is
+    CHECK(HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+    CHECK_STRING("x", name);
+    CHECK_STRING("%zz", value);
+    CHECK(!HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+}
+
+TEST(HttpRequestNextParamTooLong){
+    const char* query = "name=0123456789abcdefghij&next=1";
+    char name[8];
+    char value[8];
+    CHECK(HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+    // Doesn't fit, so it comes back with no name rather than cut short
+    CHECK_STRING("", name);
+    CHECK(HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value)));
+    CHECK_STRING("next", name);
+    CHECK_STRING("1", value);
+}
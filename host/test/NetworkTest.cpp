@@ -0,0 +1,101 @@
+#include "Check.h"
+#include "Network.h"
+#include <ESP8266WiFi.h>
+
+// update() as its task would run it, every 10 ms, with SNTP getting its
+// turn in between like it does after each loop()
+static void runNetwork(NetworkManager& network, unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms){
+        network.update();
+        hostRunScheduled();
+        hostAdvanceMillis(10);
+    }
+}
+
+// Up from the first cold boot, then reset with RTC memory kept
+static void connectThenReset(){
+    NetworkManager network("HostNet", "hostpass");
+    network.begin();
+    runNetwork(network, 1000 * 5);
+    CHECK(network.connected());
+    hostReset(true);
+}
+
+TEST(NetworkJoinsInTheBackground){
+    NetworkManager network("HostNet", "hostpass");
+    unsigned long start = millis();
+    network.begin();
+    CHECK_EQUAL(start, millis());
+    CHECK(!network.connected());
+
+    // Nothing in RTC memory after a power cycle, so it scans
+    runNetwork(network, 1000 * 5);
+    CHECK(network.connected());
+    CHECK(!network.fastConnected());
+    CHECK_NEAR(3000, network.lastConnectMillis(), 10);
+    CHECK_EQUAL(1ul, network.connects());
+}
+
+TEST(NetworkFastConnectAfterAReset){
+    connectThenReset();
+    NetworkManager network("HostNet", "hostpass");
+    network.begin();
+    CHECK_CONTAINS("WiFi: fast connect on channel 6", hostSerialOutput());
+    runNetwork(network, 1000);
+    CHECK(network.connected());
+    CHECK(network.fastConnected());
+    CHECK_NEAR(400, network.lastConnectMillis(), 10);
+}
+
+TEST(NetworkScansWhenTheApMoved){
+    connectThenReset();
+    hostAccessPoint.channel = 11;
+    NetworkManager network("HostNet", "hostpass");
+    network.begin();
+    runNetwork(network, 1000 * 10);
+    CHECK_CONTAINS("WiFi: fast connect failed, scanning.", hostSerialOutput());
+    CHECK(network.connected());
+    CHECK(!network.fastConnected());
+
+    // And the new channel's what's cached next time
+    hostReset(true);
+    hostAccessPoint.channel = 11;
+    NetworkManager again("HostNet", "hostpass");
+    again.begin();
+    runNetwork(again, 1000);
+    CHECK(again.fastConnected());
+}
+
+TEST(NetworkTimesAReconnect){
+    NetworkManager network("HostNet", "hostpass");
+    network.begin();
+    runNetwork(network, 1000 * 5);
+
+    hostAccessPoint.up = false;
+    runNetwork(network, 1000 * 10);
+    CHECK(!network.connected());
+    CHECK_CONTAINS("WiFi connection lost.", hostSerialOutput());
+
+    // The SDK finds it again on its own
+    hostAccessPoint.up = true;
+    runNetwork(network, 1000 * 10);
+    CHECK(network.connected());
+    CHECK_EQUAL(2ul, network.connects());
+}
+
+TEST(NetworkClockComesAfterWiFi){
+    NetworkManager network("HostNet", "hostpass");
+    configTime(0, 0, "pool.ntp.org");
+    network.begin();
+    CHECK(!NetworkManager::validTime(time(nullptr)));
+    runNetwork(network, 3100);
+    CHECK(network.connected());
+    CHECK(!network.clockSet());
+
+    // NTP answers a second after WiFi's up
+    runNetwork(network, 1000);
+    CHECK(network.clockSet());
+    CHECK(NetworkManager::validTime(time(nullptr)));
+    CHECK_CONTAINS("Clock set by NTP.", hostSerialOutput());
+}
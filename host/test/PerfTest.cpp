@@ -0,0 +1,107 @@
+#include "Check.h"
+#include "Perf.h"
+
+// What the cycle counter would have gone up by, at 80 MHz
+static uint32_t cycles(uint32_t micros){
+    return micros * 80;
+}
+
+TEST(PerfProbeStats){
+    PerfProbe probe("test");
+    CHECK_EQUAL(0u, probe.count());
+    CHECK_EQUAL(0u, probe.minMicros());
+    CHECK_EQUAL(0u, probe.averageMicros());
+
+    probe.record(cycles(5));
+    probe.record(cycles(100));
+    probe.record(cycles(1000));
+    CHECK_EQUAL(3u, probe.count());
+    CHECK_EQUAL(5u, probe.minMicros());
+    CHECK_EQUAL(1000u, probe.maxMicros());
+    CHECK_EQUAL(368u, probe.averageMicros());
+    CHECK_EQUAL(1105ull, probe.totalMicros());
+
+    probe.reset();
+    CHECK_EQUAL(0u, probe.count());
+    CHECK_EQUAL(0u, probe.maxMicros());
+}
+
+TEST(PerfProbeHistogram){
+    PerfProbe probe("test");
+    // 5 us is in (4, 8], 1000 us in (512, 1024]
+    probe.record(cycles(5));
+    probe.record(cycles(7));
+    probe.record(cycles(1000));
+    CHECK_EQUAL(2u, probe.bucket(3));
+    CHECK_EQUAL(8u, PerfProbe::bucketLimitMicros(3));
+    CHECK_EQUAL(1u, probe.bucket(10));
+
+    // A limit itself is in its bucket, as "le" says, one over is in the next
+    probe.record(cycles(8));
+    probe.record(cycles(9));
+    probe.record(cycles(1024));
+    CHECK_EQUAL(3u, probe.bucket(3));
+    CHECK_EQUAL(1u, probe.bucket(4));
+    CHECK_EQUAL(2u, probe.bucket(10));
+
+    // Up to a microsecond, and a whole second, go in the ends
+    probe.record(cycles(0));
+    probe.record(cycles(1));
+    probe.record(cycles(1000 * 1000));
+    CHECK_EQUAL(2u, probe.bucket(0));
+    CHECK_EQUAL(1u, probe.bucket(PerfProbe::BUCKETS - 1));
+
+    uint32_t total = 0;
+    for (int i = 0; i < PerfProbe::BUCKETS; i++) total += probe.bucket(i);
+    CHECK_EQUAL(probe.count(), total);
+}
+
+TEST(PerfTimerTimesItsScope){
+    PerfProbe probe("test");
+    {
+        PerfTimer timer(probe);
+        hostAdvanceMicros(1500);
+    }
+    CHECK_EQUAL(1u, probe.count());
+    // Plus however long the host took over it
+    CHECK(probe.maxMicros() >= 1500);
+    CHECK_NEAR(1500, probe.maxMicros(), 100);
+}
+
+TEST(PerfProbeReport){
+    PerfProbe probe("test");
+    probe.record(cycles(5));
+    probe.record(cycles(1000));
+    probe.record(cycles(1000 * 1000));
+    char buff[256];
+    {
+        BufferedPrint out(Serial, buff, sizeof(buff));
+        probe.report(out);
+    }
+    const char* report = hostSerialOutput();
+    CHECK_CONTAINS("test       n=3 min=5 avg=333668 max=1000000 us\n", report);
+    CHECK_CONTAINS("    <=      8 us: 1\n", report);
+    CHECK_CONTAINS("    <=   1024 us: 1\n", report);
+    CHECK_CONTAINS("    >  262144 us: 1\n", report);
+    // Only the buckets with something in them
+    CHECK(strstr(report, "<=     16 us") == NULL);
+}
+
+// Out here so the compiler can't drop the new/delete pair
+static char* volatile block;
+
+TEST(PerfHeapMonitorLowWater){
+    HeapMonitor monitor;
+    monitor.sampleFragmentation();
+    uint32_t before = monitor.freeLowWater();
+    CHECK_EQUAL(ESP.getFreeHeap(), before);
+
+    block = new char[4000];
+    monitor.sample();
+    delete[] block;
+    monitor.sampleFragmentation();
+    // It keeps the lowest it saw, not what's free now
+    CHECK_EQUAL(before - 4000, monitor.freeLowWater());
+    CHECK(ESP.getFreeHeap() > monitor.freeLowWater());
+    CHECK_EQUAL(0, monitor.maxFragmentation());
+}
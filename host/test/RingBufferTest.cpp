@@ -0,0 +1,96 @@
+#include "Check.h"
+#include "RingBuffer.h"
+
+TEST(RingBufferStartsEmpty){
+    RingBuffer<int16_t, 4> buffer;
+    CHECK(buffer.isEmpty());
+    CHECK_EQUAL(0, buffer.count());
+    CHECK_EQUAL(4, buffer.capacity());
+    CHECK_EQUAL(0, buffer.mean());
+}
+
+TEST(RingBufferOverwritesOldest){
+    RingBuffer<int16_t, 3> buffer;
+    for (int16_t v = 1; v <= 5; v++) buffer.push(v * 100);
+    CHECK_EQUAL(3, buffer.count());
+    CHECK_EQUAL(500, buffer.newest());
+    CHECK_EQUAL(400, buffer.at(1));
+    CHECK_EQUAL(300, buffer.at(2));
+    CHECK_EQUAL(400, buffer.mean());
+}
+
+TEST(RingBufferRescansWhenMinOrMaxFallsOff){
+    RingBuffer<int16_t, 3> buffer;
+    buffer.push(-500);
+    buffer.push(100);
+    buffer.push(900);
+    CHECK_EQUAL(-500, buffer.min());
+    CHECK_EQUAL(900, buffer.max());
+
+    // -500 goes, the min has to come from what's left
+    buffer.push(200);
+    CHECK_EQUAL(100, buffer.min());
+    CHECK_EQUAL(900, buffer.max());
+
+    // Then the max
+    buffer.push(300);
+    buffer.push(250);
+    CHECK_EQUAL(200, buffer.min());
+    CHECK_EQUAL(300, buffer.max());
+}
+
+// Against a plain scan of the last 16, falling (every push evicts the max)
+// then noisy
+TEST(RingBufferMinMaxMatchAScan){
+    RingBuffer<int16_t, 16> buffer;
+    int16_t values[200];
+    uint32_t seed = 1;
+    for (int i = 0; i < 200; i++){
+        seed = seed * 1103515245 + 12345;
+        values[i] = i < 100 ? 4000 - i * 10 : (int16_t)((seed >> 16) % 1000) - 500;
+        buffer.push(values[i]);
+        int16_t lowest = values[i];
+        int16_t highest = values[i];
+        for (int j = i > 15 ? i - 15 : 0; j < i; j++){
+            lowest = min(lowest, values[j]);
+            highest = max(highest, values[j]);
+        }
+        if (buffer.min() != lowest || buffer.max() != highest){
+            checkFailed(__FILE__, __LINE__, "after %d pushes min/max %d/%d, scan says %d/%d",
+                i + 1, buffer.min(), buffer.max(), lowest, highest);
+            return;
+        }
+    }
+}
+
+TEST(RingBufferMeanWithNegatives){
+    RingBuffer<int16_t, 4> buffer;
+    buffer.push(-1000);
+    buffer.push(-2000);
+    buffer.push(500);
+    CHECK_EQUAL(-833, buffer.mean());
+}
+
+TEST(RingBufferCountBelowOnlyLooksAtTheLastM){
+    RingBuffer<int16_t, 10> buffer;
+    buffer.push(3000);
+    buffer.push(3000);
+    buffer.push(4000);
+    buffer.push(3000);
+    CHECK_EQUAL(1, buffer.countBelow(3500, 2));
+    CHECK_EQUAL(3, buffer.countBelow(3500, 4));
+    // More than it holds is just everything
+    CHECK_EQUAL(3, buffer.countBelow(3500, 10));
+}
+
+TEST(RingBufferClear){
+    RingBuffer<int16_t, 3> buffer;
+    buffer.push(7);
+    buffer.push(9);
+    buffer.clear();
+    CHECK(buffer.isEmpty());
+    buffer.push(-4);
+    CHECK_EQUAL(-4, buffer.min());
+    CHECK_EQUAL(-4, buffer.max());
+    CHECK_EQUAL(-4, buffer.mean());
+}
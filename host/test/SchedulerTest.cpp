@@ -0,0 +1,110 @@
+#include "Check.h"
+#include "Scheduler.h"
+
+static int order[16];
+static int orderCount;
+static int runsA;
+static int runsB;
+
+static void taskA(){
+    runsA++;
+    order[orderCount++ % 16] = 'A';
+}
+
+static void taskB(){
+    runsB++;
+    order[orderCount++ % 16] = 'B';
+}
+
+static void slowTask(){
+    delay(5);
+}
+
+TEST(SchedulerRunsInOrderWhenDue){
+    Scheduler scheduler;
+    scheduler.add("a", taskA, 100);
+    scheduler.add("b", taskB, 0);
+    scheduler.run();
+    CHECK_EQUAL(1, runsA);
+    CHECK_EQUAL(1, runsB);
+    CHECK_EQUAL('A', order[0]);
+    CHECK_EQUAL('B', order[1]);
+
+    // b runs every pass, a every 100 ms
+    for (int i = 0; i < 10; i++){
+        hostAdvanceMillis(10);
+        scheduler.run();
+    }
+    CHECK_EQUAL(2, runsA);
+    CHECK_EQUAL(11, runsB);
+}
+
+TEST(SchedulerKeepsCadenceWhenALittleLate){
+    Scheduler scheduler;
+    int task = scheduler.add("a", taskA, 100);
+    scheduler.run();
+    unsigned long start = millis();
+
+    hostAdvanceMillis(130);
+    scheduler.run();
+    CHECK_EQUAL(30, scheduler.taskMaxLateMillis(task));
+    // Still due at start + 200, not 130 + 100
+    CHECK_EQUAL(70, scheduler.millisUntilNextTask());
+    hostAdvanceMillis(70);
+    CHECK_EQUAL(start + 200, millis());
+    scheduler.run();
+    CHECK_EQUAL(3, runsA);
+}
+
+TEST(SchedulerReanchorsWhenAPeriodBehind){
+    Scheduler scheduler;
+    scheduler.add("a", taskA, 100);
+    scheduler.run();
+
+    // Blocked for 3.5 periods: it runs once, not 3 times back to back
+    hostAdvanceMillis(350);
+    scheduler.run();
+    scheduler.run();
+    CHECK_EQUAL(2, runsA);
+    CHECK_EQUAL(100, scheduler.millisUntilNextTask());
+}
+
+TEST(SchedulerTimedTasksLeaveOutEveryPass){
+    Scheduler scheduler;
+    scheduler.add("a", taskA, 250);
+    scheduler.add("b", taskB, 0);
+    scheduler.run();
+    CHECK_EQUAL(0, scheduler.millisUntilNextTask());
+    CHECK_EQUAL(250, scheduler.millisUntilNextTimedTask());
+
+    Scheduler empty;
+    CHECK_EQUAL(0xFFFFFFFF, empty.millisUntilNextTask());
+}
+
+TEST(SchedulerTableFull){
+    Scheduler scheduler;
+    int last = 0;
+    for (int i = 0; i < 12; i++) last = scheduler.add("a", taskA, 10);
+    CHECK_EQUAL(11, last);
+    CHECK_EQUAL(-1, scheduler.add("b", taskB, 10));
+    CHECK_EQUAL(12, scheduler.taskCount());
+}
+
+// micros() is the virtual clock, so what's timed is what a task blocks for
+TEST(SchedulerTimesTasks){
+    Scheduler scheduler;
+    int task = scheduler.add("slow", slowTask, 0);
+    scheduler.run();
+    scheduler.run();
+    CHECK_EQUAL(2, scheduler.taskRuns(task));
+    CHECK_EQUAL(5000, scheduler.taskMaxMicros(task));
+    CHECK_EQUAL(5000, scheduler.taskAverageMicros(task));
+
+    HardwareSerial& out = Serial;
+    scheduler.report(out);
+    CHECK_CONTAINS("slow", hostSerialOutput());
+
+    scheduler.resetStats();
+    CHECK_EQUAL(0, scheduler.taskRuns(task));
+    CHECK_EQUAL(0, scheduler.taskMaxMicros(task));
+}
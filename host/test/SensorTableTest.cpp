@@ -0,0 +1,315 @@
+#include "Check.h"
+#include "SensorTable.h"
+
+// update() as loop() would call it, with the clock moving a millisecond a pass
+static void runTable(SensorTable& table, unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms){
+        table.update();
+        hostAdvanceMillis(1);
+    }
+}
+
+TEST(SensorTableFindsEverySensorOnEachBus){
+    hostAddDS18B20(D1, 4.0);
+    hostAddDS18B20(D1, 5.0);
+    hostAddDS18B20(D1, 6.0);
+    hostAddDS18B20(D6, -18.0);
+    SensorTable table(1000 * 10);
+    CHECK(table.addBus(D1));
+    CHECK(table.addBus(D6));
+    runTable(table, 1000 * 2);
+
+    // In bus order, then the order they were found
+    CHECK_EQUAL(4, table.count());
+    CHECK(table.allChecked());
+    CHECK_EQUAL(0, table.faultCount());
+    CHECK_EQUAL(0, table.sensor(0).bus);
+    CHECK_EQUAL(0, table.sensor(2).bus);
+    CHECK_EQUAL(1, table.sensor(3).bus);
+    CHECK_STRING("Sensor 1", table.sensor(0).label);
+    CHECK_STRING("Sensor 4", table.sensor(3).label);
+    CHECK_EQUAL(fromCelsius(4.0), table.sensor(0).temp);
+    CHECK_EQUAL(fromCelsius(6.0), table.sensor(2).temp);
+    CHECK_EQUAL(fromCelsius(-18.0), table.sensor(3).temp);
+}
+
+TEST(SensorTableConvertsABusAtOnce){
+    for (int i = 0; i < 6; i++) hostAddDS18B20(D1, 4.0 + i);
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    unsigned long start = millis();
+    while (!table.allChecked() && millis() - start < 1000 * 5){
+        table.update();
+        hostAdvanceMillis(1);
+    }
+
+    // One 750 ms conversion for all six, not six of them back to back
+    CHECK(table.allChecked());
+    CHECK(millis() - start < 750 + 100);
+    for (int i = 0; i < 6; i++){
+        CHECK_EQUAL(table.sensor(0).convertMillis, table.sensor(i).convertMillis);
+        CHECK_EQUAL(1u, hostDS18B20(D1, i)->conversions);
+        CHECK_EQUAL(fromCelsius(4.0 + i), table.sensor(i).temp);
+    }
+
+    // And again each interval
+    runTable(table, 1000 * 30);
+    CHECK_EQUAL(4u, hostDS18B20(D1, 0)->conversions);
+    CHECK_EQUAL(4u, hostDS18B20(D1, 5)->conversions);
+}
+
+TEST(SensorTableLabelsFromSettings){
+    HostDS18B20* first = hostAddDS18B20(D1, 4.0);
+    HostDS18B20* second = hostAddDS18B20(D1, 5.0);
+    SensorSettings settings[1];
+    memcpy(settings[0].addr, second->rom, 8);
+    settings[0].label = "Chamber";
+    settings[0].resolution = 0;
+    settings[0].sampleIntervalMillis = 0;
+    SensorTable table(1000 * 10);
+    table.setSettings(settings, 1);
+    table.addBus(D1);
+    runTable(table, 1000 * 2);
+
+    CHECK_EQUAL(2, table.count());
+    CHECK_EQUAL(0, memcmp(first->rom, table.sensor(0).addr, 8));
+    CHECK_STRING("Sensor 1", table.sensor(0).label);
+    CHECK_STRING("Chamber", table.sensor(1).label);
+    CHECK_EQUAL(12, table.sensor(1).resolution);
+    CHECK_EQUAL(1000ul * 10, table.sensor(1).sampleIntervalMillis);
+}
+
+TEST(SensorTableFillsUp){
+    for (int i = 0; i < 8; i++){
+        hostAddDS18B20(D1, 4.0);
+        hostAddDS18B20(D2, 4.0);
+    }
+    hostAddDS18B20(D5, 4.0);
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    table.addBus(D2);
+    table.addBus(D5);
+    CHECK(table.addBus(D6));
+    CHECK(!table.addBus(D7));
+    runTable(table, 1000 * 2);
+
+    CHECK_EQUAL(MAX_SENSORS, table.count());
+    CHECK(table.allChecked());
+    CHECK_CONTAINS("Sensor table full!", hostSerialOutput());
+}
+
+// Settings for one sensor, by its ROM
+static SensorSettings settingsFor(HostDS18B20* device, byte resolution, unsigned long intervalMillis){
+    SensorSettings settings;
+    memcpy(settings.addr, device->rom, 8);
+    settings.label = "Probe";
+    settings.resolution = resolution;
+    settings.sampleIntervalMillis = intervalMillis;
+    return settings;
+}
+
+TEST(SensorTableWritesResolutionOnce){
+    HostDS18B20* device = hostAddDS18B20(D1, 20.3);
+    SensorSettings settings = settingsFor(device, 9, 0);
+    SensorTable table(1000 * 10);
+    table.setSettings(&settings, 1);
+    table.addBus(D1);
+    runTable(table, 1000 * 2);
+
+    CHECK_EQUAL(9, device->resolution());
+    CHECK_EQUAL(0x1F, device->eeprom[2]);
+    CHECK_EQUAL(1u, device->eepromWrites);
+    // The alarm bytes are left alone
+    CHECK_EQUAL(0x4B, device->eeprom[0]);
+    CHECK_EQUAL(0x46, device->eeprom[1]);
+    // 20.3 is 20.3125 at 12 bits, 20.0 at 9 with the undefined bits dropped
+    CHECK_EQUAL(fromCelsius(20.0), table.sensor(0).temp);
+
+    // Checked again after a re-search, but it's already right so no more EEPROM writes
+    hostShortBus(D1, true);
+    runTable(table, 100);
+    hostShortBus(D1, false);
+    runTable(table, 1000 * 5);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+    CHECK_EQUAL(1u, device->eepromWrites);
+
+    // Changed at runtime, it goes out before the next conversion
+    table.setResolution(0, 11);
+    runTable(table, 1000 * 11);
+    CHECK_EQUAL(11, device->resolution());
+    CHECK_EQUAL(2u, device->eepromWrites);
+    CHECK_EQUAL(fromCelsius(20.25), table.sensor(0).temp);
+}
+
+TEST(SensorTableWaitsOnlyAsLongAsTheResolutionNeeds){
+    CHECK_EQUAL(94u, SensorTable::conversionMillis(9));
+    CHECK_EQUAL(750u, SensorTable::conversionMillis(12));
+    CHECK_EQUAL(750u, SensorTable::conversionMillis(15));
+
+    HostDS18B20* device = hostAddDS18B20(D1, 4.0);
+    SensorSettings settings = settingsFor(device, 9, 0);
+    SensorTable table(1000 * 10);
+    table.setSettings(&settings, 1);
+    table.addBus(D1);
+    runTable(table, 1000 * 2);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+
+    // Read as soon as the line's released, not after 750 ms
+    runTable(table, 1000 * 10);
+    const Sensor& sensor = table.sensor(0);
+    CHECK(sensor.sampleMillis - sensor.convertMillis >= 94);
+    CHECK(sensor.sampleMillis - sensor.convertMillis < 94 + 5);
+}
+
+TEST(SensorTableSamplesEachSensorOnItsOwnInterval){
+    HostDS18B20* fast = hostAddDS18B20(D1, 4.0);
+    HostDS18B20* slow = hostAddDS18B20(D1, 5.0);
+    SensorSettings settings[] = {settingsFor(fast, 9, 1000), settingsFor(slow, 12, 1000 * 10)};
+    SensorTable table(1000 * 10);
+    table.setSettings(settings, 2);
+    table.addBus(D1);
+    runTable(table, 1000 * 30);
+
+    CHECK_EQUAL(1000ul, table.sensor(0).sampleIntervalMillis);
+    CHECK_NEAR(30, fast->conversions, 2);
+    CHECK_NEAR(3, slow->conversions, 1);
+    // The fast one isn't held up behind the slow one's 750 ms
+    const Sensor& sensor = table.sensor(0);
+    CHECK(sensor.sampleMillis - sensor.convertMillis < 94 + 5);
+
+    table.setSampleInterval(1, 1000);
+    runTable(table, 1000 * 10);
+    CHECK_NEAR(13, slow->conversions, 2);
+}
+
+TEST(SensorTableRetriesBadCrc){
+    HostDS18B20* device = hostAddDS18B20(D1, 4.0);
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    runTable(table, 1000 * 2);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+
+    // One bad read is put down to noise and read again
+    device->crcErrors = 1;
+    device->celsius = 5.0;
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(5.0), table.sensor(0).temp);
+    CHECK_EQUAL(0, device->crcErrors);
+
+    // Three in a row and it's marked, keeping the last good reading
+    device->crcErrors = 3;
+    device->celsius = 6.0;
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_CRC_ERROR, table.sensor(0).health);
+    CHECK_EQUAL(1, table.sensor(0).failures);
+    CHECK_EQUAL(fromCelsius(5.0), table.sensor(0).temp);
+    CHECK_EQUAL(1, table.faultCount());
+
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(6.0), table.sensor(0).temp);
+    CHECK_CONTAINS("recovered after 1 failed reads", hostSerialOutput());
+}
+
+TEST(SensorTableMarksAMissingSensor){
+    HostDS18B20* gone = hostAddDS18B20(D1, 4.0);
+    hostAddDS18B20(D1, 5.0);
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    runTable(table, 1000 * 2);
+
+    // Unplugged, it reads as all 1s rather than -0.06 or 127.94
+    gone->missing = true;
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_MISSING, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(4.0), table.sensor(0).temp);
+    CHECK(table.sensor(0).hasReading);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(1).health);
+    CHECK_EQUAL(1, table.faultCount());
+    CHECK_CONTAINS("Sensor 1: missing", hostSerialOutput());
+
+    gone->missing = false;
+    gone->celsius = 3.0;
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(3.0), table.sensor(0).temp);
+    CHECK_EQUAL(0, table.faultCount());
+}
+
+TEST(SensorTableCatchesThePowerOnValue){
+    HostDS18B20* device = hostAddDS18B20(D1, 4.0);
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    runTable(table, 1000 * 2);
+
+    // Browned out mid conversion, the scratchpad's back to 85 C
+    while (!device->converting){
+        table.update();
+        hostAdvanceMillis(1);
+    }
+    device->powerCycle();
+    runTable(table, 1000);
+    CHECK_EQUAL(SENSOR_POWER_ON, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(4.0), table.sensor(0).temp);
+
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+
+    // Warming up through 85 C it's a reading, not a reset
+    device->celsius = 82.0;
+    runTable(table, 1000 * 10);
+    device->celsius = 85.0;
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(85.0), table.sensor(0).temp);
+}
+
+TEST(SensorTableResearchesAShortedBus){
+    hostAddDS18B20(D1, 4.0);
+    hostAddDS18B20(D1, 5.0);
+    hostAddDS18B20(D6, 6.0);
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    table.addBus(D6);
+    runTable(table, 1000 * 2);
+
+    hostShortBus(D1, true);
+    runTable(table, 1000 * 10);
+    CHECK_EQUAL(SENSOR_BUS_FAULT, table.sensor(0).health);
+    CHECK_EQUAL(SENSOR_BUS_FAULT, table.sensor(1).health);
+    CHECK_EQUAL(SENSOR_OK, table.sensor(2).health);
+    CHECK_EQUAL(2, table.faultCount());
+
+    // Found again in the same slots, the other bus carried on meanwhile
+    hostShortBus(D1, false);
+    runTable(table, 1000 * 60 * 2);
+    CHECK_EQUAL(3, table.count());
+    CHECK_EQUAL(SENSOR_OK, table.sensor(0).health);
+    CHECK_EQUAL(fromCelsius(5.0), table.sensor(1).temp);
+    CHECK_EQUAL(fromCelsius(6.0), table.sensor(2).temp);
+    CHECK_EQUAL(0, table.faultCount());
+}
+
+TEST(SensorTableBacksOffAnEmptyBus){
+    SensorTable table(1000 * 10);
+    table.addBus(D1);
+    runTable(table, 1000 * 60 * 5);
+    CHECK_EQUAL(0, table.count());
+    CHECK(!table.allChecked());
+    CHECK_CONTAINS("next search in 250 ms", hostSerialOutput());
+    CHECK_CONTAINS("next search in 60000 ms", hostSerialOutput());
+
+    // Plugged in now, it's not seen until the minute's up
+    hostAddDS18B20(D1, 4.0);
+    runTable(table, 1000);
+    unsigned long waited = 1000;
+    while (table.count() == 0 && waited < 1000 * 61){
+        runTable(table, 1000);
+        waited += 1000;
+    }
+    CHECK_EQUAL(1, table.count());
+    CHECK(waited > 1000 * 2);
+    CHECK(waited <= 1000 * 61);
+}
@@ -0,0 +1,447 @@
+#include "Check.h"
+#include "Sketch.h"
+#include "WebServer.h"
+#include <ESP8266WiFi.h>
+#include <OneWire.h>
+#include <SSD1306Wire.h>
+#include "Network.h"
+#include "SensorTable.h"
+#include "Temperature.h"
+#include "ConfigStore.h"
+
+// The sketch's own globals
+extern NetworkManager network;
+extern SensorTable sensors;
+extern RuntimeConfig config;
+
+static void bootWithSensors(){
+    hostAddDS18B20(D1, 4.0);
+    hostAddDS18B20(D6, 20.0);
+    sketchSetup();
+}
+
+// Send a whole request as a browser would and run the sketch until it hangs
+// up, what came back (empty if it never did)
+static const char* fetch(const char* request){
+    static char response[1024 * 16];
+    response[0] = '\0';
+    HostPeer browser = hostConnect(80);
+    if (!browser.valid()) return response;
+    browser.send(request);
+    unsigned long start = millis();
+    while (!browser.closedByDevice() && millis() - start < 1000 * 5) sketchPass();
+    if (browser.closedByDevice()) snprintf(response, sizeof(response), "%s", browser.received());
+    return response;
+}
+
+static const char* get(const char* path){
+    char request[128];
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: thermo\r\n\r\n", path);
+    return fetch(request);
+}
+
+TEST(SketchBootsAndJoins){
+    bootWithSensors();
+    CHECK(!network.connected());
+    sketchRunFor(1000 * 5);
+    CHECK(network.connected());
+    CHECK(network.clockSet());
+    CHECK(NetworkManager::validTime(time(nullptr)));
+    CHECK_CONTAINS("WiFi connected", hostSerialOutput());
+}
+
+TEST(SketchReadsSensors){
+    bootWithSensors();
+    sketchRunFor(1000 * 3);
+    CHECK_EQUAL(2, sensors.count());
+    CHECK_EQUAL(SENSOR_OK, sensors.sensor(0).health);
+    CHECK_EQUAL(SENSOR_OK, sensors.sensor(1).health);
+    CHECK_EQUAL(fromCelsius(4.0), sensors.sensor(0).temp);
+    CHECK_EQUAL(fromCelsius(20.0), sensors.sensor(1).temp);
+}
+
+TEST(SketchServesReadings){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    const char* response = get("/api/v1/readings");
+    CHECK_CONTAINS("HTTP/1.1 200", response);
+    CHECK_CONTAINS("39.2", response);
+}
+
+// A sensor's labels as /metrics gives them
+static void metricLabels(char* buff, size_t size, int index){
+    char id[17];
+    SensorTable::formatAddress(sensors.sensor(index).addr, id);
+    snprintf(buff, size, "sensor=\"%s\",name=\"%s\"", id, sensors.sensor(index).label);
+}
+
+TEST(SketchServesMetrics){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    const char* metrics = get("/metrics");
+    CHECK_CONTAINS("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4", metrics);
+
+    char labels[64];
+    char line[128];
+    metricLabels(labels, sizeof(labels), 0);
+    snprintf(line, sizeof(line), "tempmon_temperature_degrees{%s,unit=\"F\"} 39.20\n", labels);
+    CHECK_CONTAINS(line, metrics);
+    snprintf(line, sizeof(line), "tempmon_sensor_up{%s,state=\"ok\"} 1\n", labels);
+    CHECK_CONTAINS(line, metrics);
+    CHECK_CONTAINS("tempmon_sensor_faults 0\n", metrics);
+    CHECK_CONTAINS("tempmon_wifi_up 1\n", metrics);
+    CHECK_CONTAINS("tempmon_wifi_connects_total 1\n", metrics);
+
+    // Every metric has its HELP and TYPE once, ahead of its samples
+    const char* type = metrics;
+    while ((type = strstr(type, "# TYPE ")) != NULL){
+        type += 7;
+        char name[64];
+        sscanf(type, "%63s", name);
+        char help[80];
+        snprintf(help, sizeof(help), "# HELP %s ", name);
+        const char* helpAt = strstr(metrics, help);
+        CHECK(helpAt != NULL && helpAt < type);
+        char again[80];
+        snprintf(again, sizeof(again), "# TYPE %s ", name);
+        CHECK(strstr(type, again) == NULL);
+        char sample[80];
+        snprintf(sample, sizeof(sample), "\n%s", name);
+        const char* sampleAt = strstr(metrics, sample);
+        CHECK(sampleAt == NULL || sampleAt > type);
+    }
+}
+
+TEST(SketchMetricsLoopHistogram){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    const char* metrics = get("/metrics");
+
+    // Buckets only ever go up, and +Inf is the count
+    unsigned long last = 0;
+    int buckets = 0;
+    const char* bucket = metrics;
+    while ((bucket = strstr(bucket, "tempmon_loop_duration_seconds_bucket{le=\"")) != NULL){
+        bucket = strchr(bucket, '}') + 1;
+        unsigned long cumulative = strtoul(bucket, NULL, 10);
+        CHECK(cumulative >= last);
+        last = cumulative;
+        buckets++;
+    }
+    CHECK(buckets > 4);
+    CHECK(last > 0);
+    const char* count = strstr(metrics, "tempmon_loop_duration_seconds_count ");
+    CHECK(count != NULL);
+    if (count) CHECK_EQUAL(last, strtoul(count + strlen("tempmon_loop_duration_seconds_count "), NULL, 10));
+}
+
+TEST(SketchMetricsShowAFaultySensor){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    // The only sensor on its bus, so nothing answers at all
+    hostDS18B20(D6, 0)->missing = true;
+    sketchRunFor(1000 * 15);
+    const char* metrics = get("/metrics");
+
+    char labels[64];
+    char line[128];
+    metricLabels(labels, sizeof(labels), 1);
+    snprintf(line, sizeof(line), "tempmon_sensor_up{%s,state=\"bus fault\"} 0\n", labels);
+    CHECK_CONTAINS(line, metrics);
+    // No temperature for it, the last good one's getting old
+    snprintf(line, sizeof(line), "tempmon_temperature_degrees{%s,", labels);
+    CHECK(strstr(metrics, line) == NULL);
+    snprintf(line, sizeof(line), "tempmon_sensor_reading_age_seconds{%s} 15.", labels);
+    CHECK_CONTAINS(line, metrics);
+    CHECK_CONTAINS("tempmon_sensor_faults 1\n", metrics);
+}
+
+// A header's value out of a response, empty if it isn't there
+static void headerValue(const char* response, const char* name, char* buff, size_t size){
+    buff[0] = '\0';
+    const char* at = strstr(response, name);
+    if (!at) return;
+    at += strlen(name);
+    size_t length = strcspn(at, "\r\n");
+    snprintf(buff, size, "%.*s", (int)length, at);
+}
+
+TEST(SketchRevalidatesThePage){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    const char* page = get("/");
+    CHECK_CONTAINS("HTTP/1.1 200", page);
+    CHECK_CONTAINS("Cache-Control: no-cache\r\n", page);
+    // It polls for its values instead of reloading
+    CHECK_CONTAINS("fetch(\"/api/v1/readings\")", page);
+    CHECK(strstr(page, "http-equiv=\"refresh\"") == NULL);
+    char etag[16];
+    headerValue(page, "ETag: ", etag, sizeof(etag));
+    CHECK_EQUAL(10u, strlen(etag));
+
+    // Still the same page, nothing to send but the headers
+    char request[128];
+    snprintf(request, sizeof(request), "GET / HTTP/1.1\r\nHost: thermo\r\nIf-None-Match: %s\r\n\r\n", etag);
+    const char* cached = fetch(request);
+    CHECK_CONTAINS("HTTP/1.1 304 Not Modified\r\n", cached);
+    CHECK_CONTAINS(etag, cached);
+    CHECK_CONTAINS("\r\n\r\n", cached);
+    CHECK_EQUAL(0u, strlen(strstr(cached, "\r\n\r\n") + 4));
+
+    // An older version gets it all again
+    cached = fetch("GET / HTTP/1.1\r\nHost: thermo\r\nIf-None-Match: \"00000000\"\r\n\r\n");
+    CHECK_CONTAINS("HTTP/1.1 200", cached);
+}
+
+TEST(SketchReadingsJson){
+    bootWithSensors();
+    sketchRunFor(1000 * 60);
+    const char* response = get("/api/v1/readings");
+    CHECK_CONTAINS("Content-Type: application/json\r\n", response);
+    const char* json = strstr(response, "\r\n\r\n") + 4;
+    CHECK_CONTAINS("{\"time\":", json);
+    CHECK_CONTAINS("\"unit\":\"F\"", json);
+    CHECK_CONTAINS("\"threshold\":35.00", json);
+
+    char id[17];
+    char field[64];
+    for (int i = 0; i < 2; i++){
+        SensorTable::formatAddress(sensors.sensor(i).addr, id);
+        snprintf(field, sizeof(field), "{\"id\":\"%s\",", id);
+        CHECK_CONTAINS(field, json);
+    }
+    CHECK_CONTAINS("\"health\":\"ok\"", json);
+    CHECK_CONTAINS("\"temp\":39.20", json);
+    CHECK_CONTAINS("\"temp\":68.00", json);
+    CHECK_CONTAINS("\"min\":39.20,\"mean\":39.20,\"max\":39.20", json);
+    CHECK_CONTAINS("\"alert\":{\"outOfSpec\":false,\"alerting\":false,\"faults\":0,\"queued\":0}}", json);
+
+    // Nothing left open
+    int depth = 0;
+    for (const char* c = json; *c; c++){
+        if (*c == '{' || *c == '[') depth++;
+        if (*c == '}' || *c == ']') depth--;
+        CHECK(depth >= 0);
+    }
+    CHECK_EQUAL(0, depth);
+}
+
+TEST(SketchReadingsDontTouchTheBus){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    // Line up just after a conversion so none are due while we poll
+    uint32_t conversions = hostDS18B20(D1, 0)->conversions;
+    while (hostDS18B20(D1, 0)->conversions == conversions) sketchPass();
+    conversions = hostDS18B20(D1, 0)->conversions;
+    unsigned long start = millis();
+    for (int i = 0; i < 20; i++){
+        CHECK_CONTAINS("HTTP/1.1 200", get("/api/v1/readings"));
+    }
+    CHECK(millis() - start < 1000);
+    CHECK_EQUAL(conversions, hostDS18B20(D1, 0)->conversions);
+}
+
+TEST(SketchWritesResponsesInBigPieces){
+    bootWithSensors();
+    // Well clear of the minutely perf report, its long printf()s allocate
+    sketchRunFor(1000 * 70);
+    const uint64_t allocations = hostHeapStats().allocations;
+
+    // The page is its headers then the shell from flash, a full response
+    // buffer each write but the last
+    HostPeer browser = hostConnect(80);
+    browser.send("GET / HTTP/1.1\r\nHost: thermo\r\n\r\n");
+    while (!browser.closedByDevice()) sketchPass();
+    CHECK(browser.receivedLength() > 2000);
+    size_t buffer = WebServer::RESPONSE_BUFFER;
+    CHECK_EQUAL((browser.receivedLength() + buffer - 1) / buffer, browser.receivedWrites());
+
+    // The readings are a write a part: the time, two for each sensor, the alerts
+    browser = hostConnect(80);
+    browser.send("GET /api/v1/readings HTTP/1.1\r\nHost: thermo\r\n\r\n");
+    while (!browser.closedByDevice()) sketchPass();
+    CHECK_EQUAL(6u, browser.receivedWrites());
+
+    // And neither touched the heap
+    CHECK_EQUAL(allocations, hostHeapStats().allocations);
+}
+
+static void pressButton(){
+    hostSetPin(D2, HIGH);
+    sketchRunFor(100);
+    hostSetPin(D2, LOW);
+    sketchRunFor(100);
+}
+
+TEST(SketchDisplayOnlyDrawsWhatChanged){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    // Off until the button's pressed, and nothing's drawn while it is
+    CHECK(!hostDisplayOn());
+    uint32_t frames = hostDisplayFrames();
+    uint32_t draws = hostDisplayDraws();
+    sketchRunFor(1000 * 5);
+    CHECK_EQUAL(frames, hostDisplayFrames());
+    CHECK_EQUAL(draws, hostDisplayDraws());
+
+    pressButton();
+    CHECK(hostDisplayOn());
+    CHECK_CONTAINS("192.168.1.50\n", hostDisplayText());
+    CHECK_CONTAINS("39.2°\n68.0°\n", hostDisplayText());
+
+    // Then only the clock ticks, a frame a second with its field redrawn
+    frames = hostDisplayFrames();
+    draws = hostDisplayDraws();
+    sketchRunFor(1000 * 10);
+    CHECK_NEAR(10, hostDisplayFrames() - frames, 1);
+    CHECK(hostDisplayDraws() - draws <= 2 * (hostDisplayFrames() - frames));
+
+    // A change you can see once it's rounded gets its field redrawn
+    hostDS18B20(D1, 0)->celsius = 5.0;
+    sketchRunFor(1000 * 3);
+    CHECK_CONTAINS("41.0°", hostDisplayText());
+
+    // And off again after 15 s
+    sketchRunFor(1000 * 5);
+    CHECK(!hostDisplayOn());
+    frames = hostDisplayFrames();
+    sketchRunFor(1000 * 5);
+    CHECK_EQUAL(frames, hostDisplayFrames());
+}
+
+TEST(SketchServesPerf){
+    bootWithSensors();
+    sketchRunFor(1000 * 10);
+    const char* perf = get("/debug/perf");
+    CHECK_CONTAINS("HTTP/1.1 200", perf);
+    CHECK_CONTAINS("uptime 10 s, first readings at ", perf);
+    const char* probes[] = {"loop", "web", "sensors", "dispatch", "display"};
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++){
+        char line[32];
+        snprintf(line, sizeof(line), "\n%-10s n=", probes[i]);
+        CHECK_CONTAINS(line, perf);
+    }
+    CHECK_CONTAINS("\nheap free=", perf);
+
+    // The same report goes out on Serial every minute
+    sketchRunFor(1000 * 60);
+    CHECK_CONTAINS("\nloop       n=", hostSerialOutput());
+}
+
+TEST(SketchReadsBeforeTheNetworkIsUp){
+    hostAccessPoint.up = false;
+    bootWithSensors();
+    sketchRunFor(1000 * 3);
+    // Sensing doesn't wait on WiFi or the clock
+    CHECK(!network.connected());
+    CHECK(!network.clockSet());
+    CHECK_EQUAL(SENSOR_OK, sensors.sensor(0).health);
+    const char* first = strstr(hostSerialOutput(), "First readings ");
+    CHECK(first != NULL);
+    if (first) CHECK(strtoul(first + strlen("First readings "), NULL, 10) < 1500);
+
+    hostAccessPoint.up = true;
+    sketchRunFor(1000 * 10);
+    CHECK(network.connected());
+    CHECK(network.clockSet());
+}
+
+// Half an hour of everything the firmware does day to day: readings, page
+// and API polls, scrapes, the button, an alert going out, the minutely
+// report. None of it should touch the heap once it's booted.
+static const char* post(const char* pathAndQuery){
+    char request[192];
+    snprintf(request, sizeof(request), "POST %s HTTP/1.1\r\nHost: thermo\r\n\r\n", pathAndQuery);
+    return fetch(request);
+}
+
+TEST(SketchConfigNeedsItsOwnToken){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    const int16_t limit = config.alertLimit;
+    // No token set, the WiFi password doesn't stand in for one
+    char query[160];
+    snprintf(query, sizeof(query), "/config?token=%s&alertLimit=40", config.password);
+    const char* response = post(query);
+    CHECK_CONTAINS("HTTP/1.1 403", response);
+    CHECK_CONTAINS("no config token set", response);
+    CHECK_EQUAL(limit, config.alertLimit);
+
+    strcpy(config.configToken, "fridge-token");
+    sketchRunFor(1000 * 10);
+    response = post("/config?token=fridge-token&alertLimit=40");
+    CHECK_CONTAINS("HTTP/1.1 200", response);
+    CHECK_EQUAL(4000, config.alertLimit);
+}
+
+TEST(SketchConfigChecksTheTokenFirst){
+    bootWithSensors();
+    strcpy(config.configToken, "fridge-token");
+    sketchRunFor(1000 * 5);
+    // Without the token a bad name gets the same answer as a good one
+    const char* response = post("/config?nosuchfield=1&token=guess");
+    CHECK_CONTAINS("HTTP/1.1 403", response);
+    CHECK(!strstr(response, "nosuchfield"));
+
+    // And for a while after that even the right one is turned away
+    response = post("/config?token=fridge-token&alertLimit=40");
+    CHECK_CONTAINS("HTTP/1.1 429", response);
+    CHECK(config.alertLimit != 4000);
+
+    sketchRunFor(1000 * 5);
+    response = post("/config?token=fridge-token&nosuchfield=1");
+    CHECK_CONTAINS("HTTP/1.1 400", response);
+    CHECK_CONTAINS("can't set nosuchfield", response);
+    response = post("/config?token=fridge-token&alertLimit=40");
+    CHECK_CONTAINS("HTTP/1.1 200", response);
+    CHECK_EQUAL(4000, config.alertLimit);
+}
+
+TEST(SketchSoakDoesntAllocate){
+    bootWithSensors();
+    sketchRunFor(1000 * 70);
+    const uint64_t allocations = hostHeapStats().allocations;
+    const uint32_t passes = sketchPasses();
+
+    for (int second = 0; second < 60 * 30; second++){
+        if (second % 10 == 0) get("/api/v1/readings");
+        if (second % 60 == 0){
+            get("/");
+            get("/metrics");
+            get("/debug/perf");
+            get("/config");
+        }
+        if (second % 300 == 0) pressButton();
+        // The fridge warms up for a while, past the alert limit and back
+        if (second == 600) hostDS18B20(D1, 0)->celsius = 1.0;
+        if (second == 900) hostDS18B20(D1, 0)->celsius = 4.0;
+        sketchRunFor(1000);
+    }
+
+    CHECK(sketchPasses() - passes > 100000);
+    CHECK(hostHttpsRequestCount() > 0);
+    CHECK_EQUAL(allocations, hostHeapStats().allocations);
+}
+
+TEST(SketchNeverWaitsOnTheBus){
+    bootWithSensors();
+    sketchRunFor(1000 * 5);
+    uint32_t conversions = hostDS18B20(D1, 0)->conversions;
+
+    // No loop() pass sits in a delay() waiting on a conversion
+    unsigned long longest = 0;
+    unsigned long start = millis();
+    while (millis() - start < 1000 * 60){
+        unsigned long before = micros();
+        loop();
+        longest = max(longest, micros() - before);
+        hostRunScheduled();
+        hostAdvanceMillis(1);
+    }
+    CHECK(longest < 1000);
+
+    // One conversion a second whoever's looking, started and collected
+    // over many passes
+    CHECK_NEAR(60, hostDS18B20(D1, 0)->conversions - conversions, 1);
+    CHECK_EQUAL(fromCelsius(4.0), sensors.sensor(0).temp);
+}
@@ -0,0 +1,38 @@
+#include "Check.h"
+#include "SleepPlanner.h"
+
+TEST(SleepPlannerPlan){
+    SleepPlanner planner(5, 100);
+    CHECK_EQUAL(0, planner.plan(50, true));
+    CHECK_EQUAL(0, planner.plan(4, false));
+    CHECK_EQUAL(5, planner.plan(5, false));
+    CHECK_EQUAL(60, planner.plan(60, false));
+    CHECK_EQUAL(100, planner.plan(101, false));
+    CHECK_EQUAL(100, planner.plan(SleepPlanner::NO_DEADLINE, false));
+}
+
+TEST(SleepPlannerSooner){
+    CHECK_EQUAL(3, SleepPlanner::sooner(3, 7));
+    CHECK_EQUAL(3, SleepPlanner::sooner(7, 3));
+    CHECK_EQUAL(0, SleepPlanner::sooner(0, SleepPlanner::NO_DEADLINE));
+}
+
+TEST(SleepPlannerAwakeShare){
+    SleepPlanner planner(5, 100);
+    CHECK_EQUAL(1000, planner.awakePermille(0));
+    CHECK_EQUAL(1000, planner.awakePermille(1000));
+    planner.slept(100);
+    planner.slept(150);
+    CHECK_EQUAL(2, planner.sleeps());
+    CHECK_EQUAL(250, planner.sleptMillis());
+    CHECK_EQUAL(750, planner.awakePermille(1000));
+    // Slept more than the uptime it's given (the clock rolled over)
+    CHECK_EQUAL(0, planner.awakePermille(200));
+}
+
+// 49 days of uptime doesn't overflow the share
+TEST(SleepPlannerAwakeShareLongUptime){
+    SleepPlanner planner(5, 100);
+    planner.slept(0xC0000000);
+    CHECK_EQUAL(250, planner.awakePermille(0xFFFFFFFF));
+}
@@ -0,0 +1,196 @@
+#include "Check.h"
+#include "Telemetry.h"
+#include "FlashLog.h"
+#include "Temperature.h"
+#include <OneWire.h>
+
+static const uint16_t port = 4210;
+
+static uint16_t get16(const uint8_t* p){
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p){
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static const uint8_t* sentFrame(int index){
+    return (const uint8_t*)hostUdpSent(index).data.data();
+}
+
+// Acks every frame the way tools/telemetry_collector.py does
+static void ack(const uint8_t* frame){
+    uint8_t reply[12] = {'T', 'A', 1, 0};
+    memcpy(reply + 4, frame + 4, 8);
+    hostUdpDeliver(port, IPAddress(192, 168, 1, 20), port, reply, sizeof(reply));
+}
+
+static void collector(const HostDatagram& datagram){
+    ack((const uint8_t*)datagram.data.data());
+}
+
+// Two sensors, on the network, and the table and telemetry run a
+// millisecond apart as loop() would
+static void setUp(SensorTable& table){
+    hostAddDS18B20(D1, 4.0);
+    hostAddDS18B20(D6, -18.0);
+    table.addBus(D1);
+    table.addBus(D6);
+    WiFi.begin("HostNet", "hostpass");
+    hostAdvanceMillis(1000 * 5);
+}
+
+static void run(SensorTable& table, Telemetry& telemetry, unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms){
+        table.update();
+        telemetry.update();
+        hostAdvanceMillis(1);
+    }
+}
+
+TEST(TelemetryFrameLayout){
+    SensorTable table(1000);
+    setUp(table);
+    Telemetry telemetry(table, 4, 1000, 1000 * 10);
+    telemetry.begin("192.168.1.20", port);
+    run(table, telemetry, 1000 * 5);
+
+    CHECK_EQUAL(1, hostUdpSentCount());
+    const HostDatagram& datagram = hostUdpSent(0);
+    CHECK(datagram.ip == IPAddress(192, 168, 1, 20));
+    CHECK_EQUAL(port, datagram.port);
+    // Header, 4 samples of a time and two sensors, CRC
+    CHECK_EQUAL(16u + 4 * (4 + 2 * 3) + 4, datagram.data.size());
+    const uint8_t* frame = sentFrame(0);
+    CHECK_EQUAL('T', frame[0]);
+    CHECK_EQUAL('M', frame[1]);
+    CHECK_EQUAL(1, frame[2]);
+    CHECK_EQUAL(1, frame[3]);
+    CHECK_EQUAL(ESP.getChipId(), get32(frame + 4));
+    CHECK_EQUAL(1u, get32(frame + 8));
+    CHECK_EQUAL(2, frame[12]);
+    CHECK_EQUAL(4, frame[13]);
+
+    // No clock yet, so the times are uptime with the top bit set
+    const uint8_t* sample = frame + 16;
+    CHECK(get32(sample) & 0x80000000UL);
+    CHECK_EQUAL(fromCelsius(4.0), (int16_t)get16(sample + 4));
+    CHECK_EQUAL(SENSOR_OK, sample[6]);
+    CHECK_EQUAL(fromCelsius(-18.0), (int16_t)get16(sample + 7));
+    CHECK_EQUAL(get32(sample) + 1, get32(sample + 10));
+
+    size_t crcAt = datagram.data.size() - 4;
+    CHECK_EQUAL(FlashLog::crc32(0, frame, crcAt), get32(frame + crcAt));
+    CHECK_EQUAL((uint32_t)datagram.data.size(), telemetry.bytesSent());
+}
+
+TEST(TelemetryFlushesAPartBatch){
+    SensorTable table(1000);
+    setUp(table);
+    Telemetry telemetry(table, 8, 1000, 1000 * 3);
+    telemetry.begin("192.168.1.20", port);
+    run(table, telemetry, 1000 * 5);
+    // 3 s after the first sample, so the one due then makes it in too
+    CHECK_EQUAL(1, hostUdpSentCount());
+    CHECK_EQUAL(4, sentFrame(0)[13]);
+}
+
+TEST(TelemetryAckedFramesArentResent){
+    hostUdpSetResponder(collector);
+    SensorTable table(1000);
+    setUp(table);
+    Telemetry telemetry(table, 4, 1000, 1000 * 10);
+    telemetry.begin("192.168.1.20", port);
+    run(table, telemetry, 1000 * 30);
+    CHECK(telemetry.framesSent() >= 6);
+    CHECK_EQUAL(telemetry.framesSent(), telemetry.framesAcked());
+    CHECK_EQUAL(0u, telemetry.framesResent());
+    CHECK_EQUAL((int)telemetry.framesSent(), hostUdpSentCount());
+}
+
+TEST(TelemetryResendsUntilAcked){
+    SensorTable table(1000);
+    setUp(table);
+    // One frame and no more for a while
+    Telemetry telemetry(table, 1, 1000 * 60, 1000 * 60);
+    telemetry.begin("192.168.1.20", port);
+    run(table, telemetry, 1000);
+    CHECK_EQUAL(1, hostUdpSentCount());
+
+    // Again after 2 s, then 4 s after that, the same bytes each time
+    run(table, telemetry, 2100);
+    CHECK_EQUAL(2, hostUdpSentCount());
+    run(table, telemetry, 3000);
+    CHECK_EQUAL(2, hostUdpSentCount());
+    run(table, telemetry, 1100);
+    CHECK_EQUAL(3, hostUdpSentCount());
+    CHECK(hostUdpSent(0).data == hostUdpSent(2).data);
+    CHECK_EQUAL(2u, telemetry.framesResent());
+
+    ack(sentFrame(0));
+    run(table, telemetry, 1000 * 20);
+    CHECK_EQUAL(1u, telemetry.framesAcked());
+    CHECK_EQUAL(3, hostUdpSentCount());
+}
+
+TEST(TelemetryKeepsFramesWhileOffline){
+    hostUdpSetResponder(collector);
+    SensorTable table(1000);
+    setUp(table);
+    WiFi.setAutoReconnect(true);
+    Telemetry telemetry(table, 2, 1000, 1000 * 10);
+    telemetry.begin("192.168.1.20", port);
+    run(table, telemetry, 1000 * 3);
+    int sentBefore = hostUdpSentCount();
+
+    // Six frames' worth with nowhere to go, only four slots to keep them in
+    hostAccessPoint.up = false;
+    run(table, telemetry, 1000 * 12);
+    CHECK_EQUAL(sentBefore, hostUdpSentCount());
+    CHECK_EQUAL(2u, telemetry.framesDropped());
+
+    // Back on, the four kept go out oldest first
+    hostAccessPoint.up = true;
+    run(table, telemetry, 1000 * 5);
+    CHECK(hostUdpSentCount() >= sentBefore + 4);
+    uint32_t seq = get32(sentFrame(sentBefore) + 8);
+    for (int i = 1; i < 4; i++){
+        CHECK_EQUAL(seq + i, get32(sentFrame(sentBefore + i) + 8));
+    }
+    CHECK_EQUAL(telemetry.framesSent(), telemetry.framesAcked());
+}
+
+TEST(TelemetryReplaysOldSamples){
+    hostUdpSetResponder(collector);
+    SensorTable table(1000 * 60);
+    setUp(table);
+    Telemetry telemetry(table, 2, 1000 * 60, 1000);
+    telemetry.begin("192.168.1.20", port);
+    run(table, telemetry, 1000 * 3);
+    CHECK(telemetry.readyForReplay());
+    int sentBefore = hostUdpSentCount();
+
+    // From before a reset, with the clock set then, one sensor unreadable
+    int16_t temps[2] = {fromCelsius(3.0), INT16_MIN};
+    telemetry.replay(1760000000, temps, 2);
+    telemetry.replay(1760000060, temps, 2);
+    CHECK_EQUAL(sentBefore + 1, hostUdpSentCount());
+    const uint8_t* sample = sentFrame(sentBefore) + 16;
+    CHECK_EQUAL(1760000000u, get32(sample));
+    CHECK_EQUAL(fromCelsius(3.0), (int16_t)get16(sample + 4));
+    CHECK_EQUAL(SENSOR_MISSING, sample[9]);
+    CHECK_EQUAL(1760000060u, get32(sample + 10));
+}
+
+TEST(TelemetryOffCostsNothing){
+    SensorTable table(1000);
+    setUp(table);
+    uint64_t allocations = hostHeapStats().allocations;
+    Telemetry telemetry(table, 4, 1000, 1000 * 10);
+    telemetry.begin("", port);
+    run(table, telemetry, 1000 * 10);
+    CHECK_EQUAL(0, hostUdpSentCount());
+    CHECK_EQUAL(allocations, hostHeapStats().allocations);
+    CHECK(!telemetry.readyForReplay());
+}
@@ -0,0 +1,103 @@
+#include "Check.h"
+#include "Temperature.h"
+
+// These assume the default, tempInFahrenheit
+static_assert(tempInFahrenheit, "tests are written for Fahrenheit");
+
+TEST(TemperatureRawToCenti){
+    // 85 C, the power-on value
+    CHECK_EQUAL(18500, rawToCenti(0x0550));
+    CHECK_EQUAL(3200, rawToCenti(0));
+    // -10.125 C is 13.775 F, rounded away from zero before the offset
+    CHECK_EQUAL(1377, rawToCenti(-162));
+    // 1/16 C
+    CHECK_EQUAL(3211, rawToCenti(1));
+    // -55 C, the bottom of the range
+    CHECK_EQUAL(-6700, rawToCenti(-55 * 16));
+    // Way out of range clamps, and never to INT16_MIN
+    CHECK_EQUAL(INT16_MAX, rawToCenti(INT16_MAX));
+    CHECK_EQUAL(INT16_MIN + 1, rawToCenti(INT16_MIN));
+}
+
+// Every raw value against the float conversion the sketch used to do
+TEST(TemperatureRawToCentiMatchesFloat){
+    for (int32_t raw = INT16_MIN; raw <= INT16_MAX; raw++){
+        double centi = (raw * 0.0625 * 1.8 + 32) * 100;
+        int16_t got = rawToCenti(raw);
+        // Clamped, or the nearest hundredth (either one on an exact half,
+        // where the double is a hair either side of it anyway)
+        bool ok;
+        if (centi > INT16_MAX) ok = got == INT16_MAX;
+        else if (centi < INT16_MIN + 1) ok = got == INT16_MIN + 1;
+        else ok = fabs(got - centi) <= 0.5 + 1e-6;
+        if (!ok){
+            checkFailed(__FILE__, __LINE__, "raw %ld gave %d, float says %.3f", (long)raw, got, centi);
+            return;
+        }
+    }
+}
+
+TEST(TemperatureConstants){
+    CHECK_EQUAL(3500, fromFahrenheit(35.00));
+    CHECK_EQUAL(3200, fromCelsius(0));
+    CHECK_EQUAL(-4000, fromCelsius(-40));
+    CHECK_EQUAL(50, fahrenheitDelta(0.50));
+    CHECK_EQUAL(-25, fromFahrenheit(-0.25));
+}
+
+TEST(TemperatureFormat){
+    char buff[TEMP_TEXT_SIZE];
+    formatTemperature(buff, 3350, 1);
+    CHECK_STRING("33.5", buff);
+    formatTemperature(buff, 3350, 0);
+    CHECK_STRING("34", buff);
+    formatTemperature(buff, 7, 2);
+    CHECK_STRING("0.07", buff);
+    formatTemperature(buff, -5, 2);
+    CHECK_STRING("-0.05", buff);
+    // Rounds to nothing, no "-0.0"
+    formatTemperature(buff, -4, 1);
+    CHECK_STRING("0.0", buff);
+    CHECK_EQUAL(7, formatTemperature(buff, INT16_MIN, 2));
+    CHECK_STRING("-327.68", buff);
+    // More than 2 decimals is 2
+    formatTemperature(buff, 1234, 5);
+    CHECK_STRING("12.34", buff);
+}
+
+TEST(TemperatureParse){
+    int16_t centi = 0;
+    CHECK(parseTemperature("33.5", centi));
+    CHECK_EQUAL(3350, centi);
+    CHECK(parseTemperature("-0.05", centi));
+    CHECK_EQUAL(-5, centi);
+    CHECK(parseTemperature(".5", centi));
+    CHECK_EQUAL(50, centi);
+    CHECK(parseTemperature("1.005", centi));
+    CHECK_EQUAL(101, centi);
+    CHECK(parseTemperature("-327.68", centi));
+    CHECK_EQUAL(INT16_MIN, centi);
+}
+
+TEST(TemperatureParseRejects){
+    int16_t centi = 1234;
+    CHECK(!parseTemperature("", centi));
+    CHECK(!parseTemperature("-", centi));
+    CHECK(!parseTemperature("abc", centi));
+    CHECK(!parseTemperature("12a", centi));
+    CHECK(!parseTemperature("400", centi));
+    CHECK(!parseTemperature("99999999999", centi));
+    CHECK_EQUAL(1234, centi);
+}
+
+TEST(TemperatureRoundTrip){
+    char buff[TEMP_TEXT_SIZE];
+    for (int32_t centi = INT16_MIN; centi <= INT16_MAX; centi += 37){
+        formatTemperature(buff, centi, 2);
+        int16_t parsed;
+        if (!parseTemperature(buff, parsed) || parsed != centi){
+            checkFailed(__FILE__, __LINE__, "%ld came back from \"%s\"", (long)centi, buff);
+            return;
+        }
+    }
+}
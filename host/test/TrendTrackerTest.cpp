@@ -0,0 +1,95 @@
+#include "Check.h"
+#include "TrendTracker.h"
+
+// As main.ino has it: 24 points 2 min apart, median of 3
+typedef TrendTracker<24, 3> Tracker;
+static const uint32_t stepMillis = 1000 * 120;
+
+// A steady fall of 0.10 a step (3.00 an hour) from 40.00
+static void falling(Tracker& tracker, uint32_t start, int readings){
+    for (int i = 0; i < readings; i++){
+        tracker.add(4000 - 10 * i, start + i * stepMillis);
+    }
+}
+
+TEST(TrendTrackerFollowsASteadyFall){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    falling(tracker, 1000, 30);
+    CHECK_EQUAL(24, tracker.points());
+    CHECK_EQUAL(-300, tracker.slopePerHour());
+    // The median runs a reading behind on a steady slope
+    CHECK_EQUAL(3720, tracker.level());
+    // 2.20 to go at 3.00 an hour
+    CHECK_NEAR(2640000, tracker.millisUntil(3500, true), 1000);
+    // Heading away from a high limit, and already past a higher low one
+    CHECK_EQUAL(Tracker::NO_PREDICTION, tracker.millisUntil(4500, false));
+    CHECK_EQUAL(0, tracker.millisUntil(3800, true));
+}
+
+TEST(TrendTrackerNeedsEnoughPoints){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    falling(tracker, 1000, Tracker::MIN_FIT - 1);
+    CHECK_EQUAL(0, tracker.slopePerHour());
+    CHECK_EQUAL(Tracker::NO_PREDICTION, tracker.millisUntil(3500, true));
+    falling(tracker, 1000 + stepMillis * (Tracker::MIN_FIT - 1), 1);
+    CHECK(tracker.slopePerHour() < 0);
+}
+
+TEST(TrendTrackerNoisyFlatPredictsNothing){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    for (int i = 0; i < 40; i++){
+        tracker.add(i % 2 ? 3620 : 3600, i * stepMillis);
+    }
+    CHECK_EQUAL(Tracker::NO_PREDICTION, tracker.millisUntil(3500, true));
+    CHECK_EQUAL(Tracker::NO_PREDICTION, tracker.millisUntil(3700, false));
+}
+
+TEST(TrendTrackerMedianDropsAGlitch){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    uint32_t t = 0;
+    for (int i = 0; i < 10; i++) tracker.add(3500, t += 1000);
+    CHECK_EQUAL(3500, tracker.add(5000, t += 1000));
+    CHECK_EQUAL(3500, tracker.add(3500, t += 1000));
+    CHECK_EQUAL(1, tracker.spikes());
+    CHECK_EQUAL(3500, tracker.mean());
+    // A rounding step isn't a spike
+    tracker.add(3506, t += 1000);
+    tracker.add(3500, t += 1000);
+    CHECK_EQUAL(1, tracker.spikes());
+}
+
+TEST(TrendTrackerSameReadingTwice){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    tracker.add(3500, 1000);
+    tracker.add(3600, 2000);
+    // Handed the same reading again (same time): ignored
+    CHECK_EQUAL(3500, tracker.add(9000, 2000));
+    tracker.add(3600, 3000);
+    CHECK_EQUAL(3600, tracker.filtered());
+}
+
+TEST(TrendTrackerGapStartsOver){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    falling(tracker, 1000, 20);
+    CHECK_EQUAL(20, tracker.points());
+    uint32_t last = 1000 + 19 * stepMillis;
+    tracker.add(3000, last + Tracker::GAP_STEPS * stepMillis + 1);
+    CHECK_EQUAL(1, tracker.points());
+    CHECK_EQUAL(3000, tracker.filtered());
+    CHECK_EQUAL(0, tracker.slopePerHour());
+}
+
+TEST(TrendTrackerAcrossRollover){
+    Tracker tracker;
+    tracker.configure(stepMillis, 100);
+    falling(tracker, 0xFFFFFFFF - 5 * stepMillis, 30);
+    CHECK_EQUAL(24, tracker.points());
+    CHECK_EQUAL(-300, tracker.slopePerHour());
+    CHECK_NEAR(2640000, tracker.millisUntil(3500, true), 1000);
+}
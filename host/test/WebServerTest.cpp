@@ -0,0 +1,216 @@
+#include "Check.h"
+#include "WebServer.h"
+#include <ESP8266WiFi.h>
+
+// Answers with the path it was asked for, so each browser can tell its own,
+// or for /big, bigParts parts of 1000 bytes each
+static int handled;
+static const int bigParts = 20;
+
+static bool answer(BufferedPrint& out, HttpRequest& request, uint16_t part){
+    if (strcmp(request.path(), "/big") == 0){
+        char line[1001];
+        memset(line, 'a' + part, 1000);
+        line[1000] = '\0';
+        out.print(line);
+        if (part < bigParts - 1) return true;
+    }
+    else {
+        out.appendf(PSTR("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n%s"), request.path());
+    }
+    handled++;
+    return false;
+}
+
+static void startServer(WebServer& server){
+    WiFi.begin("HostNet", "hostpass");
+    hostAdvanceMillis(1000 * 5);
+    server.begin();
+}
+
+// update() as loop() would call it, a millisecond apart
+static void runServer(WebServer& server, unsigned long ms){
+    unsigned long start = millis();
+    while (millis() - start < ms){
+        server.update();
+        hostAdvanceMillis(1);
+    }
+}
+
+TEST(WebServerAnswersARequest){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer browser = hostConnect(80);
+    CHECK(browser.valid());
+    browser.send("GET /hello HTTP/1.1\r\nHost: thermo\r\n\r\n");
+    runServer(server, 10);
+    CHECK(browser.closedByDevice());
+    CHECK_STRING("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n/hello", browser.received());
+    CHECK_EQUAL(0, server.activeClients());
+}
+
+TEST(WebServerServesClientsSideBySide){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer browsers[3];
+    for (int i = 0; i < 3; i++){
+        browsers[i] = hostConnect(80);
+        browsers[i].send("GET /");
+    }
+    runServer(server, 10);
+    CHECK_EQUAL(3, server.activeClients());
+    CHECK_EQUAL(0, handled);
+
+    // The last to finish its request isn't stuck behind the first
+    browsers[2].send("c HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    CHECK(browsers[2].closedByDevice());
+    CHECK(!browsers[0].closedByDevice());
+    CHECK_CONTAINS("\r\n\r\n/c", browsers[2].received());
+
+    browsers[0].send("a HTTP/1.1\r\n\r\n");
+    browsers[1].send("b HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    CHECK_CONTAINS("\r\n\r\n/a", browsers[0].received());
+    CHECK_CONTAINS("\r\n\r\n/b", browsers[1].received());
+    CHECK_EQUAL(3, handled);
+    CHECK_EQUAL(0, server.activeClients());
+}
+
+TEST(WebServerDropsAnIdleClient){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer idle = hostConnect(80);
+    idle.send("GET / HTTP/1.1\r\n");
+    runServer(server, 1000);
+    CHECK_EQUAL(1, server.activeClients());
+
+    // Others still get served while it dawdles
+    HostPeer browser = hostConnect(80);
+    browser.send("GET /quick HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    CHECK(browser.closedByDevice());
+
+    runServer(server, 1100);
+    CHECK(idle.closedByDevice());
+    CHECK_STRING("", idle.received());
+    CHECK_EQUAL(0, server.activeClients());
+    CHECK_CONTAINS("Client timed out.", hostSerialOutput());
+}
+
+TEST(WebServerTurnsAwayOneTooMany){
+    WebServer server(80, answer);
+    startServer(server);
+    // lwIP's 5 sockets, one kept back for the alert posts
+    HostPeer browsers[5];
+    for (int i = 0; i < 5; i++){
+        browsers[i] = hostConnect(80);
+    }
+    runServer(server, 10);
+    CHECK_EQUAL(4, server.activeClients());
+    CHECK(browsers[4].closedByDevice());
+    CHECK_CONTAINS("HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\n", browsers[4].received());
+
+    // Room again once one's done
+    browsers[0].send("GET / HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    HostPeer late = hostConnect(80);
+    late.send("GET /late HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    CHECK_CONTAINS("\r\n\r\n/late", late.received());
+}
+
+TEST(WebServerAnswersBadAndOversizedRequests){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer bad = hostConnect(80);
+    bad.send("GARBAGE\r\n\r\n");
+    HostPeer big = hostConnect(80);
+    big.send("GET / HTTP/1.1\r\n");
+    for (int i = 0; i < 60; i++) big.send("X-Filler: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\r\n");
+    runServer(server, 100);
+
+    CHECK_STRING("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n", bad.received());
+    CHECK_STRING("HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n", big.received());
+    CHECK(big.closedByDevice());
+    CHECK_EQUAL(0, handled);
+}
+
+TEST(WebServerReadsALittleEachPass){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer browser = hostConnect(80);
+    browser.send("GET /long HTTP/1.1\r\n");
+    for (int i = 0; i < 20; i++) browser.send("X-Filler: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\r\n");
+    browser.send("\r\n");
+
+    // 800 or so bytes at 256 a pass
+    server.update();
+    server.update();
+    CHECK(!browser.closedByDevice());
+    server.update();
+    server.update();
+    CHECK(browser.closedByDevice());
+    CHECK_CONTAINS("\r\n\r\n/long", browser.received());
+}
+
+TEST(WebServerSendsEachPart){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer browser = hostConnect(80);
+    browser.send("GET /big HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    CHECK(browser.closedByDevice());
+    CHECK_EQUAL((size_t)bigParts * 1000, browser.receivedLength());
+    // In order
+    CHECK_EQUAL('a', browser.received()[999]);
+    CHECK_EQUAL('b', browser.received()[1000]);
+    CHECK_EQUAL('a' + bigParts - 1, browser.received()[bigParts * 1000 - 1]);
+}
+
+TEST(WebServerDoesntWaitOnAClientThatStopsReading){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer slow = hostConnect(80);
+    slow.stopReading();
+    slow.send("GET /big HTTP/1.1\r\n\r\n");
+
+    // The socket fills, and each pass still returns straight away rather
+    // than sitting out the write timeout
+    unsigned long longest = 0;
+    for (int i = 0; i < 200; i++){
+        unsigned long start = millis();
+        server.update();
+        longest = max(longest, millis() - start);
+        hostAdvanceMillis(1);
+    }
+    CHECK_EQUAL(0ul, longest);
+    CHECK(!slow.closedByDevice());
+    CHECK(slow.receivedLength() < (size_t)bigParts * 1000);
+
+    // Others still get served meanwhile
+    HostPeer quick = hostConnect(80);
+    quick.send("GET /quick HTTP/1.1\r\n\r\n");
+    runServer(server, 10);
+    CHECK_CONTAINS("\r\n\r\n/quick", quick.received());
+
+    // And it picks up where it left off once the client does
+    slow.resumeReading();
+    runServer(server, 10);
+    CHECK(slow.closedByDevice());
+    CHECK_EQUAL((size_t)bigParts * 1000, slow.receivedLength());
+}
+
+TEST(WebServerDropsAClientThatNeverReads){
+    WebServer server(80, answer);
+    startServer(server);
+    HostPeer stuck = hostConnect(80);
+    stuck.stopReading();
+    stuck.send("GET /big HTTP/1.1\r\n\r\n");
+    runServer(server, 1000 * 9);
+    CHECK_EQUAL(1, server.activeClients());
+    runServer(server, 1000 * 2);
+    CHECK(stuck.closedByDevice());
+    CHECK_EQUAL(0, server.activeClients());
+    CHECK_CONTAINS("Client stopped reading.", hostSerialOutput());
+}
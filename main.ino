@@ -4,7 +4,12 @@ WiFiConfig wifiConfig;
 HttpsConfig httpsConfig;
 
 // Generic
-#include <math.h>
+#include "Scheduler.h"
+#include "Perf.h"
+#include "ConfigStore.h"
+#include "FixedString.h"
+#include "Button.h"
+#include "SleepPlanner.h"
 
 // ESP Specifics
 #include <ESP8266WiFi.h>
@@ -13,11 +18,15 @@ HttpsConfig httpsConfig;
 
 // Wifi client for HTTPS requests
 #include <WiFiClientSecure.h>
+#include "HttpsConnection.h"
+#include "AlertDispatcher.h"
+#include "AlertRules.h"
 
 // Time
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
-#include <coredecls.h>                  // settimeofday_cb()
+#include "Network.h"
+#include "Telemetry.h"
 
 // OLED Display
 #include "Wire.h"
@@ -28,19 +37,42 @@ HttpsConfig httpsConfig;
 #include "Fonts.h"
 #include "Images.h"
 
+// Web server and page
+#include "WebServer.h"
+#include "BufferedPrint.h"
+#include "WebPage.h"
+
 // DS18B20 Sensor library
 #include <OneWire.h>
+#include "SensorTable.h"
+#include "Temperature.h"
+
+// Sample history
+#include "RingBuffer.h"
+#include "FlashLog.h"
+#include "TrendTracker.h"
 
 /*
-  Future Expansion(??):
+  Sample history:
 
   While we're CONNECTED to WiFi:
     - Store 10 values, at a rate of 60 seconds, to a ring buffer
-    - Alert if 3, or more, values are below the threshold
+    - Rules with a historyCount alert if that many values are past their limit
 
 
   While we're DISconnected from WiFi:
     - Store 96 values, at a rate of 900 seconds (15 min), to a ring buffer
+      and the sample log in flash, so they survive a reset
+    - Once we're back the logged ones go to the telemetry collector (if
+      there is one) and the log is trimmed
+
+  Either way, every reading also goes through a TrendTracker:
+    - A median of 3 drops single glitched reads before the rules see them
+    - A line fitted over the last 48 minutes says where the temp is heading,
+      so the predict rules can alert before the limit is actually crossed
+
+  Temperatures are kept in hundredths of a degree (int16_t) rather than
+  floats all the way through, see Temperature.h to switch to Celsius.
 */
 
 
@@ -48,10 +80,31 @@ HttpsConfig httpsConfig;
  * Begin Settings
  **************************/
 
+// Settings that can be changed at runtime from /config and are kept in flash.
+// The values in this file (and Config.cpp) are the defaults they start from
+// on first boot, or if the stored copy is lost, see configDefaults().
+RuntimeConfig config;
+ConfigStore configStore("/config.bin");
+// Changing the config takes ?token= with this. It's a secret of its own, the
+// WiFi password is known to everyone on the network. Left empty /config is
+// read only.
+const char* configToken = "";
+// After a wrong token no change is taken at all for this long, so guessing
+// it is slow (milli * seconds)
+const unsigned long configRetryMillis = 1000 * 5;
+// A new SSID or password is only saved once it's joined, if it hasn't
+// within this long the old ones go back in (milli * seconds)
+const unsigned long wifiTrialMillis = 1000 * 60;
+
 // WIFI
 char* WIFI_SSID = wifiConfig.ssid();
 char* WIFI_PWD = wifiConfig.password();
+// Joins WiFi and waits on NTP in the background, nothing else waits for it
+NetworkManager network(config.ssid, config.password);
+// When the first round of sensor readings came in, for the perf report
+unsigned long firstReadingMillis = 0;
 
+// Defaults, the runtime config has the ones in use
 #define TZ              -7       // (utc+) TZ in hours
 #define DST_MN          60      // use 60mn for summer time in some countries
 
@@ -63,57 +116,183 @@ const int SDC_PIN = D4;
 // Initialize the oled display for address 0x3c
 SSD1306Wire     display(I2C_DISPLAY_ADDRESS, SDA_PIN, SDC_PIN);
 
-// Set up sensor I/O pins and vars
-const int sensor1 = D1;
-const int sensor2 = D6;
-int tempCheckWaitMillis;
-float s1Reading = 0;
-float s2Reading = 0;
+// Set up sensor bus I/O pins, any number of DS18B20s can share each bus
+const int sensorBusPins[] = {D1, D6};
+// How often to sample the sensors (milli * seconds)
+const unsigned long tempCheckWaitMillis = 1000 * 1;
+// Every sensor and its latest cached reading, everything else reads these instead of the bus
+SensorTable sensors(tempCheckWaitMillis);
+// Names, resolution (9 - 12 bits) and sample interval for sensors by ROM
+// address (each one found is printed on Serial). Anything not listed here is
+// called "Sensor N" and read at 12 bits every tempCheckWaitMillis. 0 keeps
+// the default. Lower resolutions convert faster, 9 bits can be read about
+// every 100 ms.
+const SensorSettings sensorSettings[] = {
+  //{{0x28, 0xFF, 0x4B, 0x6D, 0x61, 0x16, 0x04, 0x5C}, "Chamber 1", 9, 250},
+  //{{0x28, 0xFF, 0x1A, 0x2C, 0x61, 0x16, 0x03, 0x8E}, "Chamber 2", 12, 0},
+  {{0}, NULL, 0, 0}
+};
 
 // Temp we need to alert at
-const float tempThreshold = 35.00;
-// How long we need to be out of spec before we alert (milli * seconds)
-const int maxTempOutOfSpecTime = 1000 * 10;
-unsigned long triggeredTempMillis;  // Var to hold and compare timespans
-// How long to wait between alerts (milli * seconds)
-const int alertInterval = 1000 * 10;
-unsigned long triggeredAlertMillis;  //Var to hold and compare timespans
+constexpr int16_t tempThreshold = fromFahrenheit(35.00);
+// Alert rules, checked against every new reading. Sensor is the table index
+// (-1 for all of them), limits and hysteresis are temps, rates are degrees a
+// minute. Times are (milli * seconds), 0 turns that part off.
+// Predict rules alert when the trend (see trendStepMillis) will reach the
+// limit within the horizon.
+// The first rule's limit, hysteresis and times can be changed from /config,
+// and "below" predict rules follow its limit.
+// name, sensor, kind, limit, hysteresis, dwell, repeat, escalate, maxPerHour, historyCount, horizon
+AlertRule alertRules[] = {
+  {"Too cold", -1, RULE_BELOW, tempThreshold, fahrenheitDelta(1.00), 1000 * 10, 1000 * 60 * 10, 1000 * 60 * 30, 12, 3, 0},
+  {"Falling fast", -1, RULE_FALLING, fahrenheitDelta(2.00), fahrenheitDelta(0.50), 1000 * 60, 1000 * 60 * 30, 0, 4, 0, 0},
+  {"Cold soon", -1, RULE_PREDICT_BELOW, tempThreshold, fahrenheitDelta(0.50), 1000 * 60, 1000 * 60 * 30, 0, 4, 0, 1000 * 60 * 30},
+  //{"Too warm", 0, RULE_ABOVE, fromFahrenheit(45.00), fahrenheitDelta(1.00), 1000 * 60, 1000 * 60 * 30, 0, 4, 0, 0},
+};
+void onAlert(const AlertRule& rule, int sensor, AlertEvent event, int16_t value);
+AlertEngine alertEngine(alertRules, sizeof(alertRules) / sizeof(alertRules[0]), onAlert);
+// How long a sensor has to be faulty (unplugged, CRC errors...) before we
+// send a fault alert, only one is sent until they're all back (milli * seconds)
+const unsigned long maxSensorFaultTime = 1000 * 30;
+unsigned long sensorFaultMillis;
+bool sensorFaultAlerted = false;
+
+// Sample history, see the notes at the top (milli * seconds)
+const unsigned long onlineHistoryMillis = 1000 * 60;
+const unsigned long offlineHistoryMillis = 1000 * 900;
+unsigned long onlineHistoryWaitMillis;
+unsigned long offlineHistoryWaitMillis;
+bool onlineHistoryStarted = false;
+bool offlineHistoryStarted = false;
+RingBuffer<int16_t, 10> onlineHistory[MAX_SENSORS];
+RingBuffer<int16_t, 96> offlineHistory[MAX_SENSORS];
+
+// Each sensor's trend, fitted over 24 points trendStepMillis apart (48 min).
+// Keep the fit longer than a compressor cycle or every cooling run looks like
+// it's heading for the limit, see tools/trend_bench.cpp. A reading held back
+// by the median filter that's this far off the mean counts as a spike
+// (milli * seconds).
+const unsigned long trendStepMillis = 1000 * 120;
+constexpr int16_t minSpikeDelta = fahrenheitDelta(1.00);
+TrendTracker<24, 3> trends[MAX_SENSORS];
+// The reading the alert rules last saw for each sensor, so the same one isn't run twice
+unsigned long alertSampleMillis[MAX_SENSORS];
+
+// Stream the readings to a collector on the local network as binary UDP
+// frames (see tools/telemetry_collector.py), "" turns it off. A sample is
+// taken every telemetrySampleMillis, and a frame goes out once it has
+// telemetryBatch samples (up to 8) or telemetryFlushMillis after its first
+// one (milli * seconds).
+const char* telemetryHost = "";
+const uint16_t telemetryPort = 4210;
+const uint8_t telemetryBatch = 5;
+const unsigned long telemetrySampleMillis = 1000 * 2;
+const unsigned long telemetryFlushMillis = 1000 * 10;
+Telemetry telemetry(sensors, telemetryBatch, telemetrySampleMillis, telemetryFlushMillis);
+
+// Offline samples and unsent alerts are kept in flash so a reset doesn't lose
+// them, and forwarded to the telemetry collector once we're back online, see
+// forwardOfflineSamples(). A sample only comes every offlineHistoryMillis, so
+// each is written as it's taken: batching them saves little wear and a crash
+// would take the whole batch with it (milli * seconds, 0 is straight away).
+const size_t logSegmentBytes = 1024 * 4;
+const unsigned long sampleLogFlushMillis = 0;
+FlashLog alertLog("alerts", logSegmentBytes, 0);
+FlashLog sampleLog("samples", logSegmentBytes, sampleLogFlushMillis);
+// One offline history sample as it's kept in the sample log
+const byte SAMPLE_RECORD = 1;
+struct StoredSample {
+  uint32_t time;
+  uint8_t count;
+  int16_t temps[MAX_SENSORS];       // INT16_MIN for a sensor that couldn't be read
+};
 
 // Define display timeout and current frame vars (milli * seconds)
 const unsigned long maxDisplayOnMillis = 1000 * 15;
 unsigned long displayOnMillis;  //Var to hold and compare timespans
+bool displayIsOn = false;
+
+// With more than two sensors the display pages through them two at a time (milli * seconds)
+const unsigned long displayPageMillis = 1000 * 5;
 
-// Vars for sending test notification (milli * seconds)
-const int buttonHoldActionMillis = 1000 * 4;
-int testNotificationSent = 0;
+// What's currently drawn on the info grid, so we only redraw fields that changed
+bool infoGridDrawn = false;
+int infoGridPage;
+time_t infoGridTime;
+long infoGridTenths[2];
+uint32_t infoGridIp;
 
-// Var for ESP.restart();
-const int buttonHoldRestartMillis = 1000 * 20;
+// Hold the button this long to send a test notification (milli * seconds)
+const unsigned long buttonHoldActionMillis = 1000 * 4;
 
-// Timezone DST stuff
-#define TZ_MN           ((TZ)*60)
-#define TZ_SEC          ((TZ)*3600)
-#define DST_SEC         ((DST_MN)*60)
+// Hold it this long for ESP.restart();
+const unsigned long buttonHoldRestartMillis = 1000 * 20;
+
+// Time and date names
 time_t now;
-const String WDAY_NAMES[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
-const String MONTH_NAMES[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+static const char WDAY_NAMES[][4] PROGMEM = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char MONTH_NAMES[][4] PROGMEM = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
 // HTTPS Client - Host name, port and SHA1 fingerprint of the certificate
 const char* IFTTT_Host    = "maker.ifttt.com";
 const int httpsPort       = 443; 
-String API_KEY            = httpsConfig.apikey();
-String IFTTT_ALERT        = httpsConfig.iftttalert();
-String IFTTT_NOTIFICATION = httpsConfig.iftttnotification();
+char* API_KEY             = httpsConfig.apikey();
 char* fingerprint         = httpsConfig.fingerprint();
-
-// HTTP SERVER port and var to store the HTTP request 
-WiFiServer server(80);
-String header;
-
-// vars for button pin and status
+const char* IFTTT_ALERT         = config.iftttAlert;
+const char* IFTTT_NOTIFICATION  = config.iftttNotification;
+// One TLS connection to IFTTT, kept open between posts
+HttpsConnection iftttConnection(IFTTT_Host, httpsPort, config.fingerprint);
+// Alerts are queued and posted a step at a time from loop()
+AlertDispatcher alertDispatcher(iftttConnection, config.iftttKey);
+// How long to keep trying to get queued alerts out before a restart (milli * seconds)
+const unsigned long restartFlushMillis = 1000 * 15;
+
+// HTTP SERVER port and the function that answers each request, a part at a time
+bool routeRequest(BufferedPrint& out, HttpRequest& request, uint16_t part);
+WebServer webServer(80, routeRequest);
+// ETag for the page shell, a hash of the page so it changes when the firmware does
+char pageEtag[12];
+
+// Button pin, edges are caught on an interrupt and turned into press/hold events
 const int buttonPin = D2;
-int buttonState = 0;
-int buttonLockout = 0;
+Button button(buttonPin, true, buttonHoldActionMillis, buttonHoldRestartMillis);
+
+// Low power mode: between tasks loop() sleeps until the next one is due,
+// and WiFi uses light sleep, only waking for every wifiListenInterval'th
+// DTIM beacon (the association is kept, incoming packets wake us). The
+// button wakes it too. It's off by default since it makes the web server and
+// alert posts a little slower to respond.
+const bool lowPowerMode = false;
+const uint8_t wifiListenInterval = 3;
+// Don't bother sleeping for less than this, and never more than this so the
+// every pass tasks (web server, alert posts) still get looked at (milli * seconds)
+const unsigned long minSleepMillis = 5;
+const unsigned long maxSleepMillis = 100;
+SleepPlanner sleepPlanner(minSleepMillis, maxSleepMillis);
+
+// Everything loop() does is a task run on its own period (milli * seconds, 0 = every pass)
+// In low power mode the sensors and button are looked at less often, the
+// button is on an interrupt and conversions take 94 ms or more anyway.
+Scheduler scheduler;
+const unsigned long networkTaskMillis = 100;
+const unsigned long webTaskMillis = 0;
+const unsigned long sensorTaskMillis = lowPowerMode ? 50 : 10;
+const unsigned long alertTaskMillis = 100;
+const unsigned long dispatchTaskMillis = 0;
+const unsigned long buttonTaskMillis = lowPowerMode ? 50 : 10;
+const unsigned long displayTaskMillis = 100;
+const unsigned long reportTaskMillis = 1000 * 60;
+const unsigned long heapTaskMillis = 1000 * 1;
+const unsigned long logTaskMillis = 1000 * 60;
+const unsigned long telemetryTaskMillis = 100;
+
+// Timing probes for the hot paths and the heap watcher, see /debug/perf
+PerfProbe loopProbe("loop");
+PerfProbe webProbe("web");
+PerfProbe sensorProbe("sensors");
+PerfProbe dispatchProbe("dispatch");
+PerfProbe displayProbe("display");
+HeapMonitor heapMonitor;
 /***************************
  * End Settings
  **************************/
@@ -131,317 +310,637 @@ void setup() {
   display.setTextAlignment(TEXT_ALIGN_CENTER);
   display.setContrast(255);
 
+  // Settings saved from /config, or the defaults in this file
+  configDefaults(config);
+  configStore.load(config);
+  Serial.printf("Config: %s\n", ConfigStore::loadResultName(configStore.loadResult()));
+  applyAlertConfig();
+
+  // Open the flash logs, pick up the offline history from before the last
+  // reset, and hand any alerts we couldn't send to the dispatcher
+  alertLog.begin();
+  sampleLog.begin();
+  restoreOfflineHistory();
+  alertDispatcher.setStore(alertLog);
+
+  // Start looking for sensors straight away, readings and alerts don't need the network
+  for (unsigned int i = 0; i < sizeof(sensorBusPins) / sizeof(sensorBusPins[0]); i++){
+    sensors.addBus(sensorBusPins[i]);
+  }
+  sensors.setSettings(sensorSettings, sizeof(sensorSettings) / sizeof(sensorSettings[0]));
+  // Rules with a historyCount look back through the online history, predict
+  // rules at the trends
+  alertEngine.setHistoryCounter(countHistory);
+  for (int i = 0; i < MAX_SENSORS; i++){
+    trends[i].configure(trendStepMillis, minSpikeDelta);
+  }
+  alertEngine.setBreachPredictor(predictBreach);
+
   // Disable the Soft AP functionality
   WiFi.enableAP(false);
 
-  // Start Wifi
-  WiFi.begin(WIFI_SSID, WIFI_PWD);
-
-  int counter = 0;
-  // This one is just for testing without WiFi... On startup we *must*
-  //   wait for WiFi in order to get the NTP time data we'll need later. 
-  //while (WiFi.status() != WL_CONNECTED && counter <= 60) {
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-    display.clear();
-    display.drawString(64, 10, "Connecting to WiFi");
-    display.drawXbm(46, 30, 8, 8, counter % 3 == 0 ? activeSymbole : inactiveSymbole);
-    display.drawXbm(60, 30, 8, 8, counter % 3 == 1 ? activeSymbole : inactiveSymbole);
-    display.drawXbm(74, 30, 8, 8, counter % 3 == 2 ? activeSymbole : inactiveSymbole);
-    display.display();
-
-    counter++;
-  }
-
-  // Print local IP address and start web server
-  Serial.println();
-  Serial.println("WiFi connected.");
-  Serial.println("IP address: " + WiFi.localIP().toString());
-  server.begin();
-
-  // Get time from network time service 
+  // Start joining WiFi, the network task follows it from here. The web server
+  // can listen before we have an address.
+  network.begin();
+  telemetry.begin(config.telemetryHost, config.telemetryPort);
+  webServer.begin();
+  computePageEtag();
+
+  // Get time from network time service whenever the network comes up. Until
+  // then alert timestamps are left blank and filled in once it's set.
   //(216.239.35.8 = "time.google.com" in case we can't resolve DNS)
-  configTime(TZ_SEC, DST_SEC, "pool.ntp.org", "time.nist.gov", "216.239.35.8");
+  configTime(config.tzHours * 3600, config.dstMinutes * 60, "pool.ntp.org", "time.nist.gov", "216.239.35.8");
 
   // Init the pushbutton input:
-  pinMode(buttonPin, INPUT);
+  button.begin();
+
+  // Only wake for every few DTIM beacons in light sleep, the button wakes
+  // us too (see sleepUntilDue())
+  if (lowPowerMode){
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP, wifiListenInterval);
+  }
 
   // Shut off the display to save power until the button is pressed
   display.displayOff();
+  displayIsOn = false;
+
+  // Register the loop() tasks
+  scheduler.add("network", updateNetwork, networkTaskMillis);
+  scheduler.add("web", serveWeb, webTaskMillis);
+  scheduler.add("sensors", checkSensors, sensorTaskMillis);
+  scheduler.add("alerts", checkAlerts, alertTaskMillis);
+  scheduler.add("dispatch", sendAlerts, dispatchTaskMillis);
+  scheduler.add("button", checkButton, buttonTaskMillis);
+  scheduler.add("display", updateDisplay, displayTaskMillis);
+  scheduler.add("heap", checkHeap, heapTaskMillis);
+  scheduler.add("log", flushLogs, logTaskMillis);
+  scheduler.add("telemetry", sendTelemetry, telemetryTaskMillis);
+  scheduler.add("report", reportTasks, reportTaskMillis);
 
   Serial.println("Setup - Complete. Entering Loop...");
 }
 
 
 void loop() {
-  /**********************************************************
-   *   WEB SERVER
-   * ********************************************************/
-  // Listen for incoming clients
-  WiFiClient webClientConnection = server.available(); 
-  // If a new client connects, kick off a function to send page data
-  if (webClientConnection) {sendPage(webClientConnection);}
-
-
-  /**********************************************************
-   *   TEMP SENSOR
-   * ********************************************************/
-  if (millis() - tempCheckWaitMillis > 1000){
-    // Get the current sensor readings
-    s1Reading = getTemp(sensor1);
-    s2Reading = getTemp(sensor2);
-    tempCheckWaitMillis = millis();
-  }
-
-  // If either sensor is over the threshold, start checking and reporting
-  if (s1Reading < tempThreshold || s2Reading < tempThreshold){
-    // If this is the first time we've been out of spec, record the start time.
-    if (triggeredTempMillis == 0){triggeredTempMillis = millis();}
-    
-    // If we're over the max out of spec time
-    if (millis() - triggeredTempMillis >= maxTempOutOfSpecTime){
-      // If the time between the last triggered time and the current time 
-      // is greater than the max time between triggers trigger again.
-      if (triggeredAlertMillis == 0){
-        //Serial.println("Temperature alert! " + String(s1Reading) + " : " + String(s2Reading));
-        triggeredAlertMillis = millis();
-        // POST to maker.ifttt.com
-        postIFTTT(IFTTT_ALERT, "Temperature alert!", s1Reading, s2Reading);
-      }
-      else if (millis() - triggeredAlertMillis >= alertInterval){
-        //Serial.println("Followup temperature alert! " + String(s1Reading) + " : " + String(s2Reading));
-        triggeredAlertMillis = millis();
-        // POST to maker.ifttt.com
-        postIFTTT(IFTTT_ALERT, "Followup temperature alert!", s1Reading, s2Reading);
-      }
-    }
+  {
+    PerfTimer timer(loopProbe);
+
+    // Run whichever tasks are due
+    scheduler.run();
+    heapMonitor.sample();
+  }
+
+  // Time asleep isn't loop work, so it's outside the timer
+  if (lowPowerMode){sleepUntilDue();}
+}
+
+// Sleep until the next task or alert retry is due. delay() lets the SDK put
+// the CPU into light sleep, the WiFi modem already is between beacons.
+void sleepUntilDue() {
+  unsigned long wait = SleepPlanner::sooner(scheduler.millisUntilNextTimedTask(), alertDispatcher.millisUntilDue());
+  // A browser part way through a request gets answered first
+  unsigned long sleepMillis = sleepPlanner.plan(wait, webServer.activeClients() > 0);
+  if (sleepMillis == 0){return;}
+
+  unsigned long startMillis = millis();
+  button.armWake();
+  delay(sleepMillis);
+  button.disarmWake();
+  sleepPlanner.slept(millis() - startMillis);
+}
+
+/**********************************************************
+ *   WEB SERVER
+ * ********************************************************/
+void serveWeb() {
+  PerfTimer timer(webProbe);
+
+  // Take new clients and move the ones we've got along
+  webServer.update();
+}
+
+/**********************************************************
+ *   TEMP SENSOR
+ * ********************************************************/
+void checkSensors() {
+  PerfTimer timer(sensorProbe);
+
+  // Advance each bus's conversion cycle a step, new readings land in the table
+  sensors.update();
+
+  if (firstReadingMillis == 0 && sensors.allChecked()){
+    firstReadingMillis = millis();
+    Serial.printf("First readings %lu ms after boot.\n", firstReadingMillis);
+  }
+}
+
+/**********************************************************
+ *   ALERTS
+ * ********************************************************/
+void checkAlerts() {
+  // Feed the history buffers
+  recordHistory();
+
+  // A sensor we can't read is a fault, not a cold reading
+  checkSensorFaults();
+
+  // Run the rules over every sensor with a new good reading, once it's been
+  // through the spike filter. Readings come in far slower than this runs.
+  for (int i = 0; i < sensors.count(); i++){
+    const Sensor& sensor = sensors.sensor(i);
+    if (sensor.health != SENSOR_OK || sensor.sampleMillis == alertSampleMillis[i]){continue;}
+    alertSampleMillis[i] = sensor.sampleMillis;
+    alertEngine.update(i, trends[i].add(sensor.temp, sensor.sampleMillis));
+  }
+}
+
+// Turn a rule event into an IFTTT post, e.g. "Too cold: Chamber 1"
+void onAlert(const AlertRule& rule, int sensor, AlertEvent event, int16_t value) {
+  const char* prefix = "";
+  if (event == ALERT_ESCALATED){prefix = "Escalated ";}
+  else if (event == ALERT_CLEARED){prefix = "Cleared ";}
+
+  char message[40];
+  int length = snprintf_P(message, sizeof(message), PSTR("%s%s: %s"), prefix, rule.name, sensors.sensor(sensor).label);
+  // Predict rules say how long it has, e.g. "Cold soon: Chamber 1 (12 min)"
+  bool predicted = rule.kind == RULE_PREDICT_BELOW || rule.kind == RULE_PREDICT_ABOVE;
+  if (predicted && event != ALERT_CLEARED && length < (int)sizeof(message)){
+    snprintf_P(message + length, sizeof(message) - length, PSTR(" (%d min)"), value);
   }
-  // If the sensors have moved to a non-alert state, and we perviously alerted, 
-  // send an "all clear" alert and reset the triggeredalertMillis
-  else if (s1Reading >= tempThreshold && s2Reading >= tempThreshold && triggeredAlertMillis > 0){
-    postIFTTT(IFTTT_NOTIFICATION, "Normal temperature resumed.", s1Reading, s2Reading);
-    triggeredAlertMillis = 0;
+  postIFTTT(event == ALERT_CLEARED ? IFTTT_NOTIFICATION : IFTTT_ALERT, message);
+}
+
+// How many of a sensor's online history samples are below (or above) limit
+uint16_t countHistory(int sensor, int16_t limit, bool below) {
+  RingBuffer<int16_t, 10>& history = onlineHistory[sensor];
+  uint16_t countBelow = history.countBelow(below ? limit : limit + 1, history.capacity());
+  return below ? countBelow : history.count() - countBelow;
+}
+
+// How long until a sensor's trend reaches limit, for the predict rules
+uint32_t predictBreach(int sensor, int16_t limit, bool below) {
+  return trends[sensor].millisUntil(limit, below);
+}
+
+// Alert once when sensors have been faulty for a while, and again when
+// they've all recovered
+void checkSensorFaults() {
+  if (sensors.faultCount() > 0){
+    if (sensorFaultMillis == 0){sensorFaultMillis = millis();}
+
+    if (!sensorFaultAlerted && millis() - sensorFaultMillis >= config.sensorFaultMillis){
+      sensorFaultAlerted = true;
+      postIFTTT(IFTTT_ALERT, "Sensor fault!");
+    }
   }
   else {
-    // Remove the timers
-    triggeredTempMillis = 0;
-    triggeredAlertMillis = 0;
-  }
-
-  /**********************************************************
-   *   BUTTON STATE / ACTIONS
-   * ********************************************************/
-  // read the state of the pushbutton value:
-  buttonState = digitalRead(buttonPin);
-
-  // If the button was pressed and we're not in lockout 
-  // (e.g. the first press, not subsequent readings while the button was in the down state)
-  if (buttonState && !buttonLockout){
-    Serial.println("Button Dn (no Lockout): " + String(buttonState));
-
-    // Start Timer... If we're just turning the display on set the "display on time" time to 
-    // the current millis time and turn on the display
-    displayOnMillis = millis();
-    display.displayOn();
-    Serial.println("Display On!");
-
-    // Start the lockout timer
-    buttonLockout = millis();
-  }
-  // If the button was held down, here's where we'll catch the additional readings
-  else if (buttonState && buttonLockout){
-    // If the button was held longer than required for the secondary action, 
-    // and we haven't already sent one, send a test notification.
-    if ((millis() - buttonLockout > buttonHoldActionMillis) && !testNotificationSent){
-      Serial.println("Button Dn ( + Lockout): Send Alert!");
-
-      // Send a test alert
-      postIFTTT(IFTTT_NOTIFICATION, "Test Notification.", 0.00, 0.00);
-
-      // Flag that we've sent an notification for this button hold event.
-      testNotificationSent = 1;
+    if (sensorFaultAlerted){
+      postIFTTT(IFTTT_NOTIFICATION, "Sensors recovered.");
+    }
+    sensorFaultMillis = 0;
+    sensorFaultAlerted = false;
+  }
+}
+
+void sendTelemetry() {
+  telemetry.update();
+  forwardOfflineSamples();
+}
+
+// Once we're back online the samples logged while we weren't are handed to
+// the telemetry collector, a batch at a time as it acks them, and the log is
+// trimmed once they've all gone. Without a collector they're trimmed straight
+// away, the offline history keeps them in RAM (and /api/v1/readings shows
+// them) until a restart. Dropping offline again part way through starts the
+// forwarding over next time, so the collector can see some samples twice.
+bool forwardingSamples = false;
+int forwardedSamples = 0;
+
+void forwardOfflineSamples() {
+  if (!network.connected()){
+    forwardingSamples = false;
+    return;
+  }
+  if (!forwardingSamples){
+    if (sampleLog.isEmpty()){return;}
+    if (!config.telemetryHost[0]){
+      sampleLog.clear();
+      Serial.println("Back online, offline samples cleared from flash.");
+      return;
+    }
+    sampleLog.rewind();
+    forwardingSamples = true;
+    forwardedSamples = 0;
+  }
+  if (!telemetry.readyForReplay()){return;}
+
+  StoredSample sample;
+  byte type;
+  for (int n = 0; n < telemetryBatch; n++){
+    if (sampleLog.next(type, &sample, sizeof(sample)) < 0){
+      sampleLog.clear();
+      forwardingSamples = false;
+      Serial.printf("Back online, forwarded %d offline samples.\n", forwardedSamples);
+      return;
     }
+    if (type != SAMPLE_RECORD){continue;}
+    telemetry.replay(sample.time, sample.temps, sample.count);
+    forwardedSamples++;
+  }
+}
+
+void sendAlerts() {
+  PerfTimer timer(dispatchProbe);
 
-    // Soft Restart 
-    if ((millis() - buttonLockout > buttonHoldRestartMillis)){
-      // Send a test alert
-      postIFTTT(IFTTT_NOTIFICATION, "Soft Restart Called.", 0.00, 0.00);
+  // Move any queued alert post along a step
+  alertDispatcher.update();
+}
 
-      // Call Restart
-      ESP.restart();
+/**********************************************************
+ *   BUTTON STATE / ACTIONS
+ * ********************************************************/
+void checkButton() {
+  // Pick up the edges the interrupt has queued since last time
+  button.update();
+
+  ButtonEvent event;
+  while (button.next(event)){
+    switch (event){
+      case BUTTON_PRESSED:
+        Serial.println("Button Dn");
+
+        // Start Timer... If we're just turning the display on set the "display on time" time to 
+        // the current millis time and turn on the display
+        displayOnMillis = millis();
+        display.displayOn();
+        if (!displayIsOn){
+          // Draw the whole grid again the next time around
+          displayIsOn = true;
+          infoGridDrawn = false;
+        }
+        Serial.println("Display On!");
+        break;
+
+      // Held longer than required for the secondary action, send a test notification
+      case BUTTON_HELD:
+        Serial.println("Button Held: Send Alert!");
+        postIFTTT(IFTTT_NOTIFICATION, "Test Notification.");
+        break;
+
+      // Soft Restart
+      case BUTTON_LONG_HELD:
+        postIFTTT(IFTTT_NOTIFICATION, "Soft Restart Called.");
+
+        // Give the queued alerts a chance to go out first, and write out any batched samples
+        alertDispatcher.flush(restartFlushMillis);
+        sampleLog.flush();
+
+        // Call Restart
+        ESP.restart();
+        break;
+
+      case BUTTON_RELEASED:
+        Serial.println("Button Up");
+        break;
     }
   }
-  // We're no longer in the button down state, reset the lockout and notification flag.
-  else {
-    buttonLockout = 0;
-    testNotificationSent = 0;
+}
+
+/**********************************************************
+ *   RUNTIME CONFIG
+ * ********************************************************/
+// What the runtime config starts out as, from the settings above and Config.cpp
+void configDefaults(RuntimeConfig& defaults) {
+  memset(&defaults, 0, sizeof(defaults));
+  strncpy(defaults.ssid, WIFI_SSID, sizeof(defaults.ssid) - 1);
+  strncpy(defaults.password, WIFI_PWD, sizeof(defaults.password) - 1);
+  strncpy(defaults.iftttKey, API_KEY, sizeof(defaults.iftttKey) - 1);
+  strncpy(defaults.iftttAlert, httpsConfig.iftttalert(), sizeof(defaults.iftttAlert) - 1);
+  strncpy(defaults.iftttNotification, httpsConfig.iftttnotification(), sizeof(defaults.iftttNotification) - 1);
+  strncpy(defaults.fingerprint, fingerprint, sizeof(defaults.fingerprint) - 1);
+  defaults.tzHours = TZ;
+  defaults.dstMinutes = DST_MN;
+  defaults.alertLimit = alertRules[0].limit;
+  defaults.alertHysteresis = alertRules[0].hysteresis;
+  defaults.alertDwellMillis = alertRules[0].dwellMillis;
+  defaults.alertRepeatMillis = alertRules[0].repeatMillis;
+  defaults.alertEscalateMillis = alertRules[0].escalateMillis;
+  defaults.sensorFaultMillis = maxSensorFaultTime;
+  strncpy(defaults.telemetryHost, telemetryHost, sizeof(defaults.telemetryHost) - 1);
+  defaults.telemetryPort = telemetryPort;
+  strncpy(defaults.configToken, configToken, sizeof(defaults.configToken) - 1);
+}
+
+// The rule engine reads the table as it goes, so this takes effect from the next reading
+void applyAlertConfig() {
+  alertRules[0].limit = config.alertLimit;
+  alertRules[0].hysteresis = config.alertHysteresis;
+  alertRules[0].dwellMillis = config.alertDwellMillis;
+  alertRules[0].repeatMillis = config.alertRepeatMillis;
+  alertRules[0].escalateMillis = config.alertEscalateMillis;
+  for (unsigned int r = 0; r < sizeof(alertRules) / sizeof(alertRules[0]); r++){
+    if (alertRules[r].kind == RULE_PREDICT_BELOW){alertRules[r].limit = config.alertLimit;}
+  }
+}
+
+// The WiFi settings that worked, kept while new ones are tried
+char trustedSsid[sizeof(config.ssid)];
+char trustedPassword[sizeof(config.password)];
+bool wifiOnTrial = false;
+unsigned long wifiTrialStartMillis = 0;
+
+// Switch to a new config without a restart. Most things read it as they go,
+// only what's changed and kept elsewhere (the WiFi association, the IFTTT
+// connection, the clock and the telemetry socket) is restarted.
+void applyConfig(const RuntimeConfig& updated) {
+  bool wifiChanged = strcmp(updated.ssid, config.ssid) != 0 || strcmp(updated.password, config.password) != 0;
+  bool iftttChanged = strcmp(updated.iftttKey, config.iftttKey) != 0 || strcmp(updated.fingerprint, config.fingerprint) != 0;
+  bool clockChanged = updated.tzHours != config.tzHours || updated.dstMinutes != config.dstMinutes;
+  bool telemetryChanged = strcmp(updated.telemetryHost, config.telemetryHost) != 0 || updated.telemetryPort != config.telemetryPort;
+
+  if (wifiChanged){
+    // Another change while one's on trial still falls back to the last one that worked
+    if (!wifiOnTrial){
+      strcpy(trustedSsid, config.ssid);
+      strcpy(trustedPassword, config.password);
+    }
+    wifiOnTrial = true;
+    wifiTrialStartMillis = millis();
+  }
+
+  config = updated;
+  applyAlertConfig();
+  if (wifiChanged){network.reconnect();}
+  if (iftttChanged){iftttConnection.close();}
+  if (clockChanged){
+    configTime(config.tzHours * 3600, config.dstMinutes * 60, "pool.ntp.org", "time.nist.gov", "216.239.35.8");
+  }
+  if (telemetryChanged){telemetry.begin(config.telemetryHost, config.telemetryPort);}
+}
+
+// Save the config, but with the WiFi settings that last worked while new ones
+// are on trial, so a typo in them can't stick
+bool saveConfig() {
+  if (!wifiOnTrial){return configStore.save(config);}
+  RuntimeConfig saving = config;
+  strcpy(saving.ssid, trustedSsid);
+  strcpy(saving.password, trustedPassword);
+  return configStore.save(saving);
+}
+
+// Once new WiFi settings have joined they're saved, if they don't in time the
+// old ones go back
+void checkWifiTrial() {
+  if (!wifiOnTrial){return;}
+  if (network.connected()){
+    wifiOnTrial = false;
+    Serial.printf("WiFi: joined %s, saving it.\n", config.ssid);
+    if (!saveConfig()){Serial.println("Config save failed, changes only last until a restart.");}
+  }
+  else if (millis() - wifiTrialStartMillis >= wifiTrialMillis){
+    Serial.printf("WiFi: couldn't join %s, going back to %s.\n", config.ssid, trustedSsid);
+    wifiOnTrial = false;
+    strcpy(config.ssid, trustedSsid);
+    strcpy(config.password, trustedPassword);
+    network.reconnect();
+  }
+}
+
+// When the last wrong token came in
+bool configRefused = false;
+unsigned long configRefusedMillis = 0;
+
+// Whether a request's token is the one for changing the config. Every
+// character is compared whatever's found, so the time taken doesn't tell
+// how much of a guess was right.
+bool configTokenMatches(const char* given) {
+  const char* expected = config.configToken;
+  if (!expected[0]){return false;}
+  size_t expectedLength = strlen(expected);
+  size_t givenLength = strlen(given);
+  byte differs = expectedLength != givenLength;
+  for (size_t i = 0; i < expectedLength; i++){
+    differs |= expected[i] ^ (i < givenLength ? given[i] : 0);
+  }
+  return !differs;
+}
+
+// GET /config shows the settings (secrets only say whether they're set).
+// POST /config?token=...&name=value&name=value changes them, saves them and
+// applies them straight away. If any of them is refused nothing is changed.
+// Nothing about the names or values is said until the token's been checked.
+// New WiFi settings are tried first, see checkWifiTrial(). All in one part.
+void sendConfig(BufferedPrint& out, HttpRequest& request) {
+  bool saved = false;
+
+  if (strcmp(request.method(), "POST") == 0){
+    if (configRefused && millis() - configRefusedMillis < configRetryMillis){
+      out.appendf(CONFIG_RETRY_HEADERS);
+      out.appendf(PSTR("{\"error\":\"try again later\"}"));
+      return;
+    }
+    configRefused = false;
+
+    char name[24];
+    char value[72];
+    bool authorized = false;
+    const char* query = request.query();
+    while (HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value))){
+      if (strcmp(name, "token") == 0){authorized = configTokenMatches(value);}
+    }
+    if (!authorized){
+      configRefused = true;
+      configRefusedMillis = millis();
+      out.appendf(CONFIG_FORBIDDEN_HEADERS);
+      out.appendf(config.configToken[0] ? PSTR("{\"error\":\"token needed\"}") : PSTR("{\"error\":\"no config token set\"}"));
+      return;
+    }
+
+    RuntimeConfig updated = config;
+    query = request.query();
+    while (HttpRequest::nextParam(query, name, sizeof(name), value, sizeof(value))){
+      if (strcmp(name, "token") == 0){continue;}
+      if (!ConfigStore::set(updated, name, value)){
+        // It's going back in a JSON string
+        for (char* c = name; *c; c++){
+          if (*c == '"' || *c == '\\' || *c < ' '){*c = '?';}
+        }
+        out.appendf(CONFIG_REJECTED_HEADERS);
+        out.appendf(PSTR("{\"error\":\"can't set %s\"}"), name[0] ? name : "(too long)");
+        return;
+      }
+    }
+    applyConfig(updated);
+    saved = saveConfig();
+    Serial.println(saved ? "Config saved." : "Config save failed, changes only last until a restart.");
   }
 
+  out.appendf(API_HEADERS);
+  out.appendf(PSTR("{\"loaded\":\"%s\",\"saved\":%s,\"wifiPending\":%s,\"unit\":\"%c\",\"config\":"), 
+    ConfigStore::loadResultName(configStore.loadResult()), saved ? "true" : "false", 
+    wifiOnTrial ? "true" : "false", tempUnit);
+  ConfigStore::printJson(out, config);
+  out.appendf(PSTR("}"));
+}
+
+/**********************************************************
+ *   DISPLAY
+ * ********************************************************/
+void updateDisplay() {
   // Turn off the display if it's been on longer than max "on time"
-  if (millis() - displayOnMillis > maxDisplayOnMillis){
+  if (displayIsOn && millis() - displayOnMillis > maxDisplayOnMillis){
     // Turn the display off
     display.displayOff();
+    displayIsOn = false;
 
     //Reset the display on time to 0
     displayOnMillis = 0;
   }
 
   // Update the display info
+  PerfTimer timer(displayProbe);
   drawInfoGrid();
 }
 
-// Function to return temp from a sensor given it's I/O pin
-float getTemp(int sensor_pin) {
-  // OneWire DS18S20, DS18B20, DS1822 Temperature Example
-  //
-  // http://www.pjrc.com/teensy/td_libs_OneWire.html
-  //
-  // The DallasTemperature library can do all this work for you!
-  // https://github.com/milesburton/Arduino-Temperature-Control-Library
-  
-  // (a 4.7K resistor is necessary)
-  OneWire  sensor(sensor_pin);
-
-  byte i;
-  byte present = 0;
-  byte type_s;
-  byte data[12];
-  byte addr[8];
-  float celsius, fahrenheit;
-  
-  if (!sensor.search(addr)) {
-    //Serial.println("No more addresses.");
-    //Serial.println();
-    sensor.reset_search();
-    delay(250);
-    return 0;
-  }
-
-  if (OneWire::crc8(addr, 7) != addr[7]) {
-      Serial.println("CRC is not valid!");
-      return 0;
-  }
-
-  sensor.reset();
-  sensor.select(addr);
-  sensor.write(0x44, 0);        // start conversion, with parasite power OFF at the end
-  
-  //delay(1000);     // maybe 750ms is enough, maybe not
-  // we might do a sensor.depower() here, but the reset will take care of it.
-  
-  present = sensor.reset();
-  sensor.select(addr);    
-  sensor.write(0xBE);         // Read Scratchpad
-
-  // we need 9 bytes
-  for ( i = 0; i < 9; i++) { 
-    data[i] = sensor.read();
-  }
-
-  // Convert the data to actual temperature
-  // because the result is a 16 bit signed integer, it should
-  // be stored to an "int16_t" type, which is always 16 bits
-  // even when compiled on a 32 bit processor.
-  int16_t raw = (data[1] << 8) | data[0];
-  if (type_s) {
-    raw = raw << 3; // 9 bit resolution default
-    if (data[7] == 0x10) {
-      // "count remain" gives full 12 bit resolution
-      raw = (raw & 0xFFF0) + 12 - data[6];
-    }
-  } else {
-    byte cfg = (data[4] & 0x60);
-    // at lower res, the low bits are undefined, so let's zero them
-    if (cfg == 0x00) raw = raw & ~7;  // 9 bit resolution, 93.75 ms
-    else if (cfg == 0x20) raw = raw & ~3; // 10 bit res, 187.5 ms
-    else if (cfg == 0x40) raw = raw & ~1; // 11 bit res, 375 ms
-    //// default is 12 bit resolution, 750 ms conversion time
+// Walking the heap for fragmentation isn't free, so only do it now and then
+void checkHeap() {
+  heapMonitor.sampleFragmentation();
+}
+
+// Follow the WiFi connection along
+void updateNetwork() {
+  network.update();
+  checkWifiTrial();
+}
+
+// Print how long each task has been taking, then start a fresh window.
+// The probes and heap numbers are kept since boot.
+void reportTasks() {
+  char buff[256];
+  {
+    BufferedPrint out(Serial, buff, sizeof(buff));
+    reportPerf(out);
   }
-  celsius = (float)raw / 16.0;
-  fahrenheit = celsius * 1.8 + 32.0;
-  return fahrenheit;
+  scheduler.resetStats();
 }
 
-void postIFTTT(String iftttAction, char* strMessage, float s1Reading, float s2Reading){ 
-  
-  String IFTTT_URI = "/trigger/" + iftttAction + "/with/key/";
+// Everything goes through appendf(), Print::printf() allocates for lines
+// over 64 characters. In three pieces so /debug/perf can send it in parts.
+void reportPerf(BufferedPrint& out) {
+  reportPerfSummary(out);
+  PerfProbe::reportAll(out);
+  reportPerfCounters(out);
+}
 
-  Serial.println("========== postIFTTT() ==========");
-  // Add the time to the right side of the display
-  now = time(nullptr);
-  struct tm* timeInfo;
-  timeInfo = localtime(&now);
-  char buff[16];
-  sprintf_P(buff, PSTR("%02d:%02d:%02d"), timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
-
-  // Repeat the post data to the buffer
-  Serial.println("   (" + String(buff) + ") " + strMessage + 
-    " Sensor1 = " + String(s1Reading) + 
-    " Sensor2 = " + String(s2Reading));
-
-  // Use WiFiClientSecure class to create TLS connection
-  WiFiClientSecure httpClient;
-  //Serial.print("connecting to ");
-  //Serial.println(IFTTT_Host);
-  //Serial.printf("Using fingerprint '%s'\n", fingerprint);
-
-  // Connect to IFTTT
-  if (!httpClient.connect(IFTTT_Host, httpsPort)) {
-    Serial.println("   Connection failed.");
-    return;
+// Uptime, WiFi and the task table
+void reportPerfSummary(BufferedPrint& out) {
+  out.appendf(PSTR("uptime %lu s, first readings at %lu ms\n"), millis() / 1000, firstReadingMillis);
+  out.appendf(PSTR("wifi %s, %lu connects, last took %lu ms%s, clock %s\n"), 
+    network.connected() ? "up" : "down", network.connects(), network.lastConnectMillis(), 
+    network.fastConnected() ? " (fast)" : "", network.clockSet() ? "set" : "not set");
+  scheduler.report(out);
+}
+
+// Heap, logs, sleep, telemetry, the button and the alert rules
+void reportPerfCounters(BufferedPrint& out) {
+  heapMonitor.report(out);
+  out.appendf(PSTR("log alerts %lu appended %lu flushes, samples %lu appended %lu flushes\n"), 
+    (unsigned long)alertLog.appended(), (unsigned long)alertLog.flushes(), 
+    (unsigned long)sampleLog.appended(), (unsigned long)sampleLog.flushes());
+  out.appendf(PSTR("awake %u.%u%% of uptime, %lu ms asleep in %lu sleeps\n"), 
+    sleepPlanner.awakePermille(millis()) / 10, sleepPlanner.awakePermille(millis()) % 10, 
+    (unsigned long)sleepPlanner.sleptMillis(), (unsigned long)sleepPlanner.sleeps());
+  out.appendf(PSTR("telemetry %lu samples, %lu frames sent %lu acked %lu resent %lu dropped, %lu bytes\n"), 
+    (unsigned long)telemetry.samples(), (unsigned long)telemetry.framesSent(), (unsigned long)telemetry.framesAcked(), 
+    (unsigned long)telemetry.framesResent(), (unsigned long)telemetry.framesDropped(), (unsigned long)telemetry.bytesSent());
+  out.appendf(PSTR("button %lu edges, %lu queue overflows\n"), (unsigned long)button.edges(), (unsigned long)button.overflows());
+  alertEngine.report(out);
+}
+
+// Push the latest readings into the history ring buffers at their own rates.
+// Online history runs while we have WiFi, offline history while we don't.
+// Faulty sensors just miss the sample, their stale reading isn't history.
+void recordHistory() {
+  if (!sensors.allChecked()){return;}
+
+  if (network.connected()){
+    if (!onlineHistoryStarted || millis() - onlineHistoryWaitMillis >= onlineHistoryMillis){
+      for (int i = 0; i < sensors.count(); i++){
+        if (sensors.sensor(i).health == SENSOR_OK){onlineHistory[i].push(sensors.sensor(i).temp);}
+      }
+      onlineHistoryWaitMillis = millis();
+      onlineHistoryStarted = true;
+    }
+  }
+  else if (!offlineHistoryStarted || millis() - offlineHistoryWaitMillis >= offlineHistoryMillis){
+    StoredSample sample;
+    sample.time = time(nullptr);
+    sample.count = sensors.count();
+    for (int i = 0; i < sensors.count(); i++){
+      sample.temps[i] = INT16_MIN;
+      if (sensors.sensor(i).health == SENSOR_OK){
+        offlineHistory[i].push(sensors.sensor(i).temp);
+        sample.temps[i] = sensors.sensor(i).temp;
+      }
+    }
+    sampleLog.append(SAMPLE_RECORD, &sample, offsetof(StoredSample, temps) + sample.count * sizeof(int16_t));
+    offlineHistoryWaitMillis = millis();
+    offlineHistoryStarted = true;
   }
+}
 
-  // Verify the fingerprint matches the host we're connected to
-  if (!httpClient.verify(fingerprint, IFTTT_Host)) {
-    Serial.println("   Certificate doesn't match.");
-  } 
-
-  Serial.print("   Requesting URL: ");
-  Serial.println(IFTTT_Host + IFTTT_URI);
-
-  // Create the post data json
-  String postData = "{"
-    "\"value1\":\"(" + String(buff) + ") " + strMessage + "\\n\","
-    "\"value2\":\"Sensor1 = " + String(s1Reading) + "\\n\","
-    "\"value3\":\"Sensor2 = " + String(s2Reading) + "\""
-    "}";
-  
-  // Send the data to the remote endpoint
-  httpClient.print("POST " + IFTTT_URI + API_KEY + " HTTP/1.1\r\n" +
-    "Host: " + IFTTT_Host + "\r\n" +
-    "Content-length: " + postData.length() + "\r\n" +
-    "Content-Type: application/json\r\n" +
-    "Connection: close\r\n\r\n" +
-    postData
-  );
-  
-  Serial.println("   Request sent.");
-
-  ///*
-  // Report what happened
-  while (httpClient.connected()) {
-    String line = httpClient.readStringUntil('\n');
-    if (line == "\r") {
-      Serial.println("   Headers received.");
-      break;
+// Refill the offline history from the sample log, oldest first
+void restoreOfflineHistory() {
+  StoredSample sample;
+  byte type;
+  int restored = 0;
+  sampleLog.rewind();
+  while (sampleLog.next(type, &sample, sizeof(sample)) >= 0){
+    if (type != SAMPLE_RECORD){continue;}
+    for (int i = 0; i < sample.count && i < MAX_SENSORS; i++){
+      if (sample.temps[i] != INT16_MIN){offlineHistory[i].push(sample.temps[i]);}
     }
+    restored++;
   }
-  /*
-  String line = httpClient.readStringUntil('\n');
-  if (line.startsWith("{\"state\":\"success\"")) {
-    Serial.println("   Success!");
-  } else {
-    Serial.println("   Failed.");
+  if (restored > 0){Serial.printf("Restored %d offline samples.\n", restored);}
+}
+
+// Write out the batched samples once they've waited long enough
+void flushLogs() {
+  sampleLog.flushIfDue();
+}
+
+// Every sensor's reading as "Label = 12.34, Label = missing"
+void formatReadings(char* buff, size_t size) {
+  int length = 0;
+  buff[0] = '\0';
+  for (int i = 0; i < sensors.count() && length < (int)size - 1; i++){
+    const Sensor& sensor = sensors.sensor(i);
+    char reading[TEMP_TEXT_SIZE];
+    formatTemperature(reading, sensor.temp, 2);
+    length += snprintf_P(buff + length, size - length, PSTR("%s%s = %s"), 
+      i > 0 ? ", " : "", sensor.label, 
+      sensor.health == SENSOR_OK ? reading : SensorTable::healthName(sensor.health));
   }
-  Serial.println("   Reply was: " + line);
-  */
+}
+
+// Queue an alert for maker.ifttt.com with the current readings, alertDispatcher posts it from loop()
+void postIFTTT(const char* iftttAction, const char* strMessage){ 
+  Serial.println("========== postIFTTT() ==========");
+  char readings[128];
+  formatReadings(readings, sizeof(readings));
+  alertDispatcher.enqueue(iftttAction, strMessage, readings);
+}
 
-   //
-   httpClient.stop();
+// Blank out one field of the info grid so it can be drawn over
+void clearField(int x, int y, int width, int height) {
+  display.setColor(BLACK);
+  display.fillRect(x, y, width, height);
+  display.setColor(WHITE);
 }
 
-void drawInfoGrid() {
+// Draw the grid lines and labels, these only change when we move to another page of sensors
+void drawInfoGridChrome(int page) {
   display.clear();
 
   // H start, V start, H end, V end
@@ -452,215 +951,442 @@ void drawInfoGrid() {
   // Sets the current font. Available default fonts
   // ArialMT_Plain_10, ArialMT_Plain_16, ArialMT_Plain_24
   display.setFont(ArialMT_Plain_10);
-  // Draws a String with a maximum width at the given location.
-  // If the given String is wider than the specified width
-  // The text will be wrapped to the next line at a space or dash
-  display.drawString(0, 0, "Sensor 1:");
-  display.drawString((display.getWidth()/2)+4, 0, "Sensor 2:");
+  for (int slot = 0; slot < 2; slot++){
+    int index = page * 2 + slot;
+    if (index >= sensors.count()){continue;}
+    FixedString<sizeof(Sensor::label) + 1> label;
+    label.append(sensors.sensor(index).label).append(":");
+    display.drawString(slot * ((display.getWidth()/2)+4), 0, label.c_str());
+  }
   display.drawString(0, display.getHeight()-26, "Time: ");
   display.drawString(0, display.getHeight()-14, "IP:   ");
-  
-  // Change to right allignment
-  display.setTextAlignment(TEXT_ALIGN_RIGHT);
+}
+
+// Update the info grid. Only fields whose values changed are redrawn, and
+// nothing at all is done while the display is off. SSD1306Wire's display()
+// already only sends the area that changed since the last one. Two sensors are shown at a time, paging
+// through the rest.
+void drawInfoGrid() {
+  if (!displayIsOn){return;}
+
+  int pages = max(1, (sensors.count() + 1) / 2);
+  int page = (millis() / displayPageMillis) % pages;
+
+  // Redrawing the chrome wipes every field, so they all need drawing again
+  bool redrawAll = !infoGridDrawn || page != infoGridPage;
+  bool changed = redrawAll;
+  if (redrawAll){
+    drawInfoGridChrome(page);
+    infoGridDrawn = true;
+    infoGridPage = page;
+  }
 
   // Add the IP to the right side of the display
-  display.drawString(display.getWidth(), display.getHeight()-14, WiFi.localIP().toString());
+  uint32_t ip = network.connected() ? (uint32_t)WiFi.localIP() : 0;
+  if (redrawAll || ip != infoGridIp){
+    infoGridIp = ip;
+    clearField(24, display.getHeight()-13, display.getWidth()-24, 13);
+    display.setFont(ArialMT_Plain_10);
+    display.setTextAlignment(TEXT_ALIGN_RIGHT);
+    char ipBuff[16] = "Connecting...";
+    if (ip){
+      sprintf_P(ipBuff, PSTR("%u.%u.%u.%u"), 
+        (unsigned int)(ip & 0xFF), (unsigned int)((ip >> 8) & 0xFF), (unsigned int)((ip >> 16) & 0xFF), (unsigned int)(ip >> 24));
+    }
+    display.drawString(display.getWidth(), display.getHeight()-14, ipBuff);
+    changed = true;
+  }
 
   // Add the time to the right side of the display
   now = time(nullptr);
+  if (redrawAll || now != infoGridTime){
+    infoGridTime = now;
+    struct tm* timeInfo;
+    timeInfo = localtime(&now);
+    char buff[16] = "--:--:--";
+    if (NetworkManager::validTime(now)){
+      sprintf_P(buff, PSTR("%02d:%02d:%02d"), timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+    }
+    clearField(32, display.getHeight()-25, display.getWidth()-32, 12);
+    display.setFont(ArialMT_Plain_10);
+    display.setTextAlignment(TEXT_ALIGN_RIGHT);
+    display.drawString(display.getWidth(), display.getHeight()-26, buff);
+    changed = true;
+  }
+
+  // Draw in the temp readings, rounded to what's shown
+  for (int slot = 0; slot < 2; slot++){
+    int index = page * 2 + slot;
+    if (index >= sensors.count()){continue;}
+
+    // Found but not read yet shows as "--", a faulty sensor as "Err"
+    const Sensor& sensor = sensors.sensor(index);
+    long tenths;
+    if (sensor.health == SENSOR_OK){tenths = divRound(sensor.temp, 10);}
+    else if (sensor.health == SENSOR_UNREAD){tenths = LONG_MIN;}
+    else {tenths = LONG_MIN + 1;}
+    if (redrawAll || tenths != infoGridTenths[slot]){
+      infoGridTenths[slot] = tenths;
+      int x = slot * ((display.getWidth()/2)+1);
+      clearField(x, 11, (display.getWidth()/2)-1, 25);
+      display.setFont(ArialMT_Plain_24);
+      display.setTextAlignment(TEXT_ALIGN_LEFT);
+      char text[TEMP_TEXT_SIZE + 2] = "--";
+      if (sensor.health == SENSOR_OK){
+        formatTemperature(text, sensor.temp, 1);
+        strcat(text, "°");
+      }
+      else if (sensor.health != SENSOR_UNREAD){
+        strcpy(text, "Err");
+      }
+      display.drawStringMaxWidth(x + slot * 3, 10, (display.getWidth()/2)-2, text);
+      changed = true;
+    }
+  }
+
+  // Send the changes to the screen
+  if (changed){display.display();}
+}
+
+// Answer a complete request, a part at a time (see WebServer.h); true while
+// there's more to come. The page itself is a static shell in flash
+// (WebPage.h), the live values are served as JSON from /api/v1/readings out
+// of the cached readings, never straight off the bus.
+bool routeRequest(BufferedPrint& out, HttpRequest& request, uint16_t part) {
+  const char* path = request.path();
+  if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0){
+    return sendShell(out, request, part);
+  }
+  else if (strcmp(path, "/api/v1/readings") == 0){
+    return sendReadings(out, part);
+  }
+  else if (strcmp(path, "/config") == 0){
+    sendConfig(out, request);
+  }
+  else if (strcmp(path, "/metrics") == 0){
+    return sendMetrics(out, part);
+  }
+  else if (strcmp(path, "/debug/perf") == 0){
+    return sendPerf(out, part);
+  }
+  else {
+    out.append_P(PAGE_NOT_FOUND, strlen_P(PAGE_NOT_FOUND));
+  }
+  return false;
+}
+
+// The serial log's perf report, a part for the summary, each probe and the rest
+bool sendPerf(BufferedPrint& out, uint16_t part) {
+  if (part == 0){
+    out.appendf(DEBUG_HEADERS);
+    reportPerfSummary(out);
+    return true;
+  }
+  PerfProbe* probe = PerfProbe::at(part - 1);
+  if (probe){
+    probe->report(out);
+    return true;
+  }
+  reportPerfCounters(out);
+  return false;
+}
+
+// FNV-1a over the page shell, done once at boot
+void computePageEtag() {
+  uint32_t hash = 2166136261UL;
+  size_t length = strlen_P(PAGE_SHELL);
+  for (size_t i = 0; i < length; i++){
+    hash ^= pgm_read_byte(PAGE_SHELL + i);
+    hash *= 16777619UL;
+  }
+  snprintf_P(pageEtag, sizeof(pageEtag), PSTR("\"%08lx\""), (unsigned long)hash);
+}
+
+// The static page, or a 304 if the browser already has this version. The
+// page goes out of flash a buffer's worth at a time, the headers in front
+// of the first.
+bool sendShell(BufferedPrint& out, HttpRequest& request, uint16_t part) {
+  if (request.ifNoneMatch(pageEtag)){
+    out.appendf(PAGE_NOT_MODIFIED, pageEtag);
+    return false;
+  }
+  size_t headerLength = snprintf_P(NULL, 0, PAGE_SHELL_HEADERS, pageEtag);
+  if (part == 0){out.appendf(PAGE_SHELL_HEADERS, pageEtag);}
+  size_t length = strlen_P(PAGE_SHELL);
+  size_t start = part ? part * WebServer::RESPONSE_BUFFER - headerLength : 0;
+  size_t end = min((part + 1) * WebServer::RESPONSE_BUFFER - headerLength, length);
+  out.append_P(PAGE_SHELL + start, end - start);
+  return end < length;
+}
+
+// One sensor's reading, history and trend as a JSON object, in two halves so
+// each fits a response part: the reading and recent history, then the
+// offline samples, the trend and the closing brace. The trend's slope is in
+// degrees an hour.
+void printSensorJson(BufferedPrint& out, const Sensor& sensor, RingBuffer<int16_t, 10>& history) {
+  char id[17];
+  SensorTable::formatAddress(sensor.addr, id);
+  char value[3][TEMP_TEXT_SIZE];
+  formatTemperature(value[0], sensor.temp, 2);
+  out.appendf(PSTR("{\"id\":\"%s\",\"name\":\"%s\",\"resolution\":%d,\"health\":\"%s\",\"failures\":%u,"
+    "\"temp\":%s,\"age\":%lu,\"history\":{\"count\":%d"), 
+    id, sensor.label, sensor.resolution, SensorTable::healthName(sensor.health), sensor.failures, 
+    value[0], millis() - sensor.sampleMillis, history.count());
+  if (!history.isEmpty()){
+    formatTemperature(value[0], history.min(), 2);
+    formatTemperature(value[1], history.mean(), 2);
+    formatTemperature(value[2], history.max(), 2);
+    out.appendf(PSTR(",\"min\":%s,\"mean\":%s,\"max\":%s"), value[0], value[1], value[2]);
+  }
+  // Oldest first
+  out.appendf(PSTR(",\"samples\":["));
+  for (int age = history.count() - 1; age >= 0; age--){
+    formatTemperature(value[0], history.at(age), 2);
+    out.appendf(PSTR("%s%s"), value[0], age > 0 ? "," : "");
+  }
+  out.appendf(PSTR("]}"));
+}
+
+void printSensorJsonTail(BufferedPrint& out, RingBuffer<int16_t, 96>& offline, TrendTracker<24, 3>& trend) {
+  char value[3][TEMP_TEXT_SIZE];
+  // What was logged while we were offline (this boot or before it), oldest first
+  out.appendf(PSTR(",\"offline\":{\"count\":%d,\"samples\":["), offline.count());
+  for (int age = offline.count() - 1; age >= 0; age--){
+    formatTemperature(value[0], offline.at(age), 2);
+    out.appendf(PSTR("%s%s"), value[0], age > 0 ? "," : "");
+  }
+  out.appendf(PSTR("]}"));
+  if (trend.hasReading()){
+    formatTemperature(value[0], trend.mean(), 2);
+    formatTemperature(value[1], (int16_t)min(trend.stddev(), (uint16_t)32767), 2);
+    formatTemperature(value[2], (int16_t)constrain(trend.slopePerHour(), (int32_t)-32768, (int32_t)32767), 2);
+    out.appendf(PSTR(",\"trend\":{\"mean\":%s,\"sd\":%s,\"slope\":%s,\"points\":%u,\"spikes\":%lu}"), 
+      value[0], value[1], value[2], trend.points(), (unsigned long)trend.spikes());
+  }
+  out.appendf(PSTR("}"));
+}
+
+// The cached readings, history and alert state as JSON for the page to poll.
+// With any number of sensors the size isn't known up front, so it goes out
+// in parts (the time, each sensor in two, the alert state) and the end of
+// the response is the connection closing.
+bool sendReadings(BufferedPrint& out, uint16_t part) {
+  if (part > 0){
+    int i = (part - 1) / 2;
+    if (i < sensors.count()){
+      if (part % 2){
+        if (i > 0){out.appendf(PSTR(","));}
+        printSensorJson(out, sensors.sensor(i), onlineHistory[i]);
+      }
+      else {
+        printSensorJsonTail(out, offlineHistory[i], trends[i]);
+      }
+      return true;
+    }
+    out.appendf(PSTR("],\"alert\":{\"outOfSpec\":%s,\"alerting\":%s,\"faults\":%d,\"queued\":%d}}"), 
+      alertEngine.breachedCount() > 0 ? "true" : "false", 
+      alertEngine.activeCount() > 0 ? "true" : "false", 
+      sensors.faultCount(), 
+      alertDispatcher.pending());
+    return false;
+  }
+
+  // Get and format the current time
+  now = time(nullptr);
   struct tm* timeInfo;
   timeInfo = localtime(&now);
-  char buff[16];
-  sprintf_P(buff, PSTR("%02d:%02d:%02d"), timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
-  display.drawString(display.getWidth(), display.getHeight()-26, String(buff));
-  
-  // Draw in the temp readings
-  float tempS1 = getTemp(sensor1);
-  float tempS1Rounded = round(tempS1 * 10)/10.0;
+  char timeBuff[32] = "Clock not set yet";
+  if (NetworkManager::validTime(now)){
+    char day[4];
+    char month[4];
+    strcpy_P(day, WDAY_NAMES[timeInfo->tm_wday]);
+    strcpy_P(month, MONTH_NAMES[timeInfo->tm_mon]);
+    sprintf_P(timeBuff, PSTR("%s %s %02d, %d - %02d:%02d:%02d"), 
+      day, 
+      month, 
+      timeInfo->tm_mday, 
+      timeInfo->tm_year+1900, 
+      timeInfo->tm_hour, 
+      timeInfo->tm_min, 
+      timeInfo->tm_sec);
+  }
 
-  float tempS2 = getTemp(sensor2);
-  float tempS2Rounded = round(tempS2 * 10)/10.0;
+  char thresholdBuff[TEMP_TEXT_SIZE];
+  formatTemperature(thresholdBuff, alertRules[0].limit, 2);
 
-  display.setTextAlignment(TEXT_ALIGN_LEFT);
-  display.setFont(ArialMT_Plain_24);
-  // Display Sensor1
-  display.drawStringMaxWidth(0, 10, (display.getWidth()/2)-2, String(tempS1Rounded, 1) + "°");
-  // Display Sensor2
-  display.drawStringMaxWidth((display.getWidth()/2)+4, 10, display.getWidth(), String(tempS2Rounded, 1) + "°");
+  out.appendf(API_HEADERS);
+  out.appendf(PSTR("{\"time\":%lu,\"timestamp\":\"%s\",\"uptime\":%lu,\"unit\":\"%c\",\"threshold\":%s,\"sensors\":["), 
+    (unsigned long)now, timeBuff, millis(), tempUnit, thresholdBuff);
+  return true;
+}
 
-  // Send the completed data to the screen
-  display.display();
+// A sensor's Prometheus labels, e.g. sensor="28ff4b6d6116045c",name="Chamber 1".
+// The name is escaped since it comes from the settings.
+void formatSensorLabels(char* buff, size_t size, const Sensor& sensor) {
+  char id[17];
+  SensorTable::formatAddress(sensor.addr, id);
+  int length = snprintf_P(buff, size, PSTR("sensor=\"%s\",name=\""), id);
+  for (const char* c = sensor.label; *c && length < (int)size - 4; c++){
+    if (*c == '\\' || *c == '"'){buff[length++] = '\\';}
+    if (*c == '\n'){buff[length++] = '\\'; buff[length++] = 'n'; continue;}
+    buff[length++] = *c;
+  }
+  buff[length++] = '"';
+  buff[length] = '\0';
 }
 
-void sendPage(WiFiClient client) {
-    Serial.println("New Client.");          // print a message out in the serial port
-    String currentLine = "";                // make a String to hold incoming data from the client
-
-    while (client.connected()) {            // loop while the client's connected
-      if (client.available()) {             // if there's bytes to read from the client,
-        char c = client.read();             // read a byte, then
-        Serial.write(c);                    // print it out the serial monitor
-        header += c;
-        if (c == '\n') {                    // if the byte is a newline character
-          // if the current line is blank, you got two newline characters in a row.
-          // that's the end of the client HTTP request, so send a response:
-          if (currentLine.length() == 0) {
-            // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
-            // and a content-type so the client knows what's coming, then a blank line:
-            client.println("HTTP/1.1 200 OK");
-            client.println("Content-type:text/html");
-            client.println("Connection: close");
-            client.println();
-
-            // HTML starts here
-            //
-            // Declare doctype and style info
-            // We're forcing an HTML meta-refresh here until the, lazy, dev 
-            // can work out funneling sensor data directly through to the client.
-            client.println("<!DOCTYPE html><html>");
-            client.println("<head>");
-            client.println("  <meta http-equiv=\"refresh\" content=\"15\">");
-            client.println("  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
-            client.println("  <link rel=\"icon\" href=\"data:,\">");
-            client.println("  <style>");
-            client.println("    html {font-family: Helvetica;}");
-            client.println("    table {border-collapse:collapse;width: 50%}");
-            client.println("    table, td, th {border:1px solid gray;padding:5px;text-align:center;}");
-            client.println("    th {background-color: #666361; color: white;}");
-            client.println("  </style>");
-            
-            // Declare JavaScript functions
-            client.println("  <script>");
-            client.println("    function localTime() {");
-            client.println("      var now     = new Date();");
-            client.println("      var day     = now.getDay();");
-            client.println("      var date    = now.getDate();");
-            client.println("      var month   = now.getMonth();");
-            client.println("      var year    = now.getYear();");
-            client.println("      var hours   = now.getHours();");
-            client.println("      var minutes = now.getMinutes();");
-            client.println("      var seconds = now.getSeconds();");
-            client.println("      day         = dateIntToString(day);");
-            client.println("      month       = monthIntToString(month);");
-            client.println("      hours       = correctHourMinSec(hours);");
-            client.println("      minutes     = correctHourMinSec(minutes);");
-            client.println("      seconds     = correctHourMinSec(seconds);");
-            client.println("      document.getElementById('LocalTime').innerHTML = day + \" \" + month + \" \" + date + \", \" + (year + 1900) + \" - \" + hours + \":\" + minutes + \":\" + seconds;");
-            client.println("      var t = setTimeout(localTime, 500);");
-            client.println("    }");
-            client.println("    function dateIntToString(int){");
-            client.println("      var dayString = \"\"");
-            client.println("      switch (int) {");
-            client.println("        case 0:dayString = \"Sun\";break;");
-            client.println("        case 1:dayString = \"Mon\";break;");
-            client.println("        case 2:dayString = \"Tue\";break;");
-            client.println("        case 3:dayString = \"Wed\";break;");
-            client.println("        case 4:dayString = \"Thu\";break;");
-            client.println("        case 5:dayString = \"Fri\";break;");
-            client.println("        case 6:dayString = \"Sat\";break;");
-            client.println("      }");
-            client.println("      return dayString;");
-            client.println("    }");
-            client.println("    function monthIntToString(int){");
-            client.println("      var monthString = \"\"");
-            client.println("      switch (int) {");
-            client.println("        case 0: monthString = \"Jan\";break;");
-            client.println("        case 1: monthString = \"Feb\";break;");
-            client.println("        case 2: monthString = \"Mar\";break;");
-            client.println("        case 3: monthString = \"Apr\";break;");
-            client.println("        case 4: monthString = \"May\";break;");
-            client.println("        case 5: monthString = \"Jun\";break;");
-            client.println("        case 6: monthString = \"Jul\";break;");
-            client.println("        case 7: monthString = \"Aug\";break;");
-            client.println("        case 8: monthString = \"Sep\";break;");
-            client.println("        case 9: monthString = \"Oct\";break;");
-            client.println("        case 10:monthString = \"Nov\";break;");
-            client.println("        case 11:monthString = \"Dec\";break;");
-            client.println("      }");
-            client.println("      return monthString;");
-            client.println("    }");
-            client.println("    function correctHourMinSec(int) {");
-            client.println("      if (int < 10) {int = \"0\" + int};  // add zero in front of numbers < 10");
-            client.println("      return int;");
-            client.println("    }");
-            client.println("  </script>");
-            client.println("</head>");
-
-            // Get and format the current time to plug into the page HTML
-            now = time(nullptr);
-            struct tm* timeInfo;
-            timeInfo = localtime(&now);
-            char buff[32];
-            sprintf_P(buff, PSTR("%s %s %02d, %d - %02d:%02d:%02d"), 
-              WDAY_NAMES[timeInfo->tm_wday].c_str(), 
-              MONTH_NAMES[timeInfo->tm_mon].c_str(), 
-              timeInfo->tm_mday, 
-              timeInfo->tm_year+1900, 
-              timeInfo->tm_hour, 
-              timeInfo->tm_min, 
-              timeInfo->tm_sec);
-
-            // Get the sensor readings
-            float s1Reading = getTemp(sensor1);
-            float s2Reading = getTemp(sensor2);
-
-            // Open BODY and place content
-            client.println("<body>");
-            client.println("<br>");
-            client.println("<table align=\"center\" style=\"width: 100%; max-width: 500px;\">");
-            client.println("  <tr>");
-            client.println("    <th>Remote Timestamp</th>");
-            client.println("  </tr>");
-            client.println("  <tr>");
-            client.println("    <td>");
-            client.println(       String(buff));
-            client.println("    </td>");
-            client.println("  </tr>");
-            client.println("</table>");
-            client.println("<br>");
-            client.println("<table align=\"center\" style=\"width: 100%; max-width: 500px;\">");
-            client.println("  <tr>");
-            client.println("    <th>Sensor 1 Temp</th>");
-            client.println("    <th>Sensor 2 Temp</th>");
-            client.println("  </tr>");
-            client.println("  <tr>");
-            // If the sensor is out of spec turn the temp text bold red
-            if (s1Reading < tempThreshold){
-              client.println("    <td><font size=\"5\" color=\"red\"><b>" + String(s1Reading) + "&deg!</b></font></td>");
-            }
-            else {
-              client.println("    <td><font size=\"5\">" + String(s1Reading) + "&deg</font></td>");
-            }
-            if (s2Reading < tempThreshold){
-              client.println("    <td><font size=\"5\" color=\"red\"><b>" + String(s2Reading) + "&deg!</b></font></td>");
-            }
-            else {
-              client.println("    <td><font size=\"5\">" + String(s2Reading) + "&deg</font></td>");
-            }
-            client.println("  </tr>");
-            client.println("</table>");
-            client.println("<script>localTime();</script>");
-            client.println("</body>");
-            client.println("</html>");
-
-            // The HTTP response ends with another blank line
-            client.println();
-            // Break out of the while loop
-            break;
-          } 
-          else { // if you got a newline, then clear currentLine
-            currentLine = "";
-          }
-        } 
-        else if (c != '\r') {  // if you got anything else but a carriage return character,
-          currentLine += c;      // add it to the end of the currentLine
-        }
+// Millis as seconds with 3 decimals, e.g. 1234 -> 1.234
+void printMillisAsSeconds(BufferedPrint& out, unsigned long ms) {
+  out.appendf(PSTR("%lu.%03lu\n"), ms / 1000, ms % 1000);
+}
+
+// Lines "from" up to "to" of the loop time histogram. Its counts are
+// cumulative, so they're added up from the first bucket whatever the range.
+// A probe bucket's limit is inclusive, so it's the "le" as it stands.
+void printLoopBuckets(BufferedPrint& out, int from, int to) {
+  uint32_t cumulative = 0;
+  for (int i = 0; i < to; i++){
+    cumulative += loopProbe.bucket(i);
+    if (i < from){continue;}
+    uint32_t limit = PerfProbe::bucketLimitMicros(i);
+    out.appendf(PSTR("tempmon_loop_duration_seconds_bucket{le=\"%lu.%06lu\"} %lu\n"), 
+      (unsigned long)(limit / 1000000), (unsigned long)(limit % 1000000), (unsigned long)cumulative);
+  }
+}
+
+// Everything a fleet monitor wants to scrape, in the Prometheus text format.
+// It's all cached state (nothing here touches the sensor bus) sent a part
+// at a time, so a scrape costs about as much as a readings poll.
+bool sendMetrics(BufferedPrint& out, uint16_t part) {
+  char labels[64];
+  char value[TEMP_TEXT_SIZE];
+  switch (part){
+    case 0:
+      out.appendf(METRICS_HEADERS);
+      out.appendf(PSTR("# HELP tempmon_uptime_seconds Time since boot.\n# TYPE tempmon_uptime_seconds gauge\ntempmon_uptime_seconds "));
+      printMillisAsSeconds(out, millis());
+
+      // Sensors, a part for each metric since there can be 16 of them
+      out.appendf(PSTR("# HELP tempmon_temperature_degrees Latest good reading, in the unit label.\n# TYPE tempmon_temperature_degrees gauge\n"));
+      for (int i = 0; i < sensors.count(); i++){
+        const Sensor& sensor = sensors.sensor(i);
+        if (sensor.health != SENSOR_OK){continue;}
+        formatSensorLabels(labels, sizeof(labels), sensor);
+        formatTemperature(value, sensor.temp, 2);
+        out.appendf(PSTR("tempmon_temperature_degrees{%s,unit=\"%c\"} %s\n"), labels, tempUnit, value);
+      }
+      return true;
+    case 1:
+      out.appendf(PSTR("# HELP tempmon_sensor_up Whether the last read of the sensor was good.\n# TYPE tempmon_sensor_up gauge\n"));
+      for (int i = 0; i < sensors.count(); i++){
+        const Sensor& sensor = sensors.sensor(i);
+        formatSensorLabels(labels, sizeof(labels), sensor);
+        out.appendf(PSTR("tempmon_sensor_up{%s,state=\"%s\"} %d\n"), 
+          labels, SensorTable::healthName(sensor.health), sensor.health == SENSOR_OK ? 1 : 0);
+      }
+      return true;
+    case 2:
+      out.appendf(PSTR("# HELP tempmon_sensor_failures_total Failed reads.\n# TYPE tempmon_sensor_failures_total counter\n"));
+      for (int i = 0; i < sensors.count(); i++){
+        const Sensor& sensor = sensors.sensor(i);
+        formatSensorLabels(labels, sizeof(labels), sensor);
+        out.appendf(PSTR("tempmon_sensor_failures_total{%s} %u\n"), labels, sensor.failures);
       }
+      return true;
+    case 3:
+      out.appendf(PSTR("# HELP tempmon_sensor_reading_age_seconds Time since the last good reading.\n# TYPE tempmon_sensor_reading_age_seconds gauge\n"));
+      for (int i = 0; i < sensors.count(); i++){
+        const Sensor& sensor = sensors.sensor(i);
+        if (!sensor.hasReading){continue;}
+        formatSensorLabels(labels, sizeof(labels), sensor);
+        out.appendf(PSTR("tempmon_sensor_reading_age_seconds{%s} "), labels);
+        printMillisAsSeconds(out, millis() - sensor.sampleMillis);
+      }
+      return true;
+    case 4:
+      out.appendf(PSTR("# HELP tempmon_temperature_slope_degrees_per_hour Trend of the filtered readings.\n# TYPE tempmon_temperature_slope_degrees_per_hour gauge\n"));
+      for (int i = 0; i < sensors.count(); i++){
+        if (trends[i].points() < TrendTracker<24, 3>::MIN_FIT){continue;}
+        formatSensorLabels(labels, sizeof(labels), sensors.sensor(i));
+        formatTemperature(value, (int16_t)constrain(trends[i].slopePerHour(), (int32_t)-32768, (int32_t)32767), 2);
+        out.appendf(PSTR("tempmon_temperature_slope_degrees_per_hour{%s,unit=\"%c\"} %s\n"), labels, tempUnit, value);
+      }
+      return true;
+    case 5:
+      out.appendf(PSTR("# HELP tempmon_sensor_spikes_total Readings dropped by the spike filter.\n# TYPE tempmon_sensor_spikes_total counter\n"));
+      for (int i = 0; i < sensors.count(); i++){
+        formatSensorLabels(labels, sizeof(labels), sensors.sensor(i));
+        out.appendf(PSTR("tempmon_sensor_spikes_total{%s} %lu\n"), labels, (unsigned long)trends[i].spikes());
+      }
+      return true;
+    case 6:
+      // Alerts
+      out.appendf(PSTR("# HELP tempmon_alert_rules_breached Rule and sensor pairs out of spec.\n# TYPE tempmon_alert_rules_breached gauge\n"
+        "tempmon_alert_rules_breached %d\n"), alertEngine.breachedCount());
+      out.appendf(PSTR("# HELP tempmon_alert_rules_active Rule and sensor pairs that have tripped.\n# TYPE tempmon_alert_rules_active gauge\n"
+        "tempmon_alert_rules_active %d\n"), alertEngine.activeCount());
+      out.appendf(PSTR("# HELP tempmon_alerts_suppressed_total Alerts held back by rule rate limits.\n# TYPE tempmon_alerts_suppressed_total counter\n"
+        "tempmon_alerts_suppressed_total %lu\n"), alertEngine.suppressed());
+      out.appendf(PSTR("# HELP tempmon_sensor_faults Sensors that can't currently be read.\n# TYPE tempmon_sensor_faults gauge\n"
+        "tempmon_sensor_faults %d\n"), sensors.faultCount());
+      out.appendf(PSTR("# HELP tempmon_alert_queue_length Alerts waiting to be posted.\n# TYPE tempmon_alert_queue_length gauge\n"
+        "tempmon_alert_queue_length %d\n"), alertDispatcher.pending());
+      return true;
+    case 7:
+      // IFTTT posts
+      out.appendf(PSTR("# HELP tempmon_ifttt_posts_total Post attempts by result.\n# TYPE tempmon_ifttt_posts_total counter\n"
+        "tempmon_ifttt_posts_total{result=\"success\"} %lu\ntempmon_ifttt_posts_total{result=\"failure\"} %lu\n"), 
+        alertDispatcher.sent(), alertDispatcher.failedAttempts());
+      out.appendf(PSTR("# HELP tempmon_ifttt_dropped_total Alerts given up on.\n# TYPE tempmon_ifttt_dropped_total counter\n"
+        "tempmon_ifttt_dropped_total %lu\n"), alertDispatcher.dropped());
+      out.appendf(PSTR("# HELP tempmon_ifttt_request_seconds Time from sending a post to its response.\n# TYPE tempmon_ifttt_request_seconds summary\n"
+        "tempmon_ifttt_request_seconds_count %lu\ntempmon_ifttt_request_seconds_sum "), iftttConnection.requests());
+      printMillisAsSeconds(out, iftttConnection.totalLatencyMillis());
+      out.appendf(PSTR("# HELP tempmon_ifttt_request_max_seconds Slowest post so far.\n# TYPE tempmon_ifttt_request_max_seconds gauge\n"
+        "tempmon_ifttt_request_max_seconds "));
+      printMillisAsSeconds(out, iftttConnection.maxLatencyMillis());
+      return true;
+    case 8:
+      // Loop timing, straight from the probe's log2 buckets, in two halves
+      out.appendf(PSTR("# HELP tempmon_loop_duration_seconds Time for one pass through loop().\n# TYPE tempmon_loop_duration_seconds histogram\n"));
+      printLoopBuckets(out, 0, PerfProbe::BUCKETS / 2);
+      return true;
+    case 9: {
+      printLoopBuckets(out, PerfProbe::BUCKETS / 2, PerfProbe::BUCKETS - 1);
+      uint64_t totalMicros = loopProbe.totalMicros();
+      out.appendf(PSTR("tempmon_loop_duration_seconds_bucket{le=\"+Inf\"} %lu\ntempmon_loop_duration_seconds_count %lu\n"
+        "tempmon_loop_duration_seconds_sum %lu.%06lu\n"), 
+        (unsigned long)loopProbe.count(), (unsigned long)loopProbe.count(), 
+        (unsigned long)(totalMicros / 1000000), (unsigned long)(totalMicros % 1000000));
+      return true;
     }
-    // Clear the header variable
-    header = "";
-    // Close the connection
-    client.stop();
-    Serial.println("Client disconnected.");
-    Serial.println("");
-}
\ No newline at end of file
+    case 10:
+      // Heap
+      out.appendf(PSTR("# HELP tempmon_heap_free_bytes Free heap now.\n# TYPE tempmon_heap_free_bytes gauge\n"
+        "tempmon_heap_free_bytes %lu\n"), (unsigned long)ESP.getFreeHeap());
+      out.appendf(PSTR("# HELP tempmon_heap_free_low_water_bytes Least free heap seen.\n# TYPE tempmon_heap_free_low_water_bytes gauge\n"
+        "tempmon_heap_free_low_water_bytes %lu\n"), (unsigned long)heapMonitor.freeLowWater());
+      out.appendf(PSTR("# HELP tempmon_heap_fragmentation_max_percent Worst heap fragmentation seen.\n# TYPE tempmon_heap_fragmentation_max_percent gauge\n"
+        "tempmon_heap_fragmentation_max_percent %u\n"), heapMonitor.maxFragmentation());
+      out.appendf(PSTR("# HELP tempmon_sleep_seconds_total Time loop() has spent asleep between tasks.\n# TYPE tempmon_sleep_seconds_total counter\n"
+        "tempmon_sleep_seconds_total "));
+      printMillisAsSeconds(out, sleepPlanner.sleptMillis());
+      out.appendf(PSTR("# HELP tempmon_awake_ratio Share of uptime spent awake.\n# TYPE tempmon_awake_ratio gauge\n"
+        "tempmon_awake_ratio %u.%03u\n"), sleepPlanner.awakePermille(millis()) / 1000, sleepPlanner.awakePermille(millis()) % 1000);
+      return true;
+    default:
+      // Network and the telemetry stream
+      out.appendf(PSTR("# HELP tempmon_wifi_up Whether WiFi is connected.\n# TYPE tempmon_wifi_up gauge\n"
+        "tempmon_wifi_up %d\n"), network.connected() ? 1 : 0);
+      out.appendf(PSTR("# HELP tempmon_wifi_connects_total Times WiFi has connected.\n# TYPE tempmon_wifi_connects_total counter\n"
+        "tempmon_wifi_connects_total %lu\n"), (unsigned long)network.connects());
+      out.appendf(PSTR("# HELP tempmon_telemetry_frames_total Telemetry frames by what happened to them.\n# TYPE tempmon_telemetry_frames_total counter\n"
+        "tempmon_telemetry_frames_total{result=\"sent\"} %lu\ntempmon_telemetry_frames_total{result=\"acked\"} %lu\n"
+        "tempmon_telemetry_frames_total{result=\"resent\"} %lu\ntempmon_telemetry_frames_total{result=\"dropped\"} %lu\n"), 
+        (unsigned long)telemetry.framesSent(), (unsigned long)telemetry.framesAcked(), 
+        (unsigned long)telemetry.framesResent(), (unsigned long)telemetry.framesDropped());
+      out.appendf(PSTR("# HELP tempmon_telemetry_bytes_total Telemetry bytes sent.\n# TYPE tempmon_telemetry_bytes_total counter\n"
+        "tempmon_telemetry_bytes_total %lu\n"), (unsigned long)telemetry.bytesSent());
+      return false;
+  }
+}
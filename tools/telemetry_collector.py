@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""Reference collector for the TempMonitor telemetry stream.
+
+Listens for the binary UDP frames sent by Telemetry.cpp, acks each one,
+drops duplicates (a resent frame whose ack was lost) and appends the samples
+to a CSV file (or stdout):
+
+    device,seq,time,sensor,temp,health
+
+Usage:
+    telemetry_collector.py [--port 4210] [--csv samples.csv]
+    telemetry_collector.py --loopback [--seconds 5] [--sensors 4] [--batch 5]
+
+--loopback runs a fake device against the collector over 127.0.0.1 and
+reports frames/s and bytes per sample, as a check of both ends of the format.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+import zlib
+
+VERSION = 1
+HEADER = struct.Struct("<2sBBIIBBH")
+ACK = struct.Struct("<2sBBII")
+HEALTH = ["unread", "ok", "crc error", "power-on reset", "missing", "bus fault"]
+# Matches Telemetry::MAX_BATCH
+MAX_BATCH = 8
+
+
+def decode(frame):
+    """Returns (device, seq, fahrenheit, samples) or raises ValueError.
+    samples is a list of (time, [(temp, health), ...])."""
+    if len(frame) < HEADER.size + 4:
+        raise ValueError("short frame")
+    body, crc = frame[:-4], struct.unpack("<I", frame[-4:])[0]
+    if zlib.crc32(body) != crc:
+        raise ValueError("bad crc")
+    magic, version, flags, device, seq, sensors, count, _ = HEADER.unpack_from(body)
+    if magic != b"TM" or version != VERSION:
+        raise ValueError("not a telemetry frame")
+    sample_size = 4 + sensors * 3
+    if len(body) != HEADER.size + count * sample_size:
+        raise ValueError("bad length")
+
+    samples = []
+    offset = HEADER.size
+    for _ in range(count):
+        (stamp,) = struct.unpack_from("<I", body, offset)
+        offset += 4
+        readings = []
+        for _ in range(sensors):
+            temp, health = struct.unpack_from("<hB", body, offset)
+            offset += 3
+            readings.append((temp, health))
+        samples.append((stamp, readings))
+    return device, seq, bool(flags & 1), samples
+
+
+def encode(device, seq, samples, fahrenheit=True):
+    """The device side, for --loopback."""
+    sensors = len(samples[0][1])
+    body = HEADER.pack(b"TM", VERSION, 1 if fahrenheit else 0, device, seq, sensors, len(samples), 0)
+    for stamp, readings in samples:
+        body += struct.pack("<I", stamp)
+        for temp, health in readings:
+            body += struct.pack("<hB", temp, health)
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def format_time(stamp):
+    # Top bit set means uptime seconds, the device's clock wasn't set yet
+    if stamp & 0x80000000:
+        return "T+%ds" % (stamp & 0x7FFFFFFF)
+    return time.strftime("%Y-%m-%dT%H:%M:%S", time.localtime(stamp))
+
+
+class Collector:
+    def __init__(self, sock, out):
+        self.sock = sock
+        self.out = out
+        # Last few sequence numbers per device, to spot resends
+        self.seen = {}
+        self.frames = 0
+        self.duplicates = 0
+        self.errors = 0
+        self.samples = 0
+        self.bytes = 0
+
+    def handle(self, frame, addr):
+        try:
+            device, seq, fahrenheit, samples = decode(frame)
+        except ValueError as e:
+            self.errors += 1
+            print("%s: %s" % (addr[0], e), file=sys.stderr)
+            return
+        # Ack even if it's a duplicate, the first ack may be what got lost
+        self.sock.sendto(ACK.pack(b"TA", VERSION, 0, device, seq), addr)
+
+        seen = self.seen.setdefault(device, [])
+        if seq in seen:
+            self.duplicates += 1
+            return
+        # A device's sequence starts again from 1 when it reboots
+        if seen and seq < min(seen):
+            seen.clear()
+        seen.append(seq)
+        del seen[:-64]
+
+        self.frames += 1
+        self.bytes += len(frame)
+        self.samples += len(samples)
+        if self.out:
+            unit = "F" if fahrenheit else "C"
+            for stamp, readings in samples:
+                for sensor, (temp, health) in enumerate(readings):
+                    value = "%.2f%s" % (temp / 100, unit) if health == 1 else ""
+                    state = HEALTH[health] if health < len(HEALTH) else str(health)
+                    self.out.write("%08x,%d,%s,%d,%s,%s\n" % (device, seq, format_time(stamp), sensor, value, state))
+            self.out.flush()
+
+    def serve(self, stop=None):
+        self.sock.settimeout(0.2)
+        while not (stop and stop.is_set()):
+            try:
+                frame, addr = self.sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            self.handle(frame, addr)
+
+
+def loopback(args):
+    server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    server.bind(("127.0.0.1", 0))
+    collector = Collector(server, None)
+    stop = threading.Event()
+    thread = threading.Thread(target=collector.serve, args=(stop,))
+    thread.start()
+
+    device = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    device.settimeout(1)
+    target = server.getsockname()
+    readings = [(3500 + i, 1) for i in range(args.sensors)]
+    seq = 0
+    acked = 0
+    start = time.time()
+    while time.time() - start < args.seconds:
+        seq += 1
+        stamp = int(time.time())
+        frame = encode(0x1234, seq, [(stamp + n, readings) for n in range(args.batch)])
+        device.sendto(frame, target)
+        ack = ACK.unpack(device.recv(64))
+        if ack[0] == b"TA" and ack[4] == seq:
+            acked += 1
+    elapsed = time.time() - start
+    stop.set()
+    thread.join()
+
+    print("%d frames in %.1f s, %.0f frames/s, %d acked" % (seq, elapsed, seq / elapsed, acked))
+    print("%d sensors x %d samples a frame: %d bytes a frame, %.1f bytes a sample, %.2f bytes a reading" % (
+        args.sensors, args.batch, collector.bytes / max(collector.frames, 1),
+        collector.bytes / max(collector.samples, 1),
+        collector.bytes / max(collector.samples * args.sensors, 1)))
+    ok = collector.frames == seq and acked == seq and collector.errors == 0
+    print("ok" if ok else "MISMATCH: collector saw %d frames, %d errors" % (collector.frames, collector.errors))
+    return 0 if ok else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=4210)
+    parser.add_argument("--csv", help="append samples here instead of stdout")
+    parser.add_argument("--loopback", action="store_true", help="benchmark against a fake device")
+    parser.add_argument("--seconds", type=float, default=5)
+    parser.add_argument("--sensors", type=int, default=4)
+    parser.add_argument("--batch", type=int, default=5)
+    args = parser.parse_args()
+
+    if args.loopback:
+        args.batch = max(1, min(args.batch, MAX_BATCH))
+        return loopback(args)
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", args.port))
+    out = open(args.csv, "a") if args.csv else sys.stdout
+    print("Listening on udp/%d" % args.port, file=sys.stderr)
+    try:
+        Collector(sock, out).serve()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
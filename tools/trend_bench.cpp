@@ -0,0 +1,318 @@
+// Trace driven check of TrendTracker.h on a PC: how early a predict rule
+// would have alerted compared to the plain limit rule, how far off its time
+// to go was, alerts on traces that never cross, glitches let through, and
+// what each call costs.
+//
+// Build and run from the repo root:
+//
+//     g++ -O2 -std=gnu++11 -o trend_bench tools/trend_bench.cpp
+//     ./trend_bench                          synthetic traces
+//     ./trend_bench samples.csv [sensor [limit]]
+//
+// The CSV is what telemetry_collector.py --csv writes. With a recorded trace
+// there's no true temp to compare against, so the crossing is taken as the
+// first of 3 readings in a row under the limit.
+//
+// Settings match main.ino: 24 points 2 min apart, median of 3, "Cold soon"
+// at 35.00 F with 0.50 hysteresis, 1 min dwell and a 30 min horizon, against
+// "Too cold" with its 10 s dwell. Fitting over less than a compressor cycle
+// (the "cycling" traces) makes every cooling run look like a coming breach.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../TrendTracker.h"
+
+typedef TrendTracker<24, 3> Tracker;
+
+const uint32_t stepMillis = 1000 * 120;
+const int16_t minSpike = 100;
+const int16_t hysteresis = 50;
+const uint32_t dwellMillis = 1000 * 60;
+const uint32_t horizonMillis = 1000 * 60 * 30;
+const uint32_t limitDwellMillis = 1000 * 10;
+const uint32_t NONE = 0xFFFFFFFF;
+
+struct Reading {
+    uint32_t millis;
+    int16_t temp;           // What the sensor gave, hundredths of a degree
+    double truth;           // NAN if unknown
+    double truthSlope;      // Degrees an hour, NAN if unknown
+    bool glitch;            // Injected spike
+};
+
+struct Result {
+    uint32_t crossMillis;       // When it actually went under the limit
+    uint32_t limitAlertMillis;  // When "Too cold" would have tripped
+    uint32_t firstTripMillis;   // When "Cold soon" first tripped
+    uint32_t firstEtaMillis;    // What it said then
+    int trips;
+    int falseTrips;             // Trips with nothing under the limit within 1.5 horizons
+    int glitches;
+    int letThrough;             // Filtered reading more than a degree off the truth
+    uint32_t spikes;
+    double slopeSquaredError;
+    double meanSquaredError;
+    int fitted;
+};
+
+// Run a trace through a tracker and the two rules
+Result run(const std::vector<Reading>& trace, int16_t limit){
+    Result result;
+    memset(&result, 0, sizeof(result));
+    result.crossMillis = NONE;
+    result.limitAlertMillis = NONE;
+    result.firstTripMillis = NONE;
+
+    // Which readings are really under the limit, from the truth if we have
+    // it, else 3 readings in a row. The first of them is the crossing.
+    std::vector<bool> under(trace.size(), false);
+    int below = 0;
+    for (size_t i = 0; i < trace.size(); i++){
+        const Reading& r = trace[i];
+        if (!isnan(r.truth)){
+            under[i] = r.truth * 100 < limit;
+        }
+        else {
+            below = r.temp < limit ? below + 1 : 0;
+            if (below >= 3) under[i - 2] = under[i - 1] = under[i] = true;
+        }
+    }
+    for (size_t i = 0; i < trace.size() && result.crossMillis == NONE; i++){
+        if (under[i]) result.crossMillis = trace[i].millis;
+    }
+    // When each reading is next under the limit
+    std::vector<uint32_t> nextUnder(trace.size() + 1, NONE);
+    for (size_t i = trace.size(); i-- > 0;){
+        nextUnder[i] = under[i] ? trace[i].millis : nextUnder[i + 1];
+    }
+
+    Tracker tracker;
+    tracker.configure(stepMillis, minSpike);
+    bool breached = false;
+    bool active = false;
+    uint32_t breachMillis = 0;
+    uint32_t underMillis = NONE;
+    for (size_t i = 0; i < trace.size(); i++){
+        const Reading& r = trace[i];
+        int16_t filtered = tracker.add(r.temp, r.millis);
+
+        // Too cold
+        if (filtered < limit){
+            if (underMillis == NONE) underMillis = r.millis;
+            if (result.limitAlertMillis == NONE && r.millis - underMillis >= limitDwellMillis){
+                result.limitAlertMillis = r.millis;
+            }
+        }
+        else {
+            underMillis = NONE;
+        }
+
+        // Cold soon, the same way AlertEngine runs it
+        uint32_t eta = tracker.millisUntil(limit, true);
+        bool out = eta > 0 && (breached ? tracker.millisUntil(limit + hysteresis, true) : eta) <= horizonMillis;
+        if (out && !breached) breachMillis = r.millis;
+        breached = out;
+        if (out && !active && r.millis - breachMillis >= dwellMillis){
+            active = true;
+            if (nextUnder[i] == NONE || nextUnder[i] - r.millis > horizonMillis * 3 / 2) result.falseTrips++;
+            result.trips++;
+            if (result.firstTripMillis == NONE){
+                result.firstTripMillis = r.millis;
+                result.firstEtaMillis = eta;
+            }
+        }
+        else if (!out){
+            active = false;
+        }
+
+        if (r.glitch) result.glitches++;
+        if (!isnan(r.truth)){
+            if (fabs(filtered / 100.0 - r.truth) > 1.0) result.letThrough++;
+            if (tracker.points() >= Tracker::MIN_FIT){
+                double slopeError = tracker.slopePerHour() / 100.0 - r.truthSlope;
+                double meanError = tracker.mean() / 100.0 - r.truth;
+                result.slopeSquaredError += slopeError * slopeError;
+                result.meanSquaredError += meanError * meanError;
+                result.fitted++;
+            }
+        }
+    }
+
+    result.spikes = tracker.spikes();
+    return result;
+}
+
+void printMinutes(uint32_t ms){
+    if (ms == NONE) printf("%8s", "-");
+    else printf("%8.1f", ms / 60000.0);
+}
+
+void report(const char* name, const std::vector<Reading>& trace, int16_t limit){
+    Result r = run(trace, limit);
+    printf("%-22s", name);
+    printMinutes(r.crossMillis);
+    printMinutes(r.limitAlertMillis);
+    printMinutes(r.firstTripMillis);
+    if (r.firstTripMillis != NONE && r.crossMillis != NONE && r.crossMillis > r.firstTripMillis){
+        printf("%8.1f", ((double)r.firstEtaMillis - (r.crossMillis - r.firstTripMillis)) / 60000.0);
+    }
+    else {
+        printf("%8s", "-");
+    }
+    printf("%6d%6d", r.trips, r.falseTrips);
+    printf("%7d%7lu%6d", r.glitches, (unsigned long)r.spikes, r.letThrough);
+    if (r.fitted){
+        printf("%8.2f%8.3f", sqrt(r.slopeSquaredError / r.fitted), sqrt(r.meanSquaredError / r.fitted));
+    }
+    printf("\n");
+}
+
+void printHeader(){
+    printf("%-22s%8s%8s%8s%8s%6s%6s%7s%7s%6s%8s%8s\n", "trace", "crosses", "limit", "predict", "etaerr",
+        "trips", "false", "glitch", "spikes", "thru", "slopeE", "meanE");
+    printf("%-22s%8s%8s%8s%8s%6s%6s%7s%7s%6s%8s%8s\n", "", "min", "alert", "alert", "min",
+        "", "", "", "", "", "F/h", "F");
+}
+
+// Synthetic traces, one reading a second. The truth goes through a DS18B20 at
+// 12 bits: a little sensor noise, then rounded to sixteenths of a degree C.
+typedef double (*Profile)(double seconds);
+
+std::vector<Reading> synthesize(Profile profile, double hours, int glitchEvery, std::mt19937& random){
+    std::normal_distribution<double> noise(0, 0.02);
+    std::uniform_int_distribution<int> glitchSize(-800, 800);
+    std::vector<Reading> trace;
+    for (uint32_t s = 0; s < hours * 3600; s++){
+        Reading r;
+        r.millis = s * 1000 + 1000;
+        r.truth = profile(s);
+        r.truthSlope = (profile(s + 30) - profile(s - 30)) * 60;
+        double c = (r.truth - 32) * 5 / 9 + noise(random);
+        int32_t raw = lround(c * 16);
+        r.temp = (int16_t)((raw * 45 + (raw >= 0 ? 2 : -2)) / 4 + 3200);
+        r.glitch = glitchEvery && (int)(s % glitchEvery) == glitchEvery / 2;
+        if (r.glitch) r.temp += glitchSize(random) > 0 ? 600 : -600;
+        trace.push_back(r);
+    }
+    return trace;
+}
+
+double steady(double){ return 38.0; }
+double justAbove(double){ return 35.4; }
+double slowDrift(double s){ return 38.0 - 2.0 * s / 3600; }
+double stuckOn(double s){ return s < 1200 ? 40.0 : 40.0 - 12.0 * (s - 1200) / 3600; }
+double settles(double s){ return 35.5 + 4.5 * exp(-s / 600); }
+// Compressor cycling between 36 and 40, 10 min on (-24 F/h), 30 off
+double cycling(double s){
+    double t = fmod(s, 2400);
+    return t < 600 ? 40.0 - 4.0 * t / 600 : 36.0 + 4.0 * (t - 600) / 1800;
+}
+// Same, but a failing door seal drags the whole cycle down 1 F an hour
+double cyclingDown(double s){ return cycling(s) - s / 3600; }
+
+// A telemetry_collector.py CSV: device,seq,time,sensor,temp,health
+std::vector<Reading> load(const char* path, int sensor){
+    std::vector<Reading> trace;
+    FILE* file = fopen(path, "r");
+    if (!file){
+        perror(path);
+        exit(1);
+    }
+    char line[256];
+    long first = -1;
+    while (fgets(line, sizeof(line), file)){
+        char* fields[6];
+        int count = 0;
+        for (char* p = strtok(line, ",\n"); p && count < 6; p = strtok(NULL, ",\n")) fields[count++] = p;
+        // Unhealthy readings have no temp, so only 5 fields
+        if (count < 6 || atoi(fields[3]) != sensor) continue;
+
+        long seconds;
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (fields[2][0] == 'T') seconds = atol(fields[2] + 2);
+        else if (strptime(fields[2], "%Y-%m-%dT%H:%M:%S", &tm)) seconds = mktime(&tm);
+        else continue;
+        if (first < 0) first = seconds;
+
+        Reading r;
+        r.millis = (uint32_t)(seconds - first) * 1000 + 1000;
+        r.temp = (int16_t)lround(atof(fields[4]) * 100);
+        r.truth = NAN;
+        r.truthSlope = NAN;
+        r.glitch = false;
+        if (!trace.empty() && trace.back().millis == r.millis) continue;
+        trace.push_back(r);
+    }
+    fclose(file);
+    return trace;
+}
+
+// Time per call, over a trace played round and round
+void benchmark(const std::vector<Reading>& trace){
+    const int calls = 20000000;
+    Tracker tracker;
+    tracker.configure(stepMillis, minSpike);
+    volatile int32_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t offset = 0;
+    for (int i = 0; i < calls; i++){
+        size_t at = i % trace.size();
+        if (at == 0 && i > 0) offset += trace.back().millis;
+        sink += tracker.add(trace[at].temp, trace[at].millis + offset);
+    }
+    double addNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++){
+        sink += tracker.millisUntil(3500 + (i & 255), true);
+    }
+    double predictNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+
+    printf("\n%d calls: add() %.1f ns, millisUntil() %.1f ns, %u bytes a sensor\n",
+        calls, addNanos, predictNanos, (unsigned)sizeof(Tracker));
+    (void)sink;
+}
+
+int main(int argc, char** argv){
+    printHeader();
+    if (argc > 1){
+        int sensor = argc > 2 ? atoi(argv[2]) : 0;
+        int16_t limit = argc > 3 ? (int16_t)lround(atof(argv[3]) * 100) : 3500;
+        std::vector<Reading> trace = load(argv[1], sensor);
+        if (trace.empty()){
+            fprintf(stderr, "no readings for sensor %d in %s\n", sensor, argv[1]);
+            return 1;
+        }
+        report(argv[1], trace, limit);
+        benchmark(trace);
+        return 0;
+    }
+
+    std::mt19937 random(42);
+    struct { const char* name; Profile profile; double hours; int glitchEvery; } traces[] = {
+        {"steady 38", steady, 4, 0},
+        {"steady 38, glitches", steady, 4, 97},
+        {"steady 35.4", justAbove, 4, 0},
+        {"settles at 35.5", settles, 2, 0},
+        {"cycling 36-40", cycling, 4, 0},
+        {"drift -2 F/h", slowDrift, 3, 0},
+        {"stuck on, -12 F/h", stuckOn, 2, 0},
+        {"stuck on, glitches", stuckOn, 2, 61},
+        {"cycling, -1 F/h", cyclingDown, 4, 0},
+    };
+    std::vector<Reading> last;
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++){
+        last = synthesize(traces[i].profile, traces[i].hours, traces[i].glitchEvery, random);
+        report(traces[i].name, last, 3500);
+    }
+    benchmark(last);
+    return 0;
+}